@@ -0,0 +1,35 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "hostMemory.h"
+
+/* Blocks are at least this big, larger requests get a block of their own */
+#define ARENA_BLOCK_SIZE            4096
+#define ARENA_ALIGNMENT             8
+
+
+typedef struct _arena_block_t
+{
+    struct _arena_block_t *next;
+    size_t size;
+    size_t used;
+} arena_block_t;
+
+
+/* Many small allocations that are all freed together */
+typedef struct _arena_t
+{
+    arena_block_t *blocks;
+    size_t bytesUsed;
+} arena_t;
+
+
+void *arenaAlloc(arena_t *arena, size_t size);
+char *arenaStrndup(arena_t *arena, const char *string, size_t length);
+char *arenaStrdup(arena_t *arena, const char *string);
+void freeArena(arena_t *arena);
+
+#endif
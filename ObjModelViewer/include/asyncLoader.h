@@ -0,0 +1,71 @@
+#ifndef __ASYNC_LOADER_H__
+#define __ASYNC_LOADER_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+#include "osThread.h"
+#include "hostMemory.h"
+
+#define LOADER_MAX_THREADS          8
+#define LOADER_MIN_CAPACITY         16
+
+
+/* Posted by a finished job, the type and index say what it loaded */
+typedef struct _load_event_t
+{
+    uint32_t type;
+    uint32_t index;
+    VkBool32 success;
+    double timeMs;
+} load_event_t;
+
+
+/* Runs on a worker thread, must not touch the device */
+typedef load_event_t (*loadJobFunc_t)(void *arg, uint32_t index);
+
+
+typedef struct _load_job_t
+{
+    loadJobFunc_t func;
+    void *arg;
+    uint32_t index;
+} load_job_t;
+
+
+typedef struct _async_loader_t
+{
+    thread_t threads[LOADER_MAX_THREADS];
+    uint32_t threadCount;
+
+    mutex_t lock;
+    condition_t jobReady;
+    condition_t eventReady;
+
+    /* Jobs not yet started, first in first out */
+    load_job_t *jobs;
+    uint32_t jobHead;
+    uint32_t jobCount;
+    uint32_t jobCapacity;
+
+    /* Finished jobs the render thread has not picked up yet, with room for every pending one */
+    load_event_t *events;
+    uint32_t eventCount;
+    uint32_t eventCapacity;
+
+    /* Submitted jobs whose events have not been polled */
+    uint32_t pending;
+    VkBool32 quit;
+} async_loader_t;
+
+
+VkBool32 initAsyncLoader(async_loader_t *loader, uint32_t threadCount);
+VkBool32 submitLoadJob(async_loader_t *loader, loadJobFunc_t func, void *arg, uint32_t index);
+uint32_t pollLoadEvents(async_loader_t *loader, load_event_t *events, uint32_t maxEvents);
+uint32_t waitLoadEvents(async_loader_t *loader, load_event_t *events, uint32_t maxEvents);
+uint32_t pendingLoadJobs(async_loader_t *loader);
+void destroyAsyncLoader(async_loader_t *loader);
+
+#endif
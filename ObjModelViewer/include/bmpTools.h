@@ -6,15 +6,35 @@
 #include <string.h>
 #include <inttypes.h>
 #include <vulkan/vulkan.h>
-#include "vulkanCmds.h"
+#include "osCompat.h"
+#include "hostMemory.h"
 
 #define BMP_WIDTH_OFFSET            18
 #define BMP_HEIGHT_OFFSET           22
 #define BMP_PIX_PER_COLOR           3
 #define BMP_HEADER_SIZE             54
 
+#define TEXTURE_BYTES_PER_TEXEL     4
+#define MAX_MIP_LEVELS              16
+
+
+/* Every level of a texture, finest first, packed one after the other */
+typedef struct _mip_chain_t
+{
+    VkExtent2D size;
+    uint32_t levelCount;
+    VkDeviceSize offsets[MAX_MIP_LEVELS + 1];
+    uint8_t *pixels;
+} mip_chain_t;
+
 
 VkResult getBmpSize(char *path, VkExtent2D *size);
 void loadBmpToBuffer(char *path, VkExtent2D *size, unsigned char **ptr);
+unsigned char *loadBmpFile(char *path, VkExtent2D *size);
+
+void buildMipChain(VkExtent2D *size, unsigned char *pixels, mip_chain_t *chain);
+void freeMipChain(mip_chain_t *chain);
+VkExtent2D mipExtent(mip_chain_t *chain, uint32_t level);
+VkDeviceSize mipLevelBytes(mip_chain_t *chain, uint32_t level);
 
 #endif
@@ -0,0 +1,76 @@
+#ifndef __DESCRIPTOR_MANAGER_H__
+#define __DESCRIPTOR_MANAGER_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+#include "hostMemory.h"
+
+#define DESCRIPTOR_MAX_POOL_SIZES   8
+#define DESCRIPTOR_MAX_FRAMES       4
+#define DESCRIPTOR_MIN_CAPACITY     16
+
+/* Each new pool in a chain is this many times the size of the first one, at most */
+#define DESCRIPTOR_MAX_POOL_SCALE   64
+
+
+/* Pools are only added, a chain grows instead of failing when it runs out */
+typedef struct _descriptor_pool_chain_t
+{
+    VkDescriptorPool *pools;
+    uint32_t count;
+    uint32_t capacity;
+
+    /* Pool new sets are taken from, earlier ones are full */
+    uint32_t current;
+} descriptor_pool_chain_t;
+
+
+/* Writes gathered for one frame slot, the infos are pointed at when flushing */
+typedef struct _descriptor_write_queue_t
+{
+    VkWriteDescriptorSet *writes;
+    uint32_t *writeInfos;
+    uint32_t writeCount;
+    uint32_t writeCapacity;
+
+    VkDescriptorBufferInfo *bufferInfos;
+    uint32_t bufferInfoCount;
+    uint32_t bufferInfoCapacity;
+
+    VkDescriptorImageInfo *imageInfos;
+    uint32_t imageInfoCount;
+    uint32_t imageInfoCapacity;
+} descriptor_write_queue_t;
+
+
+typedef struct _descriptor_manager_t
+{
+    VkDevice device;
+
+    /* Size of the first pool of every chain */
+    VkDescriptorPoolSize poolSizes[DESCRIPTOR_MAX_POOL_SIZES];
+    uint32_t poolSizeCount;
+    uint32_t maxSets;
+
+    /* Every set has a copy per frame slot, a copy is only written once its slot's fence has been waited on */
+    descriptor_pool_chain_t frames[DESCRIPTOR_MAX_FRAMES];
+    descriptor_write_queue_t queues[DESCRIPTOR_MAX_FRAMES];
+    uint32_t frameCount;
+
+    /* Totals for the log */
+    uint32_t flushCount;
+    uint32_t descriptorsWritten;
+} descriptor_manager_t;
+
+
+VkResult initDescriptorManager(descriptor_manager_t *dm, VkDevice device, const VkDescriptorPoolSize *poolSizes, uint32_t poolSizeCount, uint32_t maxSets, uint32_t frameCount);
+VkResult allocateFrameDescriptorSets(descriptor_manager_t *dm, VkDescriptorSetLayout layout, VkDescriptorSet *sets);
+VkResult queueBufferWrite(descriptor_manager_t *dm, const VkDescriptorSet *sets, uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+VkResult queueImageWrite(descriptor_manager_t *dm, const VkDescriptorSet *sets, uint32_t binding, VkDescriptorType type, uint32_t firstElement, uint32_t count, const VkDescriptorImageInfo *infos);
+uint32_t flushDescriptorWrites(descriptor_manager_t *dm, uint32_t frameIndex);
+void destroyDescriptorManager(descriptor_manager_t *dm);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __FRUSTUM_CULL_H__
+#define __FRUSTUM_CULL_H__
+
+#include <inttypes.h>
+#include "matrixMath.h"
+
+#define FRUSTUM_PLANE_COUNT         6
+#define CORNERS_PER_FACE            3
+
+/* Cone cutoff for clusters that can't be backface culled */
+#define CONE_NO_CULL                2.0f
+
+/* Layout matches a vec4 in the cull shader */
+typedef struct _boundingSphere_t
+{
+    vec3_t center;
+    float radius;
+} boundingSphere_t;
+
+
+/* Every face normal is within the cone, cutoff is the sine of its spread */
+typedef struct _normalCone_t
+{
+    vec3_t axis;
+    float cutoff;
+} normalCone_t;
+
+
+/* Planes are normalized, a point is inside when dot(xyz, p) + w >= 0 */
+typedef struct _frustum_t
+{
+    vec4_t planes[FRUSTUM_PLANE_COUNT];
+} frustum_t;
+
+
+/* Layout matches VkDrawIndirectCommand */
+typedef struct _indirectDraw_t
+{
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t firstVertex;
+    uint32_t firstInstance;
+} indirectDraw_t;
+
+
+void extractFrustumPlanes(float *viewProj, frustum_t *frustum);
+boundingSphere_t computeBoundingSphere(float *positions, uint32_t *faces, uint32_t cornerStride, uint32_t firstFace, uint32_t faceCount);
+normalCone_t computeNormalCone(float *positions, float *normals, uint32_t *faces, uint32_t cornerStride, uint32_t firstFace, uint32_t faceCount);
+uint32_t sphereInFrustum(frustum_t *frustum, boundingSphere_t *sphere);
+uint32_t coneBackfacing(normalCone_t *cone, boundingSphere_t *sphere, vec3_t cameraPosition);
+uint32_t cullDraws(frustum_t *frustum, boundingSphere_t *bounds, normalCone_t *cones, vec3_t cameraPosition, indirectDraw_t *draws, uint32_t drawCount, indirectDraw_t *visibleDraws);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __HOST_MEMORY_H__
+#define __HOST_MEMORY_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/* What an allocation is charged to, MEMORY_SUBSYSTEM_COUNT reads the totals */
+#define MEMORY_LOADER               0
+#define MEMORY_TEXTURE              1
+#define MEMORY_RENDERER             2
+#define MEMORY_SUBSYSTEM_COUNT      3
+
+
+/* Where the tracked blocks come from, malloc unless another allocator is installed */
+typedef struct _host_allocator_t
+{
+    void *(*alloc)(void *userData, size_t size);
+    void *(*realloc)(void *userData, void *ptr, size_t size);
+    void (*free)(void *userData, void *ptr);
+    void *userData;
+} host_allocator_t;
+
+
+/* Calls and requested bytes since the start, live bytes now and their highest point */
+typedef struct _memory_usage_t
+{
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    uint64_t liveBytes;
+    uint64_t peakBytes;
+} memory_usage_t;
+
+
+void setHostAllocator(host_allocator_t *allocator);
+void *memAlloc(uint32_t subsystem, size_t size);
+void *memCalloc(uint32_t subsystem, size_t count, size_t size);
+void *memRealloc(uint32_t subsystem, void *ptr, size_t size);
+void memFree(void *ptr);
+
+void getMemoryUsage(uint32_t subsystem, memory_usage_t *usage);
+void resetMemoryPeaks(void);
+uint64_t getPeakRss(void);
+void printMemoryUsage(void);
+
+#endif
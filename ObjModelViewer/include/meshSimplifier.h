@@ -0,0 +1,67 @@
+#ifndef __MESH_SIMPLIFIER_H__
+#define __MESH_SIMPLIFIER_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+#include "objFileLoader.h"
+#include "frustumCull.h"
+
+#define MAX_LOD_LEVELS              4
+
+/* Each level aims for this fraction of the faces of the level above */
+#define LOD_REDUCTION               0.5f
+
+/* Largest error allowed, relative to the radius of the material range */
+#define LOD_MAX_ERROR               0.05f
+
+/* Coarser levels are used while their error stays under this many pixels */
+#define LOD_PIXEL_ERROR             1.0f
+
+/* Distance floor used when the camera is inside a range */
+#define LOD_MIN_DISTANCE            0.001f
+
+#define LOD_CACHE_MAGIC             "OMVL"
+#define LOD_CACHE_VERSION           1
+#define LOD_CACHE_EXTENSION         ".lods"
+
+
+/* Layout matches lodLevel_t in the cull shader */
+typedef struct _lod_level_t
+{
+    uint32_t firstFace;
+    uint32_t faceCount;
+    float error;
+    uint32_t reserved;
+} lod_level_t;
+
+
+/* MAX_LOD_LEVELS entries per material range, missing levels repeat the last one */
+typedef struct _lod_list_t
+{
+    lod_level_t *levels;
+    uint32_t rangeCount;
+} lod_list_t;
+
+
+typedef struct _lod_cache_header_t
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t sourceHash;
+    uint32_t numOfFaces;
+    uint32_t cornerStride;
+    uint32_t rangeCount;
+    uint32_t numOfLodFaces;
+} lod_cache_header_t;
+
+
+void buildLods(model_t *model, lod_list_t *lods);
+uint32_t selectLod(lod_level_t *levels, boundingSphere_t *sphere, vec3_t cameraPosition, float lodScale);
+VkBool32 saveLodCache(char *fileName, model_t *model, lod_list_t *lods, uint32_t sourceHash);
+VkBool32 loadLodCache(char *fileName, model_t *model, lod_list_t *lods, uint32_t sourceHash);
+void freeLods(lod_list_t *lods);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __MESHLET_BUILDER_H__
+#define __MESHLET_BUILDER_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+#include "objFileLoader.h"
+#include "frustumCull.h"
+
+#define MESHLET_MAX_VERTICES        64
+#define MESHLET_MAX_TRIANGLES       124
+
+#define MESHLET_CACHE_MAGIC         "OMVM"
+#define MESHLET_CACHE_VERSION       1
+#define MESHLET_CACHE_EXTENSION     ".meshlets"
+
+
+/* A run of faces in the reordered face array, all of one material */
+typedef struct _meshlet_t
+{
+    uint32_t firstFace;
+    uint32_t faceCount;
+    uint32_t vertexCount;
+    uint32_t materialIndex;
+    boundingSphere_t sphere;
+    normalCone_t cone;
+} meshlet_t;
+
+
+typedef struct _meshlet_list_t
+{
+    meshlet_t *meshlets;
+    uint32_t count;
+    uint32_t capacity;
+
+    /* Every edge is shared by two faces, backfacing clusters are hidden */
+    VkBool32 closed;
+} meshlet_list_t;
+
+
+typedef struct _meshlet_cache_header_t
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t sourceHash;
+    uint32_t numOfFaces;
+    uint32_t cornerStride;
+    uint32_t meshletCount;
+    uint32_t closed;
+} meshlet_cache_header_t;
+
+
+void buildMeshlets(model_t *model, meshlet_list_t *list);
+VkBool32 isClosedMesh(model_t *model);
+uint32_t hashFaces(model_t *model);
+VkBool32 saveMeshletCache(char *fileName, model_t *model, meshlet_list_t *list, uint32_t sourceHash);
+VkBool32 loadMeshletCache(char *fileName, model_t *model, meshlet_list_t *list, uint32_t sourceHash);
+void freeMeshlets(meshlet_list_t *list);
+
+#endif
@@ -7,20 +7,31 @@
 #include <inttypes.h>
 #include <vulkan/vulkan.h>
 #include <errno.h>
+#include "osCompat.h"
 #include "matrixMath.h"
+#include "arena.h"
+#include "osFile.h"
+#include "hostMemory.h"
 
 #define STRLEN                      128
 
-#define MAX_MATERIALS               32
-#define MAX_MATERIAL_CHANGES        300
+/* Longer MTL lines are cut, texture paths can be long */
+#define MTL_LINE_LENGTH             1024
+
+#define MATERIAL_NOT_FOUND          0xFFFFFFFF
+#define MIN_TABLE_CAPACITY          16
 
 #define ELEMENTS_PER_FACE           3
 #define ELEMENTS_PER_VERTEX         3
 #define ELEMENTS_PER_TEXCOORDS      2
 
+/* Faces parsed before they are handed on as one chunk when streaming */
+#define OBJ_CHUNK_FACES             16384
+
 typedef struct materialProperties_t
 {
     uint32_t imageIndex;
+    uint32_t imageLayer;
     float Ns;
     vec3_t Ka;
     vec3_t Kd;
@@ -39,16 +50,18 @@ typedef struct sceneProperties_t
     vec3_t lightSourceIntensity;
 } sceneProperties_t;
 
-typedef struct pushConstants_t
-{
-    materialProperties_t mp;
-    sceneProperties_t sp;
-} pushConstants_t;
-
 typedef struct material_t
 {
     char *name;
+
+    /* map_Kd, the only map that is drawn */
     char *fileName;
+
+    /* map_Ks, map_Bump and map_d, relative to the MTL file */
+    char *specularFileName;
+    char *bumpFileName;
+    char *alphaFileName;
+
     materialProperties_t mp;
 } material_t;
 
@@ -56,10 +69,25 @@ typedef struct material_t
 typedef struct material_change_t
 {
     uint32_t startFace;
-    material_t *material;
+    uint32_t materialIndex;
 } material_change_t;
 
 
+typedef struct material_table_t
+{
+    material_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+
+    /* Open addressed name lookup, holds indices into entries */
+    uint32_t *hashSlots;
+    uint32_t hashCapacity;
+
+    /* Names and map file names of every entry */
+    arena_t strings;
+} material_table_t;
+
+
 typedef struct model_t
 {
     float *vertArray;
@@ -78,10 +106,13 @@ typedef struct model_t
     uint32_t *f;
     uint32_t numOfFaces;
 
+    /* Simplified faces stored after numOfFaces */
+    uint32_t numOfLodFaces;
+
     char *materialLibFilename;
-    uint32_t materialCount;
-    material_change_t materialChange[MAX_MATERIAL_CHANGES];
+    material_change_t *materialChange;
     uint32_t materialChangeCount;
+    uint32_t materialChangeCapacity;
 
     float modelRotationUp;
     float modelRotationRight;
@@ -98,8 +129,28 @@ typedef struct model_t
 } model_t;
 
 
-VkBool32 loadModel(model_t *object, material_t *materials, char *objFileName);
+/* Gets every run of parsed faces, expanded like prepareObjectArrays, on the parsing thread */
+typedef void (*objChunkFunc_t)(void *arg, model_t *model, uint32_t firstFace, uint32_t faceCount, float *vertices);
+
+typedef struct obj_stream_t
+{
+    objChunkFunc_t func;
+    void *arg;
+} obj_stream_t;
+
+
+VkBool32 loadModel(model_t *object, material_table_t *materials, char *objFileName, obj_stream_t *stream);
+VkBool32 loadObjFile(model_t *object, material_table_t *materials, char *objFileName, obj_stream_t *stream);
+VkBool32 loadMtlFile(model_t *object, material_table_t *materials, char *mtlFileName);
+void mergeMaterialRanges(model_t *object);
 void prepareObjectArrays(model_t *object);
+void releaseParsedArrays(model_t *object);
+uint32_t expandFaces(model_t *object, uint32_t firstFace, uint32_t faceCount, float *vertices);
+void setMaterialDefaults(material_t *material);
 char* getPath(char *string);
 
+uint32_t findMaterial(material_table_t *table, char *name);
+uint32_t addMaterial(material_table_t *table, char *name);
+void freeMaterialTable(material_table_t *table);
+
 #endif
@@ -0,0 +1,25 @@
+#ifndef __OS_COMPAT_H__
+#define __OS_COMPAT_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <errno.h>
+
+/* Conversions one sscanf_s call can fill, the parsers use at most ten */
+#define COMPAT_SCANF_MAX_ARGS       16
+#define COMPAT_SCANF_FORMAT_SIZE    256
+
+
+/* The bounds checked CRT functions the code is written against, the C runtime has them on Windows */
+#if !defined(_WIN32) && !defined(__STDC_LIB_EXT1__)
+typedef int errno_t;
+
+errno_t fopen_s(FILE **file, const char *fileName, const char *mode);
+int sscanf_s(const char *buffer, const char *format, ...);
+errno_t strcpy_s(char *dest, size_t destSize, const char *src);
+errno_t strcat_s(char *dest, size_t destSize, const char *src);
+errno_t strncpy_s(char *dest, size_t destSize, const char *src, size_t count);
+errno_t strncat_s(char *dest, size_t destSize, const char *src, size_t count);
+#endif
+
+#endif
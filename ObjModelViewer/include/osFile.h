@@ -0,0 +1,28 @@
+#ifndef __OS_FILE_H__
+#define __OS_FILE_H__
+
+#include <inttypes.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+/* Read only view of a whole file, the data is not NUL terminated */
+typedef struct _mapped_file_t
+{
+    const char *data;
+    uint64_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} mapped_file_t;
+
+
+int32_t mapFile(mapped_file_t *file, const char *fileName);
+void unmapFile(mapped_file_t *file);
+
+#endif
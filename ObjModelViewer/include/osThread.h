@@ -0,0 +1,61 @@
+#ifndef __OS_THREAD_H__
+#define __OS_THREAD_H__
+
+#include <inttypes.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef void (*threadFunc_t)(void *arg);
+
+typedef struct _thread_t
+{
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    threadFunc_t func;
+    void *arg;
+} thread_t;
+
+
+typedef struct _mutex_t
+{
+#ifdef _WIN32
+    CRITICAL_SECTION handle;
+#else
+    pthread_mutex_t handle;
+#endif
+} mutex_t;
+
+
+typedef struct _condition_t
+{
+#ifdef _WIN32
+    CONDITION_VARIABLE handle;
+#else
+    pthread_cond_t handle;
+#endif
+} condition_t;
+
+
+int32_t createThread(thread_t *thread, threadFunc_t func, void *arg);
+void joinThread(thread_t *thread);
+uint32_t getCpuCount(void);
+
+void createMutex(mutex_t *mutex);
+void lockMutex(mutex_t *mutex);
+void unlockMutex(mutex_t *mutex);
+void destroyMutex(mutex_t *mutex);
+
+void createCondition(condition_t *condition);
+void waitCondition(condition_t *condition, mutex_t *mutex);
+void signalCondition(condition_t *condition);
+void broadcastCondition(condition_t *condition);
+void destroyCondition(condition_t *condition);
+
+#endif
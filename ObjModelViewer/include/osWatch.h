@@ -0,0 +1,77 @@
+#ifndef __OS_WATCH_H__
+#define __OS_WATCH_H__
+
+#include <inttypes.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* A change is reported once the file has not changed for this long, editors save in several writes */
+#define WATCH_SETTLE_MS             150.0
+
+#define WATCH_EVENT_BUFFER_SIZE     4096
+
+/* Where the system has no change notifications, every watched file is looked at this often */
+#define WATCH_POLL_MS               250.0
+#define WATCH_MIN_CAPACITY          16
+
+
+/* The kind and index are the caller's, they come back with each change */
+typedef struct _watched_file_t
+{
+    char *fileName;
+    uint32_t directory;
+    uint32_t kind;
+    uint32_t index;
+
+    /* What the file looked like when last seen, a change is a new time or size */
+    int64_t modified;
+    uint64_t size;
+    double changedMs;
+} watched_file_t;
+
+
+/* The system watches directories, their files are compared when one of them changes */
+typedef struct _watched_directory_t
+{
+    char *path;
+    uint32_t changed;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int wd;
+#endif
+} watched_directory_t;
+
+
+typedef struct _file_change_t
+{
+    uint32_t kind;
+    uint32_t index;
+} file_change_t;
+
+
+typedef struct _file_watcher_t
+{
+    watched_file_t *files;
+    uint32_t fileCount;
+    uint32_t fileCapacity;
+
+    watched_directory_t *directories;
+    uint32_t directoryCount;
+    uint32_t directoryCapacity;
+
+#ifndef _WIN32
+    int fd;
+    double polledMs;
+#endif
+} file_watcher_t;
+
+
+int32_t initFileWatcher(file_watcher_t *watcher);
+int32_t watchFile(file_watcher_t *watcher, const char *fileName, uint32_t kind, uint32_t index);
+uint32_t pollFileChanges(file_watcher_t *watcher, file_change_t *changes, uint32_t maxChanges);
+void destroyFileWatcher(file_watcher_t *watcher);
+
+#endif
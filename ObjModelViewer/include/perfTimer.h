@@ -0,0 +1,8 @@
+#ifndef __PERF_TIMER_H__
+#define __PERF_TIMER_H__
+
+#include <inttypes.h>
+
+double getTimeMs(void);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+#include "objFileLoader.h"
+#include "frustumCull.h"
+#include "meshletBuilder.h"
+#include "meshSimplifier.h"
+
+/* Bytes per expanded vertex written by prepareObjectArrays, matches vertexData_t */
+#define SCENE_VERTEX_SIZE           (sizeof(float) * ((ELEMENTS_PER_VERTEX+1)*2 + ELEMENTS_PER_TEXCOORDS))
+
+/* Gap between the copies of a mesh, in mesh diameters */
+#define SCENE_INSTANCE_SPACING      1.25f
+
+
+/* One OBJ file, drawn once per instance */
+typedef struct _scene_mesh_t
+{
+    char *fileName;
+    char *mtlFileName;
+    model_t model;
+    material_table_t materials;
+    meshlet_list_t meshlets;
+    lod_list_t lods;
+
+    /* Where the mesh starts in the shared tables */
+    uint32_t firstMaterial;
+    uint32_t firstVertex;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+
+    /* Every edge is shared by two faces, backfaces can be culled */
+    VkBool32 closed;
+} scene_mesh_t;
+
+
+/* Layout matches a mat4 in the vertex shader */
+typedef struct _scene_instance_t
+{
+    float transform[16];
+} scene_instance_t;
+
+
+typedef struct _scene_t
+{
+    scene_mesh_t *meshes;
+    uint32_t meshCount;
+    uint32_t meshCapacity;
+
+    /* Every mesh's materials, textures are full paths */
+    material_t *materials;
+    uint32_t materialCount;
+
+    /* Instances of a mesh are contiguous */
+    scene_instance_t *instances;
+    uint32_t instanceCount;
+
+    /* Expanded vertices of every mesh, back to back */
+    float *vertices;
+    uint32_t vertexCount;
+
+    boundingSphere_t bounds;
+
+    /* Gets the faces of each model while it is parsed, unused when func is NULL */
+    obj_stream_t stream;
+} scene_t;
+
+
+VkBool32 addSceneModel(scene_t *scene, char *objFileName, uint32_t instanceCount);
+void buildScene(scene_t *scene);
+VkBool32 reloadSceneModel(scene_t *scene, scene_t *previous, uint32_t meshIndex);
+VkBool32 reloadSceneMaterials(scene_t *scene, uint32_t meshIndex, uint32_t *retextured, uint32_t *retexturedCount);
+void releaseSceneSources(scene_t *scene);
+void freeReplacedScene(scene_t *scene, uint32_t meshIndex);
+boundingSphere_t instanceBounds(scene_t *scene, scene_mesh_t *mesh, boundingSphere_t *sphere);
+void freeScene(scene_t *scene);
+
+#endif
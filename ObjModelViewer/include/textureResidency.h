@@ -0,0 +1,112 @@
+#ifndef __TEXTURE_RESIDENCY_H__
+#define __TEXTURE_RESIDENCY_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <vulkan/vulkan.h>
+#include "vulkanCmds.h"
+#include "bmpTools.h"
+
+/* Levels this size or smaller are uploaded with the texture and never evicted */
+#define TEXTURE_TAIL_SIZE           64
+
+/* Textures this size or smaller are packed with the others of their size as the layers of one array */
+#define TEXTURE_ARRAY_MAX_SIZE      512
+#define TEXTURE_ARRAY_MAX_LAYERS    16
+
+/* Swaps recorded per batch and the bytes they copy, bounds the streaming added to a frame */
+#define MAX_TEXTURE_SWAPS           8
+#define TEXTURE_SWAP_BYTES          (16*1024*1024)
+
+#define DEFAULT_TEXTURE_BUDGET_MB   256
+
+/* Frames between reads of the driver's memory budget */
+#define TEXTURE_BUDGET_INTERVAL     64
+
+#define NO_RESIDENT_TEXTURE         0xFFFFFFFF
+
+
+/* A texture whose finest levels come and go, the coarse tail always stays */
+typedef struct _resident_texture_t
+{
+    mip_chain_t chain;
+    uint32_t slot;
+    uint32_t residentLevel;
+    uint32_t wantedLevel;
+    uint32_t tailLevel;
+    uint32_t lastUsedFrame;
+    VkBool32 swapping;
+
+    /* A new version of the file replaces the chain between batches, its tail is then uploaded before anything else */
+    mip_chain_t reloadChain;
+    VkBool32 reloadPending;
+    VkBool32 reloaded;
+} resident_texture_t;
+
+
+/* A texture replaced by a copy holding one level more or one level less */
+typedef struct _texture_swap_t
+{
+    uint32_t texture;
+    uint32_t level;
+    texture_t image;
+    buffer_t staging;
+} texture_swap_t;
+
+
+typedef struct _texture_residency_t
+{
+    resident_texture_t *textures;
+    uint32_t count;
+    uint32_t capacity;
+
+    /* Resident texture of each material, NO_RESIDENT_TEXTURE when it has none */
+    uint32_t *materialTextures;
+    uint32_t materialCount;
+
+    /* The budget is the configured one, lowered to what the driver reports free */
+    VkDeviceSize configuredBudget;
+    VkDeviceSize budget;
+    VkDeviceSize residentBytes;
+    VkDeviceSize peakBytes;
+
+    /* Packed arrays are resident whole, they count against the budget but never stream */
+    VkDeviceSize pinnedBytes;
+
+    /* One batch of swaps in flight at a time */
+    VkCommandBuffer cmdBuffer;
+    VkFence fence;
+    VkBool32 pending;
+    texture_swap_t swaps[MAX_TEXTURE_SWAPS];
+    uint32_t swapCount;
+
+    /* Reported at exit */
+    uint32_t frame;
+    uint64_t streamedBytes;
+    uint64_t misses;
+    uint32_t promotions;
+    uint32_t evictions;
+    uint32_t budgetStalls;
+    uint32_t reloads;
+    double streamMs;
+    double batchStartMs;
+} texture_residency_t;
+
+
+uint32_t mipTailLevel(mip_chain_t *chain);
+texture_t uploadMipLevels(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, mip_chain_t *chain, uint32_t firstLevel, buffer_t *staging);
+texture_t uploadTextureArray(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, mip_chain_t *chains[], uint32_t layerCount, buffer_t *staging);
+
+VkResult initTextureResidency(texture_residency_t *residency, VulkanObject *vulkanObj, uint32_t budgetMb);
+void addResidentTexture(texture_residency_t *residency, uint32_t material, mip_chain_t *chain, uint32_t slot);
+void pinResidentBytes(texture_residency_t *residency, VkDeviceSize bytes);
+VkBool32 reloadResidentTexture(texture_residency_t *residency, uint32_t material, mip_chain_t *chain);
+void remapResidentMaterials(texture_residency_t *residency, uint32_t *remap, uint32_t materialCount);
+void updateTextureResidency(texture_residency_t *residency, VulkanObject *vulkanObj, float pixelsPerUnit, VkFence frameFence);
+void printTextureResidency(texture_residency_t *residency);
+void destroyTextureResidency(texture_residency_t *residency, VulkanObject *vulkanObj);
+
+#endif
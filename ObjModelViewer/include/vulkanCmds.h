@@ -2,31 +2,48 @@
 #define __VULKAN_CMDS_H__
 
 #include <stdio.h>
-#include <windows.h>
 #include <stdlib.h>
 #include <stddef.h>
 
+/* Windows creates its surface from the window handle, elsewhere SDL creates it for the window system it runs on */
+#ifdef _WIN32
+#include <windows.h>
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include <vulkan/vulkan.h>
 
 #include <SDL.h>
+#ifdef _WIN32
 #include <SDL_syswm.h>
+#else
+#include <SDL_vulkan.h>
+#endif
 
+#include "osFile.h"
+#include "hostMemory.h"
 #include "objFileLoader.h"
+#include "frustumCull.h"
+#include "meshletBuilder.h"
+#include "meshSimplifier.h"
+#include "scene.h"
+#include "osThread.h"
+#include "descriptorManager.h"
 
 #define GLOBAL_APP_NAME_W   "Wavefront Object Model Viewer"
 
 #define MAX_TIMEOUT                 1000000000L
 
 #define NUM_SWAP_CHAIN_IMAGES       2
+#define MAX_FRAMES_IN_FLIGHT        2
+#define MAX_RECORD_THREADS          64
 
-#define MAX_DESCRIPTOR_SETS         32
-#define MAX_IMAGE_TEXTURES          16
+#define MAX_BINDLESS_TEXTURES       4096
 
-#define LAYOUT_BINDING_COUNT        3
+#define LAYOUT_BINDING_COUNT        7
 #define INPUT_BINDING_COUNT         3
 
 #define BINDING_VERT_POSITION       0
+#define BINDING_VERT_ATTRIBUTES     1
 #define LOCATION_VERT_POSITION      0
 #define LOCATION_VERT_NORMALS       1
 #define LOCATION_VERT_TEXCOORDS     2
@@ -35,6 +52,48 @@
 #define BINDING_FRAG_SAMPLER        0
 #define BINDING_FRAG_TEXTURES       1
 #define BINDING_FRAG_UNIFORM        2
+#define BINDING_FRAG_MATERIALS      3
+#define BINDING_VERT_INSTANCES      4
+#define BINDING_VERT_INSTANCE_REFS  5
+#define BINDING_FRAG_SCENE          6
+
+#define CULL_LAYOUT_BINDING_COUNT   6
+#define CULL_WORKGROUP_SIZE         64
+
+#define BINDING_CULL_BOUNDS         0
+#define BINDING_CULL_DRAWS          1
+#define BINDING_CULL_VISIBLE        2
+#define BINDING_CULL_COUNT          3
+#define BINDING_CULL_CONES          4
+#define BINDING_CULL_LODS           5
+
+/* What invalidated the pre-recorded draw commands */
+#define DIRTY_DRAWS                 0x1
+#define DIRTY_MATERIALS             0x2
+#define DIRTY_FRAMEBUFFER           0x8
+#define DIRTY_PIPELINES             0x10
+
+/* Passes recorded by each worker, the depth pass only with the pre-pass */
+#define RECORD_PASS_DEPTH           0
+#define RECORD_PASS_SHADE           1
+#define RECORD_PASS_COUNT           2
+
+#define STATS_QUERY_FLAGS           VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+
+/* First size of the streamed vertex arena, it doubles when a chunk does not fit */
+#define VERTEX_ARENA_MIN_SIZE       (4*1024*1024)
+
+/* Buffers and textures replaced while frames may still read them */
+#define MAX_RETIRED_RESOURCES       32
+
+/* Loaded when the pipelines are built, and again when they change on disk */
+#define SHADER_VERT_FILE            "shaders/modelobjviewer.vert.spv"
+#define SHADER_FRAG_FILE            "shaders/modelobjviewer.frag.spv"
+#define SHADER_DEPTH_VERT_FILE      "shaders/modelobjviewer_depth.vert.spv"
+#define SHADER_CULL_FILE            "shaders/modelobjviewer.comp.spv"
+
+/* Instance extensions asked for, the ones the loader does not have are left out */
+#define MAX_INSTANCE_EXTENSIONS     8
 
 
 typedef struct _vertexData_t {
@@ -44,6 +103,43 @@ typedef struct _vertexData_t {
 } vertexData_t;
 
 
+/* Split layout, position only passes fetch 12 bytes per vertex */
+typedef struct _vertexPosition_t {
+    float vx, vy, vz;
+} vertexPosition_t;
+
+
+typedef struct _vertexAttributes_t {
+    float nx, ny, nz, nw;
+    float s, t;
+} vertexAttributes_t;
+
+
+/* The attribute stream follows the position stream in the vertex buffer */
+#define VERTEX_ATTRIBUTE_OFFSET(count)  ((sizeof(vertexPosition_t) * (VkDeviceSize)(count) + 15) & ~(VkDeviceSize)15)
+
+
+/* std430 material, the colours are vec4 so the shader loads them whole */
+typedef struct _gpuMaterial_t {
+    float Ka[3], Ni;
+    float Kd[3], d;
+    float Ks[3], Ns;
+    uint32_t imageIndex;
+    float illum;
+    int32_t shininess;
+    uint32_t imageLayer;
+} gpuMaterial_t;
+
+
+/* std140 scene block, written when the scene properties change */
+typedef struct _gpuScene_t {
+    float lightPosition[4];
+    float cameraTarget[4];
+    float ambientLight[4];
+    float lightSourceIntensity[4];
+} gpuScene_t;
+
+
 typedef struct _buffer_t {
     VkBuffer        buffer;
     VkDeviceMemory  memory;
@@ -58,6 +154,59 @@ typedef struct _texture_t {
 } texture_t;
 
 
+/* Device local vertices copied in chunk by chunk, moved to a larger buffer when full */
+typedef struct _vertex_arena_t {
+    buffer_t        buffer;
+    VkDeviceSize    size;
+    VkDeviceSize    capacity;
+    uint32_t        copyCount;
+    uint32_t        growCount;
+} vertex_arena_t;
+
+
+/* Freed once every frame recorded before it was retired has completed, either handle may be null */
+typedef struct _retired_resource_t {
+    buffer_t        buffer;
+    texture_t       texture;
+    uint32_t        frame;
+} retired_resource_t;
+
+
+/* Layout matches a uvec2 in the vertex shader */
+typedef struct _instanceRef_t {
+    uint32_t        instance;
+    uint32_t        material;
+} instanceRef_t;
+
+
+/* Records one slice of the draw list into a secondary command buffer, pools are per frame so a slot can be reset while the other is in flight */
+typedef struct _recordThread_t {
+    thread_t                thread;
+    VkBool32                running;
+    VkCommandPool           cmdPool[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer         cmdBuffer[MAX_FRAMES_IN_FLIGHT][RECORD_PASS_COUNT];
+    struct VulkanObject*    vulkanObj;
+    VkDrawIndirectCommand*  drawCmds;
+    uint32_t                firstDraw;
+    uint32_t                drawCount;
+    uint32_t                cullBackCount;
+    VkBool32                hasSlice;
+    uint32_t                generation;
+    VkResult                result;
+} recordThread_t;
+
+
+/* The lod scale rides in cameraPosition.w, 0 keeps level 0 */
+typedef struct _cullPushConstants_t {
+    frustum_t       frustum;
+    vec4_t          cameraPosition;
+    uint32_t        drawCount;
+    uint32_t        compact;
+    uint32_t        cull;
+    uint32_t        cullBackCount;
+} cullPushConstants_t;
+
+
 typedef struct VulkanObject
 {
     VkDevice                device;
@@ -70,12 +219,39 @@ typedef struct VulkanObject
     VkCommandBuffer         cmdBuffer;
     VkFence                 cmdBuffFence;
 
+    /* Workers live as long as the device, each frame bumps the generation to wake them */
+    recordThread_t*         recordThreads;
+    uint32_t                recordThreadCount;
+    mutex_t                 recordLock;
+    condition_t             recordStart;
+    condition_t             recordDone;
+    uint32_t                recordGeneration;
+    uint32_t                recordPending;
+    VkBool32                recordQuit;
+    uint32_t                frameIndex;
+
+    /* Frames only clear until the scene has been loaded, or draw the streamed ranges */
+    VkBool32                sceneReady;
+    vertex_arena_t          vertexArena;
+    VkDrawIndirectCommand*  streamDrawCmds;
+    uint32_t                streamDrawCount;
+    uint32_t                streamDrawCapacity;
+
+    retired_resource_t      retiredResources[MAX_RETIRED_RESOURCES];
+    uint32_t                retiredCount;
+    uint32_t                frameSerial;
+
+    /* Each frame slot replays its own recording, it binds that slot's descriptor set */
+    VkBool32                staticCommands;
+    VkCommandBuffer         staticCmdBuffers[MAX_FRAMES_IN_FLIGHT];
+    uint32_t                staleStaticSlots;
+    uint32_t                dirtyFlags;
+
     VkDescriptorImageInfo   samplerInfo;
-    VkDescriptorPool        descriptorPool;
-    VkDescriptorImageInfo   dii[16];
-    VkDescriptorBufferInfo  dbi;
-    VkDescriptorSet         descriptorSet;
-    VkWriteDescriptorSet    wds[MAX_DESCRIPTOR_SETS];
+    descriptor_manager_t    descriptors;
+    VkDescriptorImageInfo*  dii;
+    VkDescriptorSet         descriptorSets[MAX_FRAMES_IN_FLIGHT];
+    uint32_t                writtenTextureCount;
 
     VkExtent2D              windowSize;
 
@@ -83,18 +259,71 @@ typedef struct VulkanObject
     VkFence                 imageAcquiredFence;
 
     buffer_t                vertexBuffer;
+    VkBool32                splitVertexStreams;
+    VkDeviceSize            vertexAttributeOffset;
     buffer_t                uniformBuffer;
-
-    texture_t               textures[MAX_IMAGE_TEXTURES];
+    buffer_t                materialBuffer;
+    buffer_t                sceneBuffer;
+    gpuScene_t              sceneData;
+    buffer_t                instanceBuffer;
+    buffer_t                instanceRefBuffer;
+
+    buffer_t                drawCmdBuffer;
+    VkDrawIndirectCommand*  drawCmds;
+    uint32_t                drawCount;
+    uint32_t                cullBackDrawCount;
+    VkBool32                multiDrawIndirect;
+
+    instanceRef_t*          instanceRefs;
+    uint32_t                instanceRefCount;
+
+    boundingSphere_t*       drawBounds;
+    normalCone_t*           drawCones;
+    lod_level_t*            drawLods;
+    VkDrawIndirectCommand*  lodDrawCmds;
+    VkDrawIndirectCommand*  visibleDrawCmds;
+    frustum_t               frustum;
+    vec3_t                  cameraPosition;
+    VkBool32                frustumCulling;
+    VkBool32                lodSelection;
+    float                   lodScale;
+    VkBool32                drawIndirectCount;
+    PFN_vkCmdDrawIndirectCountKHR vkCmdDrawIndirectCount;
+    buffer_t                boundsBuffer;
+    buffer_t                conesBuffer;
+    buffer_t                lodsBuffer;
+    buffer_t                visibleDrawBuffer;
+    buffer_t                visibleCountBuffer;
+    VkDescriptorSetLayout   cullDsl;
+    VkPipelineLayout        cullPll;
+    VkPipeline              cullPipeline;
+    VkDescriptorSet         cullDescriptorSets[MAX_FRAMES_IN_FLIGHT];
+
+    texture_t*              textures;
     uint32_t                numOfTextures;
+    uint32_t                textureCapacity;
+    VkBool32                descriptorIndexing;
+    VkBool32                memoryBudget;
 
     VkDescriptorSetLayout    dsl;
     VkPipelineLayout         pll;
+    VkPipelineCache          pipelineCache;
     VkPipeline               texPipeline;
+    VkPipeline               texCullPipeline;
+    VkPipeline               depthPipeline;
+    VkPipeline               depthCullPipeline;
+    VkBool32                 depthPrePass;
+
+    VkBool32                 pipelineStatistics;
+    VkQueryPool              statsQueryPool;
+    uint32_t                 statsPending;
+    uint64_t                 fragmentInvocations;
+    uint32_t                 statsFrames;
 
     VkRenderPass             renderPass;
     VkImage                  colorBuffer;
     VkImage                  depthBuffer;
+    VkFormat                 depthFormat;
     VkDeviceMemory           imageMemory[2];
     VkImageView              imageViews[2];
     VkFramebuffer            framebuffer;
@@ -108,7 +337,9 @@ typedef struct VulkanObject
     VkSurfaceKHR             surface;
 
     VkSampler                sampler;
-    uint32_t                 descSetCount;
+
+    SDL_Window*              window;
+    VkBool32                 swapChainOutOfDate;
 
 } VulkanObject;
 
@@ -118,22 +349,52 @@ VkResult initImages(VulkanObject* vulkanObj);
 VkResult initFrameBuffer(VulkanObject* vulkanObj);
 VkResult initPlatformSurface(VulkanObject* vulkanObj);
 VkResult initSwapChain(VulkanObject* vulkanObj);
+VkResult recreateAttachments(VulkanObject* vulkanObj);
+VkResult recreateSwapChain(VulkanObject* vulkanObj);
+void destroyAttachments(VulkanObject* vulkanObj);
 
 buffer_t createBuffer(VulkanObject* vulkanObj, uint32_t size, uint32_t usageFlags, VkMemoryPropertyFlags memFlags, VkSharingMode sharing);
+void destroyBuffer(VulkanObject* vulkanObj, buffer_t* buffer);
+void retireBuffer(VulkanObject* vulkanObj, buffer_t* buffer);
+void destroyTexture(VulkanObject* vulkanObj, texture_t* texture);
+void retireTexture(VulkanObject* vulkanObj, texture_t* texture);
+VkDeviceSize queryDeviceLocalBudget(VulkanObject* vulkanObj, VkDeviceSize* usage);
+void beginGeometryStream(VulkanObject* vulkanObj);
+void appendVertexArena(VulkanObject* vulkanObj, VkCommandBuffer cmdBuf, buffer_t* staging, VkDeviceSize size);
+VkBool32 endGeometryStream(VulkanObject* vulkanObj, VkBool32 keepVertices);
+void releaseSceneBuffers(VulkanObject* vulkanObj);
 void createSampler(VulkanObject* vulkanObj);
 void createUniformBufferDescriptorSet(VulkanObject* vulkanObj, uint32_t uniformStructSize);
 void createImageDescriptorSet(VulkanObject* vulkanObj, texture_t textures[]);
+void writeTextureSlot(VulkanObject* vulkanObj, uint32_t slot, texture_t* texture);
 void createTextureBufferDescriptorSet(VulkanObject* vulkanObj);
-texture_t createTextureImage(VulkanObject* vulkanObj, VkExtent2D* size, buffer_t* staging);
+void createMaterialBufferDescriptorSet(VulkanObject* vulkanObj);
+void createMaterialBuffer(VulkanObject* vulkanObj, material_t *materials, uint32_t materialCount);
+void updateMaterialBuffer(VulkanObject* vulkanObj, material_t *materials, uint32_t firstMaterial, uint32_t materialCount);
+void createSceneBufferDescriptorSet(VulkanObject* vulkanObj);
+void createSceneBuffer(VulkanObject* vulkanObj);
+void createInstanceBufferDescriptorSet(VulkanObject* vulkanObj);
+void createInstanceBuffer(VulkanObject* vulkanObj, scene_instance_t *instances, uint32_t instanceCount);
+void createDrawCommands(VulkanObject* vulkanObj, scene_t *scene);
+void createCullPipeline(VulkanObject* vulkanObj);
+void createCullDescriptorSet(VulkanObject* vulkanObj);
+VkResult reloadCullPipeline(VulkanObject* vulkanObj);
+texture_t createTextureImage(VulkanObject* vulkanObj, VkCommandBuffer cmdBuf, VkExtent2D* size, uint32_t mipLevels, uint32_t layerCount, buffer_t* staging);
 void createPipelines(VulkanObject *vulkanObj);
+VkResult createGraphicsPipelines(VulkanObject *vulkanObj);
+void destroyGraphicsPipelines(VulkanObject *vulkanObj);
+VkResult reloadGraphicsPipelines(VulkanObject *vulkanObj);
 VkResult createFence(VulkanObject *vulkanObj, VkFenceCreateInfo* info, VkFence* outFence, uint32_t count);
 VkResult createSemaphore(VulkanObject *vulkanObj, VkSemaphore semaphore[], uint32_t count);
 VkResult createCommandBuffer(VulkanObject* vulkanObj, VkCommandBuffer cmdBuffer[], uint32_t count);
+VkResult createRecordThreads(VulkanObject* vulkanObj, uint32_t threadCount);
+void destroyRecordThreads(VulkanObject* vulkanObj);
 
 void allocateDescriptorSet(VulkanObject *vulkanObj);
 void transitionImage(VulkanObject *vulkanObj);
 void draw(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, model_t model);
 void swapFrontBuffer(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkFence cmdBufFence);
+void submitFrame(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkFence cmdBufFence);
 
 void waitForFence(VulkanObject *vulkanObj, VkFence fence);
 
@@ -1,2 +1,2 @@
-for /r %%f in (*.vert;*.frag) do %VULKAN_SDK%\Bin32\glslangValidator.exe -V %%f -o %%f.spv
+for /r %%f in (*.vert;*.frag;*.comp) do %VULKAN_SDK%\Bin32\glslangValidator.exe -V %%f -o %%f.spv
 pause
\ No newline at end of file
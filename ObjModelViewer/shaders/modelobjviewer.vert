@@ -11,14 +11,34 @@ layout (binding=2) uniform MVP
     mat4 viewMatrix;
 };
 
+/* Placement of every instance in the scene */
+layout (std430, binding=4) readonly buffer instanceBuffer
+{
+    mat4 transforms[];
+};
+
+/* Transform and material per drawn instance, a draw's first instance points at its block */
+layout (std430, binding=5) readonly buffer instanceRefBuffer
+{
+    uvec2 instanceRefs[];
+};
+
+/* The depth pre-pass computes the same position, shading tests it with an equal compare */
+invariant gl_Position;
+
 layout(location=0) out vec4 oPosition;
 layout(location=1) out vec4 oNormal;
 layout(location=2) out vec2 oTexCoord;
+layout(location=3) flat out uint oMaterialIndex;
 
 void main(void)
 {
-    gl_Position = aPosition * (rotationMatrixUp * rotationMatrixRight * viewMatrix * persepctiveProjMatrix);
-    oNormal = aNormal;
+    uvec2 instanceRef = instanceRefs[gl_InstanceIndex];
+    vec4 position = aPosition * transforms[instanceRef.x];
+
+    gl_Position = position * (rotationMatrixUp * rotationMatrixRight * viewMatrix * persepctiveProjMatrix);
+    oNormal = aNormal * transforms[instanceRef.x];
     oTexCoord = aTexCoord;
-    oPosition = aPosition;
+    oPosition = position;
+    oMaterialIndex = instanceRef.y;
 }
@@ -0,0 +1,33 @@
+#version 450
+layout(location=0) in vec4 aPosition;
+
+layout (binding=2) uniform MVP
+{
+    mat4 persepctiveProjMatrix;
+    mat4 rotationMatrixUp;
+    mat4 rotationMatrixRight;
+    mat4 viewMatrix;
+};
+
+/* Placement of every instance in the scene */
+layout (std430, binding=4) readonly buffer instanceBuffer
+{
+    mat4 transforms[];
+};
+
+/* Transform and material per drawn instance, a draw's first instance points at its block */
+layout (std430, binding=5) readonly buffer instanceRefBuffer
+{
+    uvec2 instanceRefs[];
+};
+
+/* Must match modelobjviewer.vert exactly for the equal depth compare */
+invariant gl_Position;
+
+void main(void)
+{
+    uvec2 instanceRef = instanceRefs[gl_InstanceIndex];
+    vec4 position = aPosition * transforms[instanceRef.x];
+
+    gl_Position = position * (rotationMatrixUp * rotationMatrixRight * viewMatrix * persepctiveProjMatrix);
+}
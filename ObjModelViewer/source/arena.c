@@ -0,0 +1,69 @@
+#include "arena.h"
+
+
+/* The data follows the header, padded to the alignment */
+#define ARENA_HEADER_SIZE   ((sizeof(arena_block_t) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+
+void *arenaAlloc(arena_t *arena, size_t size)
+{
+    size_t blockSize;
+    arena_block_t *block = arena->blocks;
+    void *ptr;
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    /* Only the newest block is filled, older ones keep whatever is left at their end */
+    if(NULL == block || block->used + size > block->size)
+    {
+        blockSize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+        block = (arena_block_t *)memAlloc(MEMORY_LOADER, ARENA_HEADER_SIZE + blockSize);
+        if(NULL == block)
+        {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->size = blockSize;
+        block->used = 0;
+        arena->blocks = block;
+    }
+
+    ptr = (uint8_t *)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    arena->bytesUsed += size;
+    return ptr;
+}
+
+
+char *arenaStrndup(arena_t *arena, const char *string, size_t length)
+{
+    char *copy = (char *)arenaAlloc(arena, length + 1);
+
+    if(NULL != copy)
+    {
+        memcpy(copy, string, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+
+char *arenaStrdup(arena_t *arena, const char *string)
+{
+    return arenaStrndup(arena, string, strlen(string));
+}
+
+
+void freeArena(arena_t *arena)
+{
+    arena_block_t *block = arena->blocks;
+    arena_block_t *next;
+
+    while(NULL != block)
+    {
+        next = block->next;
+        memFree(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(arena_t));
+}
@@ -0,0 +1,197 @@
+#include "asyncLoader.h"
+#include "perfTimer.h"
+
+
+static void loaderThread(void *arg)
+{
+    async_loader_t *loader = (async_loader_t *)arg;
+    load_job_t job;
+    load_event_t event;
+    double start;
+
+    lockMutex(&loader->lock);
+    for(;;)
+    {
+        while(!loader->quit && 0 == loader->jobCount)
+        {
+            waitCondition(&loader->jobReady, &loader->lock);
+        }
+
+        /* Jobs still queued when the loader is destroyed are dropped */
+        if(loader->quit)
+        {
+            break;
+        }
+
+        job = loader->jobs[loader->jobHead];
+        loader->jobHead = (loader->jobHead + 1) % loader->jobCapacity;
+        loader->jobCount--;
+
+        /* The job runs without the lock, other workers and the render thread carry on */
+        unlockMutex(&loader->lock);
+        start = getTimeMs();
+        event = job.func(job.arg, job.index);
+        event.timeMs = getTimeMs() - start;
+        lockMutex(&loader->lock);
+
+        /* Room for the event was made when the job was submitted */
+        loader->events[loader->eventCount++] = event;
+        signalCondition(&loader->eventReady);
+    }
+    unlockMutex(&loader->lock);
+}
+
+
+VkBool32 initAsyncLoader(async_loader_t *loader, uint32_t threadCount)
+{
+    uint32_t i;
+
+    memset(loader, 0, sizeof(async_loader_t));
+    createMutex(&loader->lock);
+    createCondition(&loader->jobReady);
+    createCondition(&loader->eventReady);
+
+    threadCount = (threadCount > LOADER_MAX_THREADS) ? LOADER_MAX_THREADS : threadCount;
+    threadCount = (threadCount > 0) ? threadCount : 1;
+
+    for(i=0;i<threadCount;i++)
+    {
+        if(0 != createThread(&loader->threads[i], loaderThread, loader))
+        {
+            printf("Failed to create loader thread %d\n", i);
+            break;
+        }
+        loader->threadCount++;
+    }
+
+    return (loader->threadCount > 0) ? VK_TRUE : VK_FALSE;
+}
+
+
+VkBool32 submitLoadJob(async_loader_t *loader, loadJobFunc_t func, void *arg, uint32_t index)
+{
+    uint32_t i;
+    uint32_t capacity;
+    load_job_t *jobs;
+    load_event_t *events;
+
+    lockMutex(&loader->lock);
+
+    /* Grow the ring, unwrapping it into the new array */
+    if(loader->jobCount == loader->jobCapacity)
+    {
+        capacity = (loader->jobCapacity == 0) ? LOADER_MIN_CAPACITY : (loader->jobCapacity*2);
+        jobs = (load_job_t *)memAlloc(MEMORY_LOADER, sizeof(load_job_t) * capacity);
+        if(NULL == jobs)
+        {
+            unlockMutex(&loader->lock);
+            return VK_FALSE;
+        }
+        for(i=0;i<loader->jobCount;i++)
+        {
+            jobs[i] = loader->jobs[(loader->jobHead + i) % loader->jobCapacity];
+        }
+        memFree(loader->jobs);
+        loader->jobs = jobs;
+        loader->jobHead = 0;
+        loader->jobCapacity = capacity;
+    }
+
+    /* Every pending job can post its event, so the workers never allocate */
+    if(loader->pending == loader->eventCapacity)
+    {
+        capacity = (loader->eventCapacity == 0) ? LOADER_MIN_CAPACITY : (loader->eventCapacity*2);
+        events = (load_event_t *)memRealloc(MEMORY_LOADER, loader->events, sizeof(load_event_t) * capacity);
+        if(NULL == events)
+        {
+            unlockMutex(&loader->lock);
+            return VK_FALSE;
+        }
+        loader->events = events;
+        loader->eventCapacity = capacity;
+    }
+
+    loader->jobs[(loader->jobHead + loader->jobCount) % loader->jobCapacity] = (load_job_t){ func, arg, index };
+    loader->jobCount++;
+    loader->pending++;
+
+    signalCondition(&loader->jobReady);
+    unlockMutex(&loader->lock);
+    return VK_TRUE;
+}
+
+
+static uint32_t takeEvents(async_loader_t *loader, load_event_t *events, uint32_t maxEvents)
+{
+    uint32_t count = (loader->eventCount < maxEvents) ? loader->eventCount : maxEvents;
+
+    /* Oldest first, the rest move to the front */
+    memcpy(events, loader->events, sizeof(load_event_t) * count);
+    memmove(loader->events, &loader->events[count], sizeof(load_event_t) * (loader->eventCount - count));
+    loader->eventCount -= count;
+    loader->pending -= count;
+    return count;
+}
+
+
+uint32_t pollLoadEvents(async_loader_t *loader, load_event_t *events, uint32_t maxEvents)
+{
+    uint32_t count;
+
+    /* Called every frame, never blocks */
+    lockMutex(&loader->lock);
+    count = takeEvents(loader, events, maxEvents);
+    unlockMutex(&loader->lock);
+    return count;
+}
+
+
+uint32_t waitLoadEvents(async_loader_t *loader, load_event_t *events, uint32_t maxEvents)
+{
+    uint32_t count;
+
+    /* Blocks until at least one event is there, returns at once when nothing is pending */
+    lockMutex(&loader->lock);
+    while(0 == loader->eventCount && loader->pending > 0)
+    {
+        waitCondition(&loader->eventReady, &loader->lock);
+    }
+    count = takeEvents(loader, events, maxEvents);
+    unlockMutex(&loader->lock);
+    return count;
+}
+
+
+uint32_t pendingLoadJobs(async_loader_t *loader)
+{
+    uint32_t pending;
+
+    lockMutex(&loader->lock);
+    pending = loader->pending;
+    unlockMutex(&loader->lock);
+    return pending;
+}
+
+
+void destroyAsyncLoader(async_loader_t *loader)
+{
+    uint32_t i;
+
+    /* Running jobs finish, queued ones are dropped */
+    lockMutex(&loader->lock);
+    loader->quit = VK_TRUE;
+    broadcastCondition(&loader->jobReady);
+    unlockMutex(&loader->lock);
+
+    for(i=0;i<loader->threadCount;i++)
+    {
+        joinThread(&loader->threads[i]);
+    }
+
+    destroyCondition(&loader->eventReady);
+    destroyCondition(&loader->jobReady);
+    destroyMutex(&loader->lock);
+    memFree(loader->jobs);
+    memFree(loader->events);
+    memset(loader, 0, sizeof(async_loader_t));
+}
@@ -3,7 +3,7 @@
 
 VkResult getBmpSize(char *path, VkExtent2D *size)
 {
-    uint8_t *data = NULL;
+    uint8_t data[BMP_HEADER_SIZE] = { 0 };
     FILE *pFile = NULL;
     errno_t err;
 
@@ -14,13 +14,6 @@ VkResult getBmpSize(char *path, VkExtent2D *size)
        return VK_FALSE;
     }
 
-    /* Read file */
-    data = (uint8_t *)malloc( BMP_HEADER_SIZE );
-    if (data == NULL)
-    {
-        return VK_FALSE;
-    }
-
     /* Read BMP Header */
     fread(data, BMP_HEADER_SIZE, 1, pFile);
 
@@ -58,3 +51,97 @@ void loadBmpToBuffer(char *path, VkExtent2D *size, unsigned char **ptr)
 
     fclose( pFile );
 }
+
+
+unsigned char *loadBmpFile(char *path, VkExtent2D *size)
+{
+    unsigned char *pixels;
+
+    if (VK_FALSE == getBmpSize(path, size))
+    {
+        return NULL;
+    }
+
+    /* Four bytes per pixel, the header is read into the start of the buffer before the pixels overwrite it */
+    pixels = (unsigned char *)memAlloc(MEMORY_TEXTURE, (size_t)size->width * size->height * (BMP_PIX_PER_COLOR + 1) + BMP_HEADER_SIZE);
+    if (NULL == pixels)
+    {
+        return NULL;
+    }
+
+    loadBmpToBuffer(path, size, &pixels);
+    return pixels;
+}
+
+
+VkExtent2D mipExtent(mip_chain_t *chain, uint32_t level)
+{
+    VkExtent2D extent;
+
+    extent.width = ((chain->size.width >> level) > 0) ? (chain->size.width >> level) : 1;
+    extent.height = ((chain->size.height >> level) > 0) ? (chain->size.height >> level) : 1;
+    return extent;
+}
+
+
+VkDeviceSize mipLevelBytes(mip_chain_t *chain, uint32_t level)
+{
+    return chain->offsets[level + 1] - chain->offsets[level];
+}
+
+
+void buildMipChain(VkExtent2D *size, unsigned char *pixels, mip_chain_t *chain)
+{
+    uint32_t level, x, y, c;
+    uint32_t x1, y1;
+    uint8_t *src, *dst;
+    VkExtent2D from, to;
+
+    chain->size = *size;
+    chain->levelCount = 0;
+    chain->offsets[0] = 0;
+
+    /* Halve until both sides are one texel */
+    do
+    {
+        to = mipExtent(chain, chain->levelCount);
+        chain->offsets[chain->levelCount + 1] = chain->offsets[chain->levelCount] + (VkDeviceSize)to.width * to.height * TEXTURE_BYTES_PER_TEXEL;
+        chain->levelCount++;
+    } while((to.width > 1 || to.height > 1) && chain->levelCount < MAX_MIP_LEVELS);
+
+    chain->pixels = (uint8_t *)memAlloc(MEMORY_TEXTURE, (size_t)chain->offsets[chain->levelCount]);
+    memcpy(chain->pixels, pixels, (size_t)mipLevelBytes(chain, 0));
+
+    /* Each level averages 2x2 texels of the one above, odd edges repeat their last texel */
+    for(level=1;level<chain->levelCount;level++)
+    {
+        from = mipExtent(chain, level - 1);
+        to = mipExtent(chain, level);
+        src = chain->pixels + chain->offsets[level - 1];
+        dst = chain->pixels + chain->offsets[level];
+
+        for(y=0;y<to.height;y++)
+        {
+            y1 = (2*y + 1 < from.height) ? (2*y + 1) : (from.height - 1);
+            for(x=0;x<to.width;x++)
+            {
+                x1 = (2*x + 1 < from.width) ? (2*x + 1) : (from.width - 1);
+                for(c=0;c<TEXTURE_BYTES_PER_TEXEL;c++)
+                {
+                    dst[(y*to.width + x)*TEXTURE_BYTES_PER_TEXEL + c] = (uint8_t)((
+                        src[((2*y)*from.width + 2*x)*TEXTURE_BYTES_PER_TEXEL + c] +
+                        src[((2*y)*from.width + x1)*TEXTURE_BYTES_PER_TEXEL + c] +
+                        src[(y1*from.width + 2*x)*TEXTURE_BYTES_PER_TEXEL + c] +
+                        src[(y1*from.width + x1)*TEXTURE_BYTES_PER_TEXEL + c] + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+
+void freeMipChain(mip_chain_t *chain)
+{
+    memFree(chain->pixels);
+    memset(chain, 0, sizeof(mip_chain_t));
+}
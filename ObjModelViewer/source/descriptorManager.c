@@ -0,0 +1,359 @@
+#include "descriptorManager.h"
+
+
+static VkResult growArray(void **array, uint32_t *capacity, uint32_t needed, size_t elementSize)
+{
+    uint32_t newCapacity = *capacity;
+    void *grown;
+
+    if(needed <= *capacity)
+    {
+        return VK_SUCCESS;
+    }
+
+    /* Double until the new entries fit */
+    while(newCapacity < needed)
+    {
+        newCapacity = (newCapacity == 0) ? DESCRIPTOR_MIN_CAPACITY : (newCapacity * 2);
+    }
+
+    /* A failed realloc leaves the array and its capacity as they were */
+    grown = memRealloc(MEMORY_RENDERER, *array, newCapacity * elementSize);
+    if(NULL == grown)
+    {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    *array = grown;
+    *capacity = newCapacity;
+    return VK_SUCCESS;
+}
+
+
+static VkBool32 isImageDescriptor(VkDescriptorType type)
+{
+    return (VK_DESCRIPTOR_TYPE_SAMPLER == type ||
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER == type ||
+            VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE == type ||
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE == type ||
+            VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT == type) ? VK_TRUE : VK_FALSE;
+}
+
+
+static uint32_t poolScale(uint32_t poolIndex)
+{
+    uint32_t i;
+    uint32_t scale = 1;
+
+    /* Every pool is twice the size of the one before */
+    for(i=0;i<poolIndex && scale < DESCRIPTOR_MAX_POOL_SCALE;i++)
+    {
+        scale *= 2;
+    }
+    return scale;
+}
+
+
+static VkResult reserveWrite(descriptor_write_queue_t *queue)
+{
+    uint32_t infoCapacity = queue->writeCapacity;
+    VkResult result;
+
+    /* The info indices grow first, writeCapacity only counts once both arrays hold it */
+    result = growArray((void **)&queue->writeInfos, &infoCapacity, queue->writeCount + 1, sizeof(uint32_t));
+    if(VK_SUCCESS != result)
+    {
+        return result;
+    }
+    return growArray((void **)&queue->writes, &queue->writeCapacity, queue->writeCount + 1, sizeof(VkWriteDescriptorSet));
+}
+
+
+static VkResult addPool(descriptor_manager_t *dm, descriptor_pool_chain_t *chain)
+{
+    uint32_t i;
+    uint32_t scale = poolScale(chain->count);
+    VkResult result;
+    VkDescriptorPoolSize sizes[DESCRIPTOR_MAX_POOL_SIZES];
+
+    for(i=0;i<dm->poolSizeCount;i++)
+    {
+        sizes[i].type = dm->poolSizes[i].type;
+        sizes[i].descriptorCount = dm->poolSizes[i].descriptorCount * scale;
+    }
+
+    VkDescriptorPoolCreateInfo dpci =
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = dm->maxSets * scale,
+        .poolSizeCount = dm->poolSizeCount,
+        .pPoolSizes = sizes
+    };
+
+    result = growArray((void **)&chain->pools, &chain->capacity, chain->count + 1, sizeof(VkDescriptorPool));
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to grow descriptor pool chain: %d\n", result);
+        return result;
+    }
+
+    result = vkCreateDescriptorPool(dm->device, &dpci, NULL, &chain->pools[chain->count]);
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to create descriptor pool %d: %d\n", chain->count, result);
+        return result;
+    }
+
+    chain->current = chain->count++;
+    return VK_SUCCESS;
+}
+
+
+static VkResult allocateFromChain(descriptor_manager_t *dm, descriptor_pool_chain_t *chain, VkDescriptorSetLayout layout, VkDescriptorSet *set)
+{
+    VkResult result;
+    VkBool32 freshPool;
+
+    VkDescriptorSetAllocateInfo dsai =
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = VK_NULL_HANDLE,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout
+    };
+
+    for(;;)
+    {
+        /* Once the current pool is full the chain grows by a larger one */
+        freshPool = VK_FALSE;
+        if(chain->current >= chain->count)
+        {
+            result = addPool(dm, chain);
+            if(VK_SUCCESS != result)
+            {
+                return result;
+            }
+            freshPool = VK_TRUE;
+        }
+
+        dsai.descriptorPool = chain->pools[chain->current];
+        result = vkAllocateDescriptorSets(dm->device, &dsai, set);
+        if(VK_ERROR_OUT_OF_POOL_MEMORY != result && VK_ERROR_FRAGMENTED_POOL != result)
+        {
+            return result;
+        }
+
+        /* Not even an empty pool of the largest size holds the set */
+        if(freshPool && poolScale(chain->current) >= DESCRIPTOR_MAX_POOL_SCALE)
+        {
+            printf("Descriptor set does not fit a pool\n");
+            return result;
+        }
+
+        chain->current++;
+    }
+}
+
+
+VkResult initDescriptorManager(descriptor_manager_t *dm, VkDevice device, const VkDescriptorPoolSize *poolSizes, uint32_t poolSizeCount, uint32_t maxSets, uint32_t frameCount)
+{
+    uint32_t f;
+    VkResult result = VK_SUCCESS;
+
+    memset(dm, 0, sizeof(descriptor_manager_t));
+
+    if(poolSizeCount > DESCRIPTOR_MAX_POOL_SIZES || 0 == frameCount || frameCount > DESCRIPTOR_MAX_FRAMES)
+    {
+        printf("Too many descriptor pool sizes or frames\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    dm->device = device;
+    dm->poolSizeCount = poolSizeCount;
+    dm->maxSets = maxSets;
+    dm->frameCount = frameCount;
+    memcpy(dm->poolSizes, poolSizes, sizeof(VkDescriptorPoolSize) * poolSizeCount);
+
+    /* One chain per frame slot, so a slot's sets never share a pool with the other slots */
+    for(f=0;f<frameCount && VK_SUCCESS == result;f++)
+    {
+        result = addPool(dm, &dm->frames[f]);
+    }
+    return result;
+}
+
+
+VkResult allocateFrameDescriptorSets(descriptor_manager_t *dm, VkDescriptorSetLayout layout, VkDescriptorSet *sets)
+{
+    uint32_t f;
+    VkResult result = VK_SUCCESS;
+
+    /* One copy per frame slot, each slot binds and writes only its own */
+    for(f=0;f<dm->frameCount && VK_SUCCESS == result;f++)
+    {
+        result = allocateFromChain(dm, &dm->frames[f], layout, &sets[f]);
+    }
+    return result;
+}
+
+
+static VkResult queueSlotBufferWrite(descriptor_write_queue_t *queue, VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    VkWriteDescriptorSet *write;
+    VkResult result;
+
+    result = reserveWrite(queue);
+    if(VK_SUCCESS == result)
+    {
+        result = growArray((void **)&queue->bufferInfos, &queue->bufferInfoCapacity, queue->bufferInfoCount + 1, sizeof(VkDescriptorBufferInfo));
+    }
+    if(VK_SUCCESS != result)
+    {
+        return result;
+    }
+
+    queue->bufferInfos[queue->bufferInfoCount] = (VkDescriptorBufferInfo){ buffer, offset, range };
+
+    write = &queue->writes[queue->writeCount];
+    memset(write, 0, sizeof(VkWriteDescriptorSet));
+    write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write->dstSet = set;
+    write->dstBinding = binding;
+    write->dstArrayElement = 0;
+    write->descriptorCount = 1;
+    write->descriptorType = type;
+
+    queue->writeInfos[queue->writeCount++] = queue->bufferInfoCount++;
+    return VK_SUCCESS;
+}
+
+
+static VkResult queueSlotImageWrite(descriptor_write_queue_t *queue, VkDescriptorSet set, uint32_t binding, VkDescriptorType type, uint32_t firstElement, uint32_t count, const VkDescriptorImageInfo *infos)
+{
+    VkWriteDescriptorSet *write = (queue->writeCount > 0) ? &queue->writes[queue->writeCount - 1] : NULL;
+    VkResult result;
+
+    result = growArray((void **)&queue->imageInfos, &queue->imageInfoCapacity, queue->imageInfoCount + count, sizeof(VkDescriptorImageInfo));
+    if(VK_SUCCESS != result)
+    {
+        return result;
+    }
+    memcpy(&queue->imageInfos[queue->imageInfoCount], infos, sizeof(VkDescriptorImageInfo) * count);
+
+    /* Streamed textures land in consecutive slots, they extend the previous write */
+    if(NULL != write && write->dstSet == set && write->dstBinding == binding && write->descriptorType == type &&
+       write->dstArrayElement + write->descriptorCount == firstElement &&
+       queue->writeInfos[queue->writeCount - 1] + write->descriptorCount == queue->imageInfoCount)
+    {
+        write->descriptorCount += count;
+        queue->imageInfoCount += count;
+        return VK_SUCCESS;
+    }
+
+    result = reserveWrite(queue);
+    if(VK_SUCCESS != result)
+    {
+        return result;
+    }
+
+    write = &queue->writes[queue->writeCount];
+    memset(write, 0, sizeof(VkWriteDescriptorSet));
+    write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write->dstSet = set;
+    write->dstBinding = binding;
+    write->dstArrayElement = firstElement;
+    write->descriptorCount = count;
+    write->descriptorType = type;
+
+    queue->writeInfos[queue->writeCount++] = queue->imageInfoCount;
+    queue->imageInfoCount += count;
+    return VK_SUCCESS;
+}
+
+
+VkResult queueBufferWrite(descriptor_manager_t *dm, const VkDescriptorSet *sets, uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    uint32_t f;
+    VkResult result = VK_SUCCESS;
+
+    /* Every slot gets the write, it goes out when the slot is next flushed */
+    for(f=0;f<dm->frameCount && VK_SUCCESS == result;f++)
+    {
+        result = queueSlotBufferWrite(&dm->queues[f], sets[f], binding, type, buffer, offset, range);
+    }
+    return result;
+}
+
+
+VkResult queueImageWrite(descriptor_manager_t *dm, const VkDescriptorSet *sets, uint32_t binding, VkDescriptorType type, uint32_t firstElement, uint32_t count, const VkDescriptorImageInfo *infos)
+{
+    uint32_t f;
+    VkResult result = VK_SUCCESS;
+
+    for(f=0;f<dm->frameCount && VK_SUCCESS == result;f++)
+    {
+        result = queueSlotImageWrite(&dm->queues[f], sets[f], binding, type, firstElement, count, infos);
+    }
+    return result;
+}
+
+
+uint32_t flushDescriptorWrites(descriptor_manager_t *dm, uint32_t frameIndex)
+{
+    uint32_t i;
+    descriptor_write_queue_t *queue = &dm->queues[frameIndex % dm->frameCount];
+    uint32_t count = queue->writeCount;
+
+    if(0 == count)
+    {
+        return 0;
+    }
+
+    /* The info arrays may have moved while growing, point the writes at them now */
+    for(i=0;i<count;i++)
+    {
+        if(isImageDescriptor(queue->writes[i].descriptorType))
+        {
+            queue->writes[i].pImageInfo = &queue->imageInfos[queue->writeInfos[i]];
+        }
+        else
+        {
+            queue->writes[i].pBufferInfo = &queue->bufferInfos[queue->writeInfos[i]];
+        }
+        dm->descriptorsWritten += queue->writes[i].descriptorCount;
+    }
+
+    /* The slot's fence has been waited on, none of its sets is in use, everything queued goes out in one call */
+    vkUpdateDescriptorSets(dm->device, count, queue->writes, 0, NULL);
+
+    dm->flushCount++;
+    queue->writeCount = 0;
+    queue->bufferInfoCount = 0;
+    queue->imageInfoCount = 0;
+
+    return count;
+}
+
+
+void destroyDescriptorManager(descriptor_manager_t *dm)
+{
+    uint32_t i, f;
+
+    for(f=0;f<dm->frameCount;f++)
+    {
+        for(i=0;i<dm->frames[f].count;i++)
+        {
+            vkDestroyDescriptorPool(dm->device, dm->frames[f].pools[i], NULL);
+        }
+        memFree(dm->frames[f].pools);
+
+        memFree(dm->queues[f].writes);
+        memFree(dm->queues[f].writeInfos);
+        memFree(dm->queues[f].bufferInfos);
+        memFree(dm->queues[f].imageInfos);
+    }
+    memset(dm, 0, sizeof(descriptor_manager_t));
+}
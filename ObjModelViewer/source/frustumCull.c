@@ -0,0 +1,214 @@
+#include <float.h>
+#include "frustumCull.h"
+
+
+static vec4_t normalizePlane(vec4_t plane)
+{
+    float length = sqrtf(plane.x*plane.x + plane.y*plane.y + plane.z*plane.z);
+
+    if(length > 0.0f)
+    {
+        plane.x /= length;
+        plane.y /= length;
+        plane.z /= length;
+        plane.w /= length;
+    }
+    return plane;
+}
+
+
+static vec4_t combineRows(float *mat, uint32_t row, float sign)
+{
+    /* Row 3 plus or minus another row of the clip matrix */
+    vec4_t plane =
+    {
+        mat[12] + sign * mat[row*4+0],
+        mat[13] + sign * mat[row*4+1],
+        mat[14] + sign * mat[row*4+2],
+        mat[15] + sign * mat[row*4+3]
+    };
+    return plane;
+}
+
+
+void extractFrustumPlanes(float *viewProj, frustum_t *frustum)
+{
+    /* viewProj takes a column vector to clip space, x and y are clipped to [-w, w] */
+    frustum->planes[0] = normalizePlane(combineRows(viewProj, 0,  1.0f));
+    frustum->planes[1] = normalizePlane(combineRows(viewProj, 0, -1.0f));
+    frustum->planes[2] = normalizePlane(combineRows(viewProj, 1,  1.0f));
+    frustum->planes[3] = normalizePlane(combineRows(viewProj, 1, -1.0f));
+
+    /* Depth is reversed, z = w at the near plane and z = 0 at the far plane */
+    frustum->planes[4] = normalizePlane(combineRows(viewProj, 2, -1.0f));
+    frustum->planes[5] = normalizePlane((vec4_t){ viewProj[8], viewProj[9], viewProj[10], viewProj[11] });
+}
+
+
+boundingSphere_t computeBoundingSphere(float *positions, uint32_t *faces, uint32_t cornerStride, uint32_t firstFace, uint32_t faceCount)
+{
+    uint32_t i;
+    uint32_t index;
+    float *p;
+    vec3_t minPos = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    vec3_t maxPos = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    vec3_t offset;
+    float distance;
+    boundingSphere_t sphere = { { 0.0f, 0.0f, 0.0f }, 0.0f };
+
+    if(faceCount == 0)
+    {
+        return sphere;
+    }
+
+    /* Box around every corner, the first index of each corner is the position */
+    for(i=firstFace*CORNERS_PER_FACE;i<(firstFace+faceCount)*CORNERS_PER_FACE;i++)
+    {
+        index = faces[i*cornerStride] - 1;
+        p = &positions[index*3];
+
+        minPos.x = fminf(minPos.x, p[0]); maxPos.x = fmaxf(maxPos.x, p[0]);
+        minPos.y = fminf(minPos.y, p[1]); maxPos.y = fmaxf(maxPos.y, p[1]);
+        minPos.z = fminf(minPos.z, p[2]); maxPos.z = fmaxf(maxPos.z, p[2]);
+    }
+
+    /* Center the sphere on the box, and grow it to the farthest corner */
+    sphere.center = scalarProd(addProd(minPos, maxPos), 0.5f);
+    for(i=firstFace*CORNERS_PER_FACE;i<(firstFace+faceCount)*CORNERS_PER_FACE;i++)
+    {
+        index = faces[i*cornerStride] - 1;
+        p = &positions[index*3];
+
+        offset = subProd((vec3_t){ p[0], p[1], p[2] }, sphere.center);
+        distance = dotProd(offset, offset);
+        if(distance > sphere.radius)
+        {
+            sphere.radius = distance;
+        }
+    }
+    sphere.radius = sqrtf(sphere.radius);
+
+    return sphere;
+}
+
+
+static vec3_t faceNormal(float *positions, float *normals, uint32_t *faces, uint32_t cornerStride, uint32_t face)
+{
+    uint32_t j;
+    uint32_t *corner = &faces[face*CORNERS_PER_FACE*cornerStride];
+    float *p0 = &positions[(corner[0] - 1)*3];
+    float *p1 = &positions[(corner[cornerStride] - 1)*3];
+    float *p2 = &positions[(corner[cornerStride*2] - 1)*3];
+    vec3_t vertexNormal = { 0.0f, 0.0f, 0.0f };
+
+    /* Counter clockwise winding faces out */
+    vec3_t normal = crossProd((vec3_t){ p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2] },
+                              (vec3_t){ p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2] });
+
+    /* Trust the file's normals over the winding when there are any */
+    if(normals != NULL && cornerStride == 3)
+    {
+        for(j=0;j<CORNERS_PER_FACE;j++)
+        {
+            float *n = &normals[(corner[j*cornerStride+2] - 1)*3];
+            vertexNormal = addProd(vertexNormal, (vec3_t){ n[0], n[1], n[2] });
+        }
+
+        if(dotProd(normal, vertexNormal) < 0.0f)
+        {
+            normal = negate(normal);
+        }
+    }
+
+    return normal;
+}
+
+
+normalCone_t computeNormalCone(float *positions, float *normals, uint32_t *faces, uint32_t cornerStride, uint32_t firstFace, uint32_t faceCount)
+{
+    uint32_t i;
+    float length;
+    float minDot = 1.0f;
+    vec3_t normal;
+    normalCone_t cone = { { 0.0f, 0.0f, 0.0f }, CONE_NO_CULL };
+
+    /* The axis is the average face direction */
+    for(i=firstFace;i<firstFace+faceCount;i++)
+    {
+        normal = faceNormal(positions, normals, faces, cornerStride, i);
+        length = sqrtf(dotProd(normal, normal));
+        if(length > 0.0f)
+        {
+            cone.axis = addProd(cone.axis, scalarProd(normal, 1.0f / length));
+        }
+    }
+
+    length = sqrtf(dotProd(cone.axis, cone.axis));
+    if(length == 0.0f)
+    {
+        return cone;
+    }
+    cone.axis = scalarProd(cone.axis, 1.0f / length);
+
+    /* Find the widest face normal */
+    for(i=firstFace;i<firstFace+faceCount;i++)
+    {
+        normal = faceNormal(positions, normals, faces, cornerStride, i);
+        length = sqrtf(dotProd(normal, normal));
+        if(length > 0.0f)
+        {
+            minDot = fminf(minDot, dotProd(cone.axis, normal) / length);
+        }
+    }
+
+    /* A cone of 90 degrees or more always has a face towards the camera */
+    if(minDot > 0.0f)
+    {
+        cone.cutoff = sqrtf(1.0f - minDot*minDot);
+    }
+
+    return cone;
+}
+
+
+uint32_t sphereInFrustum(frustum_t *frustum, boundingSphere_t *sphere)
+{
+    uint32_t i;
+    vec4_t *plane;
+
+    for(i=0;i<FRUSTUM_PLANE_COUNT;i++)
+    {
+        plane = &frustum->planes[i];
+        if((plane->x * sphere->center.x + plane->y * sphere->center.y + plane->z * sphere->center.z + plane->w) < -sphere->radius)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+uint32_t coneBackfacing(normalCone_t *cone, boundingSphere_t *sphere, vec3_t cameraPosition)
+{
+    vec3_t view = subProd(sphere->center, cameraPosition);
+
+    /* Every face points away from the camera, from anywhere inside the sphere */
+    return (dotProd(view, cone->axis) >= cone->cutoff * sqrtf(dotProd(view, view)) + sphere->radius) ? 1 : 0;
+}
+
+
+uint32_t cullDraws(frustum_t *frustum, boundingSphere_t *bounds, normalCone_t *cones, vec3_t cameraPosition, indirectDraw_t *draws, uint32_t drawCount, indirectDraw_t *visibleDraws)
+{
+    uint32_t i;
+    uint32_t visibleCount = 0;
+
+    /* Same test and compaction as the cull compute shader */
+    for(i=0;i<drawCount;i++)
+    {
+        if(sphereInFrustum(frustum, &bounds[i]) && !(cones != NULL && coneBackfacing(&cones[i], &bounds[i], cameraPosition)))
+        {
+            visibleDraws[visibleCount++] = draws[i];
+        }
+    }
+    return visibleCount;
+}
@@ -0,0 +1,270 @@
+#include "hostMemory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+/* Every block starts with its size and owner, so frees are charged without the caller knowing either */
+typedef struct _block_header_t
+{
+    uint64_t size;
+    uint32_t subsystem;
+    uint32_t reserved;
+} block_header_t;
+
+
+/* Updated from the loader threads, read whenever */
+typedef struct _usage_counters_t
+{
+    volatile uint64_t allocations;
+    volatile uint64_t allocatedBytes;
+    volatile uint64_t liveBytes;
+    volatile uint64_t peakBytes;
+} usage_counters_t;
+
+
+static void *defaultAlloc(void *userData, size_t size);
+static void *defaultRealloc(void *userData, void *ptr, size_t size);
+static void defaultFree(void *userData, void *ptr);
+
+static host_allocator_t s_allocator = { defaultAlloc, defaultRealloc, defaultFree, NULL };
+
+/* One set per subsystem and the totals last */
+static usage_counters_t s_usage[MEMORY_SUBSYSTEM_COUNT + 1];
+
+static const char *s_subsystemNames[MEMORY_SUBSYSTEM_COUNT] = { "loader", "textures", "renderer" };
+
+
+static void *defaultAlloc(void *userData, size_t size)
+{
+    (void)userData;
+    return malloc(size);
+}
+
+
+static void *defaultRealloc(void *userData, void *ptr, size_t size)
+{
+    (void)userData;
+    return realloc(ptr, size);
+}
+
+
+static void defaultFree(void *userData, void *ptr)
+{
+    (void)userData;
+    free(ptr);
+}
+
+
+static uint64_t atomicAdd(volatile uint64_t *target, uint64_t value)
+{
+#ifdef _WIN32
+    return (uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)target, (LONG64)value) + value;
+#else
+    return __atomic_add_fetch(target, value, __ATOMIC_RELAXED);
+#endif
+}
+
+
+static void raisePeak(volatile uint64_t *peak, uint64_t value)
+{
+    uint64_t current = *peak;
+
+    /* Another thread may raise it between the read and the swap, try again until it is at least value */
+    while(value > current)
+    {
+#ifdef _WIN32
+        uint64_t seen = (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)peak, (LONG64)value, (LONG64)current);
+        if(seen == current)
+        {
+            break;
+        }
+        current = seen;
+#else
+        if(__atomic_compare_exchange_n(peak, &current, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+#endif
+    }
+}
+
+
+static void chargeBlock(uint32_t subsystem, uint64_t oldSize, uint64_t newSize, uint64_t allocations)
+{
+    usage_counters_t *counters[2] = { &s_usage[subsystem], &s_usage[MEMORY_SUBSYSTEM_COUNT] };
+    uint64_t live;
+    uint32_t i;
+
+    /* A shrinking block wraps the addition round, which subtracts */
+    for(i=0;i<2;i++)
+    {
+        atomicAdd(&counters[i]->allocations, allocations);
+        atomicAdd(&counters[i]->allocatedBytes, allocations * newSize);
+        live = atomicAdd(&counters[i]->liveBytes, newSize - oldSize);
+        raisePeak(&counters[i]->peakBytes, live);
+    }
+}
+
+
+void setHostAllocator(host_allocator_t *allocator)
+{
+    /* Blocks go back to the allocator that made them, so this is set before anything is allocated */
+    if(NULL == allocator)
+    {
+        s_allocator = (host_allocator_t){ defaultAlloc, defaultRealloc, defaultFree, NULL };
+        return;
+    }
+    s_allocator = *allocator;
+}
+
+
+void *memAlloc(uint32_t subsystem, size_t size)
+{
+    block_header_t *header = (block_header_t *)s_allocator.alloc(s_allocator.userData, sizeof(block_header_t) + size);
+
+    if(NULL == header)
+    {
+        return NULL;
+    }
+
+    header->size = size;
+    header->subsystem = subsystem;
+    chargeBlock(subsystem, 0, size, 1);
+    return header + 1;
+}
+
+
+void *memCalloc(uint32_t subsystem, size_t count, size_t size)
+{
+    void *ptr;
+
+    if(0 != size && count > ((size_t)-1 - sizeof(block_header_t)) / size)
+    {
+        return NULL;
+    }
+
+    ptr = memAlloc(subsystem, count * size);
+    if(NULL != ptr)
+    {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+
+void *memRealloc(uint32_t subsystem, void *ptr, size_t size)
+{
+    block_header_t *header;
+    uint64_t oldSize;
+
+    if(NULL == ptr)
+    {
+        return memAlloc(subsystem, size);
+    }
+
+    /* The block stays with the subsystem that allocated it */
+    header = (block_header_t *)ptr - 1;
+    oldSize = header->size;
+    header = (block_header_t *)s_allocator.realloc(s_allocator.userData, header, sizeof(block_header_t) + size);
+    if(NULL == header)
+    {
+        return NULL;
+    }
+
+    header->size = size;
+    chargeBlock(header->subsystem, oldSize, size, 1);
+    return header + 1;
+}
+
+
+void memFree(void *ptr)
+{
+    block_header_t *header;
+
+    if(NULL == ptr)
+    {
+        return;
+    }
+
+    header = (block_header_t *)ptr - 1;
+    chargeBlock(header->subsystem, header->size, 0, 0);
+    s_allocator.free(s_allocator.userData, header);
+}
+
+
+void getMemoryUsage(uint32_t subsystem, memory_usage_t *usage)
+{
+    usage->allocations = s_usage[subsystem].allocations;
+    usage->allocatedBytes = s_usage[subsystem].allocatedBytes;
+    usage->liveBytes = s_usage[subsystem].liveBytes;
+    usage->peakBytes = s_usage[subsystem].peakBytes;
+}
+
+
+void resetMemoryPeaks(void)
+{
+    uint32_t i;
+
+    /* The next peaks count from what is live now */
+    for(i=0;i<=MEMORY_SUBSYSTEM_COUNT;i++)
+    {
+        s_usage[i].peakBytes = s_usage[i].liveBytes;
+    }
+}
+
+
+uint64_t getPeakRss(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return (uint64_t)counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+
+    if(0 != getrusage(RUSAGE_SELF, &usage))
+    {
+        return 0;
+    }
+
+    /* Bytes on macOS, kilobytes elsewhere */
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+
+void printMemoryUsage(void)
+{
+    memory_usage_t usage;
+    uint32_t i;
+
+    printf("Host memory:\n");
+    for(i=0;i<=MEMORY_SUBSYSTEM_COUNT;i++)
+    {
+        getMemoryUsage(i, &usage);
+        printf("\t%-10s\t%10" PRIu64 " allocations\t%10.1f MB requested\t%8.1f MB live\t%8.1f MB peak\n",
+            (i < MEMORY_SUBSYSTEM_COUNT) ? s_subsystemNames[i] : "total",
+            usage.allocations,
+            usage.allocatedBytes / (1024.0 * 1024.0),
+            usage.liveBytes / (1024.0 * 1024.0),
+            usage.peakBytes / (1024.0 * 1024.0));
+    }
+    printf("\tpeak RSS:\t%.1f MB\n", getPeakRss() / (1024.0 * 1024.0));
+}
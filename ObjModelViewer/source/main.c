@@ -1,13 +1,20 @@
 #include <stdio.h>
 #include <string.h>
+#include <float.h>
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include <vulkan/vulkan.h>
 
 #include "objFileLoader.h"
 #include "bmpTools.h"
 #include "matrixMath.h"
 #include "vulkanCmds.h"
+#include "perfTimer.h"
+#include "asyncLoader.h"
+#include "textureResidency.h"
+#include "osWatch.h"
 
 #define WINDOW_WIDTH                1024
 #define WINDOW_HEIGHT               768
@@ -18,6 +25,34 @@
 #define SCENE_NEAR                  0.1f
 #define SCENE_FAR                   2000.0f
 
+/* What a finished loader job produced */
+#define LOAD_EVENT_SCENE            0
+#define LOAD_EVENT_TEXTURE          1
+#define LOAD_EVENT_RELOAD           2
+
+#define MAX_LOAD_EVENTS             64
+
+/* Textures copied per upload batch, bounds the work added to a frame */
+#define MAX_TEXTURE_UPLOADS         8
+
+/* Streamed faces copied per frame at most, the same bound for geometry */
+#define MAX_STREAM_FACES            65536
+#define MAX_STREAM_BYTES            (MAX_STREAM_FACES * ELEMENTS_PER_FACE * SCENE_VERTEX_SIZE)
+
+/* What a watched file is, the index is its mesh, material or shader */
+#define WATCH_OBJ                   0
+#define WATCH_MTL                   1
+#define WATCH_TEXTURE               2
+#define WATCH_SHADER                3
+
+#define MAX_WATCH_CHANGES           64
+
+/* Index of the compute shader in the watched shaders, the others are graphics stages */
+#define SHADER_CULL                 3
+
+/* How long the resize benchmark waits for the window manager to apply a new size */
+#define RESIZE_BENCH_TIMEOUT_MS     1000.0
+
 typedef struct _matrices_t
 {
     float persepctiveProjMatrix[16];
@@ -27,74 +62,1762 @@ typedef struct _matrices_t
 } matrices_t;
 
 
-static model_t s_model =
+typedef struct _viewerOptions_t
+{
+    char **objFileNames;
+    uint32_t objFileCount;
+    uint32_t instanceCount;
+    VkBool32 headless;
+    VkBool32 mergeMaterials;
+    VkBool32 noCulling;
+    VkBool32 meshlets;
+    VkBool32 lod;
+    uint32_t resizeBenchIterations;
+    uint32_t recordThreads;
+    VkBool32 staticCommands;
+    uint32_t recordBenchFrames;
+    VkBool32 splitVertexStreams;
+    uint32_t fetchBenchFrames;
+    VkBool32 depthPrePass;
+    VkBool32 pipelineStatistics;
+    VkBool32 syncLoad;
+    uint32_t textureBudgetMb;
+    VkBool32 watch;
+} viewerOptions_t;
+
+
+/* Levels built on a loader thread, waiting for the upload of their tail */
+typedef struct _decodedTexture_t
+{
+    VkExtent2D size;
+    mip_chain_t chain;
+} decodedTexture_t;
+
+
+/* One image to upload, a texture alone or same size textures packed as the layers of an array */
+typedef struct _textureUpload_t
+{
+    uint32_t *materials;
+    uint32_t layerCount;
+} textureUpload_t;
+
+
+/* The scene is parsed and its textures decoded in the background, the render loop uploads them */
+typedef struct _loadState_t
+{
+    async_loader_t loader;
+    viewerOptions_t *options;
+
+    /* One per scene material, only textured ones are decoded */
+    decodedTexture_t *textures;
+    uint32_t texturesPending;
+
+    /* Decoded textures waiting for an upload batch */
+    textureUpload_t *ready;
+    uint32_t readyCount;
+
+    /* Small textures held back until every texture is decoded, then packed by size */
+    uint32_t *packable;
+    uint32_t packableCount;
+
+    /* One batch of texture copies in flight at a time */
+    VkCommandBuffer uploadCmdBuffer;
+    VkFence uploadFence;
+    VkBool32 uploadPending;
+    buffer_t staging[MAX_TEXTURE_UPLOADS];
+    textureUpload_t uploads[MAX_TEXTURE_UPLOADS];
+    uint32_t uploadCount;
+
+    VkBool32 sceneLoaded;
+    VkBool32 done;
+    VkBool32 reported;
+
+    /* Reported once everything is in */
+    double startMs;
+    double firstFrameMs;
+    double sceneMs;
+    double doneMs;
+    double parseMs;
+    double decodeMs;
+    double lastFrameMs;
+    double frameSumMs;
+    double frameSquareSumMs;
+    double frameMaxMs;
+    uint32_t loadFrames;
+    uint32_t textureCount;
+    uint32_t packedCount;
+    uint32_t arrayCount;
+} loadState_t;
+
+
+/* Faces handed over by the loader thread while the OBJ files are parsed, drawn before the scene is in */
+typedef struct _geometryStream_t
+{
+    mutex_t lock;
+    VkBool32 enabled;
+
+    /* Expanded vertices not copied yet, the render thread takes them from the front */
+    uint8_t *pending;
+    size_t pendingStart;
+    size_t pendingSize;
+    size_t pendingCapacity;
+
+    /* One draw per material range seen so far, in the order the faces were streamed */
+    VkDrawIndirectCommand *ranges;
+    uint32_t rangeCount;
+    uint32_t rangeCapacity;
+    uint32_t faceCount;
+
+    /* Where the model being parsed starts, and its material range that may still grow */
+    uint32_t baseFace;
+    uint32_t rangeCursor;
+    VkBool32 rangeOpen;
+
+    /* Box around the streamed positions, the camera backs off as it grows */
+    vec3_t minimum;
+    vec3_t maximum;
+    float fittedRadius;
+
+    /* Render thread, one staging buffer per frame slot */
+    buffer_t staging[MAX_FRAMES_IN_FLIGHT];
+    double firstDrawMs;
+} geometryStream_t;
+
+
+/* Files edited while the viewer runs are loaded again, changes are applied one batch at a time */
+typedef struct _reloadState_t
+{
+    file_watcher_t watcher;
+    VkBool32 watching;
+    VkBool32 filesWatched;
+
+    /* Changes not applied yet, an OBJ file waits for the jobs before it to finish */
+    file_change_t changes[MAX_WATCH_CHANGES];
+    uint32_t changeCount;
+
+    /* The scene with one mesh parsed again, built on a loader thread */
+    scene_t scene;
+    VkBool32 scenePending;
+
+    /* Textures decoded again, streamed ones keep their slot */
+    uint32_t texturesPending;
+
+    uint32_t reloads;
+} reloadState_t;
+
+
+/* Window sizes cycled through by the resize benchmark */
+static const VkExtent2D s_resizeBenchSizes[] =
+{
+    {640, 480}, {1280, 720}, {800, 600}, {1920, 1080}, {1024, 768}
+};
+
+
+/* Camera, rotation and lighting shared by every mesh in the scene */
+static model_t s_model =
+{
+    .modelRotationUp    = 0.0f,
+    .modelRotationRight = 0.0f,
+    .cameraRight        = {0.0f, 0.0f, 0.0f},
+    .cameraDirection    = {0.0f, 0.0f, 0.0f},
+    .cameraTarget       = {0.0f, 0.0f, 0.0f},
+    .cameraPosition     = {0.0f, 0.0f, DEFAULT_CAM_DIST},
+    .cameraFront        = {0.0f, 0.0f, -1.0f},
+    .cameraUp           = {0.0f, 1.0f,  0.0f}
+};
+
+
+static scene_t s_scene = { 0 };
+
+/* Pushed out when the scene is larger than the default view */
+static float s_sceneFar = SCENE_FAR;
+
+static loadState_t s_load = { 0 };
+static geometryStream_t s_stream = { 0 };
+static texture_residency_t s_residency = { 0 };
+static reloadState_t s_reload = { 0 };
+
+/* Compiled shaders, watched in this order */
+static const char *s_shaderFiles[] =
+{
+    SHADER_VERT_FILE, SHADER_FRAG_FILE, SHADER_DEPTH_VERT_FILE, SHADER_CULL_FILE
+};
+
+
+void updateModelViewProjMatrix(matrices_t *matrices)
+{
+    /* Generate lookAt matrix for camera */
+    generateLookAtMatrix(s_model.cameraPosition,
+        (vec3_t) {
+        s_model.cameraPosition.x + s_model.cameraFront.x,
+            s_model.cameraPosition.y + s_model.cameraFront.y,
+            s_model.cameraPosition.z + s_model.cameraFront.z
+    },
+        s_model.cameraUp,
+            matrices->viewMatrix);
+
+    /* Generate the rotation matrix */
+    generateRotationMatrix(s_model.modelRotationUp, s_model.cameraUp, matrices->rotationMatrixUp);
+    generateRotationMatrix(s_model.modelRotationRight, s_model.cameraRight, matrices->rotationMatrixRight);
+}
+
+
+static void updateCullFrustum(VulkanObject *vulkanObj, matrices_t *matrices)
+{
+    float viewProj[16];
+    float camera[4] = { s_model.cameraPosition.x, s_model.cameraPosition.y, s_model.cameraPosition.z, 1.0f };
+
+    /* Same order as the vertex shader, the planes end up in model space */
+    matrix4x4By4x4(matrices->persepctiveProjMatrix, matrices->viewMatrix, viewProj);
+    matrix4x4By4x4(viewProj, matrices->rotationMatrixRight, viewProj);
+    matrix4x4By4x4(viewProj, matrices->rotationMatrixUp, viewProj);
+
+    extractFrustumPlanes(viewProj, &vulkanObj->frustum);
+
+    /* Undo the model rotations on the camera, by the transposed rotation matrices */
+    matrix4x4By4x1(matrices->rotationMatrixRight, camera, camera);
+    matrix4x4By4x1(matrices->rotationMatrixUp, camera, camera);
+    vulkanObj->cameraPosition = (vec3_t){ camera[0], camera[1], camera[2] };
+
+    /* Pixels covered by one unit at distance one, per allowed pixel of error */
+    vulkanObj->lodScale = (vulkanObj->windowSize.height * 0.5f) / tanf(DEFAULT_FOV * 0.5f * PI / 180.0f) / LOD_PIXEL_ERROR;
+}
+
+
+/* Caches sit next to the OBJ file, NULL when the mesh has no file name or the name cannot be allocated */
+static char *makeCacheFileName(scene_mesh_t *mesh, const char *extension)
+{
+    uint64_t cacheFileNameSize;
+    char *cacheFileName;
+
+    if (NULL == mesh->fileName)
+    {
+        return NULL;
+    }
+
+    cacheFileNameSize = strlen(mesh->fileName) + strlen(extension) + 1;
+    cacheFileName = (char*)memAlloc(MEMORY_LOADER, cacheFileNameSize);
+    if (NULL != cacheFileName)
+    {
+        strcpy_s(cacheFileName, cacheFileNameSize, mesh->fileName);
+        strcat_s(cacheFileName, cacheFileNameSize, extension);
+    }
+    return cacheFileName;
+}
+
+
+static void buildModelMeshlets(scene_mesh_t *mesh)
+{
+    uint32_t sourceHash = hashFaces(&mesh->model);
+    char *cacheFileName = makeCacheFileName(mesh, MESHLET_CACHE_EXTENSION);
+
+    /* Without a cache file name the meshlets are built every time */
+    if (NULL == cacheFileName)
+    {
+        buildMeshlets(&mesh->model, &mesh->meshlets);
+        return;
+    }
+
+    if (VK_FALSE == loadMeshletCache(cacheFileName, &mesh->model, &mesh->meshlets, sourceHash))
+    {
+        buildMeshlets(&mesh->model, &mesh->meshlets);
+        saveMeshletCache(cacheFileName, &mesh->model, &mesh->meshlets, sourceHash);
+    }
+
+    memFree(cacheFileName);
+}
+
+
+static void buildModelLods(scene_mesh_t *mesh)
+{
+    uint32_t sourceHash = hashFaces(&mesh->model);
+    char *cacheFileName = makeCacheFileName(mesh, LOD_CACHE_EXTENSION);
+
+    /* Without a cache file name the LODs are built every time */
+    if (NULL == cacheFileName)
+    {
+        buildLods(&mesh->model, &mesh->lods);
+        return;
+    }
+
+    if (VK_FALSE == loadLodCache(cacheFileName, &mesh->model, &mesh->lods, sourceHash))
+    {
+        buildLods(&mesh->model, &mesh->lods);
+        saveLodCache(cacheFileName, &mesh->model, &mesh->lods, sourceHash);
+    }
+
+    memFree(cacheFileName);
+}
+
+
+static void updateProjectionMatrix(VulkanObject vulkanObj, matrices_t *matrices)
+{
+    /* Set Aspect ratio */
+    float aspect = (float)vulkanObj.windowSize.width / (float)vulkanObj.windowSize.height;
+
+    /* Generate perspective/projection matrix */
+    generatePerspectiveProjectionMatrix(DEFAULT_FOV, aspect, SCENE_NEAR, s_sceneFar, matrices->persepctiveProjMatrix);
+}
+
+
+static void initModelView(VulkanObject vulkanObj, matrices_t *matrices)
+{
+    /* Generate perspective/projection matrix */
+    updateProjectionMatrix(vulkanObj, matrices);
+
+    /* Set inital camera and model settings */
+    s_model.cameraDirection = normalize(subProd(s_model.cameraPosition, s_model.cameraTarget));
+    s_model.cameraRight = normalize(crossProd(s_model.cameraUp, s_model.cameraDirection));
+    s_model.cameraUp = crossProd(s_model.cameraDirection, s_model.cameraRight);
+}
+
+static void fitCameraToBounds(VulkanObject vulkanObj, matrices_t *matrices, boundingSphere_t *bounds)
+{
+    /* Back the camera off until the whole sphere fits the field of view */
+    float distance = bounds->radius / sinf(DEFAULT_FOV * 0.5f * PI / 180.0f);
+
+    if (distance > DEFAULT_CAM_DIST)
+    {
+        s_model.cameraPosition = (vec3_t){ bounds->center.x, bounds->center.y, bounds->center.z + distance };
+        s_sceneFar = (distance + bounds->radius > SCENE_FAR) ? (distance + bounds->radius) : SCENE_FAR;
+        updateProjectionMatrix(vulkanObj, matrices);
+    }
+}
+
+static void initSceneDefaults(model_t *model)
+{
+    model->sp.ambientLight.x = 0.3f;
+    model->sp.ambientLight.y = 0.3f;
+    model->sp.ambientLight.z = 0.3f;
+
+    model->sp.lightSourceIntensity.x = 0.8f;
+    model->sp.lightSourceIntensity.y = 0.8f;
+    model->sp.lightSourceIntensity.z = 0.8f;
+}
+
+static void updateUniformBuffer(VulkanObject vulkanObj, matrices_t *matrices)
+{
+    /* Update matrix data */
+    memcpy(vulkanObj.uniformBuffer.ptr, (float*)matrices, sizeof(matrices_t));
+}
+
+static void updateVertexBuffer(VulkanObject vulkanObj)
+{
+    uint32_t i;
+    vertexData_t *vertices = (vertexData_t *)s_scene.vertices;
+    vertexPosition_t *positions = (vertexPosition_t *)vulkanObj.vertexBuffer.ptr;
+    vertexAttributes_t *attributes = (vertexAttributes_t *)((uint8_t *)vulkanObj.vertexBuffer.ptr + vulkanObj.vertexAttributeOffset);
+
+    if (!vulkanObj.splitVertexStreams)
+    {
+        /* Update vertex data */
+        memcpy(vulkanObj.vertexBuffer.ptr, s_scene.vertices, sizeof(vertexData_t) * s_scene.vertexCount);
+        return;
+    }
+
+    /* Positions go to their own stream, the rest follows them */
+    for (i = 0; i < s_scene.vertexCount; i++)
+    {
+        positions[i] = (vertexPosition_t){ vertices[i].vx, vertices[i].vy, vertices[i].vz };
+        attributes[i] = (vertexAttributes_t){ vertices[i].nx, vertices[i].ny, vertices[i].nz, vertices[i].nw, vertices[i].s, vertices[i].t };
+    }
+}
+
+static VkBool32 parseOptions(int argc, char *argv[], viewerOptions_t *options)
+{
+    int i;
+
+    options->objFileNames = (char **)memAlloc(MEMORY_LOADER, sizeof(char *) * argc);
+    if (NULL == options->objFileNames)
+    {
+        return VK_FALSE;
+    }
+    options->instanceCount = 1;
+    options->textureBudgetMb = DEFAULT_TEXTURE_BUDGET_MB;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--headless"))
+        {
+            options->headless = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--merge-materials"))
+        {
+            options->mergeMaterials = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--no-cull"))
+        {
+            options->noCulling = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--meshlets"))
+        {
+            options->meshlets = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--lod"))
+        {
+            options->lod = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--resize-bench") && (i + 1) < argc)
+        {
+            options->resizeBenchIterations = (uint32_t)atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--static-cmds"))
+        {
+            options->staticCommands = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--split-streams"))
+        {
+            options->splitVertexStreams = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--fetch-bench") && (i + 1) < argc)
+        {
+            options->fetchBenchFrames = (uint32_t)atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--depth-prepass"))
+        {
+            options->depthPrePass = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--stats"))
+        {
+            options->pipelineStatistics = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--sync-load"))
+        {
+            options->syncLoad = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--watch"))
+        {
+            options->watch = VK_TRUE;
+        }
+        else if (0 == strcmp(argv[i], "--texture-budget") && (i + 1) < argc)
+        {
+            options->textureBudgetMb = (uint32_t)atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--record-threads") && (i + 1) < argc)
+        {
+            options->recordThreads = (uint32_t)atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--record-bench") && (i + 1) < argc)
+        {
+            options->recordBenchFrames = (uint32_t)atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--instances") && (i + 1) < argc)
+        {
+            options->instanceCount = (uint32_t)atoi(argv[++i]);
+            options->instanceCount = (options->instanceCount > 0) ? options->instanceCount : 1;
+        }
+        else
+        {
+            options->objFileNames[options->objFileCount++] = argv[i];
+        }
+    }
+
+    /* Meshlets are drawn once per mesh at full detail, the options that cannot apply are dropped here rather than per mesh */
+    if (options->meshlets && options->instanceCount > 1)
+    {
+        printf("--meshlets is ignored with --instances %d\n", options->instanceCount);
+        options->meshlets = VK_FALSE;
+    }
+    if (options->lod && options->meshlets)
+    {
+        printf("--lod is ignored with --meshlets\n");
+        options->lod = VK_FALSE;
+    }
+
+    return VK_TRUE;
+}
+
+
+static void streamChunk(void *arg, model_t *model, uint32_t firstFace, uint32_t faceCount, float *vertices)
+{
+    geometryStream_t *stream = (geometryStream_t *)arg;
+    vertexData_t *vertex = (vertexData_t *)vertices;
+    size_t size = SCENE_VERTEX_SIZE * faceCount * ELEMENTS_PER_FACE;
+    uint32_t start, end;
+    uint32_t i;
+    VkBool32 closed;
+
+    lockMutex(&stream->lock);
+
+    /* A new model follows everything streamed before it, like it does in the scene */
+    if (0 == firstFace)
+    {
+        stream->baseFace = stream->faceCount;
+        stream->rangeCursor = 0;
+        stream->rangeOpen = VK_FALSE;
+    }
+
+    /* Queue the vertices behind the ones not taken yet */
+    if (stream->pendingSize + size > stream->pendingCapacity)
+    {
+        stream->pendingCapacity = (stream->pendingCapacity * 2 > stream->pendingSize + size) ? (stream->pendingCapacity * 2) : (stream->pendingSize + size);
+        stream->pending = (uint8_t *)memRealloc(MEMORY_RENDERER, stream->pending, stream->pendingCapacity);
+    }
+    memcpy(stream->pending + stream->pendingSize, vertices, size);
+    stream->pendingSize += size;
+
+    for (i = 0; i < faceCount * ELEMENTS_PER_FACE; i++)
+    {
+        stream->minimum = (vec3_t){ fminf(stream->minimum.x, vertex[i].vx), fminf(stream->minimum.y, vertex[i].vy), fminf(stream->minimum.z, vertex[i].vz) };
+        stream->maximum = (vec3_t){ fmaxf(stream->maximum.x, vertex[i].vx), fmaxf(stream->maximum.y, vertex[i].vy), fmaxf(stream->maximum.z, vertex[i].vz) };
+    }
+
+    /* Extend the open material range and add the ones started in this chunk, faces before the first usemtl are not drawn */
+    while (stream->rangeCursor < model->materialChangeCount)
+    {
+        start = model->materialChange[stream->rangeCursor].startFace;
+        closed = (stream->rangeCursor + 1 < model->materialChangeCount) ? VK_TRUE : VK_FALSE;
+        end = closed ? model->materialChange[stream->rangeCursor + 1].startFace : (firstFace + faceCount);
+
+        if (end > start)
+        {
+            if (!stream->rangeOpen)
+            {
+                if (stream->rangeCount == stream->rangeCapacity)
+                {
+                    stream->rangeCapacity = (stream->rangeCapacity == 0) ? MIN_TABLE_CAPACITY : (stream->rangeCapacity * 2);
+                    stream->ranges = (VkDrawIndirectCommand *)memRealloc(MEMORY_RENDERER, stream->ranges, sizeof(VkDrawIndirectCommand) * stream->rangeCapacity);
+                }
+                stream->ranges[stream->rangeCount++] = (VkDrawIndirectCommand){ 0, 1, (stream->baseFace + start) * ELEMENTS_PER_FACE, 0 };
+                stream->rangeOpen = VK_TRUE;
+            }
+            stream->ranges[stream->rangeCount - 1].vertexCount = (end - start) * ELEMENTS_PER_FACE;
+        }
+
+        /* The last range can still grow with the next chunk */
+        if (!closed)
+        {
+            break;
+        }
+        stream->rangeCursor++;
+        stream->rangeOpen = VK_FALSE;
+    }
+
+    stream->faceCount += faceCount;
+    unlockMutex(&stream->lock);
+}
+
+
+static void streamGeometry(VulkanObject *vulkanObj, matrices_t *matrices, VkCommandBuffer cmdBuf)
+{
+    buffer_t *staging = &s_stream.staging[vulkanObj->frameIndex];
+    VkDeviceSize uploaded;
+    VkDrawIndirectCommand *range;
+    boundingSphere_t bounds;
+    size_t size;
+    uint32_t i;
+
+    if (!s_stream.enabled || vulkanObj->sceneReady)
+    {
+        return;
+    }
+
+    lockMutex(&s_stream.lock);
+
+    /* Take at most a frame's worth of what has been parsed, the slot's fence has been waited on so its staging buffer is free */
+    size = s_stream.pendingSize - s_stream.pendingStart;
+    size = (size < MAX_STREAM_BYTES) ? size : MAX_STREAM_BYTES;
+    if (size > 0)
+    {
+        if (VK_NULL_HANDLE == staging->buffer)
+        {
+            *staging = createBuffer(vulkanObj,
+                MAX_STREAM_BYTES,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                VK_SHARING_MODE_EXCLUSIVE);
+        }
+        memcpy(staging->ptr, s_stream.pending + s_stream.pendingStart, size);
+        s_stream.pendingStart += size;
+        if (s_stream.pendingStart == s_stream.pendingSize)
+        {
+            s_stream.pendingStart = 0;
+            s_stream.pendingSize = 0;
+        }
+    }
+
+    /* The ranges grow with the faces, clipped to the vertices in the arena once this frame's copy is done */
+    uploaded = (vulkanObj->vertexArena.size + size) / SCENE_VERTEX_SIZE;
+    if (s_stream.rangeCount > vulkanObj->streamDrawCapacity)
+    {
+        vulkanObj->streamDrawCapacity = s_stream.rangeCapacity;
+        vulkanObj->streamDrawCmds = (VkDrawIndirectCommand *)memRealloc(MEMORY_RENDERER, vulkanObj->streamDrawCmds, sizeof(VkDrawIndirectCommand) * vulkanObj->streamDrawCapacity);
+    }
+    for (i = 0, vulkanObj->streamDrawCount = 0; i < s_stream.rangeCount && s_stream.ranges[i].firstVertex < uploaded; i++)
+    {
+        range = &vulkanObj->streamDrawCmds[vulkanObj->streamDrawCount++];
+        *range = s_stream.ranges[i];
+        range->vertexCount = (range->firstVertex + range->vertexCount > uploaded) ? (uint32_t)(uploaded - range->firstVertex) : range->vertexCount;
+    }
+
+    /* Sphere around the box of everything parsed so far */
+    bounds.center = scalarProd(addProd(s_stream.minimum, s_stream.maximum), 0.5f);
+    bounds.radius = (s_stream.faceCount > 0) ? sqrtf(dotProd(subProd(s_stream.maximum, bounds.center), subProd(s_stream.maximum, bounds.center))) : 0.0f;
+
+    unlockMutex(&s_stream.lock);
+
+    if (size > 0)
+    {
+        appendVertexArena(vulkanObj, cmdBuf, staging, size);
+    }
+
+    if (vulkanObj->streamDrawCount > 0 && 0 == s_stream.firstDrawMs)
+    {
+        s_stream.firstDrawMs = getTimeMs() - s_load.startMs;
+    }
+
+    /* Back the camera off each time the streamed geometry has doubled in size */
+    if (bounds.radius > s_stream.fittedRadius * 2.0f)
+    {
+        fitCameraToBounds(*vulkanObj, matrices, &bounds);
+        s_stream.fittedRadius = bounds.radius;
+    }
+}
+
+
+static VkBool32 endStream(VulkanObject *vulkanObj, viewerOptions_t *options)
+{
+    VkBool32 keep;
+    uint32_t i;
+
+    /* The arena holds the scene's vertices when every chunk has been copied and nothing reordered or added faces */
+    keep = (0 == s_stream.pendingSize && !options->mergeMaterials && !options->meshlets && !options->lod &&
+        vulkanObj->vertexArena.size == SCENE_VERTEX_SIZE * (VkDeviceSize)s_scene.vertexCount) ? VK_TRUE : VK_FALSE;
+
+    printf("Streamed %d faces in %d copies, first drawn at %.1f ms, the arena grew %d times and is %s\n",
+        s_stream.faceCount, vulkanObj->vertexArena.copyCount, s_stream.firstDrawMs, vulkanObj->vertexArena.growCount,
+        keep ? "kept as the vertex buffer" : "replaced by the scene's");
+
+    /* Waits for the frames in flight */
+    keep = endGeometryStream(vulkanObj, keep);
+    for (i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        destroyBuffer(vulkanObj, &s_stream.staging[i]);
+    }
+
+    /* The loader has finished with the stream */
+    memFree(s_stream.pending);
+    memFree(s_stream.ranges);
+    s_stream.pending = NULL;
+    s_stream.ranges = NULL;
+    s_stream.enabled = VK_FALSE;
+
+    return keep;
+}
+
+
+static void prepareSceneMesh(scene_mesh_t *mesh, viewerOptions_t *options)
+{
+    /* Regroup the faces so each material is drawn once */
+    if (options->mergeMaterials)
+    {
+        mergeMaterialRanges(&mesh->model);
+    }
+
+    /* Split the material ranges into meshlets, reusing the cached build when the faces match */
+    if (options->meshlets)
+    {
+        buildModelMeshlets(mesh);
+    }
+
+    /* Simplify each material range, parseOptions has already turned this off with --meshlets */
+    if (options->lod)
+    {
+        buildModelLods(mesh);
+    }
+}
+
+
+static load_event_t loadSceneJob(void *arg, uint32_t index)
+{
+    viewerOptions_t *options = (viewerOptions_t *)arg;
+    uint32_t i;
+
+    /* Load the model files, each one is drawn once per instance */
+    for (i = 0; i < options->objFileCount; i++)
+    {
+        if (VK_FALSE == addSceneModel(&s_scene, options->objFileNames[i], options->instanceCount))
+        {
+            printf("Error Loading OBJ file %s\n", options->objFileNames[i]);
+        }
+    }
+
+    for (i = 0; i < s_scene.meshCount; i++)
+    {
+        prepareSceneMesh(&s_scene.meshes[i], options);
+    }
+
+    /* Pack every mesh into the shared vertex, material and instance tables */
+    buildScene(&s_scene);
+
+    return (load_event_t){ LOAD_EVENT_SCENE, index, (s_scene.meshCount > 0) ? VK_TRUE : VK_FALSE, 0.0 };
+}
+
+
+static load_event_t reloadModelJob(void *arg, uint32_t index)
+{
+    viewerOptions_t *options = (viewerOptions_t *)arg;
+
+    /* Only this mesh is parsed and prepared again, the others are shared with the scene being drawn */
+    if (VK_FALSE == reloadSceneModel(&s_reload.scene, &s_scene, index))
+    {
+        return (load_event_t){ LOAD_EVENT_RELOAD, index, VK_FALSE, 0.0 };
+    }
+    prepareSceneMesh(&s_reload.scene.meshes[index], options);
+
+    buildScene(&s_reload.scene);
+
+    return (load_event_t){ LOAD_EVENT_RELOAD, index, VK_TRUE, 0.0 };
+}
+
+
+static load_event_t decodeTextureJob(void *arg, uint32_t index)
+{
+    decodedTexture_t *texture = &((decodedTexture_t *)arg)[index];
+    char *fileName = s_scene.materials[index].fileName;
+    unsigned char *pixels;
+
+    /* Only the scene's own file name is read, the render thread writes other fields of the material */
+    pixels = loadBmpFile(fileName, &texture->size);
+    if (NULL == pixels)
+    {
+        return (load_event_t){ LOAD_EVENT_TEXTURE, index, VK_FALSE, 0.0 };
+    }
+
+    /* The whole chain stays on the host, the GPU gets the levels the frames ask for */
+    buildMipChain(&texture->size, pixels, &texture->chain);
+    memFree(pixels);
+
+    return (load_event_t){ LOAD_EVENT_TEXTURE, index, VK_TRUE, 0.0 };
+}
+
+
+static texture_t uploadTexture(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkExtent2D *size, unsigned char *pixels, buffer_t *staging)
+{
+    VkDeviceSize byteCount = (VkDeviceSize)size->width * size->height * (BMP_PIX_PER_COLOR + 1);
+
+    /* The staging buffer must live until the copy recorded here has executed */
+    *staging = createBuffer(vulkanObj,
+        (uint32_t)byteCount,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+    memcpy(staging->ptr, pixels, (size_t)byteCount);
+
+    return createTextureImage(vulkanObj, cmdBuf, size, 1, 1, staging);
+}
+
+
+static void createSceneVertexBuffer(VulkanObject *vulkanObj)
+{
+    VkDeviceSize vertexBufferSize;
+
+    /* Sized for either layout so the benchmark can switch between them */
+    vulkanObj->vertexAttributeOffset = VERTEX_ATTRIBUTE_OFFSET(s_scene.vertexCount);
+    vertexBufferSize = vulkanObj->vertexAttributeOffset + sizeof(vertexAttributes_t) * (VkDeviceSize)s_scene.vertexCount;
+    vertexBufferSize = (vertexBufferSize > sizeof(vertexData_t) * (VkDeviceSize)s_scene.vertexCount) ? vertexBufferSize : sizeof(vertexData_t) * (VkDeviceSize)s_scene.vertexCount;
+
+    /* Create the vertex buffer */
+    vulkanObj->vertexBuffer = createBuffer(vulkanObj,
+        (uint32_t)vertexBufferSize,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    /* Update vertex buffer */
+    updateVertexBuffer(*vulkanObj);
+}
+
+
+static void createSceneTables(VulkanObject *vulkanObj)
+{
+    /* Build the draw commands for the material ranges */
+    createDrawCommands(vulkanObj, &s_scene);
+
+    /* Create the per instance transform buffer */
+    createInstanceBuffer(vulkanObj, s_scene.instances, s_scene.instanceCount);
+
+    /* Create the material buffer, every material shows the placeholder until its texture is in */
+    createMaterialBuffer(vulkanObj, s_scene.materials, s_scene.materialCount);
+
+    /* Written on the next frame's descriptor flush */
+    createMaterialBufferDescriptorSet(vulkanObj);
+    createInstanceBufferDescriptorSet(vulkanObj);
+    createCullDescriptorSet(vulkanObj);
+}
+
+
+static void uploadScene(VulkanObject *vulkanObj, matrices_t *matrices)
+{
+    uint32_t i;
+
+    fitCameraToBounds(*vulkanObj, matrices, &s_scene.bounds);
+
+    /* The streamed vertices are already on the GPU when they match the scene */
+    if (!s_stream.enabled || !endStream(vulkanObj, s_load.options))
+    {
+        createSceneVertexBuffer(vulkanObj);
+    }
+
+    createSceneTables(vulkanObj);
+
+    /* The parsed arrays and the host copy of the vertices are only read again to rebuild the scene or switch the fetch benchmark's layouts */
+    if (!s_reload.watching && 0 == s_load.options->fetchBenchFrames)
+    {
+        releaseSceneSources(&s_scene);
+    }
+
+    vulkanObj->sceneReady = VK_TRUE;
+
+    /* Decode the textures in the background, whether they fit in the free slots is known once they are packed */
+    s_load.textures = (decodedTexture_t *)memCalloc(MEMORY_TEXTURE, s_scene.materialCount + 1, sizeof(decodedTexture_t));
+    s_load.ready = (textureUpload_t *)memAlloc(MEMORY_TEXTURE, sizeof(textureUpload_t) * (s_scene.materialCount + 1));
+    s_load.packable = (uint32_t *)memAlloc(MEMORY_TEXTURE, sizeof(uint32_t) * (s_scene.materialCount + 1));
+    for (i = 0; i < s_scene.materialCount; i++)
+    {
+        if (s_scene.materials[i].fileName != NULL)
+        {
+            if (VK_FALSE == submitLoadJob(&s_load.loader, decodeTextureJob, s_load.textures, i))
+            {
+                printf("Cannot queue the decode of %s\n", s_scene.materials[i].fileName);
+                continue;
+            }
+            s_load.texturesPending++;
+        }
+    }
+}
+
+
+static void queueTextureUpload(uint32_t *materials, uint32_t layerCount)
+{
+    textureUpload_t *upload = &s_load.ready[s_load.readyCount++];
+
+    upload->materials = (uint32_t *)memAlloc(MEMORY_TEXTURE, sizeof(uint32_t) * layerCount);
+    memcpy(upload->materials, materials, sizeof(uint32_t) * layerCount);
+    upload->layerCount = layerCount;
+}
+
+
+static int compareTextureSize(const void *a, const void *b)
+{
+    uint32_t ma = *(const uint32_t *)a;
+    uint32_t mb = *(const uint32_t *)b;
+    VkExtent2D *sa = &s_load.textures[ma].size;
+    VkExtent2D *sb = &s_load.textures[mb].size;
+
+    /* By size, then in material order */
+    if (sa->width != sb->width)
+    {
+        return (sa->width < sb->width) ? -1 : 1;
+    }
+    if (sa->height != sb->height)
+    {
+        return (sa->height < sb->height) ? -1 : 1;
+    }
+    return (ma < mb) ? -1 : ((ma > mb) ? 1 : 0);
+}
+
+
+static void packTextures(void)
+{
+    uint32_t first, count;
+    uint32_t *packable = s_load.packable;
+
+    qsort(packable, s_load.packableCount, sizeof(uint32_t), compareTextureSize);
+
+    /* Runs of one size become the layers of an array, a size seen once is uploaded alone and streamed */
+    for (first = 0; first < s_load.packableCount; first += count)
+    {
+        count = 1;
+        while (first + count < s_load.packableCount && count < TEXTURE_ARRAY_MAX_LAYERS &&
+            s_load.textures[packable[first + count]].size.width == s_load.textures[packable[first]].size.width &&
+            s_load.textures[packable[first + count]].size.height == s_load.textures[packable[first]].size.height)
+        {
+            count++;
+        }
+
+        queueTextureUpload(&packable[first], count);
+        if (count > 1)
+        {
+            s_load.packedCount += count;
+            s_load.arrayCount++;
+        }
+    }
+    s_load.packableCount = 0;
+}
+
+
+static void beginTextureUploads(VulkanObject *vulkanObj)
+{
+    uint32_t i, k;
+    uint32_t slotsLeft = vulkanObj->textureCapacity - vulkanObj->numOfTextures;
+    textureUpload_t *upload;
+    mip_chain_t *chains[TEXTURE_ARRAY_MAX_LAYERS];
+
+    VkCommandBufferBeginInfo cbbi =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+
+    VkSubmitInfo si =
+    {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &s_load.uploadCmdBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+
+    /* Packed textures share a slot, so the limit is only known here, what does not fit keeps the placeholder */
+    if (0 == slotsLeft)
+    {
+        for (i = 0; i < s_load.readyCount; i++)
+        {
+            upload = &s_load.ready[i];
+            for (k = 0; k < upload->layerCount; k++)
+            {
+                printf("Texture limit of %d reached, %s will not be textured\n", vulkanObj->textureCapacity, s_scene.materials[upload->materials[k]].name);
+                freeMipChain(&s_load.textures[upload->materials[k]].chain);
+            }
+            s_load.texturesPending -= upload->layerCount;
+            memFree(upload->materials);
+        }
+        s_load.readyCount = 0;
+        return;
+    }
+
+    s_load.uploadCount = (s_load.readyCount < MAX_TEXTURE_UPLOADS) ? s_load.readyCount : MAX_TEXTURE_UPLOADS;
+    s_load.uploadCount = (s_load.uploadCount < slotsLeft) ? s_load.uploadCount : slotsLeft;
+
+    /* Record the copies of the oldest decoded textures, the frames keep going while they execute */
+    vkBeginCommandBuffer(s_load.uploadCmdBuffer, &cbbi);
+    for (i = 0; i < s_load.uploadCount; i++)
+    {
+        upload = &s_load.ready[i];
+        s_load.uploads[i] = *upload;
+
+        if (1 == upload->layerCount)
+        {
+            /* Only the coarse tail goes up now, the finer levels are streamed in when they are seen */
+            vulkanObj->textures[vulkanObj->numOfTextures + i] = uploadMipLevels(vulkanObj, s_load.uploadCmdBuffer,
+                &s_load.textures[upload->materials[0]].chain, mipTailLevel(&s_load.textures[upload->materials[0]].chain), &s_load.staging[i]);
+        }
+        else
+        {
+            /* Packed textures go up whole, one image and one allocation for all of them */
+            for (k = 0; k < upload->layerCount; k++)
+            {
+                chains[k] = &s_load.textures[upload->materials[k]].chain;
+            }
+            vulkanObj->textures[vulkanObj->numOfTextures + i] = uploadTextureArray(vulkanObj, s_load.uploadCmdBuffer, chains, upload->layerCount, &s_load.staging[i]);
+        }
+    }
+    vkEndCommandBuffer(s_load.uploadCmdBuffer);
+
+    memmove(s_load.ready, &s_load.ready[s_load.uploadCount], sizeof(textureUpload_t) * (s_load.readyCount - s_load.uploadCount));
+    s_load.readyCount -= s_load.uploadCount;
+
+    vkResetFences(vulkanObj->device, 1, &s_load.uploadFence);
+    vkQueueSubmit(vulkanObj->queue, 1, &si, s_load.uploadFence);
+    s_load.uploadPending = VK_TRUE;
+}
+
+
+static void finishTextureUploads(VulkanObject *vulkanObj, VkFence frameFence)
+{
+    uint32_t i, k, m;
+    uint32_t slot;
+    uint32_t first = s_load.uploads[0].materials[0];
+    uint32_t last = s_load.uploads[0].materials[0];
+    textureUpload_t *upload;
+    mip_chain_t *chain;
+
+    for (i = 0; i < s_load.uploadCount; i++)
+    {
+        destroyBuffer(vulkanObj, &s_load.staging[i]);
+    }
+
+    /* Write the new slots on the next descriptor flush */
+    vulkanObj->numOfTextures += s_load.uploadCount;
+    createImageDescriptorSet(vulkanObj, vulkanObj->textures);
+
+    /* The other frame slot may still read the materials, let it finish before they point at the new slots */
+    vkWaitForFences(vulkanObj->device, 1, &frameFence, VK_TRUE, MAX_TIMEOUT);
+    for (i = 0; i < s_load.uploadCount; i++)
+    {
+        upload = &s_load.uploads[i];
+        slot = vulkanObj->numOfTextures - s_load.uploadCount + i;
+        for (k = 0; k < upload->layerCount; k++)
+        {
+            m = upload->materials[k];
+            chain = &s_load.textures[m].chain;
+            s_scene.materials[m].mp.imageIndex = slot;
+            s_scene.materials[m].mp.imageLayer = k;
+            first = (m < first) ? m : first;
+            last = (m > last) ? m : last;
+
+            /* A texture alone streams its finer levels, packed ones are in whole */
+            if (1 == upload->layerCount)
+            {
+                addResidentTexture(&s_residency, m, chain, slot);
+            }
+            else
+            {
+                pinResidentBytes(&s_residency, chain->offsets[chain->levelCount]);
+                freeMipChain(chain);
+            }
+        }
+
+        s_load.texturesPending -= upload->layerCount;
+        s_load.textureCount += upload->layerCount;
+        memFree(upload->materials);
+    }
+    updateMaterialBuffer(vulkanObj, s_scene.materials, first, last - first + 1);
+
+    s_load.uploadCount = 0;
+    s_load.uploadPending = VK_FALSE;
+}
+
+
+static void serviceLoads(VulkanObject *vulkanObj, matrices_t *matrices, VkFence frameFence, VkBool32 block)
+{
+    load_event_t events[MAX_LOAD_EVENTS];
+    uint32_t count;
+    uint32_t i;
+    VkExtent2D *size;
+
+    if (s_load.done)
+    {
+        return;
+    }
+
+    /* Blocking waits for the next event, unless an upload can be started or finished instead */
+    count = (block && 0 == s_load.readyCount && !s_load.uploadPending) ?
+        waitLoadEvents(&s_load.loader, events, MAX_LOAD_EVENTS) :
+        pollLoadEvents(&s_load.loader, events, MAX_LOAD_EVENTS);
+
+    for (i = 0; i < count; i++)
+    {
+        if (LOAD_EVENT_SCENE == events[i].type)
+        {
+            s_load.sceneLoaded = VK_TRUE;
+            s_load.parseMs = events[i].timeMs;
+            if (events[i].success)
+            {
+                uploadScene(vulkanObj, matrices);
+            }
+            s_load.sceneMs = getTimeMs() - s_load.startMs;
+        }
+        else if (events[i].success)
+        {
+            size = &s_load.textures[events[i].index].size;
+            if (size->width <= TEXTURE_ARRAY_MAX_SIZE && size->height <= TEXTURE_ARRAY_MAX_SIZE)
+            {
+                /* Waits for the others of its size */
+                s_load.packable[s_load.packableCount++] = events[i].index;
+            }
+            else
+            {
+                queueTextureUpload(&events[i].index, 1);
+            }
+            s_load.decodeMs += events[i].timeMs;
+        }
+        else
+        {
+            printf("Failed to decode %s\n", s_scene.materials[events[i].index].fileName);
+            s_load.texturesPending--;
+        }
+    }
+
+    /* Every texture is decoded, the small ones held back can be packed */
+    if (s_load.packableCount > 0 && 0 == pendingLoadJobs(&s_load.loader))
+    {
+        packTextures();
+    }
+
+    /* Swap the uploaded textures in once their copies have executed */
+    if (s_load.uploadPending &&
+        VK_SUCCESS == (block ? vkWaitForFences(vulkanObj->device, 1, &s_load.uploadFence, VK_TRUE, MAX_TIMEOUT) : vkGetFenceStatus(vulkanObj->device, s_load.uploadFence)))
+    {
+        finishTextureUploads(vulkanObj, frameFence);
+    }
+
+    if (!s_load.uploadPending && s_load.readyCount > 0)
+    {
+        beginTextureUploads(vulkanObj);
+    }
+
+    if (s_load.sceneLoaded && 0 == s_load.texturesPending)
+    {
+        s_load.done = VK_TRUE;
+        s_load.doneMs = getTimeMs() - s_load.startMs;
+    }
+}
+
+
+static void watchSceneFiles(void)
+{
+    uint32_t i;
+
+    /* The watcher keys on mesh and material indices, a reloaded scene registers everything again */
+    for (i = 0; i < s_scene.meshCount; i++)
+    {
+        if (0 != watchFile(&s_reload.watcher, s_scene.meshes[i].fileName, WATCH_OBJ, i) ||
+            0 != watchFile(&s_reload.watcher, s_scene.meshes[i].mtlFileName, WATCH_MTL, i))
+        {
+            printf("Cannot watch %s\n", s_scene.meshes[i].fileName);
+        }
+    }
+
+    for (i = 0; i < s_scene.materialCount; i++)
+    {
+        if (s_scene.materials[i].fileName != NULL && 0 != watchFile(&s_reload.watcher, s_scene.materials[i].fileName, WATCH_TEXTURE, i))
+        {
+            printf("Cannot watch %s\n", s_scene.materials[i].fileName);
+        }
+    }
+
+    for (i = 0; i < sizeof(s_shaderFiles) / sizeof(s_shaderFiles[0]); i++)
+    {
+        if (0 != watchFile(&s_reload.watcher, s_shaderFiles[i], WATCH_SHADER, i))
+        {
+            printf("Cannot watch %s\n", s_shaderFiles[i]);
+        }
+    }
+
+    printf("Watching %d files in %d directories\n", s_reload.watcher.fileCount, s_reload.watcher.directoryCount);
+}
+
+
+static void decodeReloadedTexture(uint32_t material)
+{
+    /* Watched from now on, a new map replaces the material's previous one */
+    if (0 != watchFile(&s_reload.watcher, s_scene.materials[material].fileName, WATCH_TEXTURE, material))
+    {
+        printf("Cannot watch %s\n", s_scene.materials[material].fileName);
+    }
+
+    if (VK_FALSE == submitLoadJob(&s_load.loader, decodeTextureJob, s_load.textures, material))
+    {
+        printf("Cannot queue the decode of %s\n", s_scene.materials[material].fileName);
+        return;
+    }
+    s_reload.texturesPending++;
+}
+
+
+static void reloadTexture(uint32_t material)
+{
+    /* A streamed texture keeps its slot, the new levels replace the old ones between streaming batches */
+    if (0 != s_scene.materials[material].mp.imageIndex &&
+        VK_TRUE == reloadResidentTexture(&s_residency, material, &s_load.textures[material].chain))
+    {
+        return;
+    }
+
+    /* Packed and placeholder textures are uploaded to a new slot like the first load does, an array layer left behind stays unused */
+    queueTextureUpload(&material, 1);
+    s_load.texturesPending++;
+}
+
+
+static void reloadMaterials(VulkanObject *vulkanObj, VkFence frameFence, uint32_t meshIndex)
+{
+    uint32_t i;
+    uint32_t retexturedCount;
+    uint32_t *retextured = (uint32_t *)memAlloc(MEMORY_TEXTURE, sizeof(uint32_t) * (s_scene.materialCount + 1));
+    scene_mesh_t *mesh = &s_scene.meshes[meshIndex];
+
+    if (VK_FALSE == reloadSceneMaterials(&s_scene, meshIndex, retextured, &retexturedCount))
+    {
+        printf("Error reloading %s, keeping the previous materials\n", mesh->mtlFileName);
+        memFree(retextured);
+        return;
+    }
+
+    /* The other frame slot may still read the materials */
+    vkWaitForFences(vulkanObj->device, 1, &frameFence, VK_TRUE, MAX_TIMEOUT);
+    updateMaterialBuffer(vulkanObj, s_scene.materials, mesh->firstMaterial, mesh->materials.count);
+
+    /* Maps that changed are decoded again, the old texture shows until the new one is in */
+    for (i = 0; i < retexturedCount; i++)
+    {
+        if (s_scene.materials[retextured[i]].fileName != NULL)
+        {
+            decodeReloadedTexture(retextured[i]);
+        }
+    }
+    memFree(retextured);
+}
+
+
+static void reloadShader(VulkanObject *vulkanObj, VkFence frameFence, uint32_t shader)
+{
+    /* The pipelines are destroyed once the new ones are built, no frame may still use them */
+    vkWaitForFences(vulkanObj->device, 1, &frameFence, VK_TRUE, MAX_TIMEOUT);
+
+    printf("Reloading %s\n", s_shaderFiles[shader]);
+    if (SHADER_CULL == shader)
+    {
+        reloadCullPipeline(vulkanObj);
+    }
+    else
+    {
+        /* Every graphics pipeline is rebuilt, the stages that did not change come from the pipeline cache */
+        reloadGraphicsPipelines(vulkanObj);
+    }
+}
+
+
+static void replaceScene(VulkanObject *vulkanObj, VkFence frameFence, uint32_t meshIndex)
+{
+    uint32_t i, m;
+    uint32_t from, to;
+    uint32_t *remap;
+    uint32_t *source;
+    scene_t previous = s_scene;
+    material_t *material;
+    material_t *old;
+
+    /* No frame may still read the buffers being replaced */
+    vkWaitForFences(vulkanObj->device, 1, &frameFence, VK_TRUE, MAX_TIMEOUT);
+    releaseSceneBuffers(vulkanObj);
+
+    s_scene = s_reload.scene;
+    memset(&s_reload.scene, 0, sizeof(scene_t));
+
+    s_load.textures = (decodedTexture_t *)memRealloc(MEMORY_TEXTURE, s_load.textures, sizeof(decodedTexture_t) * (s_scene.materialCount + 1));
+    s_load.ready = (textureUpload_t *)memRealloc(MEMORY_TEXTURE, s_load.ready, sizeof(textureUpload_t) * (s_scene.materialCount + 1));
+    s_load.packable = (uint32_t *)memRealloc(MEMORY_TEXTURE, s_load.packable, sizeof(uint32_t) * (s_scene.materialCount + 1));
+    memset(s_load.textures, 0, sizeof(decodedTexture_t) * (s_scene.materialCount + 1));
+
+    /* The reloaded mesh kept the names it had first, so every old material has a new index and keeps its texture */
+    remap = (uint32_t *)memAlloc(MEMORY_TEXTURE, sizeof(uint32_t) * (previous.materialCount + 1));
+    source = (uint32_t *)memAlloc(MEMORY_TEXTURE, sizeof(uint32_t) * (s_scene.materialCount + 1));
+    memset(source, 0xFF, sizeof(uint32_t) * (s_scene.materialCount + 1));
+    for (m = 0; m < previous.meshCount; m++)
+    {
+        for (i = 0; i < previous.meshes[m].materials.count; i++)
+        {
+            from = previous.meshes[m].firstMaterial + i;
+            to = s_scene.meshes[m].firstMaterial + i;
+            remap[from] = to;
+            source[to] = from;
+
+            old = &previous.materials[from];
+            material = &s_scene.materials[to];
+            material->mp.imageIndex = (material->fileName != NULL) ? old->mp.imageIndex : 0;
+            material->mp.imageLayer = (material->fileName != NULL) ? old->mp.imageLayer : 0;
+        }
+    }
+    remapResidentMaterials(&s_residency, remap, s_scene.materialCount);
+
+    /* Materials that are new or point at another file are decoded, the others show what they had */
+    for (i = 0; i < s_scene.materialCount; i++)
+    {
+        material = &s_scene.materials[i];
+        old = (source[i] < previous.materialCount) ? &previous.materials[source[i]] : NULL;
+        if (material->fileName != NULL && (NULL == old || NULL == old->fileName || 0 != strcmp(material->fileName, old->fileName)))
+        {
+            if (VK_FALSE == submitLoadJob(&s_load.loader, decodeTextureJob, s_load.textures, i))
+            {
+                printf("Cannot queue the decode of %s\n", material->fileName);
+                continue;
+            }
+            s_reload.texturesPending++;
+        }
+    }
+
+    /* Changes still waiting name materials by their old index */
+    for (i = 0; i < s_reload.changeCount; i++)
+    {
+        if (WATCH_TEXTURE == s_reload.changes[i].kind && s_reload.changes[i].index < previous.materialCount)
+        {
+            s_reload.changes[i].index = remap[s_reload.changes[i].index];
+        }
+    }
+    memFree(remap);
+    memFree(source);
+
+    /* Only the replaced mesh is freed, the others moved to the new scene */
+    freeReplacedScene(&previous, meshIndex);
+
+    createSceneVertexBuffer(vulkanObj);
+    createSceneTables(vulkanObj);
+
+    /* Indices moved, everything is registered again */
+    destroyFileWatcher(&s_reload.watcher);
+    initFileWatcher(&s_reload.watcher);
+    watchSceneFiles();
+}
+
+
+static void applyFileChanges(VulkanObject *vulkanObj, VkFence frameFence)
+{
+    uint32_t i;
+    file_change_t *change;
+
+    for (i = 0; i < s_reload.changeCount; i++)
+    {
+        change = &s_reload.changes[i];
+
+        /* Both replace what the decode jobs read, they wait for the jobs started before them */
+        if ((WATCH_OBJ == change->kind || WATCH_MTL == change->kind) && s_reload.texturesPending > 0)
+        {
+            break;
+        }
+
+        if (WATCH_OBJ == change->kind)
+        {
+            /* Left at the front of the list to be tried again next frame */
+            if (VK_FALSE == submitLoadJob(&s_load.loader, reloadModelJob, s_load.options, change->index))
+            {
+                printf("Cannot queue the reload of %s\n", s_scene.meshes[change->index].fileName);
+                break;
+            }
+            s_reload.reloads++;
+            printf("Reloading %s\n", s_scene.meshes[change->index].fileName);
+            s_reload.scenePending = VK_TRUE;
+            i++;
+            break;
+        }
+
+        s_reload.reloads++;
+        if (WATCH_MTL == change->kind)
+        {
+            /* A texture change after it may be for a map it already decodes */
+            reloadMaterials(vulkanObj, frameFence, change->index);
+            if (s_reload.texturesPending > 0)
+            {
+                i++;
+                break;
+            }
+        }
+        else if (WATCH_TEXTURE == change->kind)
+        {
+            printf("Reloading %s\n", s_scene.materials[change->index].fileName);
+            decodeReloadedTexture(change->index);
+        }
+        else
+        {
+            reloadShader(vulkanObj, frameFence, change->index);
+        }
+    }
+
+    /* What is left waits for the jobs just started */
+    memmove(s_reload.changes, &s_reload.changes[i], sizeof(file_change_t) * (s_reload.changeCount - i));
+    s_reload.changeCount -= i;
+}
+
+
+static void serviceReloads(VulkanObject *vulkanObj, VkFence frameFence)
+{
+    load_event_t events[MAX_LOAD_EVENTS];
+    uint32_t count;
+    uint32_t i;
+
+    /* The first load owns the loader events until everything is in */
+    if (!s_reload.watching || !s_load.done)
+    {
+        return;
+    }
+
+    if (!s_reload.filesWatched)
+    {
+        watchSceneFiles();
+        s_reload.filesWatched = VK_TRUE;
+    }
+
+    count = pollLoadEvents(&s_load.loader, events, MAX_LOAD_EVENTS);
+    for (i = 0; i < count; i++)
+    {
+        if (LOAD_EVENT_RELOAD == events[i].type)
+        {
+            s_reload.scenePending = VK_FALSE;
+            if (events[i].success)
+            {
+                replaceScene(vulkanObj, frameFence, events[i].index);
+            }
+            else
+            {
+                printf("Error reloading OBJ file %s, keeping the previous one\n", s_scene.meshes[events[i].index].fileName);
+            }
+        }
+        else
+        {
+            s_reload.texturesPending--;
+            if (events[i].success)
+            {
+                reloadTexture(events[i].index);
+            }
+            else
+            {
+                printf("Failed to decode %s\n", s_scene.materials[events[i].index].fileName);
+            }
+        }
+    }
+
+    /* Textures that need a new slot go through the same batches as the first load */
+    if (s_load.uploadPending && VK_SUCCESS == vkGetFenceStatus(vulkanObj->device, s_load.uploadFence))
+    {
+        finishTextureUploads(vulkanObj, frameFence);
+    }
+
+    if (!s_load.uploadPending && s_load.readyCount > 0)
+    {
+        beginTextureUploads(vulkanObj);
+    }
+
+    /* Changes are applied between batches of jobs, nothing is replaced under a job that reads it */
+    if (s_reload.scenePending || s_reload.texturesPending > 0 || s_load.uploadPending || s_load.readyCount > 0)
+    {
+        return;
+    }
+
+    s_reload.changeCount += pollFileChanges(&s_reload.watcher, &s_reload.changes[s_reload.changeCount], MAX_WATCH_CHANGES - s_reload.changeCount);
+    applyFileChanges(vulkanObj, frameFence);
+}
+
+
+static void recordLoadFrame(VulkanObject *vulkanObj)
 {
-    .modelRotationUp    = 0.0f,
-    .modelRotationRight = 0.0f,
-    .cameraRight        = {0.0f, 0.0f, 0.0f},
-    .cameraDirection    = {0.0f, 0.0f, 0.0f},
-    .cameraTarget       = {0.0f, 0.0f, 0.0f},
-    .cameraPosition     = {0.0f, 0.0f, DEFAULT_CAM_DIST},
-    .cameraFront        = {0.0f, 0.0f, -1.0f},
-    .cameraUp           = {0.0f, 1.0f,  0.0f}
-};
+    double now = getTimeMs();
+    double frameMs = now - s_load.lastFrameMs;
+    double mean, variance;
 
+    /* Time to first frame, then the spread of the frame times until the load is done */
+    if (0 == s_load.firstFrameMs)
+    {
+        s_load.firstFrameMs = now - s_load.startMs;
+    }
+    else if (!s_load.done)
+    {
+        s_load.frameSumMs += frameMs;
+        s_load.frameSquareSumMs += frameMs * frameMs;
+        s_load.frameMaxMs = (frameMs > s_load.frameMaxMs) ? frameMs : s_load.frameMaxMs;
+        s_load.loadFrames++;
+    }
+    s_load.lastFrameMs = now;
 
-void updateModelViewProjMatrix(matrices_t *matrices)
+    if (!s_load.done || s_load.reported)
+    {
+        return;
+    }
+    s_load.reported = VK_TRUE;
+
+    /* Frame times while loading show how much the uploads disturb rendering */
+    printf("Load (%s): first frame %.1f ms, scene drawn %.1f ms, %d textures in %.1f ms\n",
+        s_load.options->syncLoad ? "blocking" : "async", s_load.firstFrameMs, s_load.sceneMs, s_load.textureCount, s_load.doneMs);
+    printf("\tparse %.1f ms, texture decode %.1f ms on %d loader threads\n", s_load.parseMs, s_load.decodeMs, s_load.loader.threadCount);
+    printf("\t%d textures packed into %d arrays, %d texture slots used\n", s_load.packedCount, s_load.arrayCount, vulkanObj->numOfTextures);
+    if (s_load.loadFrames > 0)
+    {
+        mean = s_load.frameSumMs / s_load.loadFrames;
+        variance = s_load.frameSquareSumMs / s_load.loadFrames - mean * mean;
+        printf("\t%d frames while loading, frame time avg %.2f ms, max %.2f ms, stddev %.2f ms\n",
+            s_load.loadFrames, mean, s_load.frameMaxMs, sqrt((variance > 0.0) ? variance : 0.0));
+    }
+}
+
+
+static VkBool32 processWindowEvents(VulkanObject *vulkanObj)
 {
-    /* Generate lookAt matrix for camera */
-    generateLookAtMatrix(s_model.cameraPosition,
-        (vec3_t) {
-        s_model.cameraPosition.x + s_model.cameraFront.x,
-            s_model.cameraPosition.y + s_model.cameraFront.y,
-            s_model.cameraPosition.z + s_model.cameraFront.z
-    },
-        s_model.cameraUp,
-            matrices->viewMatrix);
+    SDL_Event event;
 
-    /* Generate the rotation matrix */
-    generateRotationMatrix(s_model.modelRotationUp, s_model.cameraUp, matrices->rotationMatrixUp);
-    generateRotationMatrix(s_model.modelRotationRight, s_model.cameraRight, matrices->rotationMatrixRight);
+    while (SDL_PollEvent(&event))
+    {
+        if (SDL_QUIT == event.type)
+        {
+            return VK_FALSE;
+        }
+        else if (SDL_WINDOWEVENT == event.type && SDL_WINDOWEVENT_SIZE_CHANGED == event.window.event)
+        {
+            /* Rebuild the swapchain before the next frame */
+            vulkanObj->swapChainOutOfDate = VK_TRUE;
+        }
+    }
+
+    return VK_TRUE;
 }
 
 
-static void initModelView(VulkanObject vulkanObj, matrices_t *matrices)
+static VkBool32 waitForSurfaceExtent(VulkanObject *vulkanObj, VkExtent2D size)
 {
-    /* Set Aspect ratio */
-    float aspect = (float)vulkanObj.windowSize.width / (float)vulkanObj.windowSize.height;
+    VkSurfaceCapabilitiesKHR surCap;
+    double start = getTimeMs();
 
-    /* Generate perspective/projection matrix */
-    generatePerspectiveProjectionMatrix(DEFAULT_FOV, aspect, SCENE_NEAR, SCENE_FAR, matrices->persepctiveProjMatrix);
+    /* SDL_SetWindowSize only asks, the surface has the new size once the window manager has applied it */
+    do
+    {
+        SDL_PumpEvents();
+        if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vulkanObj->physicalDevice, vulkanObj->surface, &surCap))
+        {
+            return VK_FALSE;
+        }
 
-    /* Set inital camera and model settings */
-    s_model.cameraDirection = normalize(subProd(s_model.cameraPosition, s_model.cameraTarget));
-    s_model.cameraRight = normalize(crossProd(s_model.cameraUp, s_model.cameraDirection));
-    s_model.cameraUp = crossProd(s_model.cameraDirection, s_model.cameraRight);
+        /* 0xFFFFFFFF means the swapchain decides the size, as on Wayland */
+        if ((surCap.currentExtent.width == size.width && surCap.currentExtent.height == size.height) || 0xFFFFFFFF == surCap.currentExtent.width)
+        {
+            return VK_TRUE;
+        }
+        SDL_Delay(1);
+    } while (getTimeMs() - start < RESIZE_BENCH_TIMEOUT_MS);
+
+    return VK_FALSE;
 }
 
-static void initSceneDefaults(model_t *model)
+
+static void runResizeBenchmark(VulkanObject *vulkanObj, matrices_t *matrices, VkCommandBuffer cmdBuf, VkFence fence, uint32_t iterations)
 {
-    model->sp.ambientLight.x = 0.3f;
-    model->sp.ambientLight.y = 0.3f;
-    model->sp.ambientLight.z = 0.3f;
+    VkResult result         = VK_SUCCESS;
+    double start            = 0.0;
+    double rebuildMs        = 0.0;
+    double frameMs          = 0.0;
+    double totalRebuildMs   = 0.0;
+    double totalFrameMs     = 0.0;
+    double minRebuildMs     = DBL_MAX;
+    double maxRebuildMs     = 0.0;
+    uint32_t completed      = 0;
+    uint32_t skipped        = 0;
+    uint32_t i;
+
+    VkCommandBufferBeginInfo cbbi =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
 
-    model->sp.lightSourceIntensity.x = 0.8f;
-    model->sp.lightSourceIntensity.y = 0.8f;
-    model->sp.lightSourceIntensity.z = 0.8f;
+    printf("Resize benchmark: %d iterations (%s)\n", iterations, (VK_NULL_HANDLE == vulkanObj->swapChain) ? "headless" : "swapchain");
+
+    for (i = 0; i < iterations; i++)
+    {
+        VkExtent2D size = s_resizeBenchSizes[i % (sizeof(s_resizeBenchSizes) / sizeof(s_resizeBenchSizes[0]))];
+
+        /* A size the window manager refuses or has not applied yet would time a rebuild at the old size */
+        if (VK_NULL_HANDLE != vulkanObj->swapChain)
+        {
+            SDL_SetWindowSize(vulkanObj->window, size.width, size.height);
+            if (VK_FALSE == waitForSurfaceExtent(vulkanObj, size))
+            {
+                printf("\t%4dx%-4d\tskipped, the surface did not change size\n", size.width, size.height);
+                skipped++;
+                continue;
+            }
+        }
+
+        /* Time the rebuild of the size dependent objects */
+        start = getTimeMs();
+        if (VK_NULL_HANDLE == vulkanObj->swapChain)
+        {
+            vulkanObj->windowSize = size;
+            result = recreateAttachments(vulkanObj);
+        }
+        else
+        {
+            result = recreateSwapChain(vulkanObj);
+        }
+        rebuildMs = getTimeMs() - start;
+
+        if (VK_SUCCESS != result)
+        {
+            printf("Failed to resize to %dx%d: %d\n", size.width, size.height, result);
+            break;
+        }
+
+        updateProjectionMatrix(*vulkanObj, matrices);
+
+        /* Time the first frame rendered at the new size */
+        start = getTimeMs();
+        vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, MAX_TIMEOUT);
+        vkResetFences(vulkanObj->device, 1, &fence);
+        vkBeginCommandBuffer(cmdBuf, &cbbi);
+        updateModelViewProjMatrix(matrices);
+        updateUniformBuffer(*vulkanObj, matrices);
+        updateCullFrustum(vulkanObj, matrices);
+        draw(vulkanObj, cmdBuf, s_model);
+
+        if (VK_NULL_HANDLE == vulkanObj->swapChain)
+        {
+            submitFrame(vulkanObj, cmdBuf, fence);
+        }
+        else
+        {
+            swapFrontBuffer(vulkanObj, cmdBuf, fence);
+        }
+        vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, MAX_TIMEOUT);
+        frameMs = getTimeMs() - start;
+
+        totalRebuildMs += rebuildMs;
+        totalFrameMs += frameMs;
+        minRebuildMs = (rebuildMs < minRebuildMs) ? rebuildMs : minRebuildMs;
+        maxRebuildMs = (rebuildMs > maxRebuildMs) ? rebuildMs : maxRebuildMs;
+        completed++;
+
+        printf("\t%4dx%-4d\trebuild: %8.3f ms\tfirst frame: %8.3f ms\n", size.width, size.height, rebuildMs, frameMs);
+    }
+
+    if (completed > 0)
+    {
+        printf("\trebuild min/avg/max:\t%.3f / %.3f / %.3f ms\n", minRebuildMs, totalRebuildMs / completed, maxRebuildMs);
+        printf("\tfirst frame avg:\t%.3f ms\n", totalFrameMs / completed);
+    }
+    if (skipped > 0)
+    {
+        printf("\t%d of %d iterations skipped, the window manager did not apply their size\n", skipped, iterations);
+    }
 }
 
-static void updateUniformBuffer(VulkanObject vulkanObj, matrices_t *matrices)
+
+static void runRecordBenchmark(VulkanObject *vulkanObj, matrices_t *matrices, VkCommandBuffer cmdBuf, VkFence fence, uint32_t frames, uint32_t maxThreads)
 {
-    /* Update matrix data */
-    memcpy(vulkanObj.uniformBuffer.ptr, (float*)matrices, sizeof(matrices_t));
+    double start            = 0.0;
+    double recordMs         = 0.0;
+    double inlineMs         = 0.0;
+    uint32_t threadCount    = 0;
+    uint32_t i;
+
+    VkCommandBufferBeginInfo cbbi =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+
+    printf("Record benchmark: %d frames, %d draws\n", frames, vulkanObj->drawCount);
+
+    /* The main thread alone, then doubling worker counts up to the requested count */
+    while (threadCount <= maxThreads)
+    {
+        vkDeviceWaitIdle(vulkanObj->device);
+        destroyRecordThreads(vulkanObj);
+        if (threadCount > 0 && VK_SUCCESS != createRecordThreads(vulkanObj, threadCount))
+        {
+            printf("Failed to create %d recording threads\n", threadCount);
+            break;
+        }
+
+        /* Only the cpu time spent recording the frame is measured */
+        recordMs = 0.0;
+        vulkanObj->frameIndex = 0;
+        for (i = 0; i < frames; i++)
+        {
+            vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, MAX_TIMEOUT);
+            vkResetFences(vulkanObj->device, 1, &fence);
+            vkBeginCommandBuffer(cmdBuf, &cbbi);
+            updateModelViewProjMatrix(matrices);
+            updateUniformBuffer(*vulkanObj, matrices);
+            updateCullFrustum(vulkanObj, matrices);
+
+            start = getTimeMs();
+            draw(vulkanObj, cmdBuf, s_model);
+            recordMs += getTimeMs() - start;
+
+            submitFrame(vulkanObj, cmdBuf, fence);
+        }
+        vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, MAX_TIMEOUT);
+
+        recordMs = (frames > 0) ? (recordMs / frames) : 0.0;
+        inlineMs = (threadCount == 0) ? recordMs : inlineMs;
+        printf("\t%2d threads\trecord: %8.3f ms/frame\tspeedup: %.2fx\n", threadCount, recordMs, (recordMs > 0.0) ? (inlineMs / recordMs) : 0.0);
+
+        if (threadCount == maxThreads)
+        {
+            break;
+        }
+        threadCount = (threadCount == 0) ? 1 : ((threadCount * 2 < maxThreads) ? (threadCount * 2) : maxThreads);
+    }
 }
 
-static void updateVertexBuffer(VulkanObject vulkanObj)
+
+static void runFetchBenchmark(VulkanObject *vulkanObj, matrices_t *matrices, VkCommandBuffer cmdBuf, VkFence fence, uint32_t frames)
 {
-    /* Update vertex data */
-    memcpy(vulkanObj.vertexBuffer.ptr, (float*)s_model.vertArray, sizeof(vertexData_t) * 3 * s_model.numOfFaces);
+    VkBool32 initialLayout  = vulkanObj->splitVertexStreams;
+    uint64_t vertices       = 0;
+    uint64_t depthBytes     = 0;
+    uint64_t shadeBytes     = 0;
+    double start            = 0.0;
+    double frameMs          = 0.0;
+    uint32_t layout;
+    uint32_t i;
+
+    VkCommandBufferBeginInfo cbbi =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+
+    /* Vertices submitted per frame before culling, the same for both layouts */
+    for (i = 0; i < vulkanObj->drawCount; i++)
+    {
+        vertices += (uint64_t)vulkanObj->drawCmds[i].vertexCount * vulkanObj->drawCmds[i].instanceCount;
+    }
+
+    printf("Fetch benchmark: %d frames, %" PRIu64 " vertices per frame (%s)\n", frames, vertices, vulkanObj->depthPrePass ? "depth pre-pass" : "no depth pre-pass");
+
+    for (layout = 0; layout < 2; layout++)
+    {
+        /* Pipelines bake the vertex layout, the buffer is refilled in the new layout */
+        vkDeviceWaitIdle(vulkanObj->device);
+        destroyGraphicsPipelines(vulkanObj);
+        vulkanObj->splitVertexStreams = (layout == 1) ? VK_TRUE : VK_FALSE;
+        updateVertexBuffer(*vulkanObj);
+        if (VK_SUCCESS != createGraphicsPipelines(vulkanObj))
+        {
+            printf("Failed to create the %s pipelines\n", vulkanObj->splitVertexStreams ? "split" : "interleaved");
+            break;
+        }
+
+        /* Time whole frames, the cpu waits for each one */
+        frameMs = 0.0;
+        vulkanObj->frameIndex = 0;
+        for (i = 0; i < frames; i++)
+        {
+            vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, MAX_TIMEOUT);
+            vkResetFences(vulkanObj->device, 1, &fence);
+
+            start = getTimeMs();
+            vkBeginCommandBuffer(cmdBuf, &cbbi);
+            updateModelViewProjMatrix(matrices);
+            updateUniformBuffer(*vulkanObj, matrices);
+            updateCullFrustum(vulkanObj, matrices);
+            draw(vulkanObj, cmdBuf, s_model);
+            submitFrame(vulkanObj, cmdBuf, fence);
+            vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, MAX_TIMEOUT);
+            frameMs += getTimeMs() - start;
+        }
+        frameMs = (frames > 0) ? (frameMs / frames) : 0.0;
+
+        /* Bytes the vertex input stage reads, position only passes skip the attribute stream */
+        depthBytes = vulkanObj->depthPrePass ? vertices * (vulkanObj->splitVertexStreams ? sizeof(vertexPosition_t) : sizeof(vertexData_t)) : 0;
+        shadeBytes = vertices * (vulkanObj->splitVertexStreams ? (sizeof(vertexPosition_t) + sizeof(vertexAttributes_t)) : sizeof(vertexData_t));
+
+        printf("\t%-11s\tframe: %8.3f ms\tdepth fetch: %8.2f MB\tshade fetch: %8.2f MB\t%.2f GB/s\n",
+            vulkanObj->splitVertexStreams ? "split" : "interleaved", frameMs,
+            depthBytes / (1024.0 * 1024.0), shadeBytes / (1024.0 * 1024.0),
+            (frameMs > 0.0) ? ((depthBytes + shadeBytes) / (frameMs * 1.0e6)) : 0.0);
+    }
+
+    /* Back to the layout selected on the command line */
+    vkDeviceWaitIdle(vulkanObj->device);
+    destroyGraphicsPipelines(vulkanObj);
+    vulkanObj->splitVertexStreams = initialLayout;
+    updateVertexBuffer(*vulkanObj);
+    createGraphicsPipelines(vulkanObj);
 }
 
+
 int main(int argc, char *argv[])
 {
     VkPipelineStageFlags stages         = 0;
@@ -104,24 +1827,50 @@ int main(int argc, char *argv[])
     VkFence fences[2]                   = { 0 };
 
 
-    VkExtent2D textureSize              = { 0 };
     VkResult result                     = VK_SUCCESS;
 
     matrices_t matrices                 = { { 0 } };
     buffer_t stagingBuffer              = { 0 };
-    material_t materials[MAX_MATERIALS] = { { 0 } };
-
-    char *objFilePath                   = NULL;
-    uint64_t objFilePathSize            = 0;
+    VkExtent2D placeholderSize          = { 1, 1 };
+    unsigned char placeholderPixels[4]  = { 255, 255, 255, 255 };
     uint32_t i                          = 0;
     int frame                           = 0;
 
+    viewerOptions_t options             = { 0 };
+
+    /* Time to first frame counts from here */
+    s_load.startMs = getTimeMs();
+
+    /* Get the command line options */
+    if (VK_FALSE == parseOptions(argc, argv, &options))
+    {
+        printf("Out of memory reading the command line\n");
+        return 1;
+    }
+
+    /* The record benchmark needs the worker threads, use a thread per core unless told otherwise */
+    if (options.recordBenchFrames > 0 && 0 == options.recordThreads)
+    {
+        options.recordThreads = getCpuCount();
+    }
+    if (0 == options.objFileCount)
+    {
+        printf("Usage: %s <file.obj> [<file.obj> ...] [--instances <count>] [--headless] [--merge-materials] [--no-cull] [--meshlets] [--lod] [--static-cmds] [--depth-prepass] [--stats] [--sync-load] [--texture-budget <MB>] [--watch] [--split-streams] [--fetch-bench <frames>] [--record-threads <count>] [--record-bench <frames>] [--resize-bench <iterations>]\n", argv[0]);
+        return 1;
+    }
+
     /* Create the vulkan object, init window size */
     VulkanObject vulkanObj =
     {
         .windowSize.width = WINDOW_WIDTH,
         .windowSize.height = WINDOW_HEIGHT,
         .numOfTextures = 0,
+        .frustumCulling = !options.noCulling,
+        .recordThreadCount = options.recordThreads,
+        .staticCommands = options.staticCommands,
+        .depthPrePass = options.depthPrePass,
+        .splitVertexStreams = options.splitVertexStreams,
+        .pipelineStatistics = options.pipelineStatistics,
         .acquiredImages = NUM_SWAP_CHAIN_IMAGES,
     };
 
@@ -133,8 +1882,9 @@ int main(int argc, char *argv[])
         VK_SUCCESS == initRenderPass(&vulkanObj) &&
         VK_SUCCESS == initImages(&vulkanObj) &&
         VK_SUCCESS == initFrameBuffer(&vulkanObj) &&
-        VK_SUCCESS == initPlatformSurface(&vulkanObj) &&
-        VK_SUCCESS == initSwapChain(&vulkanObj)
+        (options.headless ||
+         (VK_SUCCESS == initPlatformSurface(&vulkanObj) &&
+          VK_SUCCESS == initSwapChain(&vulkanObj)))
         )
     {
         /* Create semaphores */
@@ -169,15 +1919,6 @@ int main(int argc, char *argv[])
             /* Create signaled fences */
             createFence(&vulkanObj, &signaledFci, fences, 2);
 
-            /* Get the path of the object file */
-            char* path = getPath(argv[1]);
-
-            /* Load the model file */
-            if (VK_FALSE == loadModel(&s_model, materials, argv[1]))
-            {
-                printf("Error Loading OBJ file\n");
-            }
-
             /* Init scene defaults */
             initSceneDefaults(&s_model);
 
@@ -202,73 +1943,14 @@ int main(int argc, char *argv[])
                 .pSignalSemaphores = &sems
             };
 
-            /* Load texture files */
-            for (i = 0;i < s_model.materialCount;i++)
-            {
-                if (materials[i].fileName != NULL && i < MAX_IMAGE_TEXTURES)
-                {
-                    /* Set the texture id to the corresponding image file */
-                    materials[i].mp.imageIndex = i;
-
-                    objFilePathSize = strlen(path) + strlen(materials[i].fileName) + 1;
-                    objFilePath = (char*)malloc(objFilePathSize);
-                    memset(objFilePath, 0, objFilePathSize);
-                    strcpy_s(objFilePath, objFilePathSize, path);
-                    strcat_s(objFilePath, objFilePathSize, materials[i].fileName);
-
-                    /* Get the BMP Size */
-                    getBmpSize(objFilePath, &textureSize);
-
-                    /* Begin command buffer */
-                    vkBeginCommandBuffer(vulkanObj.cmdBuffer, &bi);
-
-                    /* Create the staging buffer for the image */
-                    stagingBuffer = createBuffer(&vulkanObj,
-                        textureSize.width * textureSize.height * (BMP_PIX_PER_COLOR + 1),
-                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                        VK_SHARING_MODE_EXCLUSIVE);
-
-                    /* Load the image data to the staging pointer */
-                    loadBmpToBuffer(objFilePath, &textureSize, (unsigned char**)&stagingBuffer.ptr);
-
-                    /* Create image */
-                    vulkanObj.textures[i] = createTextureImage(&vulkanObj, &textureSize, &stagingBuffer);
-
-                    /* Unmap memory */
-                    vkUnmapMemory(vulkanObj.device, stagingBuffer.memory);
-
-                    /* End command buffer */
-                    vkEndCommandBuffer(vulkanObj.cmdBuffer);
-
-                    /* Submit command buffer to GPU */
-                    vkQueueSubmit(vulkanObj.queue, 1, &si, NULL);
-                    vkQueueWaitIdle(vulkanObj.queue);
-
-                    /* Update the number of textures */
-                    vulkanObj.numOfTextures++;
-
-                    /* Free path memory */
-                    free(objFilePath);
-                    objFilePath = NULL;
-                }
-            }
-
             /* Create pipelines */
             createPipelines(&vulkanObj);
 
             /* Begin command buffer */
             vkBeginCommandBuffer(vulkanObj.cmdBuffer, &bi);
 
-            /* Prepare object arrays */
-            prepareObjectArrays(&s_model);
-
-            /* Create the vertex buffer */
-            vulkanObj.vertexBuffer = createBuffer(&vulkanObj,
-                sizeof(vertexData_t) * ELEMENTS_PER_VERTEX * s_model.numOfFaces,
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                VK_SHARING_MODE_EXCLUSIVE);
+            /* Create the scene properties buffer */
+            createSceneBuffer(&vulkanObj);
 
             /* Create the uniform buffer */
             vulkanObj.uniformBuffer = createBuffer(&vulkanObj,
@@ -283,6 +1965,9 @@ int main(int argc, char *argv[])
             /* Allocate the descriptor set */
             allocateDescriptorSet(&vulkanObj);
 
+            /* Slot 0 is a white texture, used by untextured materials and by textured ones until theirs is in */
+            vulkanObj.textures[vulkanObj.numOfTextures++] = uploadTexture(&vulkanObj, vulkanObj.cmdBuffer, &placeholderSize, placeholderPixels, &stagingBuffer);
+
             /* Create the image descriptor set */
             createImageDescriptorSet(&vulkanObj, vulkanObj.textures);
 
@@ -292,6 +1977,29 @@ int main(int argc, char *argv[])
             /* Create the texture buffer descriptor set */
             createTextureBufferDescriptorSet(&vulkanObj);
 
+            /* Create the scene properties descriptor set */
+            createSceneBufferDescriptorSet(&vulkanObj);
+
+            /* Show the faces as they are parsed, unless the load is waited for or the vertex layout is split */
+            s_stream.enabled = (options.syncLoad || options.resizeBenchIterations > 0 || options.fetchBenchFrames > 0 || options.recordBenchFrames > 0 || options.splitVertexStreams) ? VK_FALSE : VK_TRUE;
+            if (s_stream.enabled)
+            {
+                createMutex(&s_stream.lock);
+                s_stream.minimum = (vec3_t){ FLT_MAX, FLT_MAX, FLT_MAX };
+                s_stream.maximum = (vec3_t){ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+                s_scene.stream = (obj_stream_t){ streamChunk, &s_stream };
+                beginGeometryStream(&vulkanObj);
+            }
+
+            /* Create the frustum cull pipeline, its descriptors are written when the scene is in */
+            createCullPipeline(&vulkanObj);
+
+            /* Write every descriptor that does not depend on the scene, one update per frame slot */
+            for (i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+            {
+                printf("Descriptor writes: %d in one update for frame slot %d\n", flushDescriptorWrites(&vulkanObj.descriptors, i), i);
+            }
+
             /* Transition Images */
             transitionImage(&vulkanObj);
 
@@ -300,9 +2008,44 @@ int main(int argc, char *argv[])
 
             /* Submit command buffer to GPU */
             vkQueueSubmit(vulkanObj.queue, 1, &si, NULL);
+            vkQueueWaitIdle(vulkanObj.queue);
+            destroyBuffer(&vulkanObj, &stagingBuffer);
+
+            /* Texture copies are submitted from their own command buffer and fence */
+            createCommandBuffer(&vulkanObj, &s_load.uploadCmdBuffer, 1);
+            createFence(&vulkanObj, &signaledFci, &s_load.uploadFence, 1);
+
+            /* Finer texture levels are streamed in and evicted within the budget */
+            initTextureResidency(&s_residency, &vulkanObj, options.textureBudgetMb);
+
+            /* Parse the scene in the background, the frames clear until it is in */
+            s_load.options = &options;
+            initAsyncLoader(&s_load.loader, (getCpuCount() > 1) ? (getCpuCount() - 1) : 1);
+            if (VK_FALSE == submitLoadJob(&s_load.loader, loadSceneJob, &options, 0))
+            {
+                /* Runs on with nothing loaded, like a scene that failed to parse */
+                printf("Cannot queue the scene load\n");
+                s_load.sceneLoaded = VK_TRUE;
+            }
+
+            /* Files edited while the window is open are loaded again, the files are registered once the load is done */
+            if (options.watch && options.headless)
+            {
+                printf("--watch is ignored with --headless\n");
+            }
+            else if (options.watch)
+            {
+                s_reload.watching = (0 == initFileWatcher(&s_reload.watcher)) ? VK_TRUE : VK_FALSE;
+            }
 
-            /* Update vertex buffer */
-            updateVertexBuffer(vulkanObj);
+            /* The benchmarks measure a loaded scene, wait for it like the blocking load does */
+            if (options.syncLoad || options.resizeBenchIterations > 0 || options.fetchBenchFrames > 0 || options.recordBenchFrames > 0)
+            {
+                while (!s_load.done)
+                {
+                    serviceLoads(&vulkanObj, &matrices, fences[1], VK_TRUE);
+                }
+            }
 
             /* Setup command buffer structure */
             VkCommandBufferBeginInfo cbbi =
@@ -313,11 +2056,65 @@ int main(int argc, char *argv[])
                 .pInheritanceInfo = NULL
             };
 
-            for (i = 0; frame < 1000; ++frame, ++i)
+            /* Measure the cost of resizing if requested */
+            if (options.resizeBenchIterations > 0)
+            {
+                runResizeBenchmark(&vulkanObj, &matrices, cmdBuffer[0], fences[0], options.resizeBenchIterations);
+            }
+
+            /* Compare the vertex fetch of the interleaved and the split layout */
+            if (options.fetchBenchFrames > 0)
+            {
+                runFetchBenchmark(&vulkanObj, &matrices, cmdBuffer[0], fences[0], options.fetchBenchFrames);
+            }
+
+            /* Compare recording on the main thread with recording on the worker threads */
+            if (options.recordBenchFrames > 0)
+            {
+                runRecordBenchmark(&vulkanObj, &matrices, cmdBuffer[0], fences[0], options.recordBenchFrames, options.recordThreads);
+            }
+
+            /* Only count the frames of the main loop */
+            vulkanObj.fragmentInvocations = 0;
+            vulkanObj.statsFrames = 0;
+
+            /* Frames drawn while loading do not count towards the run, a watched scene runs until the window is closed */
+            for (i = 0; frame < 1000; frame += (s_load.done && !s_reload.watching) ? 1 : 0, ++i)
             {
                 VkFence fence = fences[i & 1];
                 VkCommandBuffer cmdBuf = cmdBuffer[i & 1];
 
+                /* Secondary buffers are recorded into the pools of the same frame slot */
+                vulkanObj.frameIndex = i & 1;
+
+                if (!options.headless)
+                {
+                    /* Handle window events */
+                    if (VK_FALSE == processWindowEvents(&vulkanObj))
+                    {
+                        break;
+                    }
+
+                    /* Rebuild the swapchain and attachments after a resize */
+                    if (vulkanObj.swapChainOutOfDate)
+                    {
+                        result = recreateSwapChain(&vulkanObj);
+                        if (VK_NOT_READY == result)
+                        {
+                            /* Window is minimized */
+                            SDL_Delay(16);
+                            continue;
+                        }
+                        else if (VK_SUCCESS != result)
+                        {
+                            printf("Failed to recreate swapchain\n");
+                            break;
+                        }
+
+                        updateProjectionMatrix(vulkanObj, &matrices);
+                    }
+                }
+
                 /* Wait for the command buffer to useable */
                 result = vkWaitForFences(vulkanObj.device, 1, &fence, VK_TRUE, MAX_TIMEOUT);
                 if (VK_SUCCESS != result)
@@ -329,6 +2126,19 @@ int main(int argc, char *argv[])
                     /* Reset fence */
                     vkResetFences(vulkanObj.device, 1, &fence);
 
+                    /* Pick up what the loader finished, the other slot's fence guards the material updates */
+                    serviceLoads(&vulkanObj, &matrices, fences[(i + 1) & 1], VK_FALSE);
+
+                    /* Load what changed on disk, under the same fence */
+                    serviceReloads(&vulkanObj, fences[(i + 1) & 1]);
+
+                    /* Stream texture levels for what the last frame saw, the new ones are swapped in under the same fence */
+                    if (vulkanObj.sceneReady)
+                    {
+                        updateTextureResidency(&s_residency, &vulkanObj,
+                            (vulkanObj.windowSize.height * 0.5f) / tanf(DEFAULT_FOV * 0.5f * PI / 180.0f), fences[(i + 1) & 1]);
+                    }
+
                     /* Begin the command buffer */
                     result = vkBeginCommandBuffer(cmdBuf, &cbbi);
                     if (VK_SUCCESS != result)
@@ -337,6 +2147,9 @@ int main(int argc, char *argv[])
                     }
                     else
                     {
+                        /* Copy the faces parsed since the last frame and draw what is in so far */
+                        streamGeometry(&vulkanObj, &matrices, cmdBuf);
+
                         /* Rotate the object */
                         s_model.modelRotationUp -= 0.5f;
                         if (s_model.modelRotationUp > 360.0f)
@@ -350,14 +2163,55 @@ int main(int argc, char *argv[])
                         /* Update uniform buffer */
                         updateUniformBuffer(vulkanObj, &matrices);
 
+                        /* Update the planes used to cull the material ranges */
+                        updateCullFrustum(&vulkanObj, &matrices);
+
                         /* Draw */
                         draw(&vulkanObj, cmdBuf, s_model);
 
-                        /* Swap buffers */
-                        swapFrontBuffer(&vulkanObj, cmdBuf, fence);
+                        if (options.headless)
+                        {
+                            /* Submit without presenting */
+                            submitFrame(&vulkanObj, cmdBuf, fence);
+                        }
+                        else
+                        {
+                            /* Swap buffers */
+                            swapFrontBuffer(&vulkanObj, cmdBuf, fence);
+                        }
+
+                        recordLoadFrame(&vulkanObj);
                     }
                 }
             }
+
+            /* Jobs still queued when the window closes are dropped */
+            destroyAsyncLoader(&s_load.loader);
+
+            /* The recording workers wait for a next frame, stop them once the last one is done */
+            vkDeviceWaitIdle(vulkanObj.device);
+            destroyRecordThreads(&vulkanObj);
+
+            if (s_reload.watching)
+            {
+                printf("Reloaded %d changed files\n", s_reload.reloads);
+                destroyFileWatcher(&s_reload.watcher);
+            }
+
+            /* Resident bytes, streaming bandwidth and misses over the run */
+            printTextureResidency(&s_residency);
+            destroyTextureResidency(&s_residency, &vulkanObj);
+
+            /* Host allocations of the loader, textures and renderer, peaks include the load */
+            printMemoryUsage();
+
+            /* Overdraw shows up as more fragment shader invocations per frame */
+            if (vulkanObj.statsFrames > 0)
+            {
+                printf("Fragment shader invocations: %" PRIu64 " per frame over %d frames (%s)\n",
+                    vulkanObj.fragmentInvocations / vulkanObj.statsFrames, vulkanObj.statsFrames,
+                    vulkanObj.depthPrePass ? "depth pre-pass" : "no depth pre-pass");
+            }
         }
     }
     return 0;
@@ -0,0 +1,717 @@
+#include <float.h>
+#include "meshSimplifier.h"
+#include "osThread.h"
+
+
+/* Symmetric 4x4 error matrix: xx xy xz xw yy yz yw zz zw ww */
+typedef struct _quadric_t
+{
+    double a[10];
+} quadric_t;
+
+
+typedef struct _collapse_t
+{
+    double cost;
+    uint32_t from;
+    uint32_t to;
+} collapse_t;
+
+
+typedef struct _simplify_job_t
+{
+    model_t *model;
+    uint32_t cornerStride;
+    uint32_t firstFace;
+    uint32_t faceCount;
+
+    /* Corner data of each level below the original */
+    uint32_t *levelFaces[MAX_LOD_LEVELS];
+    uint32_t levelFaceCount[MAX_LOD_LEVELS];
+    float levelError[MAX_LOD_LEVELS];
+    uint32_t numOfLevels;
+} simplify_job_t;
+
+
+typedef struct _simplify_state_t
+{
+    float *v;
+    uint32_t cornerStride;
+
+    /* Alive faces, their corner data and their local vertices */
+    uint32_t *faces;
+    uint32_t *faceVerts;
+    uint32_t faceCount;
+
+    /* Per local vertex */
+    uint32_t *positions;
+    uint32_t *vertexCorners;
+    quadric_t *quadrics;
+    uint8_t *locked;
+    uint8_t *seam;
+    uint32_t vertexCount;
+} simplify_state_t;
+
+
+typedef struct _simplify_worker_t
+{
+    simplify_job_t *jobs;
+    uint32_t jobCount;
+    uint32_t first;
+    uint32_t step;
+} simplify_worker_t;
+
+
+static int compareUint32(const void *a, const void *b)
+{
+    const uint32_t ua = *(const uint32_t *)a;
+    const uint32_t ub = *(const uint32_t *)b;
+
+    return (ua < ub) ? -1 : ((ua > ub) ? 1 : 0);
+}
+
+
+static int compareUint64(const void *a, const void *b)
+{
+    const uint64_t ua = *(const uint64_t *)a;
+    const uint64_t ub = *(const uint64_t *)b;
+
+    return (ua < ub) ? -1 : ((ua > ub) ? 1 : 0);
+}
+
+
+static int compareCollapses(const void *a, const void *b)
+{
+    const collapse_t *ca = (const collapse_t *)a;
+    const collapse_t *cb = (const collapse_t *)b;
+
+    /* Cheapest first, ties broken by vertex so the result doesn't depend on qsort */
+    if(ca->cost != cb->cost)
+    {
+        return (ca->cost < cb->cost) ? -1 : 1;
+    }
+    if(ca->from != cb->from)
+    {
+        return (ca->from < cb->from) ? -1 : 1;
+    }
+    return (ca->to < cb->to) ? -1 : ((ca->to > cb->to) ? 1 : 0);
+}
+
+
+static vec3_t vertexPosition(simplify_state_t *s, uint32_t vertex)
+{
+    float *p = &s->v[s->positions[vertex]*3];
+
+    return (vec3_t){ p[0], p[1], p[2] };
+}
+
+
+static vec3_t triangleNormal(vec3_t p0, vec3_t p1, vec3_t p2)
+{
+    return crossProd(subProd(p1, p0), subProd(p2, p0));
+}
+
+
+static void addPlaneQuadric(quadric_t *q, vec3_t n, float d)
+{
+    q->a[0] += n.x*n.x;  q->a[1] += n.x*n.y;  q->a[2] += n.x*n.z;  q->a[3] += n.x*d;
+    q->a[4] += n.y*n.y;  q->a[5] += n.y*n.z;  q->a[6] += n.y*d;
+    q->a[7] += n.z*n.z;  q->a[8] += n.z*d;
+    q->a[9] += d*d;
+}
+
+
+static double quadricError(quadric_t *q, vec3_t p)
+{
+    /* Sum of squared distances to the planes accumulated in q */
+    double error = q->a[0]*p.x*p.x + 2.0*q->a[1]*p.x*p.y + 2.0*q->a[2]*p.x*p.z + 2.0*q->a[3]*p.x
+                 + q->a[4]*p.y*p.y + 2.0*q->a[5]*p.y*p.z + 2.0*q->a[6]*p.y
+                 + q->a[7]*p.z*p.z + 2.0*q->a[8]*p.z
+                 + q->a[9];
+
+    return (error > 0.0) ? error : 0.0;
+}
+
+
+static uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+    return (a < b) ? (((uint64_t)a << 32) | b) : (((uint64_t)b << 32) | a);
+}
+
+
+static uint32_t collectEdges(simplify_state_t *s, uint64_t **edges)
+{
+    uint32_t i, j;
+    uint32_t count = 0;
+
+    *edges = (uint64_t *)memAlloc(MEMORY_LOADER, sizeof(uint64_t) * s->faceCount * CORNERS_PER_FACE + 1);
+    for(i=0;i<s->faceCount;i++)
+    {
+        for(j=0;j<CORNERS_PER_FACE;j++)
+        {
+            (*edges)[count++] = edgeKey(s->faceVerts[i*CORNERS_PER_FACE + j], s->faceVerts[i*CORNERS_PER_FACE + (j+1)%CORNERS_PER_FACE]);
+        }
+    }
+
+    qsort(*edges, count, sizeof(uint64_t), compareUint64);
+    return count;
+}
+
+
+static void initState(simplify_state_t *s, simplify_job_t *job)
+{
+    uint32_t i, j;
+    uint32_t run;
+    uint32_t vertex;
+    uint32_t edgeCount;
+    uint32_t *corner;
+    uint64_t *edges;
+    uint32_t faceStride = job->cornerStride * CORNERS_PER_FACE;
+
+    s->v = job->model->v;
+    s->cornerStride = job->cornerStride;
+    s->faceCount = job->faceCount;
+    s->faces = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * faceStride * job->faceCount);
+    s->faceVerts = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * CORNERS_PER_FACE * job->faceCount);
+    memcpy(s->faces, &job->model->f[faceStride * job->firstFace], sizeof(uint32_t) * faceStride * job->faceCount);
+
+    /* Number the positions used by the range, in sorted order */
+    s->positions = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * CORNERS_PER_FACE * job->faceCount);
+    for(i=0;i<job->faceCount * CORNERS_PER_FACE;i++)
+    {
+        s->positions[i] = s->faces[i*s->cornerStride] - 1;
+    }
+    qsort(s->positions, job->faceCount * CORNERS_PER_FACE, sizeof(uint32_t), compareUint32);
+
+    s->vertexCount = 0;
+    for(i=0;i<job->faceCount * CORNERS_PER_FACE;i++)
+    {
+        if(s->vertexCount == 0 || s->positions[s->vertexCount-1] != s->positions[i])
+        {
+            s->positions[s->vertexCount++] = s->positions[i];
+        }
+    }
+
+    s->vertexCorners = (uint32_t *)memCalloc(MEMORY_LOADER, s->vertexCount * s->cornerStride, sizeof(uint32_t));
+    s->quadrics = (quadric_t *)memCalloc(MEMORY_LOADER, s->vertexCount, sizeof(quadric_t));
+    s->locked = (uint8_t *)memCalloc(MEMORY_LOADER, s->vertexCount, sizeof(uint8_t));
+    s->seam = (uint8_t *)memCalloc(MEMORY_LOADER, s->vertexCount, sizeof(uint8_t));
+
+    /* Each vertex keeps a copy of its first corner, a second texture coordinate makes it a UV seam */
+    for(i=0;i<job->faceCount * CORNERS_PER_FACE;i++)
+    {
+        corner = &s->faces[i*s->cornerStride];
+        vertex = (uint32_t)((uint32_t *)bsearch(&(uint32_t){ corner[0] - 1 }, s->positions, s->vertexCount, sizeof(uint32_t), compareUint32) - s->positions);
+        s->faceVerts[i] = vertex;
+
+        if(s->vertexCorners[vertex*s->cornerStride] == 0)
+        {
+            memcpy(&s->vertexCorners[vertex*s->cornerStride], corner, sizeof(uint32_t) * s->cornerStride);
+        }
+        else if(s->vertexCorners[vertex*s->cornerStride + 1] != corner[1])
+        {
+            s->seam[vertex] = 1;
+            s->locked[vertex] = 1;
+        }
+    }
+
+    /* Border and non-manifold edges hold their vertices in place */
+    edgeCount = collectEdges(s, &edges);
+    for(i=0;i<edgeCount;i+=run)
+    {
+        for(run=1;(i+run)<edgeCount && edges[i+run] == edges[i];run++);
+        if(run != 2)
+        {
+            s->locked[(uint32_t)(edges[i] >> 32)] = 1;
+            s->locked[(uint32_t)(edges[i] & 0xFFFFFFFF)] = 1;
+        }
+    }
+    memFree(edges);
+
+    /* Every vertex starts with the planes of its faces */
+    for(i=0;i<s->faceCount;i++)
+    {
+        vec3_t p0 = vertexPosition(s, s->faceVerts[i*CORNERS_PER_FACE + 0]);
+        vec3_t n = triangleNormal(p0, vertexPosition(s, s->faceVerts[i*CORNERS_PER_FACE + 1]), vertexPosition(s, s->faceVerts[i*CORNERS_PER_FACE + 2]));
+        float length = sqrtf(dotProd(n, n));
+
+        if(length > 0.0f)
+        {
+            n = scalarProd(n, 1.0f / length);
+            for(j=0;j<CORNERS_PER_FACE;j++)
+            {
+                addPlaneQuadric(&s->quadrics[s->faceVerts[i*CORNERS_PER_FACE + j]], n, -dotProd(n, p0));
+            }
+        }
+    }
+}
+
+
+static void freeState(simplify_state_t *s)
+{
+    memFree(s->faces);
+    memFree(s->faceVerts);
+    memFree(s->positions);
+    memFree(s->vertexCorners);
+    memFree(s->quadrics);
+    memFree(s->locked);
+    memFree(s->seam);
+}
+
+
+static VkBool32 collapseFlips(simplify_state_t *s, uint32_t *vertexStart, uint32_t *vertexFaces, uint8_t *dead, uint32_t from, uint32_t to)
+{
+    uint32_t i, j;
+    uint32_t face;
+    vec3_t p[CORNERS_PER_FACE];
+    vec3_t moved[CORNERS_PER_FACE];
+    VkBool32 hasTo;
+
+    /* Moving from onto to must not turn any remaining face over */
+    for(i=vertexStart[from];i<vertexStart[from+1];i++)
+    {
+        face = vertexFaces[i];
+        if(dead[face])
+        {
+            continue;
+        }
+
+        hasTo = VK_FALSE;
+        for(j=0;j<CORNERS_PER_FACE;j++)
+        {
+            p[j] = vertexPosition(s, s->faceVerts[face*CORNERS_PER_FACE + j]);
+            moved[j] = (s->faceVerts[face*CORNERS_PER_FACE + j] == from) ? vertexPosition(s, to) : p[j];
+            hasTo = hasTo || (s->faceVerts[face*CORNERS_PER_FACE + j] == to);
+        }
+
+        if(!hasTo && dotProd(triangleNormal(p[0], p[1], p[2]), triangleNormal(moved[0], moved[1], moved[2])) <= 0.0f)
+        {
+            return VK_TRUE;
+        }
+    }
+    return VK_FALSE;
+}
+
+
+static uint32_t collapsePass(simplify_state_t *s, uint32_t targetFaces, double maxCost, double *error)
+{
+    uint32_t i, j, k;
+    uint32_t a, b;
+    uint32_t face;
+    uint32_t edgeCount;
+    uint32_t candidateCount = 0;
+    uint32_t collapses = 0;
+    uint32_t aliveCount = s->faceCount;
+    uint64_t *edges;
+    collapse_t *candidates;
+    uint32_t *vertexStart;
+    uint32_t *vertexFaces;
+    uint8_t *touched;
+    uint8_t *dead;
+    double costAB, costBA;
+
+    /* Cost of every edge collapse, in the cheaper allowed direction */
+    edgeCount = collectEdges(s, &edges);
+    candidates = (collapse_t *)memAlloc(MEMORY_LOADER, sizeof(collapse_t) * (edgeCount + 1));
+    for(i=0;i<edgeCount;i++)
+    {
+        if(i > 0 && edges[i] == edges[i-1])
+        {
+            continue;
+        }
+
+        a = (uint32_t)(edges[i] >> 32);
+        b = (uint32_t)(edges[i] & 0xFFFFFFFF);
+        costAB = (!s->locked[a] && !s->seam[b]) ? quadricError(&s->quadrics[a], vertexPosition(s, b)) + quadricError(&s->quadrics[b], vertexPosition(s, b)) : DBL_MAX;
+        costBA = (!s->locked[b] && !s->seam[a]) ? quadricError(&s->quadrics[a], vertexPosition(s, a)) + quadricError(&s->quadrics[b], vertexPosition(s, a)) : DBL_MAX;
+
+        if(costAB < DBL_MAX || costBA < DBL_MAX)
+        {
+            candidates[candidateCount].cost = (costAB <= costBA) ? costAB : costBA;
+            candidates[candidateCount].from = (costAB <= costBA) ? a : b;
+            candidates[candidateCount].to = (costAB <= costBA) ? b : a;
+            candidateCount++;
+        }
+    }
+    memFree(edges);
+    qsort(candidates, candidateCount, sizeof(collapse_t), compareCollapses);
+
+    /* Faces around each vertex */
+    vertexStart = (uint32_t *)memCalloc(MEMORY_LOADER, s->vertexCount + 1, sizeof(uint32_t));
+    vertexFaces = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * s->faceCount * CORNERS_PER_FACE + 1);
+    for(i=0;i<s->faceCount * CORNERS_PER_FACE;i++)
+    {
+        vertexStart[s->faceVerts[i]]++;
+    }
+    for(i=1;i<=s->vertexCount;i++)
+    {
+        vertexStart[i] += vertexStart[i-1];
+    }
+    for(i=s->faceCount * CORNERS_PER_FACE;i>0;i--)
+    {
+        vertexFaces[--vertexStart[s->faceVerts[i-1]]] = (i-1) / CORNERS_PER_FACE;
+    }
+
+    touched = (uint8_t *)memCalloc(MEMORY_LOADER, s->vertexCount, sizeof(uint8_t));
+    dead = (uint8_t *)memCalloc(MEMORY_LOADER, s->faceCount, sizeof(uint8_t));
+
+    /* Collapse the cheapest edges, each vertex neighbourhood at most once per pass */
+    for(i=0;i<candidateCount && aliveCount > targetFaces;i++)
+    {
+        a = candidates[i].from;
+        b = candidates[i].to;
+
+        if(candidates[i].cost > maxCost)
+        {
+            break;
+        }
+
+        if(touched[a] || touched[b] || collapseFlips(s, vertexStart, vertexFaces, dead, a, b))
+        {
+            continue;
+        }
+
+        for(j=vertexStart[a];j<vertexStart[a+1];j++)
+        {
+            face = vertexFaces[j];
+            if(dead[face])
+            {
+                continue;
+            }
+
+            for(k=0;k<CORNERS_PER_FACE;k++)
+            {
+                touched[s->faceVerts[face*CORNERS_PER_FACE + k]] = 1;
+            }
+
+            /* Faces along the edge disappear, the rest take the corner of the kept vertex */
+            if(s->faceVerts[face*CORNERS_PER_FACE + 0] == b || s->faceVerts[face*CORNERS_PER_FACE + 1] == b || s->faceVerts[face*CORNERS_PER_FACE + 2] == b)
+            {
+                dead[face] = 1;
+                aliveCount--;
+                continue;
+            }
+
+            for(k=0;k<CORNERS_PER_FACE;k++)
+            {
+                if(s->faceVerts[face*CORNERS_PER_FACE + k] == a)
+                {
+                    s->faceVerts[face*CORNERS_PER_FACE + k] = b;
+                    memcpy(&s->faces[(face*CORNERS_PER_FACE + k)*s->cornerStride], &s->vertexCorners[b*s->cornerStride], sizeof(uint32_t) * s->cornerStride);
+                }
+            }
+        }
+
+        for(k=0;k<10;k++)
+        {
+            s->quadrics[b].a[k] += s->quadrics[a].a[k];
+        }
+
+        *error = (candidates[i].cost > *error) ? candidates[i].cost : *error;
+        collapses++;
+    }
+
+    /* Drop the collapsed faces */
+    if(collapses > 0)
+    {
+        for(i=0,j=0;i<s->faceCount;i++)
+        {
+            if(!dead[i])
+            {
+                memmove(&s->faceVerts[j*CORNERS_PER_FACE], &s->faceVerts[i*CORNERS_PER_FACE], sizeof(uint32_t) * CORNERS_PER_FACE);
+                memmove(&s->faces[j*CORNERS_PER_FACE*s->cornerStride], &s->faces[i*CORNERS_PER_FACE*s->cornerStride], sizeof(uint32_t) * CORNERS_PER_FACE * s->cornerStride);
+                j++;
+            }
+        }
+        s->faceCount = j;
+    }
+
+    memFree(candidates);
+    memFree(vertexStart);
+    memFree(vertexFaces);
+    memFree(touched);
+    memFree(dead);
+
+    return collapses;
+}
+
+
+static void simplifyRange(simplify_job_t *job)
+{
+    uint32_t level;
+    uint32_t targetFaces;
+    uint32_t previousFaces = job->faceCount;
+    uint32_t faceStride = job->cornerStride * CORNERS_PER_FACE;
+    double error = 0.0;
+    double maxCost;
+    boundingSphere_t sphere;
+    simplify_state_t state;
+
+    job->numOfLevels = 1;
+    if(job->faceCount < 2)
+    {
+        return;
+    }
+
+    initState(&state, job);
+
+    /* Errors are bounded by the size of the range, seams and borders never move */
+    sphere = computeBoundingSphere(job->model->v, job->model->f, job->cornerStride, job->firstFace, job->faceCount);
+    maxCost = (double)LOD_MAX_ERROR * sphere.radius;
+    maxCost *= maxCost;
+
+    for(level=1;level<MAX_LOD_LEVELS;level++)
+    {
+        targetFaces = (uint32_t)(previousFaces * LOD_REDUCTION);
+        while(state.faceCount > targetFaces && collapsePass(&state, targetFaces, maxCost, &error) > 0);
+
+        /* Stop once a level saves less than a tenth of the faces */
+        if(state.faceCount == 0 || state.faceCount * 10 > previousFaces * 9)
+        {
+            break;
+        }
+
+        job->levelFaces[level] = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * faceStride * state.faceCount);
+        memcpy(job->levelFaces[level], state.faces, sizeof(uint32_t) * faceStride * state.faceCount);
+        job->levelFaceCount[level] = state.faceCount;
+        job->levelError[level] = (float)sqrt(error);
+        job->numOfLevels = level + 1;
+        previousFaces = state.faceCount;
+    }
+
+    freeState(&state);
+}
+
+
+static void simplifyWorker(void *arg)
+{
+    uint32_t i;
+    simplify_worker_t *worker = (simplify_worker_t *)arg;
+
+    for(i=worker->first;i<worker->jobCount;i+=worker->step)
+    {
+        simplifyRange(&worker->jobs[i]);
+    }
+}
+
+
+void buildLods(model_t *model, lod_list_t *lods)
+{
+    uint32_t i, k;
+    uint32_t range;
+    uint32_t threadCount;
+    uint32_t totalFaces;
+    uint32_t cornerStride = (model->numOfNormals == 0) ? 2 : 3;
+    uint32_t faceStride = cornerStride * CORNERS_PER_FACE;
+    simplify_job_t *jobs;
+    simplify_worker_t *workers;
+    thread_t *threads;
+    VkBool32 *started;
+    lod_level_t *levels;
+
+    lods->rangeCount = model->materialChangeCount;
+    lods->levels = (lod_level_t *)memCalloc(MEMORY_LOADER, MAX_LOD_LEVELS * ((lods->rangeCount > 0) ? lods->rangeCount : 1), sizeof(lod_level_t));
+    model->numOfLodFaces = 0;
+    if(lods->rangeCount == 0)
+    {
+        return;
+    }
+
+    jobs = (simplify_job_t *)memCalloc(MEMORY_LOADER, lods->rangeCount, sizeof(simplify_job_t));
+    for(range=0;range<lods->rangeCount;range++)
+    {
+        jobs[range].model = model;
+        jobs[range].cornerStride = cornerStride;
+        jobs[range].firstFace = model->materialChange[range].startFace;
+        jobs[range].faceCount = ((range < lods->rangeCount - 1) ? model->materialChange[range+1].startFace : model->numOfFaces) - jobs[range].firstFace;
+    }
+
+    /* Ranges are independent, hand them out round robin so the result doesn't depend on timing */
+    threadCount = getCpuCount();
+    threadCount = (threadCount < lods->rangeCount) ? threadCount : lods->rangeCount;
+    workers = (simplify_worker_t *)memCalloc(MEMORY_LOADER, threadCount, sizeof(simplify_worker_t));
+    threads = (thread_t *)memCalloc(MEMORY_LOADER, threadCount, sizeof(thread_t));
+    started = (VkBool32 *)memCalloc(MEMORY_LOADER, threadCount, sizeof(VkBool32));
+
+    for(i=0;i<threadCount;i++)
+    {
+        workers[i] = (simplify_worker_t){ .jobs = jobs, .jobCount = lods->rangeCount, .first = i, .step = threadCount };
+        started[i] = (i > 0 && 0 == createThread(&threads[i], simplifyWorker, &workers[i])) ? VK_TRUE : VK_FALSE;
+    }
+
+    /* The calling thread takes the first share, and any share whose thread failed to start */
+    for(i=0;i<threadCount;i++)
+    {
+        if(!started[i])
+        {
+            simplifyWorker(&workers[i]);
+        }
+    }
+    for(i=1;i<threadCount;i++)
+    {
+        if(started[i])
+        {
+            joinThread(&threads[i]);
+        }
+    }
+
+    /* Simplified faces go after the source faces, the source range is level 0 */
+    totalFaces = model->numOfFaces;
+    for(range=0;range<lods->rangeCount;range++)
+    {
+        for(k=1;k<jobs[range].numOfLevels;k++)
+        {
+            totalFaces += jobs[range].levelFaceCount[k];
+        }
+    }
+    model->f = (uint32_t *)memRealloc(MEMORY_LOADER, model->f, sizeof(uint32_t) * faceStride * totalFaces);
+
+    totalFaces = model->numOfFaces;
+    for(range=0;range<lods->rangeCount;range++)
+    {
+        levels = &lods->levels[range * MAX_LOD_LEVELS];
+        levels[0] = (lod_level_t){ .firstFace = jobs[range].firstFace, .faceCount = jobs[range].faceCount, .error = 0.0f };
+
+        for(k=1;k<MAX_LOD_LEVELS;k++)
+        {
+            if(k >= jobs[range].numOfLevels)
+            {
+                levels[k] = levels[k-1];
+                continue;
+            }
+
+            memcpy(&model->f[faceStride * totalFaces], jobs[range].levelFaces[k], sizeof(uint32_t) * faceStride * jobs[range].levelFaceCount[k]);
+            levels[k] = (lod_level_t){ .firstFace = totalFaces, .faceCount = jobs[range].levelFaceCount[k], .error = jobs[range].levelError[k] };
+            totalFaces += jobs[range].levelFaceCount[k];
+            memFree(jobs[range].levelFaces[k]);
+        }
+
+        for(k=0;k<jobs[range].numOfLevels;k++)
+        {
+            printf("\trange %d lod %d:\t\t%d triangles, error %f\n", range, k, levels[k].faceCount, levels[k].error);
+        }
+    }
+    model->numOfLodFaces = totalFaces - model->numOfFaces;
+
+    printf("\tlod faces:\t\t%d (%d threads)\n", model->numOfLodFaces, threadCount);
+
+    memFree(jobs);
+    memFree(workers);
+    memFree(threads);
+    memFree(started);
+}
+
+
+uint32_t selectLod(lod_level_t *levels, boundingSphere_t *sphere, vec3_t cameraPosition, float lodScale)
+{
+    uint32_t i;
+    vec3_t offset = subProd(sphere->center, cameraPosition);
+    float distance = sqrtf(dotProd(offset, offset)) - sphere->radius;
+
+    /* Coarsest level whose error projects to under LOD_PIXEL_ERROR pixels, matches the cull shader */
+    distance = (distance > LOD_MIN_DISTANCE) ? distance : LOD_MIN_DISTANCE;
+    for(i=MAX_LOD_LEVELS-1;i>0;i--)
+    {
+        if(levels[i].error * lodScale <= distance)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+
+VkBool32 saveLodCache(char *fileName, model_t *model, lod_list_t *lods, uint32_t sourceHash)
+{
+    FILE *pFile;
+    errno_t err;
+    lod_cache_header_t header =
+    {
+        .magic = { LOD_CACHE_MAGIC[0], LOD_CACHE_MAGIC[1], LOD_CACHE_MAGIC[2], LOD_CACHE_MAGIC[3] },
+        .version = LOD_CACHE_VERSION,
+        .sourceHash = sourceHash,
+        .numOfFaces = model->numOfFaces,
+        .cornerStride = (model->numOfNormals == 0) ? 2 : 3,
+        .rangeCount = lods->rangeCount,
+        .numOfLodFaces = model->numOfLodFaces
+    };
+
+    err = fopen_s(&pFile, fileName, "wb");
+    if (err != 0)
+    {
+        printf("Error creating lod cache %s\n", fileName);
+        return VK_FALSE;
+    }
+
+    /* Header, simplified faces, then the levels of each range */
+    fwrite(&header, sizeof(lod_cache_header_t), 1, pFile);
+    fwrite(&model->f[header.cornerStride * CORNERS_PER_FACE * model->numOfFaces], sizeof(uint32_t) * header.cornerStride * CORNERS_PER_FACE, model->numOfLodFaces, pFile);
+    fwrite(lods->levels, sizeof(lod_level_t) * MAX_LOD_LEVELS, lods->rangeCount, pFile);
+
+    fclose(pFile);
+    return VK_TRUE;
+}
+
+
+VkBool32 loadLodCache(char *fileName, model_t *model, lod_list_t *lods, uint32_t sourceHash)
+{
+    FILE *pFile;
+    errno_t err;
+    uint32_t faceStride;
+    uint32_t *faces;
+    lod_level_t *levels;
+    lod_cache_header_t header;
+    VkBool32 valid;
+
+    err = fopen_s(&pFile, fileName, "rb");
+    if (err != 0)
+    {
+        return VK_FALSE;
+    }
+
+    /* The cache has to come from the same faces and ranges */
+    valid = (1 == fread(&header, sizeof(lod_cache_header_t), 1, pFile)) ? VK_TRUE : VK_FALSE;
+    valid = valid && (0 == memcmp(header.magic, LOD_CACHE_MAGIC, 4));
+    valid = valid && (header.version == LOD_CACHE_VERSION);
+    valid = valid && (header.sourceHash == sourceHash);
+    valid = valid && (header.numOfFaces == model->numOfFaces);
+    valid = valid && (header.cornerStride == ((model->numOfNormals == 0) ? 2u : 3u));
+    valid = valid && (header.rangeCount == model->materialChangeCount);
+
+    if(valid)
+    {
+        faceStride = header.cornerStride * CORNERS_PER_FACE;
+        faces = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * faceStride * (header.numOfFaces + header.numOfLodFaces));
+        levels = (lod_level_t *)memAlloc(MEMORY_LOADER, sizeof(lod_level_t) * MAX_LOD_LEVELS * ((header.rangeCount > 0) ? header.rangeCount : 1));
+        memcpy(faces, model->f, sizeof(uint32_t) * faceStride * header.numOfFaces);
+
+        valid = valid && (header.numOfLodFaces == fread(&faces[faceStride * header.numOfFaces], sizeof(uint32_t) * faceStride, header.numOfLodFaces, pFile));
+        valid = valid && (header.rangeCount == fread(levels, sizeof(lod_level_t) * MAX_LOD_LEVELS, header.rangeCount, pFile));
+
+        if(valid)
+        {
+            memFree(model->f);
+            model->f = faces;
+            model->numOfLodFaces = header.numOfLodFaces;
+            memFree(lods->levels);
+            lods->levels = levels;
+            lods->rangeCount = header.rangeCount;
+            printf("\tlod faces:\t\t%d (cached)\n", model->numOfLodFaces);
+        }
+        else
+        {
+            memFree(faces);
+            memFree(levels);
+        }
+    }
+
+    fclose(pFile);
+    return valid;
+}
+
+
+void freeLods(lod_list_t *lods)
+{
+    memFree(lods->levels);
+    memset(lods, 0, sizeof(lod_list_t));
+}
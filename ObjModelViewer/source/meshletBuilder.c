@@ -0,0 +1,406 @@
+#include "meshletBuilder.h"
+
+
+typedef struct _meshlet_state_t
+{
+    /* Faces touching each position, indexed by positionStart */
+    uint32_t *positionStart;
+    uint32_t *positionFaces;
+
+    /* Meshlet that last used a position, to count new vertices */
+    uint32_t *positionStamp;
+    uint8_t *assigned;
+
+    /* Corners of the meshlet being built */
+    uint32_t *corners[MESHLET_MAX_VERTICES];
+    uint32_t positions[MESHLET_MAX_VERTICES];
+    uint32_t vertexCount;
+} meshlet_state_t;
+
+
+static uint32_t cornerStrideOf(model_t *model)
+{
+    /* v/vt or v/vt/vn per corner */
+    return (model->numOfNormals == 0) ? 2 : 3;
+}
+
+
+static void addMeshlet(meshlet_list_t *list, meshlet_t *meshlet)
+{
+    if(list->count == list->capacity)
+    {
+        list->capacity = (list->capacity == 0) ? MIN_TABLE_CAPACITY : (list->capacity*2);
+        list->meshlets = (meshlet_t *)memRealloc(MEMORY_LOADER, list->meshlets, list->capacity * sizeof(meshlet_t));
+    }
+    list->meshlets[list->count++] = *meshlet;
+}
+
+
+static int compareEdges(const void *a, const void *b)
+{
+    const uint64_t ea = *(const uint64_t *)a;
+    const uint64_t eb = *(const uint64_t *)b;
+
+    return (ea < eb) ? -1 : ((ea > eb) ? 1 : 0);
+}
+
+
+VkBool32 isClosedMesh(model_t *model)
+{
+    uint32_t cornerStride = cornerStrideOf(model);
+    uint32_t i, j;
+    uint32_t a, b;
+    uint32_t run;
+    uint64_t *edges;
+    VkBool32 closed = VK_TRUE;
+
+    if(model->numOfFaces == 0)
+    {
+        return VK_FALSE;
+    }
+
+    /* Collect every edge by its two positions, smallest first */
+    edges = (uint64_t *)memAlloc(MEMORY_LOADER, sizeof(uint64_t) * model->numOfFaces * CORNERS_PER_FACE);
+    for(i=0;i<model->numOfFaces;i++)
+    {
+        for(j=0;j<CORNERS_PER_FACE;j++)
+        {
+            a = model->f[(i*CORNERS_PER_FACE + j)*cornerStride];
+            b = model->f[(i*CORNERS_PER_FACE + (j+1)%CORNERS_PER_FACE)*cornerStride];
+            edges[i*CORNERS_PER_FACE + j] = (a < b) ? (((uint64_t)a << 32) | b) : (((uint64_t)b << 32) | a);
+        }
+    }
+
+    /* Closed when each edge is shared by exactly two faces */
+    qsort(edges, model->numOfFaces * CORNERS_PER_FACE, sizeof(uint64_t), compareEdges);
+    for(i=0;i<model->numOfFaces * CORNERS_PER_FACE && closed;i+=run)
+    {
+        for(run=1;(i+run)<model->numOfFaces * CORNERS_PER_FACE && edges[i+run] == edges[i];run++);
+        closed = (run == 2) ? VK_TRUE : VK_FALSE;
+    }
+
+    memFree(edges);
+    return closed;
+}
+
+
+static uint32_t newPositionCount(model_t *model, meshlet_state_t *state, uint32_t cornerStride, uint32_t face, uint32_t stamp)
+{
+    uint32_t j;
+    uint32_t count = 0;
+
+    for(j=0;j<CORNERS_PER_FACE;j++)
+    {
+        if(state->positionStamp[model->f[(face*CORNERS_PER_FACE + j)*cornerStride] - 1] != stamp)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+
+static VkBool32 addFaceToMeshlet(model_t *model, meshlet_state_t *state, uint32_t cornerStride, uint32_t face, uint32_t stamp)
+{
+    uint32_t i, j;
+    uint32_t *corner;
+    uint32_t *newCorners[CORNERS_PER_FACE];
+    uint32_t newCount = 0;
+    VkBool32 found;
+
+    /* A vertex is the whole v/vt/vn corner, seams count twice */
+    for(j=0;j<CORNERS_PER_FACE;j++)
+    {
+        corner = &model->f[(face*CORNERS_PER_FACE + j)*cornerStride];
+        found = VK_FALSE;
+
+        for(i=0;i<state->vertexCount && !found;i++)
+        {
+            found = (0 == memcmp(state->corners[i], corner, cornerStride * sizeof(uint32_t))) ? VK_TRUE : VK_FALSE;
+        }
+
+        for(i=0;i<newCount && !found;i++)
+        {
+            found = (0 == memcmp(newCorners[i], corner, cornerStride * sizeof(uint32_t))) ? VK_TRUE : VK_FALSE;
+        }
+
+        if(!found)
+        {
+            newCorners[newCount++] = corner;
+        }
+    }
+
+    if(state->vertexCount + newCount > MESHLET_MAX_VERTICES)
+    {
+        return VK_FALSE;
+    }
+
+    for(i=0;i<newCount;i++)
+    {
+        state->positions[state->vertexCount] = newCorners[i][0] - 1;
+        state->corners[state->vertexCount++] = newCorners[i];
+    }
+
+    for(j=0;j<CORNERS_PER_FACE;j++)
+    {
+        state->positionStamp[model->f[(face*CORNERS_PER_FACE + j)*cornerStride] - 1] = stamp;
+    }
+
+    state->assigned[face] = 1;
+    return VK_TRUE;
+}
+
+
+static uint32_t findNextFace(model_t *model, meshlet_state_t *state, uint32_t cornerStride, uint32_t startFace, uint32_t endFace, uint32_t stamp)
+{
+    uint32_t i, j;
+    uint32_t face;
+    uint32_t score;
+    uint32_t bestScore = CORNERS_PER_FACE + 1;
+    uint32_t bestFace = MATERIAL_NOT_FOUND;
+
+    /* Prefer the unassigned neighbour adding the fewest positions, then the lowest face */
+    for(i=0;i<state->vertexCount;i++)
+    {
+        for(j=state->positionStart[state->positions[i]];j<state->positionStart[state->positions[i]+1];j++)
+        {
+            face = state->positionFaces[j];
+            if(state->assigned[face] || face < startFace || face >= endFace)
+            {
+                continue;
+            }
+
+            score = newPositionCount(model, state, cornerStride, face, stamp);
+            if(score < bestScore || (score == bestScore && face < bestFace))
+            {
+                bestScore = score;
+                bestFace = face;
+            }
+        }
+    }
+    return bestFace;
+}
+
+
+void buildMeshlets(model_t *model, meshlet_list_t *list)
+{
+    uint32_t i, j;
+    uint32_t range;
+    uint32_t face;
+    uint32_t startFace;
+    uint32_t endFace;
+    uint32_t outFace;
+    uint32_t position;
+    uint32_t *sortedFaces;
+    uint32_t cornerStride = cornerStrideOf(model);
+    uint32_t faceStride = cornerStride * CORNERS_PER_FACE;
+    meshlet_state_t state;
+    meshlet_t meshlet;
+
+    list->count = 0;
+    if(model->materialChangeCount == 0 || model->numOfFaces == 0)
+    {
+        return;
+    }
+
+    /* Faces touching each position */
+    state.positionStart = (uint32_t *)memCalloc(MEMORY_LOADER, model->numOfVertices + 1, sizeof(uint32_t));
+    state.positionFaces = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * model->numOfFaces * CORNERS_PER_FACE);
+    state.positionStamp = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * model->numOfVertices);
+    state.assigned = (uint8_t *)memCalloc(MEMORY_LOADER, model->numOfFaces, sizeof(uint8_t));
+    memset(state.positionStamp, 0xFF, sizeof(uint32_t) * model->numOfVertices);
+
+    for(i=0;i<model->numOfFaces * CORNERS_PER_FACE;i++)
+    {
+        state.positionStart[model->f[i*cornerStride] - 1]++;
+    }
+    for(i=1;i<=model->numOfVertices;i++)
+    {
+        state.positionStart[i] += state.positionStart[i-1];
+    }
+    for(i=model->numOfFaces * CORNERS_PER_FACE;i>0;i--)
+    {
+        position = model->f[(i-1)*cornerStride] - 1;
+        state.positionFaces[--state.positionStart[position]] = (i-1) / CORNERS_PER_FACE;
+    }
+
+    /* Faces before the first usemtl are not drawn, keep them in place */
+    sortedFaces = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * faceStride * model->numOfFaces);
+    outFace = model->materialChange[0].startFace;
+    memcpy(sortedFaces, model->f, sizeof(uint32_t) * faceStride * outFace);
+
+    list->closed = isClosedMesh(model);
+
+    /* Grow meshlets inside each material range, seeded in face order */
+    for(range=0;range<model->materialChangeCount;range++)
+    {
+        startFace = model->materialChange[range].startFace;
+        endFace = (range < model->materialChangeCount - 1) ? model->materialChange[range+1].startFace : model->numOfFaces;
+
+        for(i=startFace;i<endFace;i++)
+        {
+            if(state.assigned[i])
+            {
+                continue;
+            }
+
+            memset(&meshlet, 0, sizeof(meshlet_t));
+            meshlet.firstFace = outFace;
+            meshlet.materialIndex = model->materialChange[range].materialIndex;
+            state.vertexCount = 0;
+
+            for(face=i;face != MATERIAL_NOT_FOUND && meshlet.faceCount < MESHLET_MAX_TRIANGLES;)
+            {
+                if(VK_FALSE == addFaceToMeshlet(model, &state, cornerStride, face, list->count))
+                {
+                    break;
+                }
+
+                memcpy(&sortedFaces[faceStride * outFace++], &model->f[faceStride * face], sizeof(uint32_t) * faceStride);
+                meshlet.faceCount++;
+
+                face = findNextFace(model, &state, cornerStride, startFace, endFace, list->count);
+            }
+
+            meshlet.vertexCount = state.vertexCount;
+            addMeshlet(list, &meshlet);
+        }
+    }
+
+    memFree(model->f);
+    model->f = sortedFaces;
+
+    /* Bounds of each meshlet in the new face order */
+    for(j=0;j<list->count;j++)
+    {
+        list->meshlets[j].sphere = computeBoundingSphere(model->v, model->f, cornerStride, list->meshlets[j].firstFace, list->meshlets[j].faceCount);
+        list->meshlets[j].cone = computeNormalCone(model->v, model->vn, model->f, cornerStride, list->meshlets[j].firstFace, list->meshlets[j].faceCount);
+    }
+
+    printf("\tmeshlets:\t\t%d (%s mesh)\n", list->count, list->closed ? "closed" : "open");
+
+    memFree(state.positionStart);
+    memFree(state.positionFaces);
+    memFree(state.positionStamp);
+    memFree(state.assigned);
+}
+
+
+static uint32_t hashBytes(uint32_t hash, void *data, uint64_t size)
+{
+    uint64_t i;
+    uint8_t *bytes = (uint8_t *)data;
+
+    for(i=0;i<size;i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+uint32_t hashFaces(model_t *model)
+{
+    /* FNV-1a over the face indices of the source file */
+    uint32_t i;
+    uint32_t hash = hashBytes(2166136261u, model->f, sizeof(uint32_t) * cornerStrideOf(model) * CORNERS_PER_FACE * model->numOfFaces);
+
+    /* And the material ranges, a usemtl change moves faces between meshlets or gives them another material */
+    for(i=0;i<model->materialChangeCount;i++)
+    {
+        hash = hashBytes(hash, &model->materialChange[i].startFace, sizeof(uint32_t));
+        hash = hashBytes(hash, &model->materialChange[i].materialIndex, sizeof(uint32_t));
+    }
+    return hash;
+}
+
+
+VkBool32 saveMeshletCache(char *fileName, model_t *model, meshlet_list_t *list, uint32_t sourceHash)
+{
+    FILE *pFile;
+    errno_t err;
+    meshlet_cache_header_t header =
+    {
+        .magic = { MESHLET_CACHE_MAGIC[0], MESHLET_CACHE_MAGIC[1], MESHLET_CACHE_MAGIC[2], MESHLET_CACHE_MAGIC[3] },
+        .version = MESHLET_CACHE_VERSION,
+        .sourceHash = sourceHash,
+        .numOfFaces = model->numOfFaces,
+        .cornerStride = cornerStrideOf(model),
+        .meshletCount = list->count,
+        .closed = list->closed
+    };
+
+    err = fopen_s(&pFile, fileName, "wb");
+    if (err != 0)
+    {
+        printf("Error creating meshlet cache %s\n", fileName);
+        return VK_FALSE;
+    }
+
+    /* Header, reordered faces, then the meshlets */
+    fwrite(&header, sizeof(meshlet_cache_header_t), 1, pFile);
+    fwrite(model->f, sizeof(uint32_t) * header.cornerStride * CORNERS_PER_FACE, model->numOfFaces, pFile);
+    fwrite(list->meshlets, sizeof(meshlet_t), list->count, pFile);
+
+    fclose(pFile);
+    return VK_TRUE;
+}
+
+
+VkBool32 loadMeshletCache(char *fileName, model_t *model, meshlet_list_t *list, uint32_t sourceHash)
+{
+    FILE *pFile;
+    errno_t err;
+    uint32_t *faces;
+    meshlet_cache_header_t header;
+    VkBool32 valid;
+
+    err = fopen_s(&pFile, fileName, "rb");
+    if (err != 0)
+    {
+        return VK_FALSE;
+    }
+
+    /* The cache has to come from the same faces */
+    valid = (1 == fread(&header, sizeof(meshlet_cache_header_t), 1, pFile)) ? VK_TRUE : VK_FALSE;
+    valid = valid && (0 == memcmp(header.magic, MESHLET_CACHE_MAGIC, 4));
+    valid = valid && (header.version == MESHLET_CACHE_VERSION);
+    valid = valid && (header.sourceHash == sourceHash);
+    valid = valid && (header.numOfFaces == model->numOfFaces);
+    valid = valid && (header.cornerStride == cornerStrideOf(model));
+
+    if(valid)
+    {
+        faces = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * header.cornerStride * CORNERS_PER_FACE * header.numOfFaces);
+        list->meshlets = (meshlet_t *)memRealloc(MEMORY_LOADER, list->meshlets, sizeof(meshlet_t) * ((header.meshletCount > 0) ? header.meshletCount : 1));
+        list->capacity = header.meshletCount;
+
+        valid = valid && (header.numOfFaces == fread(faces, sizeof(uint32_t) * header.cornerStride * CORNERS_PER_FACE, header.numOfFaces, pFile));
+        valid = valid && (header.meshletCount == fread(list->meshlets, sizeof(meshlet_t), header.meshletCount, pFile));
+
+        if(valid)
+        {
+            memFree(model->f);
+            model->f = faces;
+            list->count = header.meshletCount;
+            list->closed = header.closed;
+            printf("\tmeshlets:\t\t%d (cached, %s mesh)\n", list->count, list->closed ? "closed" : "open");
+        }
+        else
+        {
+            memFree(faces);
+            list->count = 0;
+        }
+    }
+
+    fclose(pFile);
+    return valid;
+}
+
+
+void freeMeshlets(meshlet_list_t *list)
+{
+    memFree(list->meshlets);
+    memset(list, 0, sizeof(meshlet_list_t));
+}
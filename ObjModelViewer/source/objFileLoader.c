@@ -1,11 +1,14 @@
 #include "objFileLoader.h"
 
+/* Room for the three corners of a face, with or without normals */
+#define EXPANDED_FACE_SIZE          (sizeof(float)*ELEMENTS_PER_FACE*(ELEMENTS_PER_VERTEX+1)*3)
+
 void addFloatData(float **buffer, float *data, uint32_t *numOfData, uint32_t count)
 {
     uint32_t i;
     for(i=0;i<count;i++)
     {
-        *buffer = (float *)realloc(*buffer, ((*numOfData)+1) * sizeof(float));
+        *buffer = (float *)memRealloc(MEMORY_LOADER, *buffer, ((*numOfData)+1) * sizeof(float));
         *(*buffer+(*numOfData)) = *(data+i);
         (*numOfData)++;
     }
@@ -18,7 +21,7 @@ void addIntegerData(uint32_t **buffer, uint32_t *data, uint32_t *numOfData, uint
 
     for(i=0;i<count;i++)
     {
-        *buffer = (uint32_t *)realloc(*buffer, ((*numOfData)+1) * sizeof(uint32_t));
+        *buffer = (uint32_t *)memRealloc(MEMORY_LOADER, *buffer, ((*numOfData)+1) * sizeof(uint32_t));
         *(*buffer+(*numOfData)) = *(data+i);
         (*numOfData)++;
     }
@@ -52,123 +55,463 @@ void setMaterialDefaults(material_t *material)
     material->mp.illum      = 1.0f;
 
     material->mp.imageIndex = 0;
+    material->mp.imageLayer = 0;
     material->mp.shininess  = 32;
 }
 
 
+static uint32_t hashName(char *name)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+
+    while(*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+static void insertMaterialHash(material_table_t *table, uint32_t index)
+{
+    uint32_t slot = hashName(table->entries[index].name) & (table->hashCapacity - 1);
+
+    /* Linear probing, the table is never more than half full */
+    while(table->hashSlots[slot] != MATERIAL_NOT_FOUND)
+    {
+        slot = (slot + 1) & (table->hashCapacity - 1);
+    }
+    table->hashSlots[slot] = index;
+}
+
+
+static void growMaterialHash(material_table_t *table)
+{
+    uint32_t i;
+
+    table->hashCapacity = (table->hashCapacity == 0) ? (MIN_TABLE_CAPACITY*2) : (table->hashCapacity*2);
+    table->hashSlots = (uint32_t *)memRealloc(MEMORY_LOADER, table->hashSlots, table->hashCapacity * sizeof(uint32_t));
+    memset(table->hashSlots, 0xFF, table->hashCapacity * sizeof(uint32_t));
+
+    /* Re-insert all existing materials */
+    for(i=0;i<table->count;i++)
+    {
+        insertMaterialHash(table, i);
+    }
+}
+
+
+uint32_t findMaterial(material_table_t *table, char *name)
+{
+    uint32_t slot;
+
+    if(table->hashCapacity == 0)
+    {
+        return MATERIAL_NOT_FOUND;
+    }
+
+    slot = hashName(name) & (table->hashCapacity - 1);
+    while(table->hashSlots[slot] != MATERIAL_NOT_FOUND)
+    {
+        if(0 == strcmp(table->entries[table->hashSlots[slot]].name, name))
+        {
+            return table->hashSlots[slot];
+        }
+        slot = (slot + 1) & (table->hashCapacity - 1);
+    }
+    return MATERIAL_NOT_FOUND;
+}
+
+
+uint32_t addMaterial(material_table_t *table, char *name)
+{
+    uint32_t index = table->count;
+
+    /* Grow the material array */
+    if(table->count == table->capacity)
+    {
+        table->capacity = (table->capacity == 0) ? MIN_TABLE_CAPACITY : (table->capacity*2);
+        table->entries = (material_t *)memRealloc(MEMORY_LOADER, table->entries, table->capacity * sizeof(material_t));
+    }
+
+    /* Materials named by usemtl but missing from the library keep the defaults */
+    memset(&table->entries[index], 0, sizeof(material_t));
+    setMaterialDefaults(&table->entries[index]);
+    table->entries[index].name = arenaStrdup(&table->strings, name);
+    table->count++;
+
+    /* Keep the lookup at most half full */
+    if(table->count*2 > table->hashCapacity)
+    {
+        growMaterialHash(table);
+    }
+    else
+    {
+        insertMaterialHash(table, index);
+    }
+
+    return index;
+}
+
+
+void freeMaterialTable(material_table_t *table)
+{
+    /* Every name is in the arena */
+    freeArena(&table->strings);
+    memFree(table->entries);
+    memFree(table->hashSlots);
+    memset(table, 0, sizeof(material_table_t));
+}
+
+
+static void addMaterialChange(model_t *model, uint32_t materialIndex)
+{
+    /* Grow the material range array */
+    if(model->materialChangeCount == model->materialChangeCapacity)
+    {
+        model->materialChangeCapacity = (model->materialChangeCapacity == 0) ? MIN_TABLE_CAPACITY : (model->materialChangeCapacity*2);
+        model->materialChange = (material_change_t *)memRealloc(MEMORY_LOADER, model->materialChange, model->materialChangeCapacity * sizeof(material_change_t));
+    }
+
+    /* Mark the start face that uses this material, numOfFaces still counts indices here */
+    model->materialChange[model->materialChangeCount].startFace = model->numOfFaces;
+    model->materialChange[model->materialChangeCount].startFace /= (model->numOfNormals) ? (ELEMENTS_PER_FACE*3) : (ELEMENTS_PER_FACE*2);
+    model->materialChange[model->materialChangeCount].materialIndex = materialIndex;
+    model->materialChangeCount++;
+}
+
+
 char *getPath(char *string)
 {
     char *path = NULL;
     uint64_t position = strlen(string);
 
-    while(position != 0 && string[--position] != '\\');
-
-    path = (char *)malloc(position+2);
-    memset(path, 0, position+2);
-    strncpy_s(path, position+2, string, position+1);
+    /* Either separator, the path ends with a forward slash */
+    while(position != 0 && string[position-1] != '\\' && string[position-1] != '/')
+    {
+        position--;
+    }
 
-    /* Switch to forward slash */
-    path[position] = '/';
+    /* A bare file name is in the working directory */
+    path = (char *)memAlloc(MEMORY_LOADER, position+1);
+    memset(path, 0, position+1);
+    if(position > 0)
+    {
+        strncpy_s(path, position+1, string, position);
+        path[position-1] = '/';
+    }
 
     return path;
 }
 
 
-VkBool32 loadMtlFile(model_t *model, material_t *materials, char *mtlFilename)
+static char *nextToken(char **cursor)
 {
-    char line[STRLEN];
-    char stringName[STRLEN];
-    char keyword[STRLEN];
-    FILE *pFile;
+    char *token;
+
+    while(**cursor == ' ' || **cursor == '\t')
+    {
+        (*cursor)++;
+    }
+
+    token = *cursor;
+    while(**cursor != '\0' && **cursor != ' ' && **cursor != '\t')
+    {
+        (*cursor)++;
+    }
+
+    if(**cursor != '\0')
+    {
+        *(*cursor)++ = '\0';
+    }
+    return token;
+}
+
+
+static void readColor(char *args, vec3_t *color)
+{
+    char *end;
+    float value[3];
     uint32_t i;
-    VkBool32 endOfEntry = VK_FALSE;
-    errno_t err;
 
-    err = fopen_s(&pFile, mtlFilename, "rb");
-    if (err != 0)
+    /* "Kd r [g b]", a single value is grey */
+    for(i=0;i<3;i++)
+    {
+        value[i] = strtof(args, &end);
+        if(end == args)
+        {
+            break;
+        }
+        args = end;
+    }
+
+    if(i == 0)
+    {
+        return;
+    }
+    color->x = value[0];
+    color->y = (i < 3) ? value[0] : value[1];
+    color->z = (i < 3) ? value[0] : value[2];
+}
+
+
+static VkBool32 startsWithNumber(char *string)
+{
+    char *end;
+
+    /* The whole token has to be the number, 1.png is a file name */
+    strtof(string, &end);
+    return (end != string && (*end == '\0' || *end == ' ' || *end == '\t')) ? VK_TRUE : VK_FALSE;
+}
+
+
+static char *readMapFileName(arena_t *strings, char *args)
+{
+    /* Options before the file name and how many values each takes, numeric values may be left out */
+    static const struct { const char *name; uint32_t values; VkBool32 numeric; } options[] =
+    {
+        { "-blendu", 1, VK_FALSE },
+        { "-blendv", 1, VK_FALSE },
+        { "-clamp", 1, VK_FALSE },
+        { "-cc", 1, VK_FALSE },
+        { "-imfchan", 1, VK_FALSE },
+        { "-type", 1, VK_FALSE },
+        { "-boost", 1, VK_TRUE },
+        { "-bm", 1, VK_TRUE },
+        { "-texres", 1, VK_TRUE },
+        { "-mm", 2, VK_TRUE },
+        { "-o", 3, VK_TRUE },
+        { "-s", 3, VK_TRUE },
+        { "-t", 3, VK_TRUE }
+    };
+    char *token;
+    char *end;
+    uint32_t i, j;
+
+    for(;;)
+    {
+        while(*args == ' ' || *args == '\t')
+        {
+            args++;
+        }
+        if(*args != '-')
+        {
+            break;
+        }
+
+        token = nextToken(&args);
+        for(i=0;i<sizeof(options)/sizeof(options[0]) && 0 != strcmp(token, options[i].name);i++);
+        if(i == sizeof(options)/sizeof(options[0]))
+        {
+            continue;
+        }
+
+        for(j=0;j<options[i].values;j++)
+        {
+            while(*args == ' ' || *args == '\t')
+            {
+                args++;
+            }
+            if(options[i].numeric && !startsWithNumber(args))
+            {
+                break;
+            }
+            nextToken(&args);
+        }
+    }
+
+    /* The rest of the line is the file name, it may contain spaces */
+    end = args + strlen(args);
+    while(end > args && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+        end--;
+    }
+    return (end > args) ? arenaStrndup(strings, args, end - args) : NULL;
+}
+
+
+VkBool32 loadMtlFile(model_t *model, material_table_t *table, char *mtlFilename)
+{
+    char line[MTL_LINE_LENGTH];
+    char *args;
+    char *keyword;
+    const char *cursor;
+    const char *end;
+    const char *lineEnd;
+    uint64_t length;
+    uint32_t i;
+    uint32_t referenced = table->count;
+    uint32_t defined = 0;
+    uint32_t unresolved = 0;
+    uint8_t *isDefined;
+    material_t *material = NULL;
+    uint32_t current = MATERIAL_NOT_FOUND;
+    mapped_file_t file;
+
+    (void)model;
+
+    if(0 != mapFile(&file, mtlFilename))
     {
        printf("Error opening MTL file\n");
        return VK_FALSE;
     }
 
-    /* Get the line entry */
-    while(fgets(line, STRLEN, pFile) != NULL)
+    /* Materials usemtl named before the library was read, to report the ones it does not define */
+    isDefined = (uint8_t *)memCalloc(MEMORY_LOADER, referenced + 1, sizeof(uint8_t));
+
+    /* One pass over the mapped file, every material is kept whether the OBJ uses it or not */
+    cursor = file.data;
+    end = file.data + file.size;
+    while(cursor < end)
     {
-        if ( checkPrefix(line, "newmtl ") )
+        lineEnd = (const char *)memchr(cursor, '\n', end - cursor);
+        lineEnd = (NULL == lineEnd) ? end : lineEnd;
+
+        /* Copied so the values can be read as strings, the mapping is not NUL terminated */
+        length = lineEnd - cursor;
+        length = (length < MTL_LINE_LENGTH) ? length : (MTL_LINE_LENGTH - 1);
+        memcpy(line, cursor, length);
+        while(length > 0 && (line[length-1] == '\r' || line[length-1] == ' ' || line[length-1] == '\t'))
         {
-            endOfEntry = VK_FALSE;
-            sscanf_s(line, "%s %s", keyword, STRLEN, stringName, STRLEN);
+            length--;
+        }
+        line[length] = '\0';
+        cursor = lineEnd + 1;
+
+        args = line;
+        keyword = nextToken(&args);
 
-            for(i=0;i<model->materialCount && !endOfEntry;i++)
+        if(0 == strcmp(keyword, "newmtl"))
+        {
+            keyword = nextToken(&args);
+            current = findMaterial(table, keyword);
+            if(MATERIAL_NOT_FOUND == current)
             {
-                /* Check if newmtl matches one of the names in the material list */
-                if( 0 == strcmp(materials[i].name, stringName) )
-                {
-                    /* Set the default values in case the material file does not specify them */
-                    setMaterialDefaults(&materials[i]);
-
-                    /* If so, cycle through each entry until a blank line is found */
-                    while(!endOfEntry)
-                    {
-                        memset(line, 0, STRLEN);
-                        fgets(line, STRLEN, pFile);
-
-                        if( checkPrefix(line, "Ns ") )
-                        {
-                            sscanf_s(line, "%s %f", keyword, STRLEN, &materials[i].mp.Ns);
-                        }
-                        else if( checkPrefix(line, "Ka ") )
-                        {
-                            sscanf_s(line, "%s %f %f %f", keyword, STRLEN, &materials[i].mp.Ka.x, &materials[i].mp.Ka.y, &materials[i].mp.Ka.z);
-                        }
-                        else if( checkPrefix(line, "Kd ") )
-                        {
-                            sscanf_s(line, "%s %f %f %f", keyword, STRLEN, &materials[i].mp.Kd.x, &materials[i].mp.Kd.y, &materials[i].mp.Kd.z);
-                        }
-                        else if( checkPrefix(line, "Ks ") )
-                        {
-                            sscanf_s(line, "%s %f %f %f", keyword, STRLEN, &materials[i].mp.Ks.x, &materials[i].mp.Ks.y, &materials[i].mp.Ks.z);
-                        }
-                        else if( checkPrefix(line, "Ni ") )
-                        {
-                            sscanf_s(line, "%s %f", keyword, STRLEN, &materials[i].mp.Ni);
-                        }
-                        else if( checkPrefix(line, "d ") )
-                        {
-                            sscanf_s(line, "%s %f", keyword, STRLEN, &materials[i].mp.d);
-                        }
-                        else if( checkPrefix(line, "illum ") )
-                        {
-                            sscanf_s(line, "%s %f", keyword, STRLEN, &materials[i].mp.illum);
-                        }
-                        else if( checkPrefix(line, "map_Kd ") )
-                        {
-                            sscanf_s(line, "%s %s", keyword, STRLEN, stringName, STRLEN);
-                            materials[i].fileName = (char *)malloc(strlen(stringName)+1);
-                            memset(materials[i].fileName, 0, strlen(stringName) + 1);
-                            strcpy_s(materials[i].fileName, strlen(stringName) + 1, stringName);
-                        }
-                        else
-                        {
-                            /* Check for blank line */
-                            if ( strlen(line) <= 2 )
-                            {
-                                  endOfEntry = VK_TRUE;
-                            }
-                        }
-                    }
-                }
+                current = addMaterial(table, keyword);
             }
+            else
+            {
+                /* Already named by usemtl, or defined twice, the later definition wins */
+                setMaterialDefaults(&table->entries[current]);
+            }
+
+            if(current < referenced)
+            {
+                isDefined[current] = 1;
+            }
+            defined++;
+            continue;
+        }
+
+        /* Properties before the first newmtl have no material */
+        if(MATERIAL_NOT_FOUND == current || *keyword == '\0' || *keyword == '#')
+        {
+            continue;
+        }
+
+        /* The table may have moved when the material was added */
+        material = &table->entries[current];
+
+        if(0 == strcmp(keyword, "Ns"))
+        {
+            material->mp.Ns = strtof(args, NULL);
+        }
+        else if(0 == strcmp(keyword, "Ka"))
+        {
+            readColor(args, &material->mp.Ka);
+        }
+        else if(0 == strcmp(keyword, "Kd"))
+        {
+            readColor(args, &material->mp.Kd);
+        }
+        else if(0 == strcmp(keyword, "Ks"))
+        {
+            readColor(args, &material->mp.Ks);
+        }
+        else if(0 == strcmp(keyword, "Ni"))
+        {
+            material->mp.Ni = strtof(args, NULL);
+        }
+        else if(0 == strcmp(keyword, "d"))
+        {
+            material->mp.d = strtof(args, NULL);
+        }
+        else if(0 == strcmp(keyword, "Tr"))
+        {
+            material->mp.d = 1.0f - strtof(args, NULL);
+        }
+        else if(0 == strcmp(keyword, "illum"))
+        {
+            material->mp.illum = strtof(args, NULL);
+        }
+        else if(0 == strcmp(keyword, "map_Kd"))
+        {
+            material->fileName = readMapFileName(&table->strings, args);
+        }
+        else if(0 == strcmp(keyword, "map_Ks"))
+        {
+            material->specularFileName = readMapFileName(&table->strings, args);
+        }
+        else if(0 == strcmp(keyword, "map_Bump") || 0 == strcmp(keyword, "map_bump") || 0 == strcmp(keyword, "bump"))
+        {
+            material->bumpFileName = readMapFileName(&table->strings, args);
+        }
+        else if(0 == strcmp(keyword, "map_d"))
+        {
+            material->alphaFileName = readMapFileName(&table->strings, args);
+        }
+        else
+        {
+            /* Do Nothing */
         }
     }
 
-    fclose(pFile);
+    unmapFile(&file);
+
+    /* Resolve the usemtl references now that the whole library is known */
+    for(i=0;i<referenced;i++)
+    {
+        if(!isDefined[i])
+        {
+            printf("\n\tmaterial %s is not in %s, using defaults", table->entries[i].name, mtlFilename);
+            unresolved++;
+        }
+    }
+    if(unresolved > 0)
+    {
+        printf("\n");
+    }
+    memFree(isDefined);
+
+    printf("%d materials, %d referenced, %d unresolved...", defined, referenced, unresolved);
 
     return VK_TRUE;
 }
 
 
-VkBool32 loadObjFile(model_t *model, material_t *materials, char *objFilename)
+static uint32_t parsedFaceCount(model_t *model)
+{
+    /* numOfFaces still counts indices while parsing */
+    return model->numOfFaces / ((model->numOfNormals) ? (ELEMENTS_PER_FACE*3) : (ELEMENTS_PER_FACE*2));
+}
+
+
+static void streamFaces(model_t *model, obj_stream_t *stream, uint32_t *streamedFaces, float *vertices)
+{
+    uint32_t parsedFaces = parsedFaceCount(model);
+
+    if(parsedFaces > *streamedFaces)
+    {
+        expandFaces(model, *streamedFaces, parsedFaces - *streamedFaces, vertices);
+        stream->func(stream->arg, model, *streamedFaces, parsedFaces - *streamedFaces, vertices);
+        *streamedFaces = parsedFaces;
+    }
+}
+
+
+VkBool32 loadObjFile(model_t *model, material_table_t *materials, char *objFilename, obj_stream_t *stream)
 {
     char prefix[STRLEN];
     char line[STRLEN];
@@ -177,8 +520,9 @@ VkBool32 loadObjFile(model_t *model, material_t *materials, char *objFilename)
     float value[3];
     int32_t indices[9];
     FILE *pFile = NULL;
-    VkBool32 haveTexture = VK_FALSE;
     uint32_t i;
+    uint32_t streamedFaces = 0;
+    float *chunkVertices = NULL;
     errno_t err;
 
     /* Open object file */
@@ -189,6 +533,12 @@ VkBool32 loadObjFile(model_t *model, material_t *materials, char *objFilename)
        return VK_FALSE;
     }
 
+    /* Faces are expanded a chunk at a time while streaming, the whole model is expanded again later */
+    if(stream != NULL)
+    {
+        chunkVertices = (float *)memAlloc(MEMORY_LOADER, EXPANDED_FACE_SIZE * OBJ_CHUNK_FACES);
+    }
+
     /* Get the line entry */
     while(fgets(line, STRLEN, pFile) != NULL)
     {
@@ -226,55 +576,35 @@ VkBool32 loadObjFile(model_t *model, material_t *materials, char *objFilename)
                                 &indices[6], &indices[7], &indices[8]);
                 addIntegerData(&model->f, (uint32_t*)indices, &model->numOfFaces, 9);
             }
+
+            /* Hand on every full chunk of faces */
+            if(stream != NULL && parsedFaceCount(model) - streamedFaces >= OBJ_CHUNK_FACES)
+            {
+                streamFaces(model, stream, &streamedFaces, chunkVertices);
+            }
         }
         else if( checkPrefix(line, "usemtl ") )
         {
-            /* Reset flag */
-            haveTexture = VK_FALSE;
-
             sscanf_s(line, "%s %s", keyword, STRLEN, stringName, STRLEN);
 
-            /* Check if we have this texture */
-            for(i=0;i<model->materialCount;i++)
-            {
-                if(0 == strcmp(materials[i].name, stringName))
-                {
-                    /* We have this material already */
-                    haveTexture = VK_TRUE;
-
-                    /* Mark the start face that uses this texture */
-                    model->materialChange[model->materialChangeCount].startFace = model->numOfFaces;
-                    model->materialChange[model->materialChangeCount].startFace /= (ELEMENTS_PER_FACE*ELEMENTS_PER_VERTEX);
-                    model->materialChange[model->materialChangeCount].material = &materials[i];
-                    model->materialChangeCount++;
-                    break;
-                }
-            }
+            /* Check if we have this material */
+            i = findMaterial(materials, stringName);
 
-            /* If we dont have this texture name stored yet */
-            if ( VK_FALSE == haveTexture )
+            /* If we dont have this material name stored yet */
+            if ( MATERIAL_NOT_FOUND == i )
             {
-                /* Add material name */
-                materials[model->materialCount].name = (char *)malloc(strlen(stringName)+1);
-                memset(materials[model->materialCount].name, 0, strlen(stringName)+1);
-                strcpy_s(materials[model->materialCount].name, strlen(stringName)+1, stringName);
-
-                /* Mark the start face that uses this texture */
-                model->materialChange[model->materialChangeCount].startFace = model->numOfFaces;
-                model->materialChange[model->materialChangeCount].startFace /= (ELEMENTS_PER_FACE*ELEMENTS_PER_VERTEX);
-                model->materialChange[model->materialChangeCount].material = &materials[model->materialCount];
-                model->materialChangeCount++;
-
-                /* Increment material count */
-                model->materialCount++;
+                i = addMaterial(materials, stringName);
             }
+
+            /* Mark the start face that uses this material */
+            addMaterialChange(model, i);
         }
         else if( checkPrefix(line, "mtllib ") )
         {
             sscanf_s(line, "%s %s", keyword, STRLEN, stringName, STRLEN);
 
             /* Add material filename */
-            model->materialLibFilename = (char *)malloc(strlen(stringName)+1);
+            model->materialLibFilename = (char *)memAlloc(MEMORY_LOADER, strlen(stringName)+1);
             memset(model->materialLibFilename, 0, strlen(stringName)+1);
             strcpy_s(model->materialLibFilename, strlen(stringName)+1, stringName);
         }
@@ -302,6 +632,13 @@ VkBool32 loadObjFile(model_t *model, material_t *materials, char *objFilename)
         }
     }
 
+    /* The faces after the last full chunk */
+    if(stream != NULL)
+    {
+        streamFaces(model, stream, &streamedFaces, chunkVertices);
+        memFree(chunkVertices);
+    }
+
     model->numOfVertices /= ELEMENTS_PER_VERTEX;
     model->numOfTexCoords /= ELEMENTS_PER_TEXCOORDS;
     model->numOfNormals /= ELEMENTS_PER_VERTEX;
@@ -319,48 +656,51 @@ void cleanUp(model_t *model)
 {
     if( model->vertArray != NULL )
     {
-        free(model->vertArray);
+        memFree(model->vertArray);
     }
 
     if( model->texArray != NULL )
     {
-        free(model->texArray);
+        memFree(model->texArray);
     }
 
     if( model->normArray != NULL )
     {
-        free(model->normArray);
+        memFree(model->normArray);
     }
 }
 
 
-VkBool32 loadModel(model_t *model, material_t *materials, char *objFileName)
+VkBool32 loadModel(model_t *model, material_table_t *materials, char *objFileName, obj_stream_t *stream)
 {
     uint32_t i;
+    uint64_t mtlFileSize;
     char *mtlFile;
     char *path;
 
-    mtlFile = getPath(objFileName);
-    path = getPath(objFileName);
-
     /* Load and parse obj file */
     printf("Loading object file: %s...", objFileName);
 
-    if ( VK_FALSE == loadObjFile(model, materials, objFileName) )
+    if ( VK_FALSE == loadObjFile(model, materials, objFileName, stream) )
     {
         cleanUp(model);
         return VK_FALSE;
     }
     printf("done\n");
 
-    /* Construct material filename */
-    mtlFile = (char*)realloc(mtlFile, (strlen(mtlFile) + strlen(model->materialLibFilename))+1);
-    strncat_s(mtlFile, strlen(mtlFile) + strlen(model->materialLibFilename)+1, model->materialLibFilename, strlen(model->materialLibFilename)+1);
+    /* Construct material filename, the library is next to the OBJ file */
+    path = getPath(objFileName);
+    mtlFileSize = strlen(path) + strlen(model->materialLibFilename) + 1;
+    mtlFile = (char *)memAlloc(MEMORY_LOADER, mtlFileSize);
+    strcpy_s(mtlFile, mtlFileSize, path);
+    strcat_s(mtlFile, mtlFileSize, model->materialLibFilename);
+    memFree(path);
 
     /* Load and parse material file */
     printf("Loading mtl file: %s...", mtlFile);
     if ( VK_FALSE == loadMtlFile(model, materials, mtlFile) )
     {
+        memFree(mtlFile);
         return VK_FALSE;
     }
     printf("done\n");
@@ -370,41 +710,120 @@ VkBool32 loadModel(model_t *model, material_t *materials, char *objFileName)
     printf("\tnormals:\t\t%d\n", model->numOfNormals);
     printf("\tfaces:\t\t\t%d\n", model->numOfFaces);
     printf("\ttotal vertices drawn:\t%d\n", model->numOfFaces*ELEMENTS_PER_FACE);
-    printf("\tmaterials:\t\t%d\n", model->materialCount);
+    printf("\tmaterials:\t\t%d\n", materials->count);
+    printf("\tmaterial ranges:\t%d\n", model->materialChangeCount);
 
-    for(i=0; i<model->materialCount; i++)
+    for(i=0; i<materials->count; i++)
     {
-        printf("\t%3d: %-30s\tfilename: %-30s\n", i, materials[i].name, materials[i].fileName);
+        printf("\t%3d: %-30s\tfilename: %-30s\n", i, materials->entries[i].name, materials->entries[i].fileName);
     }
 
-    free(mtlFile);
-    free(path);
+    memFree(mtlFile);
 
     return VK_TRUE;
 }
 
 
-void prepareObjectArrays(model_t *model)
+void mergeMaterialRanges(model_t *model)
+{
+    uint32_t i, j;
+    uint32_t firstFace;
+    uint32_t endFace;
+    uint32_t numOfBuckets = 0;
+    uint32_t numOfRanges = 0;
+    uint32_t *bucketStart;
+    uint32_t *sortedFaces;
+
+    if(model->materialChangeCount < 2)
+    {
+        return;
+    }
+
+    /* Each face stores v/vt or v/vt/vn for three corners */
+    uint32_t stride = (model->numOfNormals == 0) ? (ELEMENTS_PER_FACE*ELEMENTS_PER_TEXCOORDS) : (ELEMENTS_PER_FACE*ELEMENTS_PER_VERTEX);
+
+    /* Faces before the first usemtl are not drawn, leave them where they are */
+    firstFace = model->materialChange[0].startFace;
+
+    for(i=0;i<model->materialChangeCount;i++)
+    {
+        if(model->materialChange[i].materialIndex + 1 > numOfBuckets)
+        {
+            numOfBuckets = model->materialChange[i].materialIndex + 1;
+        }
+    }
+
+    /* Count the faces per material */
+    bucketStart = (uint32_t *)memCalloc(MEMORY_LOADER, numOfBuckets + 1, sizeof(uint32_t));
+    for(i=0;i<model->materialChangeCount;i++)
+    {
+        endFace = (i < model->materialChangeCount - 1) ? model->materialChange[i+1].startFace : model->numOfFaces;
+        bucketStart[model->materialChange[i].materialIndex + 1] += endFace - model->materialChange[i].startFace;
+    }
+
+    /* Turn the counts into start faces */
+    bucketStart[0] = firstFace;
+    for(i=1;i<=numOfBuckets;i++)
+    {
+        bucketStart[i] += bucketStart[i-1];
+    }
+
+    /* Copy each range to its material, keeping the original face order within a material */
+    sortedFaces = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * stride * model->numOfFaces);
+    memcpy(sortedFaces, model->f, sizeof(uint32_t) * stride * firstFace);
+
+    for(i=0;i<model->materialChangeCount;i++)
+    {
+        endFace = (i < model->materialChangeCount - 1) ? model->materialChange[i+1].startFace : model->numOfFaces;
+        j = model->materialChange[i].materialIndex;
+
+        memcpy(&sortedFaces[stride * bucketStart[j]],
+               &model->f[stride * model->materialChange[i].startFace],
+               sizeof(uint32_t) * stride * (endFace - model->materialChange[i].startFace));
+        bucketStart[j] += endFace - model->materialChange[i].startFace;
+    }
+
+    memFree(model->f);
+    model->f = sortedFaces;
+
+    /* Rebuild one range per used material, bucketStart now holds each end face */
+    for(i=0;i<numOfBuckets;i++)
+    {
+        endFace = bucketStart[i];
+        firstFace = (i == 0) ? model->materialChange[0].startFace : bucketStart[i-1];
+
+        if(endFace > firstFace)
+        {
+            model->materialChange[numOfRanges].startFace = firstFace;
+            model->materialChange[numOfRanges].materialIndex = i;
+            numOfRanges++;
+        }
+    }
+
+    printf("\tmerged material ranges:\t%d -> %d\n", model->materialChangeCount, numOfRanges);
+    model->materialChangeCount = numOfRanges;
+
+    memFree(bucketStart);
+}
+
+
+uint32_t expandFaces(model_t *model, uint32_t firstFace, uint32_t faceCount, float *vertices)
 {
     uint32_t i, j;
     uint32_t v[3];
     uint32_t vt[3];
     uint32_t vn[3];
     uint32_t vc = 0;
+    vec3_t corners[3];
+    vec3_t faceNormal = { 0.0f, 0.0f, 0.0f };
 
     /* Assign pointers to input values */
     uint32_t *faces = (uint32_t *)model->f;
 
-    uint32_t totalSize = (sizeof(float)*model->numOfFaces*(ELEMENTS_PER_FACE*(ELEMENTS_PER_VERTEX+1))) * 2 \
-                          + sizeof(float)*model->numOfFaces*(ELEMENTS_PER_FACE*(ELEMENTS_PER_VERTEX+1));
-
-    /* Create vertex and texture buffers */
-    model->vertArray = (float *)malloc(totalSize);
-
     uint32_t stride = (model->numOfNormals == 0) ? (ELEMENTS_PER_FACE*ELEMENTS_PER_TEXCOORDS) : (ELEMENTS_PER_FACE*ELEMENTS_PER_VERTEX);
     uint32_t offset = (model->numOfNormals == 0) ? 0 : 1;
 
-    for(i=0;i<model->numOfFaces;i++)
+    for(i=firstFace;i<firstFace+faceCount;i++)
     {
         /* Get offsets from face inputs */
         v[0]  = faces[(stride*i)+0]-1;
@@ -414,13 +833,23 @@ void prepareObjectArrays(model_t *model)
         v[2]  = faces[(stride*i)+4+(offset*2)]-1;
         vt[2] = faces[(stride*i)+5+(offset*2)]-1;
 
-        /* Load vertices */
+        /* Without normals in the file every corner gets the face's, counter clockwise faces the front */
+        if(model->numOfNormals == 0)
+        {
+            for(j=0; j<3; j++)
+            {
+                corners[j] = (vec3_t){ model->v[v[j]*ELEMENTS_PER_VERTEX + 0], model->v[v[j]*ELEMENTS_PER_VERTEX + 1], model->v[v[j]*ELEMENTS_PER_VERTEX + 2] };
+            }
+            faceNormal = normalize(crossProd(subProd(corners[1], corners[0]), subProd(corners[2], corners[0])));
+        }
+
+        /* Load vertices, always laid out like vertexData_t */
         for(j=0; j<3; j++)
         {
-            model->vertArray[vc++] = *(model->v + (v[j]*ELEMENTS_PER_VERTEX + 0));
-            model->vertArray[vc++] = *(model->v + (v[j]*ELEMENTS_PER_VERTEX + 1));
-            model->vertArray[vc++] = *(model->v + (v[j]*ELEMENTS_PER_VERTEX + 2));
-            model->vertArray[vc++] = 1.0f;
+            vertices[vc++] = *(model->v + (v[j]*ELEMENTS_PER_VERTEX + 0));
+            vertices[vc++] = *(model->v + (v[j]*ELEMENTS_PER_VERTEX + 1));
+            vertices[vc++] = *(model->v + (v[j]*ELEMENTS_PER_VERTEX + 2));
+            vertices[vc++] = 1.0f;
 
             /* If this file contains normals */
             if(model->numOfNormals != 0)
@@ -429,14 +858,48 @@ void prepareObjectArrays(model_t *model)
                 vn[1] = faces[(stride*i)+5]-1;
                 vn[2] = faces[(stride*i)+8]-1;
 
-                model->vertArray[vc++] = *(model->vn + (vn[j]*ELEMENTS_PER_VERTEX + 0));
-                model->vertArray[vc++] = *(model->vn + (vn[j]*ELEMENTS_PER_VERTEX + 1));
-                model->vertArray[vc++] = *(model->vn + (vn[j]*ELEMENTS_PER_VERTEX + 2));
-                model->vertArray[vc++] = 0.0f;
+                vertices[vc++] = *(model->vn + (vn[j]*ELEMENTS_PER_VERTEX + 0));
+                vertices[vc++] = *(model->vn + (vn[j]*ELEMENTS_PER_VERTEX + 1));
+                vertices[vc++] = *(model->vn + (vn[j]*ELEMENTS_PER_VERTEX + 2));
             }
+            else
+            {
+                vertices[vc++] = faceNormal.x;
+                vertices[vc++] = faceNormal.y;
+                vertices[vc++] = faceNormal.z;
+            }
+            vertices[vc++] = 0.0f;
 
-            model->vertArray[vc++] = *(model->vt + (vt[j]*ELEMENTS_PER_TEXCOORDS + 0));
-            model->vertArray[vc++] = *(model->vt + (vt[j]*ELEMENTS_PER_TEXCOORDS + 1));
+            vertices[vc++] = *(model->vt + (vt[j]*ELEMENTS_PER_TEXCOORDS + 0));
+            vertices[vc++] = *(model->vt + (vt[j]*ELEMENTS_PER_TEXCOORDS + 1));
         }
     }
+
+    return vc;
+}
+
+
+void prepareObjectArrays(model_t *model)
+{
+    /* Simplified levels are expanded after the source faces */
+    uint32_t drawnFaces = model->numOfFaces + model->numOfLodFaces;
+
+    /* Create vertex and texture buffers */
+    model->vertArray = (float *)memAlloc(MEMORY_LOADER, EXPANDED_FACE_SIZE * drawnFaces);
+
+    expandFaces(model, 0, drawnFaces, model->vertArray);
+}
+
+
+void releaseParsedArrays(model_t *model)
+{
+    /* The counts and material ranges stay, they describe what was drawn from these arrays */
+    memFree(model->v);
+    memFree(model->vt);
+    memFree(model->vn);
+    memFree(model->f);
+    model->v = NULL;
+    model->vt = NULL;
+    model->vn = NULL;
+    model->f = NULL;
 }
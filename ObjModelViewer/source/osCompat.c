@@ -0,0 +1,190 @@
+#include "osCompat.h"
+
+#if !defined(_WIN32) && !defined(__STDC_LIB_EXT1__)
+
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+
+errno_t fopen_s(FILE **file, const char *fileName, const char *mode)
+{
+    *file = fopen(fileName, mode);
+    return (NULL == *file) ? errno : 0;
+}
+
+
+int sscanf_s(const char *buffer, const char *format, ...)
+{
+    va_list args;
+    char scanFormat[COMPAT_SCANF_FORMAT_SIZE];
+    void *pointers[COMPAT_SCANF_MAX_ARGS] = { NULL };
+    uint32_t pointerCount = 0;
+    uint32_t length = 0;
+    uint32_t size;
+    const char *cursor = format;
+    const char *spec;
+    int suppressed;
+    int hasWidth;
+
+    va_start(args, format);
+    while(*cursor != '\0' && length + 16 < COMPAT_SCANF_FORMAT_SIZE)
+    {
+        if(*cursor != '%')
+        {
+            scanFormat[length++] = *cursor++;
+            continue;
+        }
+
+        scanFormat[length++] = *cursor++;
+        if('%' == *cursor)
+        {
+            scanFormat[length++] = *cursor++;
+            continue;
+        }
+
+        /* Flags, width and length modifiers are copied as they are */
+        spec = cursor;
+        suppressed = ('*' == *cursor);
+        cursor += suppressed ? 1 : 0;
+        hasWidth = (*cursor >= '0' && *cursor <= '9');
+        while(*cursor >= '0' && *cursor <= '9')
+        {
+            cursor++;
+        }
+        while(NULL != strchr("hlLjzt", *cursor) && *cursor != '\0')
+        {
+            cursor++;
+        }
+        memcpy(&scanFormat[length], spec, cursor - spec);
+        length += (uint32_t)(cursor - spec);
+
+        if(suppressed)
+        {
+            scanFormat[length++] = *cursor++;
+            continue;
+        }
+
+        if(pointerCount < COMPAT_SCANF_MAX_ARGS)
+        {
+            pointers[pointerCount++] = va_arg(args, void *);
+        }
+
+        /* Strings, characters and sets are followed by the size of their buffer, it becomes the width */
+        if('s' == *cursor || 'c' == *cursor || '[' == *cursor)
+        {
+            size = va_arg(args, unsigned int);
+            if(!hasWidth && 's' == *cursor && size > 0)
+            {
+                length += (uint32_t)snprintf(&scanFormat[length], COMPAT_SCANF_FORMAT_SIZE - length, "%u", size - 1);
+            }
+        }
+
+        /* A set is copied up to its closing bracket, which may be its first member */
+        if('[' == *cursor)
+        {
+            scanFormat[length++] = *cursor++;
+            if('^' == *cursor)
+            {
+                scanFormat[length++] = *cursor++;
+            }
+            if(']' == *cursor)
+            {
+                scanFormat[length++] = *cursor++;
+            }
+            while(*cursor != '\0' && *cursor != ']' && length + 2 < COMPAT_SCANF_FORMAT_SIZE)
+            {
+                scanFormat[length++] = *cursor++;
+            }
+        }
+
+        if(*cursor != '\0')
+        {
+            scanFormat[length++] = *cursor++;
+        }
+    }
+    scanFormat[length] = '\0';
+    va_end(args);
+
+    /* Arguments past the ones the format uses are ignored */
+    return sscanf(buffer, scanFormat,
+        pointers[0], pointers[1], pointers[2], pointers[3], pointers[4], pointers[5], pointers[6], pointers[7],
+        pointers[8], pointers[9], pointers[10], pointers[11], pointers[12], pointers[13], pointers[14], pointers[15]);
+}
+
+
+errno_t strcpy_s(char *dest, size_t destSize, const char *src)
+{
+    size_t length = strlen(src);
+
+    /* Like the CRT, a string that does not fit leaves the destination empty */
+    if(length >= destSize)
+    {
+        if(destSize > 0)
+        {
+            dest[0] = '\0';
+        }
+        return ERANGE;
+    }
+
+    memcpy(dest, src, length + 1);
+    return 0;
+}
+
+
+errno_t strcat_s(char *dest, size_t destSize, const char *src)
+{
+    size_t used = strnlen(dest, destSize);
+
+    if(used == destSize)
+    {
+        return EINVAL;
+    }
+
+    /* The whole destination is emptied when the result does not fit */
+    if(0 != strcpy_s(dest + used, destSize - used, src))
+    {
+        dest[0] = '\0';
+        return ERANGE;
+    }
+    return 0;
+}
+
+
+errno_t strncpy_s(char *dest, size_t destSize, const char *src, size_t count)
+{
+    size_t length = strnlen(src, count);
+
+    if(length >= destSize)
+    {
+        if(destSize > 0)
+        {
+            dest[0] = '\0';
+        }
+        return ERANGE;
+    }
+
+    memcpy(dest, src, length);
+    dest[length] = '\0';
+    return 0;
+}
+
+
+errno_t strncat_s(char *dest, size_t destSize, const char *src, size_t count)
+{
+    size_t used = strnlen(dest, destSize);
+
+    if(used == destSize)
+    {
+        return EINVAL;
+    }
+
+    if(0 != strncpy_s(dest + used, destSize - used, src, count))
+    {
+        dest[0] = '\0';
+        return ERANGE;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "osFile.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+int32_t mapFile(mapped_file_t *file, const char *fileName)
+{
+    memset(file, 0, sizeof(mapped_file_t));
+
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    file->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(INVALID_HANDLE_VALUE == file->file)
+    {
+        return -1;
+    }
+
+    if(!GetFileSizeEx(file->file, &size))
+    {
+        CloseHandle(file->file);
+        return -1;
+    }
+    file->size = (uint64_t)size.QuadPart;
+
+    /* Empty files cannot be mapped, they are returned with no data */
+    if(0 == file->size)
+    {
+        return 0;
+    }
+
+    file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(NULL == file->mapping)
+    {
+        CloseHandle(file->file);
+        return -1;
+    }
+
+    file->data = (const char *)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+    if(NULL == file->data)
+    {
+        CloseHandle(file->mapping);
+        CloseHandle(file->file);
+        return -1;
+    }
+#else
+    struct stat info;
+    void *data;
+
+    file->fd = open(fileName, O_RDONLY);
+    if(file->fd < 0)
+    {
+        return -1;
+    }
+
+    if(0 != fstat(file->fd, &info))
+    {
+        close(file->fd);
+        return -1;
+    }
+    file->size = (uint64_t)info.st_size;
+
+    if(0 == file->size)
+    {
+        return 0;
+    }
+
+    data = mmap(NULL, (size_t)file->size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+    if(MAP_FAILED == data)
+    {
+        close(file->fd);
+        return -1;
+    }
+
+    /* Read front to back once */
+    madvise(data, (size_t)file->size, MADV_SEQUENTIAL);
+    file->data = (const char *)data;
+#endif
+
+    return 0;
+}
+
+
+void unmapFile(mapped_file_t *file)
+{
+#ifdef _WIN32
+    if(NULL != file->data)
+    {
+        UnmapViewOfFile(file->data);
+        CloseHandle(file->mapping);
+    }
+    CloseHandle(file->file);
+#else
+    if(NULL != file->data)
+    {
+        munmap((void *)file->data, (size_t)file->size);
+    }
+    close(file->fd);
+#endif
+    memset(file, 0, sizeof(mapped_file_t));
+}
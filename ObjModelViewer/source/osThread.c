@@ -0,0 +1,155 @@
+#include "osThread.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+static DWORD WINAPI threadEntry(LPVOID param)
+#else
+static void *threadEntry(void *param)
+#endif
+{
+    thread_t *thread = (thread_t *)param;
+
+    thread->func(thread->arg);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+
+int32_t createThread(thread_t *thread, threadFunc_t func, void *arg)
+{
+    /* The thread keeps a pointer to this struct until it is joined */
+    thread->func = func;
+    thread->arg = arg;
+
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, threadEntry, thread, 0, NULL);
+    return (NULL != thread->handle) ? 0 : -1;
+#else
+    return (0 == pthread_create(&thread->handle, NULL, threadEntry, thread)) ? 0 : -1;
+#endif
+}
+
+
+void joinThread(thread_t *thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
+
+uint32_t getCpuCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (uint32_t)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (count > 0) ? (uint32_t)count : 1;
+#endif
+}
+
+
+void createMutex(mutex_t *mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_init(&mutex->handle, NULL);
+#endif
+}
+
+
+void lockMutex(mutex_t *mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+
+void unlockMutex(mutex_t *mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+
+void destroyMutex(mutex_t *mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_destroy(&mutex->handle);
+#endif
+}
+
+
+void createCondition(condition_t *condition)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(&condition->handle);
+#else
+    pthread_cond_init(&condition->handle, NULL);
+#endif
+}
+
+
+void waitCondition(condition_t *condition, mutex_t *mutex)
+{
+    /* The mutex is released while waiting and held again on return, wakeups can be spurious */
+#ifdef _WIN32
+    SleepConditionVariableCS(&condition->handle, &mutex->handle, INFINITE);
+#else
+    pthread_cond_wait(&condition->handle, &mutex->handle);
+#endif
+}
+
+
+void signalCondition(condition_t *condition)
+{
+#ifdef _WIN32
+    WakeConditionVariable(&condition->handle);
+#else
+    pthread_cond_signal(&condition->handle);
+#endif
+}
+
+
+void broadcastCondition(condition_t *condition)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(&condition->handle);
+#else
+    pthread_cond_broadcast(&condition->handle);
+#endif
+}
+
+
+void destroyCondition(condition_t *condition)
+{
+#ifdef _WIN32
+    (void)condition;
+#else
+    pthread_cond_destroy(&condition->handle);
+#endif
+}
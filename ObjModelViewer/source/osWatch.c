@@ -0,0 +1,337 @@
+#include "osWatch.h"
+#include "perfTimer.h"
+#include "hostMemory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+/* Linux reports directory changes, other systems without notifications poll the files */
+#if !defined(_WIN32) && defined(__linux__)
+#define WATCH_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+
+static int32_t statFile(const char *fileName, int64_t *modified, uint64_t *size)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+
+    if(!GetFileAttributesExA(fileName, GetFileExInfoStandard, &data))
+    {
+        return -1;
+    }
+    *modified = ((int64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    *size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat info;
+
+    if(0 != stat(fileName, &info))
+    {
+        return -1;
+    }
+    /* The nanosecond field has a different name on macOS and the BSDs, the build checks which one there is */
+#if defined(HAVE_STAT_ST_MTIM)
+    *modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#elif defined(HAVE_STAT_ST_MTIMESPEC)
+    *modified = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    /* Whole seconds, a save within the same second still shows in the size */
+    *modified = (int64_t)info.st_mtime * 1000000000;
+#endif
+    *size = (uint64_t)info.st_size;
+#endif
+
+    return 0;
+}
+
+
+static char *directoryOf(const char *fileName)
+{
+    char *path;
+    size_t length = strlen(fileName);
+
+    /* Either separator, a bare file name is in the working directory */
+    while(length > 0 && fileName[length - 1] != '\\' && fileName[length - 1] != '/')
+    {
+        length--;
+    }
+    if(0 == length)
+    {
+        fileName = ".";
+        length = 1;
+    }
+
+    path = (char *)memAlloc(MEMORY_LOADER, length + 1);
+    if(NULL == path)
+    {
+        return NULL;
+    }
+    memcpy(path, fileName, length);
+    path[length] = '\0';
+    return path;
+}
+
+
+static int32_t addDirectory(file_watcher_t *watcher, const char *fileName, uint32_t *index)
+{
+    uint32_t i;
+    uint32_t capacity;
+    char *path = directoryOf(fileName);
+    watched_directory_t *directory;
+    watched_directory_t *directories;
+
+    if(NULL == path)
+    {
+        return -1;
+    }
+
+    for(i=0;i<watcher->directoryCount;i++)
+    {
+        if(0 == strcmp(watcher->directories[i].path, path))
+        {
+            memFree(path);
+            *index = i;
+            return 0;
+        }
+    }
+
+    /* The directories watched so far stay as they are when the array cannot grow */
+    if(watcher->directoryCount == watcher->directoryCapacity)
+    {
+        capacity = (watcher->directoryCapacity == 0) ? WATCH_MIN_CAPACITY : (watcher->directoryCapacity*2);
+        directories = (watched_directory_t *)memRealloc(MEMORY_LOADER, watcher->directories, capacity * sizeof(watched_directory_t));
+        if(NULL == directories)
+        {
+            memFree(path);
+            return -1;
+        }
+        watcher->directories = directories;
+        watcher->directoryCapacity = capacity;
+    }
+
+    directory = &watcher->directories[watcher->directoryCount];
+    memset(directory, 0, sizeof(watched_directory_t));
+    directory->path = path;
+
+    /* Writes, and files replaced by a rename, which is how many editors save */
+#ifdef _WIN32
+    directory->handle = FindFirstChangeNotificationA(path, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+    if(INVALID_HANDLE_VALUE == directory->handle)
+#elif defined(WATCH_INOTIFY)
+    directory->wd = inotify_add_watch(watcher->fd, path, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if(directory->wd < 0)
+#else
+    /* Polled, the directory only has to exist */
+    directory->wd = -1;
+    if(0 != access(path, F_OK))
+#endif
+    {
+        memFree(path);
+        return -1;
+    }
+
+    *index = watcher->directoryCount++;
+    return 0;
+}
+
+
+int32_t initFileWatcher(file_watcher_t *watcher)
+{
+    memset(watcher, 0, sizeof(file_watcher_t));
+
+#if defined(WATCH_INOTIFY)
+    /* Read without blocking from the render loop */
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher->fd < 0)
+    {
+        return -1;
+    }
+#elif !defined(_WIN32)
+    watcher->fd = -1;
+#endif
+
+    return 0;
+}
+
+
+int32_t watchFile(file_watcher_t *watcher, const char *fileName, uint32_t kind, uint32_t index)
+{
+    uint32_t i;
+    uint32_t directory;
+    uint32_t capacity;
+    char *name;
+    watched_file_t *file = NULL;
+    watched_file_t *files;
+
+    if(0 != addDirectory(watcher, fileName, &directory))
+    {
+        return -1;
+    }
+
+    /* Copied first, a failure leaves the file watched before untouched */
+    name = (char *)memAlloc(MEMORY_LOADER, strlen(fileName) + 1);
+    if(NULL == name)
+    {
+        return -1;
+    }
+    strcpy(name, fileName);
+
+    /* A kind and index watch one file, watching another one replaces it */
+    for(i=0;i<watcher->fileCount;i++)
+    {
+        if(watcher->files[i].kind == kind && watcher->files[i].index == index)
+        {
+            file = &watcher->files[i];
+            memFree(file->fileName);
+            break;
+        }
+    }
+
+    if(NULL == file)
+    {
+        if(watcher->fileCount == watcher->fileCapacity)
+        {
+            capacity = (watcher->fileCapacity == 0) ? WATCH_MIN_CAPACITY : (watcher->fileCapacity*2);
+            files = (watched_file_t *)memRealloc(MEMORY_LOADER, watcher->files, capacity * sizeof(watched_file_t));
+            if(NULL == files)
+            {
+                memFree(name);
+                return -1;
+            }
+            watcher->files = files;
+            watcher->fileCapacity = capacity;
+        }
+        file = &watcher->files[watcher->fileCount++];
+    }
+
+    memset(file, 0, sizeof(watched_file_t));
+    file->fileName = name;
+    file->directory = directory;
+    file->kind = kind;
+    file->index = index;
+
+    /* Changes count from now, a missing file is reported once it appears */
+    statFile(fileName, &file->modified, &file->size);
+    return 0;
+}
+
+
+uint32_t pollFileChanges(file_watcher_t *watcher, file_change_t *changes, uint32_t maxChanges)
+{
+    uint32_t i;
+    uint32_t count = 0;
+    int64_t modified;
+    uint64_t size;
+    double now;
+    watched_file_t *file;
+#ifdef WATCH_INOTIFY
+    char buffer[WATCH_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    ssize_t length;
+    char *cursor;
+#endif
+
+#ifdef _WIN32
+    /* Signalled notifications are re-armed straight away, the files are compared below */
+    for(i=0;i<watcher->directoryCount;i++)
+    {
+        if(WAIT_OBJECT_0 == WaitForSingleObject(watcher->directories[i].handle, 0))
+        {
+            watcher->directories[i].changed = 1;
+            FindNextChangeNotification(watcher->directories[i].handle);
+        }
+    }
+#elif defined(WATCH_INOTIFY)
+    /* Drain every queued event, only which directory changed is kept */
+    while((length = read(watcher->fd, buffer, sizeof(buffer))) > 0)
+    {
+        for(cursor = buffer; cursor < buffer + length; cursor += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event *)cursor;
+            for(i=0;i<watcher->directoryCount;i++)
+            {
+                if(watcher->directories[i].wd == event->wd)
+                {
+                    watcher->directories[i].changed = 1;
+                }
+            }
+        }
+    }
+#else
+    /* Nothing tells which directory changed, all of them are compared a few times a second */
+    if(getTimeMs() - watcher->polledMs >= WATCH_POLL_MS)
+    {
+        watcher->polledMs = getTimeMs();
+        for(i=0;i<watcher->directoryCount;i++)
+        {
+            watcher->directories[i].changed = 1;
+        }
+    }
+#endif
+
+    now = getTimeMs();
+    for(i=0;i<watcher->fileCount;i++)
+    {
+        file = &watcher->files[i];
+
+        /* A file that is gone may be halfway through being replaced, it is looked at again on the next event */
+        if(watcher->directories[file->directory].changed && 0 == statFile(file->fileName, &modified, &size) &&
+           (modified != file->modified || size != file->size))
+        {
+            file->modified = modified;
+            file->size = size;
+            file->changedMs = now;
+        }
+
+        if(file->changedMs > 0.0 && now - file->changedMs >= WATCH_SETTLE_MS && count < maxChanges)
+        {
+            changes[count++] = (file_change_t){ file->kind, file->index };
+            file->changedMs = 0.0;
+        }
+    }
+
+    for(i=0;i<watcher->directoryCount;i++)
+    {
+        watcher->directories[i].changed = 0;
+    }
+
+    return count;
+}
+
+
+void destroyFileWatcher(file_watcher_t *watcher)
+{
+    uint32_t i;
+
+    for(i=0;i<watcher->directoryCount;i++)
+    {
+#ifdef _WIN32
+        FindCloseChangeNotification(watcher->directories[i].handle);
+#elif defined(WATCH_INOTIFY)
+        inotify_rm_watch(watcher->fd, watcher->directories[i].wd);
+#endif
+        memFree(watcher->directories[i].path);
+    }
+
+    for(i=0;i<watcher->fileCount;i++)
+    {
+        memFree(watcher->files[i].fileName);
+    }
+
+#ifdef WATCH_INOTIFY
+    if(watcher->fd >= 0)
+    {
+        close(watcher->fd);
+    }
+#endif
+
+    memFree(watcher->files);
+    memFree(watcher->directories);
+    memset(watcher, 0, sizeof(file_watcher_t));
+}
@@ -0,0 +1,416 @@
+#include "scene.h"
+
+
+static uint32_t cornerStrideOf(model_t *model)
+{
+    /* v/vt or v/vt/vn per corner */
+    return (model->numOfNormals == 0) ? 2 : 3;
+}
+
+
+static vec3_t transformPoint(float *mat, vec3_t p)
+{
+    /* Row vector times matrix, the translation is in mat[3], mat[7] and mat[11] like the shaders */
+    return (vec3_t)
+    {
+        mat[0]*p.x + mat[1]*p.y + mat[2]*p.z + mat[3],
+        mat[4]*p.x + mat[5]*p.y + mat[6]*p.z + mat[7],
+        mat[8]*p.x + mat[9]*p.y + mat[10]*p.z + mat[11]
+    };
+}
+
+
+static float transformScale(float *mat)
+{
+    uint32_t j;
+    float length;
+    float scale = 0.0f;
+
+    /* Longest image of a unit axis, exact for rotations and scales */
+    for(j=0;j<3;j++)
+    {
+        length = sqrtf(mat[j]*mat[j] + mat[4+j]*mat[4+j] + mat[8+j]*mat[8+j]);
+        scale = (length > scale) ? length : scale;
+    }
+    return scale;
+}
+
+
+static boundingSphere_t mergeSpheres(boundingSphere_t a, boundingSphere_t b)
+{
+    vec3_t offset = subProd(b.center, a.center);
+    float distance = sqrtf(dotProd(offset, offset));
+    float radius;
+
+    /* One sphere already holds the other */
+    if(distance + b.radius <= a.radius)
+    {
+        return a;
+    }
+    if(distance + a.radius <= b.radius)
+    {
+        return b;
+    }
+
+    radius = (distance + a.radius + b.radius) * 0.5f;
+    return (boundingSphere_t){ addProd(a.center, scalarProd(offset, (radius - a.radius) / distance)), radius };
+}
+
+
+static char *materialLibraryPath(scene_mesh_t *mesh)
+{
+    char *path = getPath(mesh->fileName);
+    uint64_t fileNameSize;
+    char *fileName;
+
+    /* Next to the OBJ file, like loadModel reads it */
+    fileNameSize = strlen(path) + strlen(mesh->model.materialLibFilename) + 1;
+    fileName = (char *)memAlloc(MEMORY_LOADER, fileNameSize);
+    strcpy_s(fileName, fileNameSize, path);
+    strcat_s(fileName, fileNameSize, mesh->model.materialLibFilename);
+    memFree(path);
+    return fileName;
+}
+
+
+static void freeSceneMesh(scene_mesh_t *mesh)
+{
+    releaseParsedArrays(&mesh->model);
+    memFree(mesh->model.materialChange);
+    memFree(mesh->model.materialLibFilename);
+    memFree(mesh->mtlFileName);
+    freeMaterialTable(&mesh->materials);
+    freeMeshlets(&mesh->meshlets);
+    freeLods(&mesh->lods);
+}
+
+
+VkBool32 addSceneModel(scene_t *scene, char *objFileName, uint32_t instanceCount)
+{
+    uint32_t i;
+    scene_mesh_t *mesh;
+
+    /* Repeated files share one mesh */
+    for(i=0;i<scene->meshCount;i++)
+    {
+        if(0 == strcmp(scene->meshes[i].fileName, objFileName))
+        {
+            scene->meshes[i].instanceCount += instanceCount;
+            return VK_TRUE;
+        }
+    }
+
+    if(scene->meshCount == scene->meshCapacity)
+    {
+        scene->meshCapacity = (scene->meshCapacity == 0) ? MIN_TABLE_CAPACITY : (scene->meshCapacity*2);
+        scene->meshes = (scene_mesh_t *)memRealloc(MEMORY_LOADER, scene->meshes, scene->meshCapacity * sizeof(scene_mesh_t));
+    }
+
+    mesh = &scene->meshes[scene->meshCount];
+    memset(mesh, 0, sizeof(scene_mesh_t));
+    mesh->fileName = objFileName;
+    mesh->instanceCount = instanceCount;
+
+    if(VK_FALSE == loadModel(&mesh->model, &mesh->materials, objFileName, (scene->stream.func != NULL) ? &scene->stream : NULL))
+    {
+        freeMaterialTable(&mesh->materials);
+        return VK_FALSE;
+    }
+    mesh->mtlFileName = materialLibraryPath(mesh);
+
+    scene->meshCount++;
+    return VK_TRUE;
+}
+
+
+VkBool32 reloadSceneModel(scene_t *scene, scene_t *previous, uint32_t meshIndex)
+{
+    uint32_t i;
+    scene_mesh_t *mesh;
+    scene_mesh_t *old = &previous->meshes[meshIndex];
+
+    /* The other meshes are shared with the previous scene, the tables buildScene makes from them are new */
+    memset(scene, 0, sizeof(scene_t));
+    scene->meshes = (scene_mesh_t *)memAlloc(MEMORY_LOADER, previous->meshCount * sizeof(scene_mesh_t));
+    memcpy(scene->meshes, previous->meshes, previous->meshCount * sizeof(scene_mesh_t));
+    scene->meshCount = previous->meshCount;
+    scene->meshCapacity = previous->meshCount;
+
+    mesh = &scene->meshes[meshIndex];
+    memset(mesh, 0, sizeof(scene_mesh_t));
+    mesh->fileName = old->fileName;
+    mesh->instanceCount = old->instanceCount;
+
+    /* Seeded with the old names so those materials keep their indices, new ones follow them */
+    for(i=0;i<old->materials.count;i++)
+    {
+        addMaterial(&mesh->materials, old->materials.entries[i].name);
+    }
+
+    if(VK_FALSE == loadModel(&mesh->model, &mesh->materials, mesh->fileName, NULL))
+    {
+        freeSceneMesh(mesh);
+        memFree(scene->meshes);
+        memset(scene, 0, sizeof(scene_t));
+        return VK_FALSE;
+    }
+    mesh->mtlFileName = materialLibraryPath(mesh);
+
+    return VK_TRUE;
+}
+
+
+VkBool32 reloadSceneMaterials(scene_t *scene, uint32_t meshIndex, uint32_t *retextured, uint32_t *retexturedCount)
+{
+    uint32_t i;
+    uint64_t fileNameSize;
+    char *path;
+    char *fileName;
+    uint8_t *used;
+    material_t *entry;
+    material_t *material;
+    material_table_t table = { 0 };
+    scene_mesh_t *mesh = &scene->meshes[meshIndex];
+
+    *retexturedCount = 0;
+
+    /* The library is read into a table seeded with the mesh's names, so every material keeps its index */
+    for(i=0;i<mesh->materials.count;i++)
+    {
+        addMaterial(&table, mesh->materials.entries[i].name);
+    }
+
+    printf("Reloading mtl file: %s...", mesh->mtlFileName);
+    if(VK_FALSE == loadMtlFile(&mesh->model, &table, mesh->mtlFileName))
+    {
+        freeMaterialTable(&table);
+        return VK_FALSE;
+    }
+    printf("done\n");
+
+    /* Like buildScene, materials no range uses have no texture */
+    used = (uint8_t *)memCalloc(MEMORY_LOADER, mesh->materials.count + 1, sizeof(uint8_t));
+    for(i=0;i<mesh->model.materialChangeCount;i++)
+    {
+        used[mesh->model.materialChange[i].materialIndex] = 1;
+    }
+
+    /* Materials the library gained are not drawn until the OBJ file names them */
+    path = getPath(mesh->fileName);
+    for(i=0;i<mesh->materials.count;i++)
+    {
+        entry = &table.entries[i];
+        material = &scene->materials[mesh->firstMaterial + i];
+
+        mesh->materials.entries[i].mp = entry->mp;
+        mesh->materials.entries[i].fileName = (NULL != entry->fileName) ? arenaStrdup(&mesh->materials.strings, entry->fileName) : NULL;
+
+        /* The texture shown stays until a new one is in */
+        entry->mp.imageIndex = material->mp.imageIndex;
+        entry->mp.imageLayer = material->mp.imageLayer;
+        material->mp = entry->mp;
+
+        fileName = NULL;
+        if(used[i] && NULL != entry->fileName)
+        {
+            fileNameSize = strlen(path) + strlen(entry->fileName) + 1;
+            fileName = (char *)memAlloc(MEMORY_LOADER, fileNameSize);
+            strcpy_s(fileName, fileNameSize, path);
+            strcat_s(fileName, fileNameSize, entry->fileName);
+        }
+
+        /* A map that changed is loaded again, one that went shows the placeholder */
+        if((NULL == fileName) != (NULL == material->fileName) || (NULL != fileName && 0 != strcmp(fileName, material->fileName)))
+        {
+            memFree(material->fileName);
+            material->fileName = fileName;
+            if(NULL == fileName)
+            {
+                material->mp.imageIndex = 0;
+                material->mp.imageLayer = 0;
+            }
+            retextured[(*retexturedCount)++] = mesh->firstMaterial + i;
+        }
+        else
+        {
+            memFree(fileName);
+        }
+    }
+    memFree(path);
+    memFree(used);
+    freeMaterialTable(&table);
+
+    return VK_TRUE;
+}
+
+
+void buildScene(scene_t *scene)
+{
+    uint32_t i, m;
+    uint32_t side;
+    uint32_t vertexCount;
+    uint64_t fileNameSize;
+    float spacing;
+    float offsetX = 0.0f;
+    char *path;
+    uint8_t *used;
+    scene_mesh_t *mesh;
+    boundingSphere_t sphere;
+
+    scene->materialCount = 0;
+    scene->instanceCount = 0;
+    scene->vertexCount = 0;
+
+    for(m=0;m<scene->meshCount;m++)
+    {
+        scene->vertexCount += (scene->meshes[m].model.numOfFaces + scene->meshes[m].model.numOfLodFaces) * ELEMENTS_PER_FACE;
+        scene->materialCount += scene->meshes[m].materials.count;
+        scene->instanceCount += scene->meshes[m].instanceCount;
+    }
+
+    scene->vertices = (float *)memAlloc(MEMORY_LOADER, SCENE_VERTEX_SIZE * ((scene->vertexCount > 0) ? scene->vertexCount : 1));
+    scene->materials = (material_t *)memAlloc(MEMORY_LOADER, sizeof(material_t) * ((scene->materialCount > 0) ? scene->materialCount : 1));
+    scene->instances = (scene_instance_t *)memAlloc(MEMORY_LOADER, sizeof(scene_instance_t) * ((scene->instanceCount > 0) ? scene->instanceCount : 1));
+
+    scene->materialCount = 0;
+    scene->instanceCount = 0;
+    scene->vertexCount = 0;
+
+    for(m=0;m<scene->meshCount;m++)
+    {
+        mesh = &scene->meshes[m];
+
+        /* Checked on the faces before they are expanded */
+        mesh->closed = isClosedMesh(&mesh->model);
+
+        /* Append the expanded vertices */
+        prepareObjectArrays(&mesh->model);
+        vertexCount = (mesh->model.numOfFaces + mesh->model.numOfLodFaces) * ELEMENTS_PER_FACE;
+        memcpy((uint8_t *)scene->vertices + SCENE_VERTEX_SIZE * scene->vertexCount, mesh->model.vertArray, SCENE_VERTEX_SIZE * vertexCount);
+        memFree(mesh->model.vertArray);
+        mesh->model.vertArray = NULL;
+        mesh->firstVertex = scene->vertexCount;
+        scene->vertexCount += vertexCount;
+
+        /* Library materials no range uses are kept, but their textures are not loaded */
+        used = (uint8_t *)memCalloc(MEMORY_LOADER, mesh->materials.count + 1, sizeof(uint8_t));
+        for(i=0;i<mesh->model.materialChangeCount;i++)
+        {
+            used[mesh->model.materialChange[i].materialIndex] = 1;
+        }
+
+        /* Append the materials, textures are found next to their own OBJ file */
+        path = getPath(mesh->fileName);
+        mesh->firstMaterial = scene->materialCount;
+        for(i=0;i<mesh->materials.count;i++)
+        {
+            scene->materials[scene->materialCount] = mesh->materials.entries[i];
+            scene->materials[scene->materialCount].fileName = NULL;
+            if(used[i] && mesh->materials.entries[i].fileName != NULL)
+            {
+                fileNameSize = strlen(path) + strlen(mesh->materials.entries[i].fileName) + 1;
+                scene->materials[scene->materialCount].fileName = (char *)memAlloc(MEMORY_LOADER, fileNameSize);
+                strcpy_s(scene->materials[scene->materialCount].fileName, fileNameSize, path);
+                strcat_s(scene->materials[scene->materialCount].fileName, fileNameSize, mesh->materials.entries[i].fileName);
+            }
+            scene->materialCount++;
+        }
+        memFree(path);
+        memFree(used);
+
+        /* Lay the copies out on a square grid, one grid per mesh along x */
+        sphere = computeBoundingSphere(mesh->model.v, mesh->model.f, cornerStrideOf(&mesh->model), 0, mesh->model.numOfFaces);
+        side = (uint32_t)ceilf(sqrtf((float)mesh->instanceCount));
+        spacing = 2.0f * sphere.radius * SCENE_INSTANCE_SPACING;
+
+        mesh->firstInstance = scene->instanceCount;
+        for(i=0;i<mesh->instanceCount;i++)
+        {
+            generateScaleTranslationMatrix((vec3_t){ 1.0f, 1.0f, 1.0f },
+                (vec3_t){ offsetX + ((float)(i % side) - (side - 1) * 0.5f) * spacing, 0.0f, ((float)(i / side) - (side - 1) * 0.5f) * spacing },
+                scene->instances[scene->instanceCount++].transform);
+        }
+        offsetX += side * spacing;
+
+        sphere = instanceBounds(scene, mesh, &sphere);
+        scene->bounds = (m == 0) ? sphere : mergeSpheres(scene->bounds, sphere);
+    }
+
+    printf("\tscene:\t\t\t%d meshes, %d instances, %d vertices\n", scene->meshCount, scene->instanceCount, scene->vertexCount);
+}
+
+
+boundingSphere_t instanceBounds(scene_t *scene, scene_mesh_t *mesh, boundingSphere_t *sphere)
+{
+    uint32_t i;
+    float *transform;
+    boundingSphere_t bounds = { { 0.0f, 0.0f, 0.0f }, 0.0f };
+    boundingSphere_t placed;
+
+    /* Sphere around every placed copy of a mesh space sphere */
+    for(i=0;i<mesh->instanceCount;i++)
+    {
+        transform = scene->instances[mesh->firstInstance + i].transform;
+        placed.center = transformPoint(transform, sphere->center);
+        placed.radius = sphere->radius * transformScale(transform);
+        bounds = (i == 0) ? placed : mergeSpheres(bounds, placed);
+    }
+    return bounds;
+}
+
+
+void releaseSceneSources(scene_t *scene)
+{
+    uint32_t i;
+
+    /* Once the scene is on the GPU it is not built again, nothing reads the parsed or expanded vertices */
+    for(i=0;i<scene->meshCount;i++)
+    {
+        releaseParsedArrays(&scene->meshes[i].model);
+    }
+
+    memFree(scene->vertices);
+    scene->vertices = NULL;
+}
+
+
+void freeReplacedScene(scene_t *scene, uint32_t meshIndex)
+{
+    uint32_t i;
+
+    for(i=0;i<scene->materialCount;i++)
+    {
+        memFree(scene->materials[i].fileName);
+    }
+
+    /* The other meshes live on in the scene that replaced this one */
+    freeSceneMesh(&scene->meshes[meshIndex]);
+
+    memFree(scene->meshes);
+    memFree(scene->materials);
+    memFree(scene->instances);
+    memFree(scene->vertices);
+    memset(scene, 0, sizeof(scene_t));
+}
+
+
+void freeScene(scene_t *scene)
+{
+    uint32_t i;
+
+    for(i=0;i<scene->materialCount;i++)
+    {
+        memFree(scene->materials[i].fileName);
+    }
+
+    for(i=0;i<scene->meshCount;i++)
+    {
+        freeSceneMesh(&scene->meshes[i]);
+    }
+
+    memFree(scene->meshes);
+    memFree(scene->materials);
+    memFree(scene->instances);
+    memFree(scene->vertices);
+    memset(scene, 0, sizeof(scene_t));
+}
@@ -0,0 +1,554 @@
+#include "textureResidency.h"
+#include "perfTimer.h"
+
+
+uint32_t mipTailLevel(mip_chain_t *chain)
+{
+    uint32_t level;
+    VkExtent2D extent;
+
+    for(level=0;level<chain->levelCount - 1;level++)
+    {
+        extent = mipExtent(chain, level);
+        if(extent.width <= TEXTURE_TAIL_SIZE && extent.height <= TEXTURE_TAIL_SIZE)
+        {
+            break;
+        }
+    }
+    return level;
+}
+
+
+texture_t uploadMipLevels(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, mip_chain_t *chain, uint32_t firstLevel, buffer_t *staging)
+{
+    VkExtent2D extent = mipExtent(chain, firstLevel);
+    VkDeviceSize byteCount = chain->offsets[chain->levelCount] - chain->offsets[firstLevel];
+
+    /* The levels from the first one on are contiguous in the chain, the image starts at the first one */
+    *staging = createBuffer(vulkanObj,
+        (uint32_t)byteCount,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+    memcpy(staging->ptr, chain->pixels + chain->offsets[firstLevel], (size_t)byteCount);
+
+    return createTextureImage(vulkanObj, cmdBuf, &extent, chain->levelCount - firstLevel, 1, staging);
+}
+
+
+texture_t uploadTextureArray(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, mip_chain_t *chains[], uint32_t layerCount, buffer_t *staging)
+{
+    uint32_t level, layer;
+    uint8_t *dst;
+    mip_chain_t *chain = chains[0];
+
+    /* Every chain has the size of the first, each level holds that level of every layer */
+    *staging = createBuffer(vulkanObj,
+        (uint32_t)(chain->offsets[chain->levelCount] * layerCount),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    dst = (uint8_t *)staging->ptr;
+    for(level=0;level<chain->levelCount;level++)
+    {
+        for(layer=0;layer<layerCount;layer++)
+        {
+            memcpy(dst, chains[layer]->pixels + chain->offsets[level], (size_t)mipLevelBytes(chain, level));
+            dst += mipLevelBytes(chain, level);
+        }
+    }
+
+    return createTextureImage(vulkanObj, cmdBuf, &chain->size, chain->levelCount, layerCount, staging);
+}
+
+
+VkResult initTextureResidency(texture_residency_t *residency, VulkanObject *vulkanObj, uint32_t budgetMb)
+{
+    VkResult result;
+
+    memset(residency, 0, sizeof(texture_residency_t));
+    residency->configuredBudget = (VkDeviceSize)budgetMb * 1024 * 1024;
+    residency->budget = residency->configuredBudget;
+
+    /* Swaps are submitted from their own command buffer and fence */
+    result = createCommandBuffer(vulkanObj, &residency->cmdBuffer, 1);
+    if(VK_SUCCESS == result)
+    {
+        result = createFence(vulkanObj, NULL, &residency->fence, 1);
+    }
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to create the texture streaming command buffer\n");
+    }
+    return result;
+}
+
+
+void addResidentTexture(texture_residency_t *residency, uint32_t material, mip_chain_t *chain, uint32_t slot)
+{
+    uint32_t i;
+    resident_texture_t *texture;
+
+    if(residency->count == residency->capacity)
+    {
+        residency->capacity = (residency->capacity == 0) ? MIN_TABLE_CAPACITY : (residency->capacity*2);
+        residency->textures = (resident_texture_t *)memRealloc(MEMORY_TEXTURE, residency->textures, residency->capacity * sizeof(resident_texture_t));
+    }
+
+    if(material >= residency->materialCount)
+    {
+        residency->materialTextures = (uint32_t *)memRealloc(MEMORY_TEXTURE, residency->materialTextures, (material + 1) * sizeof(uint32_t));
+        for(i=residency->materialCount;i<=material;i++)
+        {
+            residency->materialTextures[i] = NO_RESIDENT_TEXTURE;
+        }
+        residency->materialCount = material + 1;
+    }
+
+    /* The chain moves in, only its tail is on the GPU so far */
+    texture = &residency->textures[residency->count];
+    memset(texture, 0, sizeof(resident_texture_t));
+    texture->chain = *chain;
+    memset(chain, 0, sizeof(mip_chain_t));
+    texture->slot = slot;
+    texture->tailLevel = mipTailLevel(&texture->chain);
+    texture->residentLevel = texture->tailLevel;
+    texture->wantedLevel = texture->tailLevel;
+
+    residency->residentBytes += texture->chain.offsets[texture->chain.levelCount] - texture->chain.offsets[texture->tailLevel];
+    residency->peakBytes = (residency->residentBytes > residency->peakBytes) ? residency->residentBytes : residency->peakBytes;
+    residency->materialTextures[material] = residency->count++;
+}
+
+
+void pinResidentBytes(texture_residency_t *residency, VkDeviceSize bytes)
+{
+    residency->pinnedBytes += bytes;
+    residency->residentBytes += bytes;
+    residency->peakBytes = (residency->residentBytes > residency->peakBytes) ? residency->residentBytes : residency->peakBytes;
+}
+
+
+VkBool32 reloadResidentTexture(texture_residency_t *residency, uint32_t material, mip_chain_t *chain)
+{
+    uint32_t t = (material < residency->materialCount) ? residency->materialTextures[material] : NO_RESIDENT_TEXTURE;
+    resident_texture_t *texture;
+
+    /* Packed textures and ones never uploaded are not streamed, the caller uploads them as new ones */
+    if(NO_RESIDENT_TEXTURE == t)
+    {
+        return VK_FALSE;
+    }
+
+    /* The chain moves in, a reload not applied yet is dropped for this one */
+    texture = &residency->textures[t];
+    freeMipChain(&texture->reloadChain);
+    texture->reloadChain = *chain;
+    memset(chain, 0, sizeof(mip_chain_t));
+    texture->reloadPending = VK_TRUE;
+    return VK_TRUE;
+}
+
+
+void remapResidentMaterials(texture_residency_t *residency, uint32_t *remap, uint32_t materialCount)
+{
+    uint32_t i;
+    uint32_t *materialTextures = (uint32_t *)memAlloc(MEMORY_TEXTURE, (materialCount + 1) * sizeof(uint32_t));
+
+    /* remap holds the new index of each old material, materials that went away drop their texture from the lookup */
+    for(i=0;i<materialCount;i++)
+    {
+        materialTextures[i] = NO_RESIDENT_TEXTURE;
+    }
+    for(i=0;i<residency->materialCount;i++)
+    {
+        if(NO_RESIDENT_TEXTURE != residency->materialTextures[i] && remap[i] < materialCount)
+        {
+            materialTextures[remap[i]] = residency->materialTextures[i];
+        }
+    }
+
+    memFree(residency->materialTextures);
+    residency->materialTextures = materialTextures;
+    residency->materialCount = materialCount;
+}
+
+
+static void requestLevels(texture_residency_t *residency, VulkanObject *vulkanObj, float pixelsPerUnit)
+{
+    uint32_t i;
+    uint32_t t;
+    uint32_t level;
+    uint32_t material;
+    float distance;
+    float texels;
+    float pixels;
+    vec3_t offset;
+    boundingSphere_t *bounds;
+    resident_texture_t *texture;
+
+    for(t=0;t<residency->count;t++)
+    {
+        residency->textures[t].wantedLevel = residency->textures[t].tailLevel;
+    }
+
+    /* The draw's bounds stand in for the area its texture is stretched over */
+    for(i=0;i<vulkanObj->drawCount;i++)
+    {
+        material = vulkanObj->instanceRefs[vulkanObj->drawCmds[i].firstInstance].material;
+        t = (material < residency->materialCount) ? residency->materialTextures[material] : NO_RESIDENT_TEXTURE;
+        bounds = &vulkanObj->drawBounds[i];
+        if(NO_RESIDENT_TEXTURE == t || !sphereInFrustum(&vulkanObj->frustum, bounds))
+        {
+            continue;
+        }
+
+        texture = &residency->textures[t];
+        texture->lastUsedFrame = residency->frame;
+
+        /* Level whose texels match the pixels the bounds cover, the finest level inside them */
+        offset = subProd(bounds->center, vulkanObj->cameraPosition);
+        distance = sqrtf(dotProd(offset, offset)) - bounds->radius;
+        level = 0;
+        if(distance > 0.0f)
+        {
+            pixels = 2.0f * bounds->radius * pixelsPerUnit / distance;
+            texels = (float)((texture->chain.size.width > texture->chain.size.height) ? texture->chain.size.width : texture->chain.size.height);
+            level = (texels > pixels && pixels > 0.0f) ? (uint32_t)log2f(texels / pixels) : 0;
+        }
+        level = (level < texture->tailLevel) ? level : texture->tailLevel;
+        texture->wantedLevel = (level < texture->wantedLevel) ? level : texture->wantedLevel;
+    }
+
+    /* A texture drawn coarser than it wants this frame is a miss */
+    for(t=0;t<residency->count;t++)
+    {
+        texture = &residency->textures[t];
+        if(texture->lastUsedFrame == residency->frame && texture->residentLevel > texture->wantedLevel)
+        {
+            residency->misses++;
+        }
+    }
+}
+
+
+static void updateBudget(texture_residency_t *residency, VulkanObject *vulkanObj)
+{
+    VkDeviceSize usage = 0;
+    VkDeviceSize heapBudget = queryDeviceLocalBudget(vulkanObj, &usage);
+    VkDeviceSize available;
+
+    /* Everything else on the heap stays, the textures may take what is left of the driver's budget */
+    residency->budget = residency->configuredBudget;
+    if(heapBudget > 0)
+    {
+        available = residency->residentBytes + ((heapBudget > usage) ? (heapBudget - usage) : 0);
+        residency->budget = (available < residency->budget) ? available : residency->budget;
+    }
+}
+
+
+static void queueSwap(texture_residency_t *residency, uint32_t t, uint32_t level)
+{
+    resident_texture_t *texture = &residency->textures[t];
+    texture_swap_t *swap = &residency->swaps[residency->swapCount++];
+
+    memset(swap, 0, sizeof(texture_swap_t));
+    swap->texture = t;
+    swap->level = level;
+    texture->swapping = VK_TRUE;
+
+    /* Counted from when it is queued, the old image goes away when the swap lands */
+    if(texture->reloaded)
+    {
+        /* The old chain's bytes went when it was replaced, every level of the new image counts */
+        residency->residentBytes += texture->chain.offsets[texture->chain.levelCount] - texture->chain.offsets[level];
+        texture->reloaded = VK_FALSE;
+        residency->reloads++;
+    }
+    else if(level < texture->residentLevel)
+    {
+        residency->residentBytes += mipLevelBytes(&texture->chain, level);
+        residency->promotions++;
+    }
+    else
+    {
+        residency->residentBytes -= mipLevelBytes(&texture->chain, texture->residentLevel);
+        residency->evictions++;
+    }
+    residency->peakBytes = (residency->residentBytes > residency->peakBytes) ? residency->residentBytes : residency->peakBytes;
+}
+
+
+static VkBool32 evictLeastRecent(texture_residency_t *residency)
+{
+    uint32_t t;
+    uint32_t victim = NO_RESIDENT_TEXTURE;
+    resident_texture_t *texture;
+
+    if(residency->swapCount == MAX_TEXTURE_SWAPS)
+    {
+        return VK_FALSE;
+    }
+
+    /* Only levels finer than this frame needs can go, the least recently drawn first */
+    for(t=0;t<residency->count;t++)
+    {
+        texture = &residency->textures[t];
+        if(!texture->swapping && texture->residentLevel < texture->wantedLevel &&
+           (NO_RESIDENT_TEXTURE == victim || texture->lastUsedFrame < residency->textures[victim].lastUsedFrame))
+        {
+            victim = t;
+        }
+    }
+
+    if(NO_RESIDENT_TEXTURE == victim)
+    {
+        return VK_FALSE;
+    }
+
+    queueSwap(residency, victim, residency->textures[victim].residentLevel + 1);
+    return VK_TRUE;
+}
+
+
+static void planSwaps(texture_residency_t *residency)
+{
+    uint32_t t;
+    uint32_t best;
+    VkDeviceSize bytes = 0;
+    resident_texture_t *texture;
+
+    residency->swapCount = 0;
+
+    /* Reloaded textures first, the old image is sampled until their new tail lands */
+    for(t=0;t<residency->count && residency->swapCount < MAX_TEXTURE_SWAPS;t++)
+    {
+        if(residency->textures[t].reloaded)
+        {
+            queueSwap(residency, t, residency->textures[t].tailLevel);
+        }
+    }
+
+    /* A budget that shrank is met first */
+    while(residency->residentBytes > residency->budget && evictLeastRecent(residency));
+
+    while(residency->swapCount < MAX_TEXTURE_SWAPS && bytes < TEXTURE_SWAP_BYTES)
+    {
+        /* The texture furthest from the level it wants goes first, one level at a time */
+        best = NO_RESIDENT_TEXTURE;
+        for(t=0;t<residency->count;t++)
+        {
+            texture = &residency->textures[t];
+            if(!texture->swapping && texture->residentLevel > texture->wantedLevel &&
+               (NO_RESIDENT_TEXTURE == best ||
+                texture->residentLevel - texture->wantedLevel > residency->textures[best].residentLevel - residency->textures[best].wantedLevel))
+            {
+                best = t;
+            }
+        }
+
+        if(NO_RESIDENT_TEXTURE == best)
+        {
+            break;
+        }
+
+        /* Make room from the least recently used levels, stop when nothing more can go */
+        texture = &residency->textures[best];
+        while(residency->residentBytes + mipLevelBytes(&texture->chain, texture->residentLevel - 1) > residency->budget && evictLeastRecent(residency));
+        if(residency->residentBytes + mipLevelBytes(&texture->chain, texture->residentLevel - 1) > residency->budget || residency->swapCount == MAX_TEXTURE_SWAPS)
+        {
+            residency->budgetStalls++;
+            break;
+        }
+
+        queueSwap(residency, best, texture->residentLevel - 1);
+        bytes += texture->chain.offsets[texture->chain.levelCount] - texture->chain.offsets[texture->residentLevel - 1];
+    }
+}
+
+
+static void applyReloads(texture_residency_t *residency)
+{
+    uint32_t t;
+    resident_texture_t *texture;
+
+    /* No batch is in flight, so no swap reads the chains being replaced */
+    for(t=0;t<residency->count;t++)
+    {
+        texture = &residency->textures[t];
+        if(!texture->reloadPending)
+        {
+            continue;
+        }
+
+        residency->residentBytes -= texture->chain.offsets[texture->chain.levelCount] - texture->chain.offsets[texture->residentLevel];
+        freeMipChain(&texture->chain);
+        texture->chain = texture->reloadChain;
+        memset(&texture->reloadChain, 0, sizeof(mip_chain_t));
+
+        /* The new file may have another size, its levels are wanted again from the tail */
+        texture->tailLevel = mipTailLevel(&texture->chain);
+        texture->residentLevel = texture->tailLevel;
+        texture->wantedLevel = texture->tailLevel;
+        texture->reloadPending = VK_FALSE;
+        texture->reloaded = VK_TRUE;
+    }
+}
+
+
+static void recordSwaps(texture_residency_t *residency, VulkanObject *vulkanObj)
+{
+    uint32_t i;
+    texture_swap_t *swap;
+    mip_chain_t *chain;
+
+    VkCommandBufferBeginInfo cbbi =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+
+    VkSubmitInfo si =
+    {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &residency->cmdBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+
+    /* Each swap builds a new image from the host chain, the old one is sampled until it lands */
+    vkBeginCommandBuffer(residency->cmdBuffer, &cbbi);
+    for(i=0;i<residency->swapCount;i++)
+    {
+        swap = &residency->swaps[i];
+        chain = &residency->textures[swap->texture].chain;
+        swap->image = uploadMipLevels(vulkanObj, residency->cmdBuffer, chain, swap->level, &swap->staging);
+        residency->streamedBytes += chain->offsets[chain->levelCount] - chain->offsets[swap->level];
+    }
+    vkEndCommandBuffer(residency->cmdBuffer);
+
+    vkResetFences(vulkanObj->device, 1, &residency->fence);
+    vkQueueSubmit(vulkanObj->queue, 1, &si, residency->fence);
+    residency->batchStartMs = getTimeMs();
+    residency->pending = VK_TRUE;
+}
+
+
+static void finishSwaps(texture_residency_t *residency, VulkanObject *vulkanObj, VkFence frameFence)
+{
+    uint32_t i;
+    texture_swap_t *swap;
+    resident_texture_t *texture;
+    texture_t replaced;
+
+    residency->streamMs += getTimeMs() - residency->batchStartMs;
+
+    /* The other frame slot may still sample the images being replaced, the slots are rewritten once it is done */
+    vkWaitForFences(vulkanObj->device, 1, &frameFence, VK_TRUE, MAX_TIMEOUT);
+    for(i=0;i<residency->swapCount;i++)
+    {
+        swap = &residency->swaps[i];
+        texture = &residency->textures[swap->texture];
+
+        replaced = vulkanObj->textures[texture->slot];
+        writeTextureSlot(vulkanObj, texture->slot, &swap->image);
+        retireTexture(vulkanObj, &replaced);
+        destroyBuffer(vulkanObj, &swap->staging);
+
+        texture->residentLevel = swap->level;
+        texture->swapping = VK_FALSE;
+    }
+
+    residency->swapCount = 0;
+    residency->pending = VK_FALSE;
+}
+
+
+void updateTextureResidency(texture_residency_t *residency, VulkanObject *vulkanObj, float pixelsPerUnit, VkFence frameFence)
+{
+    residency->frame++;
+
+    /* Swap the new images in once their copies have executed */
+    if(residency->pending && VK_SUCCESS == vkGetFenceStatus(vulkanObj->device, residency->fence))
+    {
+        finishSwaps(residency, vulkanObj, frameFence);
+    }
+
+    if(0 == residency->count)
+    {
+        return;
+    }
+
+    requestLevels(residency, vulkanObj, pixelsPerUnit);
+
+    if(1 == residency->frame % TEXTURE_BUDGET_INTERVAL)
+    {
+        updateBudget(residency, vulkanObj);
+    }
+
+    /* The next batch is planned against the levels of the one that just landed */
+    if(!residency->pending)
+    {
+        applyReloads(residency);
+        planSwaps(residency);
+        if(residency->swapCount > 0)
+        {
+            recordSwaps(residency, vulkanObj);
+        }
+    }
+}
+
+
+void printTextureResidency(texture_residency_t *residency)
+{
+    const double mb = 1024.0 * 1024.0;
+
+    if(0 == residency->count && 0 == residency->pinnedBytes)
+    {
+        return;
+    }
+
+    /* Bandwidth is over the time batches were in flight */
+    printf("Texture residency: %d streamed textures, %.1f MB resident (%.1f MB packed) of a %.1f MB budget, peak %.1f MB\n",
+        residency->count, residency->residentBytes / mb, residency->pinnedBytes / mb, residency->budget / mb, residency->peakBytes / mb);
+    printf("\tstreamed %.1f MB at %.1f MB/s, %d promotions, %d evictions, %d reloads, %" PRIu64 " misses, %d stalls on the budget\n",
+        residency->streamedBytes / mb, (residency->streamMs > 0.0) ? (residency->streamedBytes / mb) / (residency->streamMs / 1000.0) : 0.0,
+        residency->promotions, residency->evictions, residency->reloads, residency->misses, residency->budgetStalls);
+}
+
+
+void destroyTextureResidency(texture_residency_t *residency, VulkanObject *vulkanObj)
+{
+    uint32_t i;
+
+    /* The images themselves belong to the texture slots */
+    if(residency->pending)
+    {
+        vkWaitForFences(vulkanObj->device, 1, &residency->fence, VK_TRUE, MAX_TIMEOUT);
+        for(i=0;i<residency->swapCount;i++)
+        {
+            destroyBuffer(vulkanObj, &residency->swaps[i].staging);
+            destroyTexture(vulkanObj, &residency->swaps[i].image);
+        }
+    }
+
+    for(i=0;i<residency->count;i++)
+    {
+        freeMipChain(&residency->textures[i].chain);
+        freeMipChain(&residency->textures[i].reloadChain);
+    }
+
+    vkDestroyFence(vulkanObj->device, residency->fence, NULL);
+    memFree(residency->textures);
+    memFree(residency->materialTextures);
+    memset(residency, 0, sizeof(texture_residency_t));
+}
@@ -12,13 +12,44 @@ const char* EnabledLayers[] =
     NULL //"VK_LAYER_KHRONOS_validation",
 };
 
+/* Every window system SDL may run on, a headless node may have none of them */
 const char* EnabledInstanceExtensions[] =
 {
     VK_KHR_SURFACE_EXTENSION_NAME,
-    VK_KHR_WIN32_SURFACE_EXTENSION_NAME
+#ifdef _WIN32
+    VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+#else
+    "VK_KHR_xcb_surface",
+    "VK_KHR_xlib_surface",
+    "VK_KHR_wayland_surface",
+#endif
+    NULL
 };
 
 
+#ifndef _WIN32
+VkResult initPlatformSurface(VulkanObject* vulkanObj)
+{
+    SDL_Window* window = SDL_CreateWindow(
+        GLOBAL_APP_NAME_W,
+        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+        vulkanObj->windowSize.width, vulkanObj->windowSize.height,
+        SDL_WINDOW_RESIZABLE | SDL_WINDOW_VULKAN
+    );
+
+    /* Keep the window so it can be resized and polled for events */
+    vulkanObj->window = window;
+
+    /* SDL knows whether it runs on X11 or Wayland, the instance has the extensions of both */
+    if(NULL == window || SDL_TRUE != SDL_Vulkan_CreateSurface(window, vulkanObj->instance, &vulkanObj->surface))
+    {
+        printf("Failed to create a window surface: %s\n", SDL_GetError());
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    return VK_SUCCESS;
+}
+#else
 VkResult initPlatformSurface(VulkanObject* vulkanObj)
 {
     VkWin32SurfaceCreateInfoKHR surfaceCreateInfo = 
@@ -34,13 +65,16 @@ VkResult initPlatformSurface(VulkanObject* vulkanObj)
         GLOBAL_APP_NAME_W,
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         vulkanObj->windowSize.width, vulkanObj->windowSize.height,
-        0
+        SDL_WINDOW_RESIZABLE
     );
 
     SDL_SysWMinfo info;
     SDL_VERSION(&info.version);
     SDL_GetWindowWMInfo(window, &info);
 
+    /* Keep the window so it can be resized and polled for events */
+    vulkanObj->window = window;
+
     surfaceCreateInfo.hinstance = GetModuleHandle(0);
     surfaceCreateInfo.hwnd = info.info.win.window;
 
@@ -48,49 +82,44 @@ VkResult initPlatformSurface(VulkanObject* vulkanObj)
 
     return result;
 }
+#endif
 
 
 VkShaderModule createShaderModule(VkDevice device, const char* shaderFile)
 {
     VkShaderModule shaderModule = VK_NULL_HANDLE;
+    mapped_file_t file;
 
-    HANDLE hFile = CreateFile(shaderFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) return VK_NULL_HANDLE;
-
-    LARGE_INTEGER size;
-    GetFileSizeEx(hFile, &size);
+    if (0 != mapFile(&file, shaderFile)) return VK_NULL_HANDLE;
 
-    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    CloseHandle(hFile);
-    if (!hMapping) return VK_NULL_HANDLE;
-
-    const uint32_t* data = (const uint32_t*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    /* A file caught halfway through being written is not a module */
+    if (file.data == NULL || file.size < sizeof(uint32_t))
+    {
+        unmapFile(&file);
+        return VK_NULL_HANDLE;
+    }
 
     VkShaderModuleCreateInfo shaderModuleCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = size.LowPart,
-        .pCode = data,
+        .codeSize = (size_t)file.size,
+        .pCode = (const uint32_t*)file.data,
         .flags = 0,
         .pNext = NULL,
     };
     vkCreateShaderModule(device, &shaderModuleCreateInfo, 0, &shaderModule);
 
-    if (data != NULL)
-    {
-        UnmapViewOfFile(data);
-    }
-
-    CloseHandle(hMapping);
+    unmapFile(&file);
 
     return shaderModule;
 }
 
-VkResult initGraphicsPipeline(VkDevice device, VkGraphicsPipelineCreateInfo *createInfo, VkPipeline *pipeline)
+VkResult initGraphicsPipeline(VkDevice device, VkPipelineCache cache, VkGraphicsPipelineCreateInfo *createInfo, const char *vertexShaderFile, const char *fragmentShaderFile, const VkSpecializationInfo *fragSpecInfo, VkPipeline *pipeline)
 {
-    VkResult result;
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
 
-    VkShaderModule vertexShader = createShaderModule(device, "shaders\\modelobjviewer.vert.spv");
-    VkShaderModule fragmentShader = createShaderModule(device, "shaders\\modelobjviewer.frag.spv");
+    /* Depth only pipelines have no fragment stage */
+    VkShaderModule vertexShader = createShaderModule(device, vertexShaderFile);
+    VkShaderModule fragmentShader = (NULL != fragmentShaderFile) ? createShaderModule(device, fragmentShaderFile) : VK_NULL_HANDLE;
 
     const VkPipelineShaderStageCreateInfo stages[] = {
         {
@@ -104,28 +133,87 @@ VkResult initGraphicsPipeline(VkDevice device, VkGraphicsPipelineCreateInfo *cre
             .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
             .module = fragmentShader,
             .pName = "main",
+            .pSpecializationInfo = fragSpecInfo,
         },
     };
 
     /* Set the stages structures and count */
     createInfo->pStages = stages;
-    createInfo->stageCount = 2;
+    createInfo->stageCount = (NULL != fragmentShaderFile) ? 2 : 1;
 
-    /*Create a graphics pipeline object */
-    result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, createInfo, NULL, pipeline);
+    /*Create a graphics pipeline object, the cache skips compiling stages it has seen */
+    if (VK_NULL_HANDLE != vertexShader && (NULL == fragmentShaderFile || VK_NULL_HANDLE != fragmentShader))
+    {
+        result = vkCreateGraphicsPipelines(device, cache, 1, createInfo, NULL, pipeline);
+    }
 
     if (result != VK_SUCCESS)
     {
         printf("Creating graphics pipeline");
     }
 
+    /* The pipeline keeps what it needs of the modules */
+    vkDestroyShaderModule(device, vertexShader, NULL);
+    vkDestroyShaderModule(device, fragmentShader, NULL);
+
     /*P RETURN the results of creating the graphics pipeline */
     return result;
 }
 
 
+static VkBool32 deviceExtensionSupported(VkPhysicalDevice physicalDevice, const char *name)
+{
+    uint32_t i;
+    uint32_t count = 0;
+    VkBool32 found = VK_FALSE;
+    VkExtensionProperties *extensions;
+
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &count, NULL);
+    extensions = (VkExtensionProperties *)memAlloc(MEMORY_RENDERER, count * sizeof(VkExtensionProperties));
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &count, extensions);
+
+    for(i=0;i<count && !found;i++)
+    {
+        found = (0 == strcmp(extensions[i].extensionName, name)) ? VK_TRUE : VK_FALSE;
+    }
+
+    memFree(extensions);
+    return found;
+}
+
+
+static uint32_t supportedInstanceExtensions(const char **names)
+{
+    uint32_t i, j;
+    uint32_t count = 0;
+    uint32_t supported = 0;
+    VkExtensionProperties *extensions;
+
+    vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+    extensions = (VkExtensionProperties *)memAlloc(MEMORY_RENDERER, (count + 1) * sizeof(VkExtensionProperties));
+    vkEnumerateInstanceExtensionProperties(NULL, &count, extensions);
+
+    /* Only the surfaces of window systems the loader knows are asked for */
+    for(i=0;EnabledInstanceExtensions[i] != NULL && supported < MAX_INSTANCE_EXTENSIONS;i++)
+    {
+        for(j=0;j<count;j++)
+        {
+            if(0 == strcmp(extensions[j].extensionName, EnabledInstanceExtensions[i]))
+            {
+                names[supported++] = EnabledInstanceExtensions[i];
+                break;
+            }
+        }
+    }
+
+    memFree(extensions);
+    return supported;
+}
+
+
 VkResult initDriver(VulkanObject *vulkanObj)
 {
+    const char *instanceExtensions[MAX_INSTANCE_EXTENSIONS];
     uint32_t count = 10;
     VkPhysicalDevice deviceArray[10];
     VkPhysicalDeviceProperties properties = { 0 };
@@ -138,7 +226,7 @@ VkResult initDriver(VulkanObject *vulkanObj)
         .applicationVersion = 0,
         .pEngineName = NULL,
         .engineVersion = 0,
-        .apiVersion = VK_MAKE_VERSION(1,0,0)
+        .apiVersion = VK_MAKE_VERSION(1,1,0)
     };
 
     VkInstanceCreateInfo createInfo =
@@ -149,8 +237,8 @@ VkResult initDriver(VulkanObject *vulkanObj)
         .pApplicationInfo = &appInfo,
         .enabledLayerCount = (EnabledLayers[0] == NULL) ? 0 : 1,
         .ppEnabledLayerNames = EnabledLayers,
-        .enabledExtensionCount = 2,
-        .ppEnabledExtensionNames = EnabledInstanceExtensions
+        .enabledExtensionCount = supportedInstanceExtensions(instanceExtensions),
+        .ppEnabledExtensionNames = instanceExtensions
     };
 
     /* Get Vulkan Instance */
@@ -196,8 +284,78 @@ VkResult initDriver(VulkanObject *vulkanObj)
         }
     }
 
-    VkPhysicalDeviceFeatures pdfeatures;
-    vkGetPhysicalDeviceFeatures(vulkanObj->physicalDevice, &pdfeatures);
+    const char *deviceExtensions[4];
+    uint32_t deviceExtensionCount = 0;
+
+    deviceExtensions[deviceExtensionCount++] = EnabledDeviceExtensions[0];
+
+    /* Chain the descriptor indexing features in when the extension is there */
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT pddif =
+    {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT,
+        .pNext = NULL
+    };
+
+    VkPhysicalDeviceFeatures2 pdfeatures =
+    {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = NULL
+    };
+
+    if(deviceExtensionSupported(vulkanObj->physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+    {
+        pdfeatures.pNext = &pddif;
+    }
+    vkGetPhysicalDeviceFeatures2(vulkanObj->physicalDevice, &pdfeatures);
+
+    /* Material ranges are drawn with one indirect call when the device can take them all at once */
+    vulkanObj->multiDrawIndirect = (pdfeatures.features.multiDrawIndirect && pdfeatures.features.drawIndirectFirstInstance) ? VK_TRUE : VK_FALSE;
+    printf("Multi draw indirect: %s\n", vulkanObj->multiDrawIndirect ? "supported" : "not supported, drawing per range");
+
+    /* Fragment shader invocations are counted around the renderpass, which may execute secondary buffers */
+    vulkanObj->pipelineStatistics = (vulkanObj->pipelineStatistics && pdfeatures.features.pipelineStatisticsQuery && pdfeatures.features.inheritedQueries) ? VK_TRUE : VK_FALSE;
+
+    /* Textures are one array, unused slots only need to be filled without partially bound descriptors */
+    vulkanObj->descriptorIndexing = (pdfeatures.pNext != NULL && pddif.descriptorBindingPartiallyBound) ? VK_TRUE : VK_FALSE;
+    if(vulkanObj->descriptorIndexing)
+    {
+        deviceExtensions[deviceExtensionCount++] = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+    }
+    else
+    {
+        pdfeatures.pNext = NULL;
+    }
+
+    /* Culled draws can be compacted on the GPU when the draw count can come from a buffer */
+    vulkanObj->drawIndirectCount = (vulkanObj->multiDrawIndirect && deviceExtensionSupported(vulkanObj->physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) ? VK_TRUE : VK_FALSE;
+    if(vulkanObj->drawIndirectCount)
+    {
+        deviceExtensions[deviceExtensionCount++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+    }
+
+    /* Streamed textures stay inside what the driver reports free when it can report it */
+    vulkanObj->memoryBudget = deviceExtensionSupported(vulkanObj->physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if(vulkanObj->memoryBudget)
+    {
+        deviceExtensions[deviceExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+    printf("Memory budget: %s\n", vulkanObj->memoryBudget ? "reported by the driver" : "not reported, using the configured budget");
+
+    /* Size the texture array from the device limits */
+    vkGetPhysicalDeviceProperties(vulkanObj->physicalDevice, &properties);
+    vulkanObj->textureCapacity = MAX_BINDLESS_TEXTURES;
+    if(vulkanObj->textureCapacity > properties.limits.maxPerStageDescriptorSampledImages)
+    {
+        vulkanObj->textureCapacity = properties.limits.maxPerStageDescriptorSampledImages;
+    }
+    if(vulkanObj->textureCapacity > properties.limits.maxDescriptorSetSampledImages)
+    {
+        vulkanObj->textureCapacity = properties.limits.maxDescriptorSetSampledImages;
+    }
+
+    vulkanObj->textures = (texture_t *)memCalloc(MEMORY_RENDERER, vulkanObj->textureCapacity, sizeof(texture_t));
+    vulkanObj->dii = (VkDescriptorImageInfo *)memCalloc(MEMORY_RENDERER, vulkanObj->textureCapacity, sizeof(VkDescriptorImageInfo));
+    printf("Texture array: %d textures (%s)\n", vulkanObj->textureCapacity, vulkanObj->descriptorIndexing ? "partially bound" : "fully bound");
 
     float priorities[1] = {1.0};
     VkDeviceQueueCreateInfo dqci[] =
@@ -214,15 +372,15 @@ VkResult initDriver(VulkanObject *vulkanObj)
 
     VkDeviceCreateInfo dci = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = NULL,
+        .pNext = &pdfeatures,
         .flags = 0,
         .queueCreateInfoCount = 1,
         .pQueueCreateInfos = dqci,
         .enabledLayerCount = 0,
         .ppEnabledLayerNames = NULL,
-        .enabledExtensionCount = sizeof(EnabledDeviceExtensions)/sizeof(EnabledDeviceExtensions[0]),
-        .ppEnabledExtensionNames = EnabledDeviceExtensions,
-        .pEnabledFeatures = &pdfeatures
+        .enabledExtensionCount = deviceExtensionCount,
+        .ppEnabledExtensionNames = deviceExtensions,
+        .pEnabledFeatures = NULL
     };
 
     /* Create device */
@@ -233,6 +391,22 @@ VkResult initDriver(VulkanObject *vulkanObj)
         return VK_ERROR_INITIALIZATION_FAILED;
     }
 
+    if(vulkanObj->drawIndirectCount)
+    {
+        vulkanObj->vkCmdDrawIndirectCount = (PFN_vkCmdDrawIndirectCountKHR)vkGetDeviceProcAddr(vulkanObj->device, "vkCmdDrawIndirectCountKHR");
+        vulkanObj->drawIndirectCount = (vulkanObj->vkCmdDrawIndirectCount != NULL) ? VK_TRUE : VK_FALSE;
+    }
+    /* Threaded recording splits the draw list on the cpu, so the ranges are culled and drawn one by one */
+    if(vulkanObj->recordThreadCount > 0)
+    {
+        vulkanObj->multiDrawIndirect = VK_FALSE;
+    }
+    printf("Frustum culling: %s\n", vulkanObj->multiDrawIndirect ? (vulkanObj->drawIndirectCount ? "compute, compacted" : "compute") : "cpu");
+    if(vulkanObj->staticCommands && !vulkanObj->multiDrawIndirect)
+    {
+        printf("Static command buffers: the cpu culled draw list changes every frame, culled frames are recorded each frame\n");
+    }
+
     /* Create command pools for each queue and thread */
     VkCommandPoolCreateInfo cpci = {
         VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -265,6 +439,35 @@ VkResult initDriver(VulkanObject *vulkanObj)
         printf("Could not allocate command buffer\n");
         return VK_ERROR_INITIALIZATION_FAILED;
     }
+
+    /* One statistics query per frame in flight */
+    if(vulkanObj->pipelineStatistics)
+    {
+        VkQueryPoolCreateInfo qpci =
+        {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = MAX_FRAMES_IN_FLIGHT,
+            .pipelineStatistics = STATS_QUERY_FLAGS
+        };
+
+        result = vkCreateQueryPool(vulkanObj->device, &qpci, NULL, &vulkanObj->statsQueryPool);
+        if(VK_SUCCESS != result)
+        {
+            printf("Could not create the statistics query pool, statistics are off\n");
+            vulkanObj->statsQueryPool = VK_NULL_HANDLE;
+            vulkanObj->pipelineStatistics = VK_FALSE;
+        }
+    }
+
+    /* Create a pool per recording thread */
+    if(vulkanObj->recordThreadCount > 0 && VK_SUCCESS != createRecordThreads(vulkanObj, vulkanObj->recordThreadCount))
+    {
+        printf("Could not create the recording threads\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
     else
     {
         vkGetDeviceQueue(vulkanObj->device, vulkanObj->queueIndex, 0, &vulkanObj->queue);
@@ -275,8 +478,78 @@ VkResult initDriver(VulkanObject *vulkanObj)
 }
 
 
+VkDeviceSize queryDeviceLocalBudget(VulkanObject *vulkanObj, VkDeviceSize *usage)
+{
+    uint32_t i;
+    VkDeviceSize budget = 0;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT pdmbp =
+    {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+        .pNext = NULL
+    };
+
+    VkPhysicalDeviceMemoryProperties2 pdmp =
+    {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &pdmbp
+    };
+
+    *usage = 0;
+    if(!vulkanObj->memoryBudget)
+    {
+        return 0;
+    }
+
+    /* The largest device local heap is the one the textures go to */
+    vkGetPhysicalDeviceMemoryProperties2(vulkanObj->physicalDevice, &pdmp);
+    for(i=0;i<pdmp.memoryProperties.memoryHeapCount;i++)
+    {
+        if((pdmp.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && pdmbp.heapBudget[i] > budget)
+        {
+            budget = pdmbp.heapBudget[i];
+            *usage = pdmbp.heapUsage[i];
+        }
+    }
+    return budget;
+}
+
+
+static VkFormat selectDepthFormat(VkPhysicalDevice physicalDevice)
+{
+    uint32_t i;
+    VkFormatProperties properties;
+
+    /* Depth only, the float format first since reverse-Z relies on its precision near the far plane */
+    static const VkFormat candidates[] =
+    {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D16_UNORM
+    };
+
+    for(i=0;i<sizeof(candidates)/sizeof(candidates[0]);i++)
+    {
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidates[i], &properties);
+        if(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            return candidates[i];
+        }
+    }
+
+    /* Every device supports D16 attachments */
+    return VK_FORMAT_D16_UNORM;
+}
+
+
 VkResult initRenderPass(VulkanObject *vulkanObj)
 {
+    /* Picked once, the attachments are recreated with the same format */
+    vulkanObj->depthFormat = selectDepthFormat(vulkanObj->physicalDevice);
+    printf("Depth format: %s\n", (VK_FORMAT_D32_SFLOAT == vulkanObj->depthFormat) ? "D32_SFLOAT" :
+        ((VK_FORMAT_X8_D24_UNORM_PACK32 == vulkanObj->depthFormat) ? "X8_D24_UNORM" : "D16_UNORM"));
+
+    /* Depth is only tested within the pass, it is never stored */
     VkAttachmentDescription attachments[] =
     {
         {
@@ -292,12 +565,12 @@ VkResult initRenderPass(VulkanObject *vulkanObj)
         },
         {
             0,
-            VK_FORMAT_D32_SFLOAT_S8_UINT,
+            vulkanObj->depthFormat,
             VK_SAMPLE_COUNT_1_BIT,
             VK_ATTACHMENT_LOAD_OP_CLEAR,
-            VK_ATTACHMENT_STORE_OP_STORE,
-            VK_ATTACHMENT_LOAD_OP_CLEAR,
-            VK_ATTACHMENT_STORE_OP_STORE,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE,
             VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
             VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
         },
@@ -417,9 +690,9 @@ VkResult initImages(VulkanObject *vulkanObj)
     }
     else
     {
-        /* Create depth/stencil image */
-        ici.format = VK_FORMAT_D32_SFLOAT_S8_UINT;
-        ici.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        /* Create the depth image, it lives only inside the renderpass */
+        ici.format = vulkanObj->depthFormat;
+        ici.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
         result = vkCreateImage(vulkanObj->device, &ici, NULL, &vulkanObj->depthBuffer);
         if(VK_SUCCESS != result)
         {
@@ -441,8 +714,20 @@ VkResult initImages(VulkanObject *vulkanObj)
             {
                 /* Sum the sizes and add any alignment needed of the second image to the size of the first image */
                 memAllocInfo.allocationSize = memRequirements[i].size;
-                memAllocInfo.memoryTypeIndex =
-                        (uint32_t)memoryTypeIndex(vulkanObj, memRequirements[i].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                memAllocInfo.memoryTypeIndex = (uint32_t)-1;
+
+                /* Tile based devices may never back the transient depth image with memory */
+                if(i == 1)
+                {
+                    memAllocInfo.memoryTypeIndex =
+                            (uint32_t)memoryTypeIndex(vulkanObj, memRequirements[i].memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+                }
+
+                if((int32_t)memAllocInfo.memoryTypeIndex == -1)
+                {
+                    memAllocInfo.memoryTypeIndex =
+                            (uint32_t)memoryTypeIndex(vulkanObj, memRequirements[i].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                }
 
                 if((int32_t)memAllocInfo.memoryTypeIndex == -1)
                 {
@@ -501,8 +786,8 @@ VkResult initImages(VulkanObject *vulkanObj)
                     } else
                     {
                         /* Create the image view for the depth buffer */
-                        ivci.format = VK_FORMAT_D32_SFLOAT_S8_UINT;
-                        ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+                        ivci.format = vulkanObj->depthFormat;
+                        ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
                         ivci.image = vulkanObj->depthBuffer;
                         result = vkCreateImageView(vulkanObj->device, &ivci, NULL, &vulkanObj->imageViews[1]);
                         if(VK_SUCCESS != result)
@@ -546,7 +831,7 @@ void transitionImage(VulkanObject *vulkanObj)
             .srcQueueFamilyIndex = 0, 
             .dstQueueFamilyIndex = 0,
             .image = vulkanObj->depthBuffer,
-            .subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 }
+            .subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 }
         },
         /* Transition surface image 0 to transfer source */
         {
@@ -576,6 +861,9 @@ void transitionImage(VulkanObject *vulkanObj)
         },
     };
 
+    /* Without a swapchain (headless) only the color and depth buffers need transitioning */
+    uint32_t barrierCount = (VK_NULL_HANDLE == vulkanObj->swapChain) ? 2 : sizeof(barriers)/sizeof(barriers[0]);
+
     /* Create pipeline barrier */
     vkCmdPipelineBarrier(vulkanObj->cmdBuffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
                          VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
@@ -584,7 +872,7 @@ void transitionImage(VulkanObject *vulkanObj)
                          0,
                          0, NULL,
                          0, NULL,
-                         sizeof(barriers)/sizeof(barriers[0]), barriers);
+                         barrierCount, barriers);
 }
 
 
@@ -667,12 +955,13 @@ VkResult initSwapChain(VulkanObject *vulkanObj)
                     .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
                     .presentMode = VK_PRESENT_MODE_FIFO_KHR,
                     .clipped = VK_TRUE,
-                    .oldSwapchain = NULL
+                    .oldSwapchain = vulkanObj->swapChain
                 };
 
                 sci.imageExtent = surCap.currentExtent;
                 vulkanObj->displayFormat = surFormat[0].format;
                 vulkanObj->displaySize = surCap.currentExtent;
+                vulkanObj->acquiredImages = NUM_SWAP_CHAIN_IMAGES;
 
                 /* Get swap chain images (NumDisplayBuffers) */
                 result = vkCreateSwapchainKHR(vulkanObj->device, &sci, NULL, &vulkanObj->swapChain);
@@ -696,6 +985,134 @@ VkResult initSwapChain(VulkanObject *vulkanObj)
 }
 
 
+void destroyAttachments(VulkanObject *vulkanObj)
+{
+    uint32_t i;
+
+    vkDestroyFramebuffer(vulkanObj->device, vulkanObj->framebuffer, NULL);
+    vulkanObj->framebuffer = VK_NULL_HANDLE;
+
+    for(i=0; i<2; ++i)
+    {
+        vkDestroyImageView(vulkanObj->device, vulkanObj->imageViews[i], NULL);
+        vulkanObj->imageViews[i] = VK_NULL_HANDLE;
+    }
+
+    vkDestroyImage(vulkanObj->device, vulkanObj->colorBuffer, NULL);
+    vkDestroyImage(vulkanObj->device, vulkanObj->depthBuffer, NULL);
+    vulkanObj->colorBuffer = VK_NULL_HANDLE;
+    vulkanObj->depthBuffer = VK_NULL_HANDLE;
+
+    for(i=0; i<2; ++i)
+    {
+        vkFreeMemory(vulkanObj->device, vulkanObj->imageMemory[i], NULL);
+        vulkanObj->imageMemory[i] = VK_NULL_HANDLE;
+    }
+}
+
+
+VkResult recreateAttachments(VulkanObject *vulkanObj)
+{
+    VkCommandBufferBeginInfo cbbi =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+
+    VkSubmitInfo si =
+    {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &vulkanObj->cmdBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+
+    /* Nothing may still be rendering into the old attachments */
+    vkDeviceWaitIdle(vulkanObj->device);
+    vulkanObj->dirtyFlags |= DIRTY_FRAMEBUFFER;
+
+    /* Only the size dependent objects are rebuilt, the render pass and pipelines are kept */
+    destroyAttachments(vulkanObj);
+
+    VkResult result = initImages(vulkanObj);
+    if(VK_SUCCESS == result)
+    {
+        result = initFrameBuffer(vulkanObj);
+    }
+
+    if(VK_SUCCESS == result)
+    {
+        /* Transition the new images into their initial layouts */
+        vkBeginCommandBuffer(vulkanObj->cmdBuffer, &cbbi);
+        transitionImage(vulkanObj);
+        vkEndCommandBuffer(vulkanObj->cmdBuffer);
+
+        result = vkQueueSubmit(vulkanObj->queue, 1, &si, VK_NULL_HANDLE);
+        if(VK_SUCCESS != result)
+        {
+            printf("Failed to submit attachment transitions\n");
+        }
+        else
+        {
+            vkQueueWaitIdle(vulkanObj->queue);
+        }
+    }
+
+    return result;
+}
+
+
+VkResult recreateSwapChain(VulkanObject *vulkanObj)
+{
+    VkSwapchainKHR oldSwapChain = vulkanObj->swapChain;
+    VkSurfaceCapabilitiesKHR surCap;
+
+    VkResult result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vulkanObj->physicalDevice, vulkanObj->surface, &surCap);
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to get physical device surface capabilities: %d\n", result);
+        return result;
+    }
+
+    /* A minimized window has no drawable area, try again later */
+    if(0 == surCap.currentExtent.width || 0 == surCap.currentExtent.height)
+    {
+        return VK_NOT_READY;
+    }
+
+    /* Wait for the presentation engine to finish with the old images */
+    vkDeviceWaitIdle(vulkanObj->device);
+
+    /* Create the new swapchain, handing over the old one */
+    result = initSwapChain(vulkanObj);
+    if(VK_SUCCESS != result)
+    {
+        vulkanObj->swapChain = oldSwapChain;
+        return result;
+    }
+
+    vkDestroySwapchainKHR(vulkanObj->device, oldSwapChain, NULL);
+
+    /* Render at the new display size */
+    vulkanObj->windowSize = vulkanObj->displaySize;
+
+    result = recreateAttachments(vulkanObj);
+    if(VK_SUCCESS == result)
+    {
+        vulkanObj->swapChainOutOfDate = VK_FALSE;
+    }
+
+    return result;
+}
+
+
 buffer_t createBuffer(VulkanObject *vulkanObj, uint32_t size, uint32_t usageFlags, VkMemoryPropertyFlags memFlags, VkSharingMode sharing)
 {
     buffer_t buffer;
@@ -766,51 +1183,290 @@ buffer_t createBuffer(VulkanObject *vulkanObj, uint32_t size, uint32_t usageFlag
 }
 
 
-void createSampler(VulkanObject *vulkanObj)
+void destroyBuffer(VulkanObject *vulkanObj, buffer_t *buffer)
 {
-    VkSamplerCreateInfo sci =
+    /* The memory is unmapped when it is freed */
+    vkDestroyBuffer(vulkanObj->device, buffer->buffer, NULL);
+    vkFreeMemory(vulkanObj->device, buffer->memory, NULL);
+    memset(buffer, 0, sizeof(buffer_t));
+}
+
+
+static void retireResource(VulkanObject *vulkanObj, buffer_t *buffer, texture_t *texture)
+{
+    uint32_t i;
+    retired_resource_t *retired;
+
+    /* Out of room, let everything in flight finish instead */
+    if(vulkanObj->retiredCount == MAX_RETIRED_RESOURCES)
     {
-        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .magFilter = VK_FILTER_LINEAR,
-        .minFilter = VK_FILTER_LINEAR,
-        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-        .mipLodBias = 0,
-        .anisotropyEnable = VK_FALSE,
-        .maxAnisotropy = 1,
-        .compareEnable = VK_FALSE,
-        .compareOp = VK_COMPARE_OP_NEVER,
-        .minLod = 0,
-        .maxLod = 0.25,
-        .borderColor = VK_BORDER_COLOR_INT_OPAQUE_WHITE,
-        .unnormalizedCoordinates = VK_FALSE,
-    };
+        vkDeviceWaitIdle(vulkanObj->device);
+        for(i=0;i<vulkanObj->retiredCount;i++)
+        {
+            destroyBuffer(vulkanObj, &vulkanObj->retiredResources[i].buffer);
+            destroyTexture(vulkanObj, &vulkanObj->retiredResources[i].texture);
+        }
+        vulkanObj->retiredCount = 0;
+    }
 
-    VkResult result = vkCreateSampler(vulkanObj->device, &sci, NULL, &vulkanObj->sampler);
-    if(VK_SUCCESS != result)
+    /* Frames up to the one being recorded may still read it */
+    retired = &vulkanObj->retiredResources[vulkanObj->retiredCount++];
+    memset(retired, 0, sizeof(retired_resource_t));
+    retired->frame = vulkanObj->frameSerial;
+    if(buffer != NULL)
     {
-        printf("Unable to create sampler\n");
+        retired->buffer = *buffer;
+        memset(buffer, 0, sizeof(buffer_t));
     }
-    else
+    if(texture != NULL)
     {
-        vulkanObj->samplerInfo.sampler = vulkanObj->sampler;
+        retired->texture = *texture;
+        memset(texture, 0, sizeof(texture_t));
     }
 }
 
 
-void allocateDescriptorSet(VulkanObject *vulkanObj)
+void retireBuffer(VulkanObject *vulkanObj, buffer_t *buffer)
 {
-    VkDescriptorPoolSize dps[] =
+    if(VK_NULL_HANDLE != buffer->buffer)
     {
-        {
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 4
-        },
-        {
+        retireResource(vulkanObj, buffer, NULL);
+    }
+}
+
+
+void destroyTexture(VulkanObject *vulkanObj, texture_t *texture)
+{
+    vkDestroyImageView(vulkanObj->device, texture->view, NULL);
+    vkDestroyImage(vulkanObj->device, texture->image, NULL);
+    vkFreeMemory(vulkanObj->device, texture->memory, NULL);
+    memset(texture, 0, sizeof(texture_t));
+}
+
+
+void retireTexture(VulkanObject *vulkanObj, texture_t *texture)
+{
+    if(VK_NULL_HANDLE != texture->image)
+    {
+        retireResource(vulkanObj, NULL, texture);
+    }
+}
+
+
+static void releaseRetiredResources(VulkanObject *vulkanObj)
+{
+    uint32_t i;
+    uint32_t kept = 0;
+
+    /* The fence of this slot has been waited on, so has the one of the frame before it */
+    for(i=0;i<vulkanObj->retiredCount;i++)
+    {
+        if(vulkanObj->frameSerial - vulkanObj->retiredResources[i].frame >= MAX_FRAMES_IN_FLIGHT)
+        {
+            destroyBuffer(vulkanObj, &vulkanObj->retiredResources[i].buffer);
+            destroyTexture(vulkanObj, &vulkanObj->retiredResources[i].texture);
+        }
+        else
+        {
+            vulkanObj->retiredResources[kept++] = vulkanObj->retiredResources[i];
+        }
+    }
+    vulkanObj->retiredCount = kept;
+}
+
+
+void beginGeometryStream(VulkanObject *vulkanObj)
+{
+    material_t material;
+    scene_instance_t instance;
+    instanceRef_t ref = { 0, 0 };
+
+    /* One copy at the origin with the default material, the scene brings its own when it is in */
+    memset(&material, 0, sizeof(material_t));
+    setMaterialDefaults(&material);
+    generateScaleTranslationMatrix((vec3_t){ 1.0f, 1.0f, 1.0f }, (vec3_t){ 0.0f, 0.0f, 0.0f }, instance.transform);
+
+    createInstanceBuffer(vulkanObj, &instance, 1);
+    createMaterialBuffer(vulkanObj, &material, 1);
+
+    /* Every streamed range draws instance 0 */
+    vulkanObj->instanceRefBuffer = createBuffer(vulkanObj,
+        sizeof(instanceRef_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+    memcpy(vulkanObj->instanceRefBuffer.ptr, &ref, sizeof(instanceRef_t));
+
+    createInstanceBufferDescriptorSet(vulkanObj);
+    createMaterialBufferDescriptorSet(vulkanObj);
+}
+
+
+void appendVertexArena(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, buffer_t *staging, VkDeviceSize size)
+{
+    vertex_arena_t *arena = &vulkanObj->vertexArena;
+    VkDeviceSize capacity = (arena->capacity > 0) ? arena->capacity : VERTEX_ARENA_MIN_SIZE;
+    VkBufferCopy region;
+    buffer_t grown;
+
+    VkMemoryBarrier barrier =
+    {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+    };
+
+    /* Double until the chunk fits */
+    while(arena->size + size > capacity)
+    {
+        capacity *= 2;
+    }
+
+    if(capacity > arena->capacity)
+    {
+        grown = createBuffer(vulkanObj,
+            (uint32_t)capacity,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            VK_SHARING_MODE_EXCLUSIVE);
+
+        /* The vertices copied so far move along on the GPU, once the earlier copies have landed */
+        if(arena->size > 0)
+        {
+            vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+            region = (VkBufferCopy){ 0, 0, arena->size };
+            vkCmdCopyBuffer(cmdBuf, arena->buffer.buffer, grown.buffer, 1, &region);
+        }
+
+        /* The frame before this one still draws from the old buffer */
+        retireBuffer(vulkanObj, &arena->buffer);
+        arena->buffer = grown;
+        arena->capacity = capacity;
+        arena->growCount++;
+    }
+
+    /* Only the new chunk is copied, after the vertices already there */
+    region = (VkBufferCopy){ 0, arena->size, size };
+    vkCmdCopyBuffer(cmdBuf, staging->buffer, arena->buffer.buffer, 1, &region);
+
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+    arena->size += size;
+    arena->copyCount++;
+    vulkanObj->vertexBuffer = arena->buffer;
+}
+
+
+VkBool32 endGeometryStream(VulkanObject *vulkanObj, VkBool32 keepVertices)
+{
+    VkBool32 kept = (keepVertices && vulkanObj->vertexArena.size > 0) ? VK_TRUE : VK_FALSE;
+
+    /* The scene rewrites the bindings the streamed draws read, no frame may still use them */
+    vkDeviceWaitIdle(vulkanObj->device);
+
+    /* The scene brings its own instances, materials and references */
+    destroyBuffer(vulkanObj, &vulkanObj->instanceBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->materialBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->instanceRefBuffer);
+
+    /* The arena becomes the vertex buffer when it holds the scene's vertices in the scene's order */
+    if(!kept)
+    {
+        destroyBuffer(vulkanObj, &vulkanObj->vertexArena.buffer);
+        memset(&vulkanObj->vertexBuffer, 0, sizeof(buffer_t));
+    }
+
+    memFree(vulkanObj->streamDrawCmds);
+    vulkanObj->streamDrawCmds = NULL;
+    vulkanObj->streamDrawCount = 0;
+    vulkanObj->streamDrawCapacity = 0;
+    memset(&vulkanObj->vertexArena, 0, sizeof(vertex_arena_t));
+
+    return kept;
+}
+
+
+void releaseSceneBuffers(VulkanObject *vulkanObj)
+{
+    /* The scene is being replaced, no frame may be in flight */
+    destroyBuffer(vulkanObj, &vulkanObj->vertexBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->instanceBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->materialBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->instanceRefBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->drawCmdBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->boundsBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->conesBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->lodsBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->visibleDrawBuffer);
+    destroyBuffer(vulkanObj, &vulkanObj->visibleCountBuffer);
+
+    /* Rebuilt with the draw commands */
+    memFree(vulkanObj->drawCmds);
+    memFree(vulkanObj->visibleDrawCmds);
+    memFree(vulkanObj->drawBounds);
+    memFree(vulkanObj->drawCones);
+    memFree(vulkanObj->drawLods);
+    memFree(vulkanObj->lodDrawCmds);
+    memFree(vulkanObj->instanceRefs);
+    vulkanObj->drawCmds = NULL;
+    vulkanObj->visibleDrawCmds = NULL;
+    vulkanObj->drawBounds = NULL;
+    vulkanObj->drawCones = NULL;
+    vulkanObj->drawLods = NULL;
+    vulkanObj->lodDrawCmds = NULL;
+    vulkanObj->instanceRefs = NULL;
+    vulkanObj->drawCount = 0;
+    vulkanObj->instanceRefCount = 0;
+}
+
+
+void createSampler(VulkanObject *vulkanObj)
+{
+    VkSamplerCreateInfo sci =
+    {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .mipLodBias = 0,
+        .anisotropyEnable = VK_FALSE,
+        .maxAnisotropy = 1,
+        .compareEnable = VK_FALSE,
+        .compareOp = VK_COMPARE_OP_NEVER,
+        .minLod = 0,
+        .maxLod = VK_LOD_CLAMP_NONE,
+        .borderColor = VK_BORDER_COLOR_INT_OPAQUE_WHITE,
+        .unnormalizedCoordinates = VK_FALSE,
+    };
+
+    VkResult result = vkCreateSampler(vulkanObj->device, &sci, NULL, &vulkanObj->sampler);
+    if(VK_SUCCESS != result)
+    {
+        printf("Unable to create sampler\n");
+    }
+    else
+    {
+        vulkanObj->samplerInfo.sampler = vulkanObj->sampler;
+    }
+}
+
+
+void allocateDescriptorSet(VulkanObject *vulkanObj)
+{
+    VkDescriptorPoolSize dps[] =
+    {
+        {
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 4
+        },
+        {
             .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             .descriptorCount = 5
         },
@@ -820,37 +1476,23 @@ void allocateDescriptorSet(VulkanObject *vulkanObj)
         },
         {
             .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-            .descriptorCount = 5
+            .descriptorCount = vulkanObj->textureCapacity
+        },
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 3 + CULL_LAYOUT_BINDING_COUNT
         }
     };
 
-    VkDescriptorPoolCreateInfo dpci =
-    {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-        .maxSets = 6,
-        .poolSizeCount = sizeof (dps)/sizeof(dps[0]),
-        .pPoolSizes = dps
-    };
-
-    VkResult result = vkCreateDescriptorPool(vulkanObj->device, &dpci, NULL, &vulkanObj->descriptorPool);
+    /* Sized for one frame slot's scene and cull sets, the manager adds bigger pools when these run out */
+    VkResult result = initDescriptorManager(&vulkanObj->descriptors, vulkanObj->device, dps, sizeof(dps)/sizeof(dps[0]), 4, MAX_FRAMES_IN_FLIGHT);
     if(VK_SUCCESS != result)
     {
         printf("Failed to create descriptor pool\n");
     }
     else
     {
-        VkDescriptorSetAllocateInfo dsai =
-        {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .pNext = NULL,
-            .descriptorPool = vulkanObj->descriptorPool,
-            .descriptorSetCount = 1,
-            .pSetLayouts = &vulkanObj->dsl
-        };
-        result = vkAllocateDescriptorSets(vulkanObj->device, &dsai, &vulkanObj->descriptorSet);
-
+        result = allocateFrameDescriptorSets(&vulkanObj->descriptors, vulkanObj->dsl, vulkanObj->descriptorSets);
         if(VK_SUCCESS != result)
         {
             printf("Failed to allocate descriptor sets\n");
@@ -863,197 +1505,701 @@ void allocateDescriptorSet(VulkanObject *vulkanObj)
 void createImageDescriptorSet(VulkanObject *vulkanObj, texture_t textures[])
 {
     uint32_t i;
+    uint32_t first = vulkanObj->writtenTextureCount;
+    uint32_t end = vulkanObj->numOfTextures;
+
+    /* Slot 0 holds the white texture untextured materials sample, nothing else can stand in for it */
+    if(0 == end)
+    {
+        printf("No texture in slot 0, the texture array is not written\n");
+        return;
+    }
 
-    for(i=0; i<vulkanObj->numOfTextures ; i++)
+    /* Without partially bound descriptors every slot in the array has to be valid, spare slots repeat the white texture */
+    if(!vulkanObj->descriptorIndexing && 0 == first)
+    {
+        end = vulkanObj->textureCapacity;
+    }
+
+    /* Only the slots of textures added since the last call are written */
+    for(i=first; i<end; i++)
     {
         vulkanObj->dii[i].sampler = NULL;
-        vulkanObj->dii[i].imageView = textures[i].view;
+        vulkanObj->dii[i].imageView = textures[(i < vulkanObj->numOfTextures) ? i : 0].view;
         vulkanObj->dii[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
 
-    vulkanObj->wds[vulkanObj->descSetCount].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    vulkanObj->wds[vulkanObj->descSetCount].pNext = NULL;
-    vulkanObj->wds[vulkanObj->descSetCount].dstSet = vulkanObj->descriptorSet;
-    vulkanObj->wds[vulkanObj->descSetCount].dstBinding = BINDING_FRAG_TEXTURES;
-    vulkanObj->wds[vulkanObj->descSetCount].dstArrayElement = 0;
-    vulkanObj->wds[vulkanObj->descSetCount].descriptorCount = vulkanObj->numOfTextures;
-    vulkanObj->wds[vulkanObj->descSetCount].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    vulkanObj->wds[vulkanObj->descSetCount].pImageInfo = vulkanObj->dii;
-    vulkanObj->wds[vulkanObj->descSetCount].pBufferInfo = NULL;
-    vulkanObj->wds[vulkanObj->descSetCount].pTexelBufferView = NULL;
+    if(end > first)
+    {
+        /* The slots stay unwritten, the next call queues them again */
+        if(VK_SUCCESS != queueImageWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_FRAG_TEXTURES, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, first, end - first, &vulkanObj->dii[first]))
+        {
+            printf("Failed to queue texture descriptor writes %d to %d\n", first, end);
+            return;
+        }
+        vulkanObj->dirtyFlags |= DIRTY_MATERIALS;
+    }
+    vulkanObj->writtenTextureCount = vulkanObj->numOfTextures;
+}
+
 
-    vulkanObj->descSetCount++;
+void writeTextureSlot(VulkanObject *vulkanObj, uint32_t slot, texture_t *texture)
+{
+    /* Only while no frame in flight reads the slot, each frame slot shows the new image from its next descriptor flush */
+    vulkanObj->textures[slot] = *texture;
+    vulkanObj->dii[slot].sampler = NULL;
+    vulkanObj->dii[slot].imageView = texture->view;
+    vulkanObj->dii[slot].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-    vkUpdateDescriptorSets(vulkanObj->device, vulkanObj->descSetCount, vulkanObj->wds, 0, NULL);
+    if(VK_SUCCESS != queueImageWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_FRAG_TEXTURES, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, slot, 1, &vulkanObj->dii[slot]))
+    {
+        printf("Failed to queue the descriptor write of texture slot %d\n", slot);
+    }
+    vulkanObj->dirtyFlags |= DIRTY_MATERIALS;
 }
 
 
 void createUniformBufferDescriptorSet(VulkanObject *vulkanObj, uint32_t uniformStructSize)
 {
+    if(VK_SUCCESS != queueBufferWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_FRAG_UNIFORM, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        vulkanObj->uniformBuffer.buffer, 0, uniformStructSize))
+    {
+        printf("Failed to queue the uniform buffer descriptor write\n");
+    }
+}
 
-    vulkanObj->dbi.buffer = vulkanObj->uniformBuffer.buffer;
-    vulkanObj->dbi.offset = 0;
-    vulkanObj->dbi.range = uniformStructSize;
 
-    vulkanObj->wds[vulkanObj->descSetCount].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    vulkanObj->wds[vulkanObj->descSetCount].pNext = NULL;
-    vulkanObj->wds[vulkanObj->descSetCount].dstSet = vulkanObj->descriptorSet;
-    vulkanObj->wds[vulkanObj->descSetCount].dstBinding = BINDING_FRAG_UNIFORM;
-    vulkanObj->wds[vulkanObj->descSetCount].dstArrayElement = 0;
-    vulkanObj->wds[vulkanObj->descSetCount].descriptorCount = 1;
-    vulkanObj->wds[vulkanObj->descSetCount].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    vulkanObj->wds[vulkanObj->descSetCount].pImageInfo = NULL;
-    vulkanObj->wds[vulkanObj->descSetCount].pBufferInfo = &vulkanObj->dbi;
-    vulkanObj->wds[vulkanObj->descSetCount].pTexelBufferView = NULL;
+void createTextureBufferDescriptorSet(VulkanObject *vulkanObj)
+{
+    if(VK_SUCCESS != queueImageWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_FRAG_SAMPLER, VK_DESCRIPTOR_TYPE_SAMPLER, 0, 1, &vulkanObj->samplerInfo))
+    {
+        printf("Failed to queue the sampler descriptor write\n");
+    }
+}
 
-    vulkanObj->descSetCount++;
 
-    vkUpdateDescriptorSets(vulkanObj->device, vulkanObj->descSetCount, vulkanObj->wds, 0, NULL);
+void createMaterialBufferDescriptorSet(VulkanObject *vulkanObj)
+{
+    if(VK_SUCCESS != queueBufferWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_FRAG_MATERIALS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        vulkanObj->materialBuffer.buffer, 0, VK_WHOLE_SIZE))
+    {
+        printf("Failed to queue the material buffer descriptor write\n");
+    }
+    vulkanObj->dirtyFlags |= DIRTY_MATERIALS;
 }
 
 
-void createTextureBufferDescriptorSet(VulkanObject *vulkanObj)
+void createMaterialBuffer(VulkanObject *vulkanObj, material_t *materials, uint32_t materialCount)
 {
+    /* One entry per material, indexed in the shader through the instance references */
+    vulkanObj->materialBuffer = createBuffer(vulkanObj,
+        sizeof(gpuMaterial_t) * ((materialCount > 0) ? materialCount : 1),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    updateMaterialBuffer(vulkanObj, materials, 0, materialCount);
+}
 
-    vulkanObj->wds[vulkanObj->descSetCount].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    vulkanObj->wds[vulkanObj->descSetCount].pNext = NULL;
-    vulkanObj->wds[vulkanObj->descSetCount].dstSet = vulkanObj->descriptorSet;
-    vulkanObj->wds[vulkanObj->descSetCount].dstBinding = BINDING_FRAG_SAMPLER;
-    vulkanObj->wds[vulkanObj->descSetCount].dstArrayElement = 0;
-    vulkanObj->wds[vulkanObj->descSetCount].descriptorCount = 1;
-    vulkanObj->wds[vulkanObj->descSetCount].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-    vulkanObj->wds[vulkanObj->descSetCount].pImageInfo = &vulkanObj->samplerInfo;
-    vulkanObj->wds[vulkanObj->descSetCount].pBufferInfo = NULL;
-    vulkanObj->wds[vulkanObj->descSetCount].pTexelBufferView = NULL;
 
-    vulkanObj->descSetCount++;
+void updateMaterialBuffer(VulkanObject *vulkanObj, material_t *materials, uint32_t firstMaterial, uint32_t materialCount)
+{
+    uint32_t i;
+    gpuMaterial_t *gm;
+    materialProperties_t *mp;
 
-    vkUpdateDescriptorSets(vulkanObj->device, vulkanObj->descSetCount, vulkanObj->wds, 0, NULL);
+    /* Repack into the std430 layout, frames reading these entries must have completed */
+    gm = (gpuMaterial_t *)vulkanObj->materialBuffer.ptr;
+    for(i=firstMaterial;i<firstMaterial+materialCount;i++)
+    {
+        mp = &materials[i].mp;
+        gm[i] = (gpuMaterial_t)
+        {
+            .Ka = { mp->Ka.x, mp->Ka.y, mp->Ka.z }, .Ni = mp->Ni,
+            .Kd = { mp->Kd.x, mp->Kd.y, mp->Kd.z }, .d = mp->d,
+            .Ks = { mp->Ks.x, mp->Ks.y, mp->Ks.z }, .Ns = mp->Ns,
+            .imageIndex = mp->imageIndex,
+            .illum = mp->illum,
+            .shininess = mp->shininess,
+            .imageLayer = mp->imageLayer
+        };
+    }
+    vulkanObj->dirtyFlags |= DIRTY_MATERIALS;
 }
 
 
-VkResult createFence(VulkanObject *vulkanObj, VkFenceCreateInfo *info, VkFence *outFence, uint32_t count)
+void createSceneBuffer(VulkanObject *vulkanObj)
 {
-    VkResult result;
-    uint32_t i;
+    /* Lights and camera target, shared by every draw */
+    vulkanObj->sceneBuffer = createBuffer(vulkanObj,
+        sizeof(gpuScene_t),
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    memset(&vulkanObj->sceneData, 0, sizeof(gpuScene_t));
+    memset(vulkanObj->sceneBuffer.ptr, 0, sizeof(gpuScene_t));
+}
 
-    VkFenceCreateInfo fenceInfo = {0};
 
-    for(i=0;i<count;i++)
+void createSceneBufferDescriptorSet(VulkanObject *vulkanObj)
+{
+    if(VK_SUCCESS != queueBufferWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_FRAG_SCENE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        vulkanObj->sceneBuffer.buffer, 0, sizeof(gpuScene_t)))
     {
-        if ( info == NULL )
-        {
-            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fenceInfo.pNext = NULL;
-            fenceInfo.flags = 0;
-
-            result = vkCreateFence(vulkanObj->device, &fenceInfo, NULL, outFence+i);
-        }
-        else
-        {
-            result = vkCreateFence(vulkanObj->device, info, NULL, outFence+i);
-        }
+        printf("Failed to queue the scene buffer descriptor write\n");
     }
-    return result;
 }
 
 
-void waitForFence(VulkanObject *vulkanObj, VkFence fence)
+static void updateSceneBuffer(VulkanObject *vulkanObj, sceneProperties_t *sp)
 {
-    if (fence)
+    gpuScene_t scene =
     {
-        if (vkGetFenceStatus(vulkanObj->device, fence) == VK_SUCCESS)
-        {
-            vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, 0);
-        }
+        .lightPosition = { sp->lightPosition.x, sp->lightPosition.y, sp->lightPosition.z, 1.0f },
+        .cameraTarget = { sp->cameraTarget.x, sp->cameraTarget.y, sp->cameraTarget.z, 1.0f },
+        .ambientLight = { sp->ambientLight.x, sp->ambientLight.y, sp->ambientLight.z, 0.0f },
+        .lightSourceIntensity = { sp->lightSourceIntensity.x, sp->lightSourceIntensity.y, sp->lightSourceIntensity.z, 0.0f }
+    };
+
+    /* Only written when something changed, so frames in flight normally read a stable block */
+    if(0 != memcmp(&vulkanObj->sceneData, &scene, sizeof(gpuScene_t)))
+    {
+        vulkanObj->sceneData = scene;
+        memcpy(vulkanObj->sceneBuffer.ptr, &scene, sizeof(gpuScene_t));
     }
 }
 
 
-void transitionImageLayout(VulkanObject *vulkanObj, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
+void createInstanceBufferDescriptorSet(VulkanObject *vulkanObj)
 {
-    VkFence fence;
+    /* Transforms, then the per draw instance references */
+    if(VK_SUCCESS != queueBufferWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_VERT_INSTANCES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        vulkanObj->instanceBuffer.buffer, 0, VK_WHOLE_SIZE) ||
+       VK_SUCCESS != queueBufferWrite(&vulkanObj->descriptors, vulkanObj->descriptorSets, BINDING_VERT_INSTANCE_REFS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        vulkanObj->instanceRefBuffer.buffer, 0, VK_WHOLE_SIZE))
+    {
+        printf("Failed to queue the instance buffer descriptor writes\n");
+    }
+    vulkanObj->dirtyFlags |= DIRTY_DRAWS;
+}
 
-    createFence(vulkanObj, NULL, &fence, 1);
 
-    VkImageMemoryBarrier barrier = {0};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
+void createInstanceBuffer(VulkanObject *vulkanObj, scene_instance_t *instances, uint32_t instanceCount)
+{
+    /* One transform per instance, grouped by mesh */
+    vulkanObj->instanceBuffer = createBuffer(vulkanObj,
+        sizeof(scene_instance_t) * ((instanceCount > 0) ? instanceCount : 1),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    memcpy(vulkanObj->instanceBuffer.ptr, instances, sizeof(scene_instance_t) * instanceCount);
+    vulkanObj->dirtyFlags |= DIRTY_DRAWS;
+}
 
-    //these are used to transfer queue ownership, which we aren't doing
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
+static void addDraw(VulkanObject *vulkanObj, scene_t *scene, scene_mesh_t *mesh, uint32_t firstFace, uint32_t faceCount, uint32_t materialIndex,
+                    boundingSphere_t *sphere, normalCone_t *cone, lod_level_t *lods)
+{
+    uint32_t k;
+    lod_level_t *drawLods = &vulkanObj->drawLods[vulkanObj->drawCount*MAX_LOD_LEVELS];
+    VkDrawIndirectCommand *drawCmd = &vulkanObj->drawCmds[vulkanObj->drawCount];
 
-    VkPipelineStageFlags sourceStage = { 0 };
-    VkPipelineStageFlags destinationStage = { 0 };
+    /* Every copy of the mesh in one draw, the first instance points at the draw's instance references */
+    drawCmd->vertexCount = faceCount*ELEMENTS_PER_FACE;
+    drawCmd->instanceCount = mesh->instanceCount;
+    drawCmd->firstVertex = mesh->firstVertex + firstFace*ELEMENTS_PER_FACE;
+    drawCmd->firstInstance = vulkanObj->instanceRefCount;
 
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+    for(k=0;k<mesh->instanceCount;k++)
     {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        vulkanObj->instanceRefs[vulkanObj->instanceRefCount++] = (instanceRef_t){ mesh->firstInstance + k, mesh->firstMaterial + materialIndex };
     }
-    else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-    {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    }
-    else
+    /* Bounds in scene space, around every copy */
+    vulkanObj->drawBounds[vulkanObj->drawCount] = instanceBounds(scene, mesh, sphere);
+    vulkanObj->drawCones[vulkanObj->drawCount] = *cone;
+
+    /* Simplified levels, or the faces themselves at every level, moved into the shared vertex buffer */
+    for(k=0;k<MAX_LOD_LEVELS;k++)
     {
-        /* Unsupported layout transition */
-        printf("Attempting an unsupported image layout transition\n");
+        drawLods[k] = (lods != NULL) ? lods[k] : (lod_level_t){ firstFace, faceCount, 0.0f, 0 };
+        drawLods[k].firstFace += mesh->firstVertex / ELEMENTS_PER_FACE;
     }
 
-    vkCmdPipelineBarrier(
-        vulkanObj->cmdBuffer,
-        sourceStage, destinationStage,
-        0,
-        0, NULL,
-        0, NULL,
-        1, &barrier
-    );
+    vulkanObj->drawCount++;
 }
 
 
-texture_t createTextureImage(VulkanObject *vulkanObj, VkExtent2D *size, buffer_t *staging)
+static VkBool32 cullsBackfaces(scene_t *scene, scene_mesh_t *mesh, uint32_t materialIndex)
 {
-    texture_t texture;
-    uint32_t qfi[1] =
+    /* Only a closed surface hides its backfaces, unless the material lets them show through */
+    return (mesh->closed && scene->materials[mesh->firstMaterial + materialIndex].mp.d >= 1.0f) ? VK_TRUE : VK_FALSE;
+}
+
+
+void createDrawCommands(VulkanObject *vulkanObj, scene_t *scene)
+{
+    uint32_t endFace;
+    uint32_t faceCount;
+    uint32_t i, m;
+    uint32_t pass;
+    uint32_t meshDraws;
+    uint32_t cornerStride;
+    uint32_t maxDraws = 0;
+    uint32_t maxInstanceRefs = 0;
+    scene_mesh_t *mesh;
+    model_t *model;
+    boundingSphere_t sphere;
+    normalCone_t noCull = { { 0.0f, 0.0f, 0.0f }, CONE_NO_CULL };
+
+    /* Draws per mesh, each draw references every instance of its mesh */
+    for(m=0;m<scene->meshCount;m++)
     {
-        0
-    };
+        meshDraws = (scene->meshes[m].meshlets.count > 0) ? scene->meshes[m].meshlets.count : scene->meshes[m].model.materialChangeCount;
+        maxDraws += meshDraws;
+        maxInstanceRefs += meshDraws * scene->meshes[m].instanceCount;
+    }
 
-    VkImageCreateInfo ici =
+    vulkanObj->drawCmds = (VkDrawIndirectCommand *)memAlloc(MEMORY_RENDERER, sizeof(VkDrawIndirectCommand) * maxDraws);
+    vulkanObj->visibleDrawCmds = (VkDrawIndirectCommand *)memAlloc(MEMORY_RENDERER, sizeof(VkDrawIndirectCommand) * maxDraws);
+    vulkanObj->drawBounds = (boundingSphere_t *)memAlloc(MEMORY_RENDERER, sizeof(boundingSphere_t) * maxDraws);
+    vulkanObj->drawCones = (normalCone_t *)memAlloc(MEMORY_RENDERER, sizeof(normalCone_t) * maxDraws);
+    vulkanObj->drawLods = (lod_level_t *)memAlloc(MEMORY_RENDERER, sizeof(lod_level_t) * MAX_LOD_LEVELS * maxDraws);
+    vulkanObj->lodDrawCmds = (VkDrawIndirectCommand *)memAlloc(MEMORY_RENDERER, sizeof(VkDrawIndirectCommand) * maxDraws);
+    vulkanObj->instanceRefs = (instanceRef_t *)memAlloc(MEMORY_RENDERER, sizeof(instanceRef_t) * ((maxInstanceRefs > 0) ? maxInstanceRefs : 1));
+    vulkanObj->drawCount = 0;
+    vulkanObj->instanceRefCount = 0;
+    vulkanObj->lodSelection = VK_FALSE;
+
+    /* Draws that cull backfaces first, then the double sided ones, so each group is one pipeline */
+    for(pass=0;pass<2;pass++)
     {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = VK_FORMAT_R8G8B8A8_UNORM,
-        .extent = {size->width, size->height, 1},
-        .mipLevels = 1,
-        .arrayLayers = 1,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 1,
-        .pQueueFamilyIndices = qfi,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
-    };
+        for(m=0;m<scene->meshCount;m++)
+        {
+            mesh = &scene->meshes[m];
+            model = &mesh->model;
+            cornerStride = (model->numOfNormals == 0) ? 2 : 3;
+
+            /* Build one draw per meshlet, backfacing meshlets are only hidden on closed meshes drawn once */
+            for(i=0;i<mesh->meshlets.count;i++)
+            {
+                if(cullsBackfaces(scene, mesh, mesh->meshlets.meshlets[i].materialIndex) != (pass == 0))
+                {
+                    continue;
+                }
+                addDraw(vulkanObj, scene, mesh, mesh->meshlets.meshlets[i].firstFace, mesh->meshlets.meshlets[i].faceCount, mesh->meshlets.meshlets[i].materialIndex,
+                    &mesh->meshlets.meshlets[i].sphere, (mesh->meshlets.closed && mesh->instanceCount == 1) ? &mesh->meshlets.meshlets[i].cone : &noCull, NULL);
+            }
+
+            /* Otherwise build one draw per material range */
+            for(i=0;mesh->meshlets.count == 0 && i<model->materialChangeCount;i++)
+            {
+                endFace = (i < model->materialChangeCount - 1) ? model->materialChange[i+1].startFace : model->numOfFaces;
+
+                faceCount = (endFace - model->materialChange[i].startFace);
+                if(faceCount == 0 || cullsBackfaces(scene, mesh, model->materialChange[i].materialIndex) != (pass == 0))
+                {
+                    continue;
+                }
+
+                /* Bounds of the range in model space, for culling */
+                sphere = computeBoundingSphere(model->v, model->f, cornerStride, model->materialChange[i].startFace, faceCount);
+                addDraw(vulkanObj, scene, mesh, model->materialChange[i].startFace, faceCount, model->materialChange[i].materialIndex,
+                    &sphere, &noCull, (i < mesh->lods.rangeCount) ? &mesh->lods.levels[i*MAX_LOD_LEVELS] : NULL);
+            }
+
+            vulkanObj->lodSelection = vulkanObj->lodSelection || (mesh->meshlets.count == 0 && mesh->lods.rangeCount > 0);
+        }
+
+        if(pass == 0)
+        {
+            vulkanObj->cullBackDrawCount = vulkanObj->drawCount;
+        }
+    }
+
+    /* Keep the commands on the GPU, they don't change after loading */
+    vulkanObj->drawCmdBuffer = createBuffer(vulkanObj,
+        sizeof(VkDrawIndirectCommand) * ((vulkanObj->drawCount > 0) ? vulkanObj->drawCount : 1),
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    memcpy(vulkanObj->drawCmdBuffer.ptr, vulkanObj->drawCmds, sizeof(VkDrawIndirectCommand) * vulkanObj->drawCount);
+
+    /* Range bounds read by the cull shader */
+    vulkanObj->boundsBuffer = createBuffer(vulkanObj,
+        sizeof(boundingSphere_t) * ((vulkanObj->drawCount > 0) ? vulkanObj->drawCount : 1),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    memcpy(vulkanObj->boundsBuffer.ptr, vulkanObj->drawBounds, sizeof(boundingSphere_t) * vulkanObj->drawCount);
+
+    vulkanObj->conesBuffer = createBuffer(vulkanObj,
+        sizeof(normalCone_t) * ((vulkanObj->drawCount > 0) ? vulkanObj->drawCount : 1),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    memcpy(vulkanObj->conesBuffer.ptr, vulkanObj->drawCones, sizeof(normalCone_t) * vulkanObj->drawCount);
+
+    vulkanObj->lodsBuffer = createBuffer(vulkanObj,
+        sizeof(lod_level_t) * MAX_LOD_LEVELS * ((vulkanObj->drawCount > 0) ? vulkanObj->drawCount : 1),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    memcpy(vulkanObj->lodsBuffer.ptr, vulkanObj->drawLods, sizeof(lod_level_t) * MAX_LOD_LEVELS * vulkanObj->drawCount);
+
+    /* Draws that survive culling, and how many there are */
+    vulkanObj->visibleDrawBuffer = createBuffer(vulkanObj,
+        sizeof(VkDrawIndirectCommand) * ((vulkanObj->drawCount > 0) ? vulkanObj->drawCount : 1),
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    vulkanObj->visibleCountBuffer = createBuffer(vulkanObj,
+        sizeof(uint32_t) * 2,
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    /* Transform and material of every drawn instance, read by the vertex shader */
+    vulkanObj->instanceRefBuffer = createBuffer(vulkanObj,
+        sizeof(instanceRef_t) * ((vulkanObj->instanceRefCount > 0) ? vulkanObj->instanceRefCount : 1),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_SHARING_MODE_EXCLUSIVE);
+
+    memcpy(vulkanObj->instanceRefBuffer.ptr, vulkanObj->instanceRefs, sizeof(instanceRef_t) * vulkanObj->instanceRefCount);
+    vulkanObj->dirtyFlags |= DIRTY_DRAWS;
+
+    printf("\tdraw calls:\t\t%d (%s, %d instances, %d backface culled)\n", vulkanObj->drawCount, vulkanObj->multiDrawIndirect ? "multi draw indirect" : "per draw", scene->instanceCount, vulkanObj->cullBackDrawCount);
+}
+
+
+static VkResult createCullComputePipeline(VulkanObject *vulkanObj, VkPipeline *pipeline)
+{
+    VkResult result;
+    VkShaderModule computeShader = createShaderModule(vulkanObj->device, SHADER_CULL_FILE);
+
+    VkComputePipelineCreateInfo cpci =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .stage =
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = computeShader,
+            .pName = "main",
+        },
+        .layout = vulkanObj->cullPll,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = 0
+    };
+
+    if(VK_NULL_HANDLE == computeShader)
+    {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    result = vkCreateComputePipelines(vulkanObj->device, vulkanObj->pipelineCache, 1, &cpci, NULL, pipeline);
+    vkDestroyShaderModule(vulkanObj->device, computeShader, NULL);
+    return result;
+}
+
+
+void createCullPipeline(VulkanObject *vulkanObj)
+{
+    uint32_t i;
+
+    /* Bounds, source draws, visible draws, the visible count, normal cones and lod levels */
+    VkDescriptorSetLayoutBinding dslb[CULL_LAYOUT_BINDING_COUNT];
+    for(i=0;i<CULL_LAYOUT_BINDING_COUNT;i++)
+    {
+        dslb[i].binding = i;
+        dslb[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        dslb[i].descriptorCount = 1;
+        dslb[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        dslb[i].pImmutableSamplers = NULL;
+    }
+
+    VkDescriptorSetLayoutCreateInfo dslci =
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .bindingCount = CULL_LAYOUT_BINDING_COUNT,
+        .pBindings = dslb
+    };
+
+    VkResult result = vkCreateDescriptorSetLayout(vulkanObj->device, &dslci, NULL, &vulkanObj->cullDsl);
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to create cull descriptor set layout\n");
+        return;
+    }
+
+    VkPushConstantRange pushConst =
+    {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(cullPushConstants_t)
+    };
+
+    VkPipelineLayoutCreateInfo plci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &vulkanObj->cullDsl,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConst,
+    };
+
+    result = vkCreatePipelineLayout(vulkanObj->device, &plci, NULL, &vulkanObj->cullPll);
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to create cull pipeline layout\n");
+        return;
+    }
+
+    result = createCullComputePipeline(vulkanObj, &vulkanObj->cullPipeline);
+    if(VK_SUCCESS != result)
+    {
+        printf("Error creating cull pipeline %d\n", result);
+    }
+}
+
+
+VkResult reloadCullPipeline(VulkanObject *vulkanObj)
+{
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkResult result = createCullComputePipeline(vulkanObj, &pipeline);
+
+    /* A shader that does not build leaves the old pipeline in place, no frame may be in flight */
+    if(VK_SUCCESS != result)
+    {
+        printf("Error rebuilding cull pipeline %d, keeping the previous one\n", result);
+        return result;
+    }
+
+    vkDestroyPipeline(vulkanObj->device, vulkanObj->cullPipeline, NULL);
+    vulkanObj->cullPipeline = pipeline;
+    vulkanObj->dirtyFlags |= DIRTY_PIPELINES;
+    return VK_SUCCESS;
+}
+
+
+void createCullDescriptorSet(VulkanObject *vulkanObj)
+{
+    uint32_t i;
+
+    VkResult result = VK_SUCCESS;
+
+    /* A reloaded scene rewrites the set it already has */
+    if(VK_NULL_HANDLE == vulkanObj->cullDescriptorSets[0])
+    {
+        result = allocateFrameDescriptorSets(&vulkanObj->descriptors, vulkanObj->cullDsl, vulkanObj->cullDescriptorSets);
+    }
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to allocate cull descriptor set\n");
+        return;
+    }
+
+    VkBuffer buffers[CULL_LAYOUT_BINDING_COUNT] =
+    {
+        vulkanObj->boundsBuffer.buffer,
+        vulkanObj->drawCmdBuffer.buffer,
+        vulkanObj->visibleDrawBuffer.buffer,
+        vulkanObj->visibleCountBuffer.buffer,
+        vulkanObj->conesBuffer.buffer,
+        vulkanObj->lodsBuffer.buffer
+    };
+
+    /* Written into each frame slot's set when that slot is next flushed */
+    for(i=0;i<CULL_LAYOUT_BINDING_COUNT;i++)
+    {
+        if(VK_SUCCESS != queueBufferWrite(&vulkanObj->descriptors, vulkanObj->cullDescriptorSets, i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffers[i], 0, VK_WHOLE_SIZE))
+        {
+            printf("Failed to queue the cull descriptor write of binding %d\n", i);
+        }
+    }
+}
+
+
+static void recordCulling(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf)
+{
+    cullPushConstants_t pc =
+    {
+        .frustum = vulkanObj->frustum,
+        .cameraPosition = { vulkanObj->cameraPosition.x, vulkanObj->cameraPosition.y, vulkanObj->cameraPosition.z, vulkanObj->lodSelection ? vulkanObj->lodScale : 0.0f },
+        .drawCount = vulkanObj->drawCount,
+        .compact = vulkanObj->drawIndirectCount,
+        .cull = vulkanObj->frustumCulling,
+        .cullBackCount = vulkanObj->cullBackDrawCount
+    };
+
+    /* The previous frame may still be reading the visible draws */
+    VkMemoryBarrier mb =
+    {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &mb, 0, NULL, 0, NULL);
+
+    /* Reset the visible count of both groups */
+    vkCmdFillBuffer(cmdBuf, vulkanObj->visibleCountBuffer.buffer, 0, sizeof(uint32_t) * 2, 0);
+
+    mb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &mb, 0, NULL, 0, NULL);
+
+    /* Test every range against the frustum and pick its level of detail */
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanObj->cullPipeline);
+    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanObj->cullPll, 0, 1, &vulkanObj->cullDescriptorSets[vulkanObj->frameIndex], 0, NULL);
+    vkCmdPushConstants(cmdBuf, vulkanObj->cullPll, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConstants_t), &pc);
+    vkCmdDispatch(cmdBuf, (vulkanObj->drawCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    /* Make the visible draws available to the indirect draw */
+    mb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    mb.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0, 1, &mb, 0, NULL, 0, NULL);
+}
+
+
+VkResult createFence(VulkanObject *vulkanObj, VkFenceCreateInfo *info, VkFence *outFence, uint32_t count)
+{
+    VkResult result;
+    uint32_t i;
+
+    VkFenceCreateInfo fenceInfo = {0};
+
+    for(i=0;i<count;i++)
+    {
+        if ( info == NULL )
+        {
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fenceInfo.pNext = NULL;
+            fenceInfo.flags = 0;
+
+            result = vkCreateFence(vulkanObj->device, &fenceInfo, NULL, outFence+i);
+        }
+        else
+        {
+            result = vkCreateFence(vulkanObj->device, info, NULL, outFence+i);
+        }
+    }
+    return result;
+}
+
+
+void waitForFence(VulkanObject *vulkanObj, VkFence fence)
+{
+    if (fence)
+    {
+        if (vkGetFenceStatus(vulkanObj->device, fence) == VK_SUCCESS)
+        {
+            vkWaitForFences(vulkanObj->device, 1, &fence, VK_TRUE, 0);
+        }
+    }
+}
+
+
+void transitionImageLayout(VkCommandBuffer cmdBuf, VkImage image, uint32_t mipLevels, uint32_t layerCount, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+    VkImageMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+
+    //these are used to transfer queue ownership, which we aren't doing
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = layerCount;
+
+    VkPipelineStageFlags sourceStage = { 0 };
+    VkPipelineStageFlags destinationStage = { 0 };
+
+    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+    {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+    {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+    else
+    {
+        /* Unsupported layout transition */
+        printf("Attempting an unsupported image layout transition\n");
+    }
+
+    vkCmdPipelineBarrier(
+        cmdBuf,
+        sourceStage, destinationStage,
+        0,
+        0, NULL,
+        0, NULL,
+        1, &barrier
+    );
+}
+
+
+texture_t createTextureImage(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkExtent2D *size, uint32_t mipLevels, uint32_t layerCount, buffer_t *staging)
+{
+    texture_t texture;
+    uint32_t level;
+    VkDeviceSize offset = 0;
+    VkExtent2D extent;
+    uint32_t qfi[1] =
+    {
+        0
+    };
+
+    VkImageCreateInfo ici =
+    {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = {size->width, size->height, 1},
+        .mipLevels = mipLevels,
+        .arrayLayers = layerCount,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = qfi,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
 
     /* Create texture image */
     VkResult result = vkCreateImage(vulkanObj->device, &ici, NULL, &texture.image);
@@ -1100,22 +2246,29 @@ texture_t createTextureImage(VulkanObject *vulkanObj, VkExtent2D *size, buffer_t
             else
             {
                 /* Transition image */
-                transitionImageLayout(vulkanObj, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+                transitionImageLayout(cmdBuf, texture.image, mipLevels, layerCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-                /* Copy texture to buffer */
-                VkBufferImageCopy bic = {
-                    .bufferOffset = 0,
-                    .bufferRowLength = size->width,
-                    .bufferImageHeight = size->height,
-                    .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
-                    .imageOffset = { 0, 0, 0 },
-                    .imageExtent = {size->width, size->height, 1},
+                /* Copy texture to buffer, the levels follow each other in the staging buffer, each with every layer */
+                for(level=0; level<mipLevels; level++)
+                {
+                    extent.width = ((size->width >> level) > 0) ? (size->width >> level) : 1;
+                    extent.height = ((size->height >> level) > 0) ? (size->height >> level) : 1;
 
-                };
+                    VkBufferImageCopy bic = {
+                        .bufferOffset = offset,
+                        .bufferRowLength = extent.width,
+                        .bufferImageHeight = extent.height,
+                        .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, layerCount },
+                        .imageOffset = { 0, 0, 0 },
+                        .imageExtent = {extent.width, extent.height, 1},
 
-                vkCmdCopyBufferToImage(vulkanObj->cmdBuffer, staging->buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bic);
+                    };
+
+                    vkCmdCopyBufferToImage(cmdBuf, staging->buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bic);
+                    offset += (VkDeviceSize)extent.width * extent.height * 4 * layerCount;
+                }
 
-                transitionImageLayout(vulkanObj, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                transitionImageLayout(cmdBuf, texture.image, mipLevels, layerCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
                 /* Create the image view for the color buffer */
                 VkImageViewCreateInfo ivci =
@@ -1124,10 +2277,10 @@ texture_t createTextureImage(VulkanObject *vulkanObj, VkExtent2D *size, buffer_t
                     .pNext = NULL,
                     .flags = 0,
                     .image = texture.image,
-                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                    .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
                     .format = VK_FORMAT_R8G8B8A8_UNORM,
                     .components = {VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_IDENTITY},
-                    .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+                    .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, layerCount }
                 };
                 result = vkCreateImageView(vulkanObj->device, &ivci, NULL, &texture.view);
                 if(VK_SUCCESS != result)
@@ -1137,281 +2290,845 @@ texture_t createTextureImage(VulkanObject *vulkanObj, VkExtent2D *size, buffer_t
             }
         }
     }
-    return texture;
+    return texture;
+}
+
+void createPipelines(VulkanObject *vulkanObj)
+{
+    /* Define descriptor set layout */
+    VkDescriptorSetLayoutBinding dslb[LAYOUT_BINDING_COUNT] =
+    {
+        {
+            .binding = BINDING_FRAG_SAMPLER,
+            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = NULL,
+        },
+        {
+            .binding = BINDING_FRAG_TEXTURES,
+            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+            .descriptorCount = vulkanObj->textureCapacity,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = NULL,
+        },
+        {
+            .binding = BINDING_FRAG_UNIFORM,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .pImmutableSamplers = NULL,
+        },
+        {
+            .binding = BINDING_FRAG_MATERIALS,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = NULL,
+        },
+        {
+            .binding = BINDING_VERT_INSTANCES,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .pImmutableSamplers = NULL,
+        },
+        {
+            .binding = BINDING_VERT_INSTANCE_REFS,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .pImmutableSamplers = NULL,
+        },
+        {
+            .binding = BINDING_FRAG_SCENE,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = NULL,
+        }
+    };
+
+    /* Only the texture array may have unwritten slots */
+    VkDescriptorBindingFlagsEXT bindingFlags[LAYOUT_BINDING_COUNT] =
+    {
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT,
+        0,
+        0,
+        0,
+        0,
+        0
+    };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT dslbfci =
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+        .pNext = NULL,
+        .bindingCount = LAYOUT_BINDING_COUNT,
+        .pBindingFlags = bindingFlags
+    };
+
+    VkDescriptorSetLayoutCreateInfo dslci =
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = vulkanObj->descriptorIndexing ? &dslbfci : NULL,
+        .flags = 0,
+        .bindingCount = LAYOUT_BINDING_COUNT,
+        .pBindings = dslb
+    };
+
+    /* Every pipeline is built through the cache, pipelines rebuilt after a shader change reuse the stages that did not */
+    VkPipelineCacheCreateInfo pcci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = 0,
+        .pInitialData = NULL
+    };
+
+    if(VK_SUCCESS != vkCreatePipelineCache(vulkanObj->device, &pcci, NULL, &vulkanObj->pipelineCache))
+    {
+        vulkanObj->pipelineCache = VK_NULL_HANDLE;
+    }
+
+    VkResult result = vkCreateDescriptorSetLayout(vulkanObj->device, &dslci, NULL, &vulkanObj->dsl);
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to create descriptor set layout\n");
+    }
+    else
+    {
+        /* Define the pipeline layout, everything the draws need is in the descriptor set */
+        VkPipelineLayoutCreateInfo plci =
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .setLayoutCount = 1,
+            .pSetLayouts = &vulkanObj->dsl,
+            .pushConstantRangeCount = 0,
+            .pPushConstantRanges = NULL,
+        };
+
+        result = vkCreatePipelineLayout(vulkanObj->device, &plci, NULL, &vulkanObj->pll);
+        if(VK_SUCCESS != result)
+        {
+            printf("Failed to create pipeline layout\n");
+        }
+        else
+        {
+            createGraphicsPipelines(vulkanObj);
+        }
+    }
+}
+
+
+VkResult createGraphicsPipelines(VulkanObject *vulkanObj)
+{
+    VkResult result = VK_SUCCESS;
+    VkRenderPass renderPass = vulkanObj->renderPass;
+    VkBool32 split = vulkanObj->splitVertexStreams;
+
+    /* Split layout: 12 byte positions in binding 0, normals and texture coordinates in binding 1 */
+    VkVertexInputBindingDescription vibd[] =
+    {
+        {
+            .binding = BINDING_VERT_POSITION,
+            .stride = split ? sizeof(vertexPosition_t) : sizeof(vertexData_t),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        },
+        {
+            .binding = BINDING_VERT_ATTRIBUTES,
+            .stride = sizeof(vertexAttributes_t),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        }
+    };
+
+    /* A three component position reads w as 1 */
+    VkVertexInputAttributeDescription viads[] =
+    {
+        {
+            .location = LOCATION_VERT_POSITION,
+            .binding = BINDING_VERT_POSITION,
+            .format = split ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = 0,
+        },
+        {
+            .location = LOCATION_VERT_NORMALS,
+            .binding = split ? BINDING_VERT_ATTRIBUTES : BINDING_VERT_POSITION,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = split ? 0 : 4 * sizeof(float)
+        },
+        {
+            .location = LOCATION_VERT_TEXCOORDS,
+            .binding = split ? BINDING_VERT_ATTRIBUTES : BINDING_VERT_POSITION,
+            .format = VK_FORMAT_R32G32_SFLOAT,
+            .offset = split ? 4 * sizeof(float) : 8 * sizeof(float)
+        }
+    };
+    
+    VkPipelineVertexInputStateCreateInfo plvisci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .vertexBindingDescriptionCount = split ? 2 : 1,
+        .pVertexBindingDescriptions = vibd,
+        .vertexAttributeDescriptionCount = INPUT_BINDING_COUNT,
+        .pVertexAttributeDescriptions = viads
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo pliasci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE
+    };
+
+    /* Viewport and scissor are set at draw time so resizes don't require new pipelines */
+    VkPipelineViewportStateCreateInfo plvpsci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .viewportCount = 1,
+        .pViewports = NULL,
+        .scissorCount = 1,
+        .pScissors = NULL
+    };
+
+    VkDynamicState dynamicStates[] =
+    {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo pldsci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .dynamicStateCount = sizeof(dynamicStates)/sizeof(dynamicStates[0]),
+        .pDynamicStates = dynamicStates
+    };
+
+    VkPipelineRasterizationStateCreateInfo plrsci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0,
+        .depthBiasClamp = 0,
+        .depthBiasSlopeFactor = 0,
+        .lineWidth = 4
+    };
+
+    VkSampleMask sampMask =
+    {
+        0xFFFFFFFF
+    };
+
+    VkPipelineMultisampleStateCreateInfo plmssci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE,
+        .minSampleShading = 0,
+        .pSampleMask = &sampMask,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE
+    };
+
+    VkPipelineDepthStencilStateCreateInfo pldssci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_GREATER,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+        .front = { VK_STENCIL_OP_KEEP, VK_STENCIL_OP_KEEP,
+          VK_STENCIL_OP_KEEP, VK_COMPARE_OP_ALWAYS,
+          0xFF, 0xFF, 0xFF
+        },
+        .back = { VK_STENCIL_OP_KEEP, VK_STENCIL_OP_KEEP,
+          VK_STENCIL_OP_KEEP, VK_COMPARE_OP_ALWAYS,
+          0xFF, 0xFF, 0xFF
+        },
+        .minDepthBounds = 0,
+        .maxDepthBounds = 1
+    };
+
+    VkPipelineColorBlendAttachmentState pcbas =
+    {
+        .blendEnable = VK_FALSE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_COLOR,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_DST_COLOR,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_DST_ALPHA,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+    };
+
+    VkPipelineColorBlendStateCreateInfo plcbsci =
+    {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_SET,
+        .attachmentCount = 1,
+        .pAttachments = &pcbas,
+        .blendConstants = {0,0,0,0}
+    };
+
+    VkGraphicsPipelineCreateInfo gpci =
+    {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .stageCount = 0,
+        .pStages = NULL,
+        .pVertexInputState = &plvisci,
+        .pInputAssemblyState = &pliasci,
+        .pTessellationState = NULL,
+        .pViewportState = &plvpsci,
+        .pRasterizationState = &plrsci,
+        .pMultisampleState = &plmssci,
+        .pDepthStencilState = &pldssci,
+        .pColorBlendState = &plcbsci,
+        .pDynamicState = &pldsci,
+        .layout = vulkanObj->pll,
+        .renderPass = renderPass,
+        .subpass = 0,
+        .basePipelineHandle = NULL,
+        .basePipelineIndex = 0
+    };
+
+    /* The fragment shader sizes its texture array from constant 0 */
+    VkSpecializationMapEntry sme =
+    {
+        .constantID = 0,
+        .offset = 0,
+        .size = sizeof(uint32_t)
+    };
+
+    VkSpecializationInfo si =
+    {
+        .mapEntryCount = 1,
+        .pMapEntries = &sme,
+        .dataSize = sizeof(uint32_t),
+        .pData = &vulkanObj->textureCapacity
+    };
+
+    /* The pre-pass lays down the nearest depth, shading then only runs where it matches */
+    if (vulkanObj->depthPrePass)
+    {
+        /* Only the position stream is fetched */
+        plvisci.vertexBindingDescriptionCount = 1;
+        plvisci.vertexAttributeDescriptionCount = 1;
+        pcbas.colorWriteMask = 0;
+
+        result = initGraphicsPipeline(vulkanObj->device, vulkanObj->pipelineCache, &gpci, SHADER_DEPTH_VERT_FILE, NULL, NULL, &vulkanObj->depthPipeline);
+        if (VK_SUCCESS == result)
+        {
+            plrsci.cullMode = VK_CULL_MODE_BACK_BIT;
+            result = initGraphicsPipeline(vulkanObj->device, vulkanObj->pipelineCache, &gpci, SHADER_DEPTH_VERT_FILE, NULL, NULL, &vulkanObj->depthCullPipeline);
+        }
+        if (VK_SUCCESS != result)
+        {
+            printf("Error creating depth pipeline %d\n", result);
+        }
+
+        plrsci.cullMode = VK_CULL_MODE_NONE;
+        pcbas.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        pldssci.depthWriteEnable = VK_FALSE;
+        pldssci.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    }
+
+    /* Create the pipeline for texturing */
+    plvisci.vertexBindingDescriptionCount = split ? 2 : 1;
+    plvisci.vertexAttributeDescriptionCount = 3;
+    result = initGraphicsPipeline(vulkanObj->device, vulkanObj->pipelineCache, &gpci, SHADER_VERT_FILE, SHADER_FRAG_FILE, &si, &vulkanObj->texPipeline);
+    if (VK_SUCCESS != result)
+    {
+        printf("Error creating texture pipeline %d\n", result);
+    }
+
+    /* Closed meshes hide their backfaces */
+    plrsci.cullMode = VK_CULL_MODE_BACK_BIT;
+    result = initGraphicsPipeline(vulkanObj->device, vulkanObj->pipelineCache, &gpci, SHADER_VERT_FILE, SHADER_FRAG_FILE, &si, &vulkanObj->texCullPipeline);
+    if (VK_SUCCESS != result)
+    {
+        printf("Error creating backface culling pipeline %d\n", result);
+    }
+
+    return result;
+}
+
+
+void destroyGraphicsPipelines(VulkanObject *vulkanObj)
+{
+    /* The layout and descriptors stay, only the vertex layout dependent state goes */
+    vkDestroyPipeline(vulkanObj->device, vulkanObj->texPipeline, NULL);
+    vkDestroyPipeline(vulkanObj->device, vulkanObj->texCullPipeline, NULL);
+    vkDestroyPipeline(vulkanObj->device, vulkanObj->depthPipeline, NULL);
+    vkDestroyPipeline(vulkanObj->device, vulkanObj->depthCullPipeline, NULL);
+
+    vulkanObj->texPipeline = VK_NULL_HANDLE;
+    vulkanObj->texCullPipeline = VK_NULL_HANDLE;
+    vulkanObj->depthPipeline = VK_NULL_HANDLE;
+    vulkanObj->depthCullPipeline = VK_NULL_HANDLE;
+
+    /* Pre-recorded draws reference the old pipelines */
+    vulkanObj->dirtyFlags |= DIRTY_PIPELINES;
+}
+
+
+VkResult reloadGraphicsPipelines(VulkanObject *vulkanObj)
+{
+    VkResult result;
+    VkPipeline previous[4] = { vulkanObj->texPipeline, vulkanObj->texCullPipeline, vulkanObj->depthPipeline, vulkanObj->depthCullPipeline };
+
+    vulkanObj->texPipeline = VK_NULL_HANDLE;
+    vulkanObj->texCullPipeline = VK_NULL_HANDLE;
+    vulkanObj->depthPipeline = VK_NULL_HANDLE;
+    vulkanObj->depthCullPipeline = VK_NULL_HANDLE;
+
+    /* Every pipeline has to build, stages whose shaders did not change come from the cache */
+    result = createGraphicsPipelines(vulkanObj);
+    if(VK_NULL_HANDLE == vulkanObj->texPipeline || VK_NULL_HANDLE == vulkanObj->texCullPipeline ||
+       (vulkanObj->depthPrePass && (VK_NULL_HANDLE == vulkanObj->depthPipeline || VK_NULL_HANDLE == vulkanObj->depthCullPipeline)))
+    {
+        result = (VK_SUCCESS == result) ? VK_ERROR_INITIALIZATION_FAILED : result;
+    }
+
+    /* A shader that does not build leaves the old pipelines in place, no frame may be in flight */
+    if(VK_SUCCESS != result)
+    {
+        printf("Error rebuilding graphics pipelines %d, keeping the previous ones\n", result);
+        destroyGraphicsPipelines(vulkanObj);
+        vulkanObj->texPipeline = previous[0];
+        vulkanObj->texCullPipeline = previous[1];
+        vulkanObj->depthPipeline = previous[2];
+        vulkanObj->depthCullPipeline = previous[3];
+        return result;
+    }
+
+    vkDestroyPipeline(vulkanObj->device, previous[0], NULL);
+    vkDestroyPipeline(vulkanObj->device, previous[1], NULL);
+    vkDestroyPipeline(vulkanObj->device, previous[2], NULL);
+    vkDestroyPipeline(vulkanObj->device, previous[3], NULL);
+    vulkanObj->dirtyFlags |= DIRTY_PIPELINES;
+    return VK_SUCCESS;
+}
+
+
+static void bindDrawState(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf)
+{
+    /* Bind buffer, the split layout keeps both streams in it */
+    VkBuffer buffers[2] = { vulkanObj->vertexBuffer.buffer, vulkanObj->vertexBuffer.buffer };
+    VkDeviceSize offsets[2] = { 0, vulkanObj->vertexAttributeOffset };
+    vkCmdBindVertexBuffers(cmdBuf, 0, vulkanObj->splitVertexStreams ? 2 : 1, buffers, offsets);
+
+    /* Set the viewport and scissor to the current window size */
+    VkViewport viewport =
+    {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = (float)vulkanObj->windowSize.width,
+        .height = (float)vulkanObj->windowSize.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+
+    VkRect2D scissor =
+    {
+        .offset = {0,0},
+        .extent = {vulkanObj->windowSize.width, vulkanObj->windowSize.height}
+    };
+
+    vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+    vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+
+    /* Bind the frame slot's descriptors, scene and material properties are read from their buffers */
+    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanObj->pll, 0, 1, &vulkanObj->descriptorSets[vulkanObj->frameIndex], 0, NULL);
+}
+
+
+static void bindDrawPipeline(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkBool32 cullBack, uint32_t pass)
+{
+    /* Depth only for the pre-pass, backfaces culled for the draws of closed meshes */
+    if(RECORD_PASS_DEPTH == pass)
+    {
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, cullBack ? vulkanObj->depthCullPipeline : vulkanObj->depthPipeline);
+    }
+    else
+    {
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, cullBack ? vulkanObj->texCullPipeline : vulkanObj->texPipeline);
+    }
+}
+
+
+static void recordDrawList(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkDrawIndirectCommand *drawCmds, uint32_t first, uint32_t count, uint32_t cullBackCount, uint32_t pass)
+{
+    uint32_t i;
+    uint32_t end = first + count;
+    uint32_t split = (cullBackCount < first) ? first : ((cullBackCount > end) ? end : cullBackCount);
+
+    /* Draw each material range, the first instance selects the instance references */
+    if(split > first)
+    {
+        bindDrawPipeline(vulkanObj, cmdBuf, VK_TRUE, pass);
+        for(i=first;i<split;i++)
+        {
+            vkCmdDraw(cmdBuf, drawCmds[i].vertexCount, drawCmds[i].instanceCount, drawCmds[i].firstVertex, drawCmds[i].firstInstance);
+        }
+    }
+
+    if(end > split)
+    {
+        bindDrawPipeline(vulkanObj, cmdBuf, VK_FALSE, pass);
+        for(i=split;i<end;i++)
+        {
+            vkCmdDraw(cmdBuf, drawCmds[i].vertexCount, drawCmds[i].instanceCount, drawCmds[i].firstVertex, drawCmds[i].firstInstance);
+        }
+    }
+}
+
+
+static void recordSlice(void *arg)
+{
+    recordThread_t *thread = (recordThread_t *)arg;
+    VulkanObject *vulkanObj = thread->vulkanObj;
+    VkCommandBuffer cmdBuf;
+    uint32_t pass;
+
+    /* The secondary buffer continues the renderpass begun by the primary */
+    VkCommandBufferInheritanceInfo cbii =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = NULL,
+        .renderPass = vulkanObj->renderPass,
+        .subpass = 0,
+        .framebuffer = vulkanObj->framebuffer,
+        .occlusionQueryEnable = VK_FALSE,
+        .queryFlags = 0,
+        .pipelineStatistics = vulkanObj->pipelineStatistics ? STATS_QUERY_FLAGS : 0
+    };
+
+    VkCommandBufferBeginInfo cbbi =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &cbii
+    };
+
+    /* Recycle everything this thread recorded the last time the slot was used */
+    thread->result = vkResetCommandPool(vulkanObj->device, thread->cmdPool[vulkanObj->frameIndex], 0);
+
+    /* One buffer per pass, so every slice's depth is laid down before any slice is shaded */
+    for(pass = vulkanObj->depthPrePass ? RECORD_PASS_DEPTH : RECORD_PASS_SHADE; pass < RECORD_PASS_COUNT && VK_SUCCESS == thread->result; pass++)
+    {
+        cmdBuf = thread->cmdBuffer[vulkanObj->frameIndex][pass];
+        thread->result = vkBeginCommandBuffer(cmdBuf, &cbbi);
+        if(VK_SUCCESS != thread->result)
+        {
+            break;
+        }
+
+        /* Nothing is inherited from the primary but the renderpass */
+        bindDrawState(vulkanObj, cmdBuf);
+        recordDrawList(vulkanObj, cmdBuf, thread->drawCmds, thread->firstDraw, thread->drawCount, thread->cullBackCount, pass);
+
+        thread->result = vkEndCommandBuffer(cmdBuf);
+    }
+}
+
+
+static void recordWorker(void *arg)
+{
+    recordThread_t *thread = (recordThread_t *)arg;
+    VulkanObject *vulkanObj = thread->vulkanObj;
+
+    lockMutex(&vulkanObj->recordLock);
+    for(;;)
+    {
+        while(!vulkanObj->recordQuit && thread->generation == vulkanObj->recordGeneration)
+        {
+            waitCondition(&vulkanObj->recordStart, &vulkanObj->recordLock);
+        }
+
+        if(vulkanObj->recordQuit)
+        {
+            break;
+        }
+        thread->generation = vulkanObj->recordGeneration;
+
+        /* Fewer slices than workers leaves some without work this frame */
+        if(thread->hasSlice)
+        {
+            unlockMutex(&vulkanObj->recordLock);
+            recordSlice(thread);
+            lockMutex(&vulkanObj->recordLock);
+
+            thread->hasSlice = VK_FALSE;
+            if(0 == --vulkanObj->recordPending)
+            {
+                signalCondition(&vulkanObj->recordDone);
+            }
+        }
+    }
+    unlockMutex(&vulkanObj->recordLock);
+}
+
+
+static void recordThreadedDraws(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkRenderPassBeginInfo *rpbi, VkDrawIndirectCommand *drawCmds, uint32_t drawCount, uint32_t cullBackCount)
+{
+    VkCommandBuffer secondaries[MAX_RECORD_THREADS * RECORD_PASS_COUNT];
+    uint32_t sliceSize = (drawCount + vulkanObj->recordThreadCount - 1) / vulkanObj->recordThreadCount;
+    uint32_t sliceCount = (sliceSize > 0) ? ((drawCount + sliceSize - 1) / sliceSize) : 0;
+    uint32_t executed = 0;
+    uint32_t pass;
+    uint32_t i;
+    recordThread_t *thread;
+
+    /* Hand each thread a contiguous slice so the draws keep their order */
+    lockMutex(&vulkanObj->recordLock);
+    for(i=0;i<sliceCount;i++)
+    {
+        thread = &vulkanObj->recordThreads[i];
+        thread->drawCmds = drawCmds;
+        thread->firstDraw = i*sliceSize;
+        thread->drawCount = (drawCount - i*sliceSize < sliceSize) ? (drawCount - i*sliceSize) : sliceSize;
+        thread->cullBackCount = cullBackCount;
+        thread->result = VK_NOT_READY;
+        thread->hasSlice = (i > 0 && thread->running) ? VK_TRUE : VK_FALSE;
+        vulkanObj->recordPending += thread->hasSlice ? 1 : 0;
+    }
+
+    /* Wake the waiting workers, the calling thread records the first slice meanwhile */
+    vulkanObj->recordGeneration++;
+    broadcastCondition(&vulkanObj->recordStart);
+    unlockMutex(&vulkanObj->recordLock);
+
+    for(i=0;i<sliceCount;i++)
+    {
+        if(0 == i || !vulkanObj->recordThreads[i].running)
+        {
+            recordSlice(&vulkanObj->recordThreads[i]);
+        }
+    }
+
+    lockMutex(&vulkanObj->recordLock);
+    while(vulkanObj->recordPending > 0)
+    {
+        waitCondition(&vulkanObj->recordDone, &vulkanObj->recordLock);
+    }
+    unlockMutex(&vulkanObj->recordLock);
+
+    for(i=0;i<sliceCount;i++)
+    {
+        if(VK_SUCCESS != vulkanObj->recordThreads[i].result)
+        {
+            printf("Failed to record draw slice %d: %d\n", i, vulkanObj->recordThreads[i].result);
+        }
+    }
+
+    /* Every depth slice, then every shading slice */
+    for(pass = vulkanObj->depthPrePass ? RECORD_PASS_DEPTH : RECORD_PASS_SHADE; pass < RECORD_PASS_COUNT; pass++)
+    {
+        for(i=0;i<sliceCount;i++)
+        {
+            if(VK_SUCCESS == vulkanObj->recordThreads[i].result)
+            {
+                secondaries[executed++] = vulkanObj->recordThreads[i].cmdBuffer[vulkanObj->frameIndex][pass];
+            }
+        }
+    }
+
+    /* Only secondary buffers may be recorded in this renderpass */
+    vkCmdBeginRenderPass(cmdBuf, rpbi, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    if(executed > 0)
+    {
+        vkCmdExecuteCommands(cmdBuf, executed, secondaries);
+    }
+    vkCmdEndRenderPass(cmdBuf);
 }
 
-void createPipelines(VulkanObject *vulkanObj)
+
+static void recordDraws(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkDrawIndirectCommand *drawCmds, uint32_t visibleCount, uint32_t visibleCullBackCount, VkBool32 cullPass)
 {
-    VkRenderPass renderPass = vulkanObj->renderPass;
+    uint32_t pass;
+    uint32_t cullBackCount = vulkanObj->cullBackDrawCount;
+    uint32_t doubleSidedCount = vulkanObj->drawCount - vulkanObj->cullBackDrawCount;
+    VkDeviceSize doubleSidedOffset = sizeof(VkDrawIndirectCommand) * cullBackCount;
+    VkBuffer indirectBuffer = cullPass ? vulkanObj->visibleDrawBuffer.buffer : vulkanObj->drawCmdBuffer.buffer;
 
-    /* Define descriptor set layout */
-    VkDescriptorSetLayoutBinding dslb[LAYOUT_BINDING_COUNT] =
+    /* Bind the buffers and descriptors shared by every draw */
+    bindDrawState(vulkanObj, cmdBuf);
+
+    /* The pre-pass draws the same list into depth only, shading then runs once per pixel */
+    for(pass = vulkanObj->depthPrePass ? RECORD_PASS_DEPTH : RECORD_PASS_SHADE; pass < RECORD_PASS_COUNT; pass++)
     {
+        if(vulkanObj->multiDrawIndirect && cullPass && vulkanObj->drawIndirectCount)
         {
-            .binding = BINDING_FRAG_SAMPLER,
-            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .pImmutableSamplers = NULL,
-        },
+            /* Draw the compacted visible ranges of each group, the counts come from the cull shader */
+            if(cullBackCount > 0)
+            {
+                bindDrawPipeline(vulkanObj, cmdBuf, VK_TRUE, pass);
+                vulkanObj->vkCmdDrawIndirectCount(cmdBuf, vulkanObj->visibleDrawBuffer.buffer, 0, vulkanObj->visibleCountBuffer.buffer, 0, cullBackCount, sizeof(VkDrawIndirectCommand));
+            }
+            if(doubleSidedCount > 0)
+            {
+                bindDrawPipeline(vulkanObj, cmdBuf, VK_FALSE, pass);
+                vulkanObj->vkCmdDrawIndirectCount(cmdBuf, vulkanObj->visibleDrawBuffer.buffer, doubleSidedOffset, vulkanObj->visibleCountBuffer.buffer, sizeof(uint32_t), doubleSidedCount, sizeof(VkDrawIndirectCommand));
+            }
+        }
+        else if(vulkanObj->multiDrawIndirect)
         {
-            .binding = BINDING_FRAG_TEXTURES,
-            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-            .descriptorCount = vulkanObj->numOfTextures,
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .pImmutableSamplers = NULL,
-        },
+            /* Draw all material ranges of each group at once, culled ranges have no instances */
+            if(cullBackCount > 0)
+            {
+                bindDrawPipeline(vulkanObj, cmdBuf, VK_TRUE, pass);
+                vkCmdDrawIndirect(cmdBuf, indirectBuffer, 0, cullBackCount, sizeof(VkDrawIndirectCommand));
+            }
+            if(doubleSidedCount > 0)
+            {
+                bindDrawPipeline(vulkanObj, cmdBuf, VK_FALSE, pass);
+                vkCmdDrawIndirect(cmdBuf, indirectBuffer, doubleSidedOffset, doubleSidedCount, sizeof(VkDrawIndirectCommand));
+            }
+        }
+        else
         {
-            .binding = BINDING_FRAG_UNIFORM,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-            .pImmutableSamplers = NULL,
+            recordDrawList(vulkanObj, cmdBuf, drawCmds, 0, visibleCount, visibleCullBackCount, pass);
         }
+    }
+}
+
+
+static VkResult recordStaticDraws(VulkanObject *vulkanObj, VkRenderPassBeginInfo *rpbi, VkBool32 cullPass)
+{
+    VkResult result;
+
+    VkCommandBufferAllocateInfo cbai =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = vulkanObj->cmdPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = 1
     };
 
-    VkDescriptorSetLayoutCreateInfo dslci =
+    VkCommandBufferInheritanceInfo cbii =
     {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
         .pNext = NULL,
-        .flags = 0,
-        .bindingCount = LAYOUT_BINDING_COUNT,
-        .pBindings = dslb
+        .renderPass = rpbi->renderPass,
+        .subpass = 0,
+        .framebuffer = rpbi->framebuffer,
+        .occlusionQueryEnable = VK_FALSE,
+        .queryFlags = 0,
+        .pipelineStatistics = vulkanObj->pipelineStatistics ? STATS_QUERY_FLAGS : 0
     };
 
-    VkResult result = vkCreateDescriptorSetLayout(vulkanObj->device, &dslci, NULL, &vulkanObj->dsl);
-    if(VK_SUCCESS != result)
+    /* Only replayed by its own frame slot, whose fence has been waited on before it is recorded again */
+    VkCommandBufferBeginInfo cbbi =
     {
-        printf("Failed to create descriptor set layout\n");
-    }
-    else
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &cbii
+    };
+
+    VkCommandBuffer *staticCmdBuffer = &vulkanObj->staticCmdBuffers[vulkanObj->frameIndex];
+    uint32_t slot = 1u << vulkanObj->frameIndex;
+
+    /* A change has to reach the recording of every slot */
+    if(0 != vulkanObj->dirtyFlags)
     {
-        VkPushConstantRange pushConst =
-        {
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .offset = 0,
-            .size = sizeof(pushConstants_t)
-        };
+        printf("Recording static draw commands (dirty 0x%x)\n", vulkanObj->dirtyFlags);
+        vulkanObj->staleStaticSlots = (1u << MAX_FRAMES_IN_FLIGHT) - 1;
+        vulkanObj->dirtyFlags = 0;
+    }
 
-        /* Define the pipeline layout */
-        VkPipelineLayoutCreateInfo plci =
-        {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .pNext = NULL,
-            .flags = 0,
-            .setLayoutCount = 1,
-            .pSetLayouts = &vulkanObj->dsl,
-            .pushConstantRangeCount = 1,
-            .pPushConstantRanges = &pushConst,
-        };
+    if(0 == (vulkanObj->staleStaticSlots & slot) && VK_NULL_HANDLE != *staticCmdBuffer)
+    {
+        return VK_SUCCESS;
+    }
 
-        result = vkCreatePipelineLayout(vulkanObj->device, &plci, NULL, &vulkanObj->pll);
+    if(VK_NULL_HANDLE == *staticCmdBuffer)
+    {
+        result = vkAllocateCommandBuffers(vulkanObj->device, &cbai, staticCmdBuffer);
         if(VK_SUCCESS != result)
         {
-            printf("Failed to create pipeline layout\n");
+            printf("Failed to allocate the static command buffer: %d\n", result);
+            *staticCmdBuffer = VK_NULL_HANDLE;
+            return result;
         }
-        else
-        {
-            VkVertexInputBindingDescription vibd[] =
-            {
-                {
-                    .binding = BINDING_VERT_POSITION,
-                    .stride = sizeof(vertexData_t),
-                    .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-                }
-            };
-
-            VkVertexInputAttributeDescription viads[] =
-            {
-                {
-                    .location = LOCATION_VERT_POSITION,
-                    .binding = BINDING_VERT_POSITION,
-                    .format = VK_FORMAT_R32G32B32A32_SFLOAT,
-                    .offset = 0,
-                },
-                {
-                    .location = LOCATION_VERT_NORMALS,
-                    .binding = BINDING_VERT_POSITION,
-                    .format = VK_FORMAT_R32G32B32A32_SFLOAT,
-                    .offset = 4 * sizeof(float)
-                },
-                {
-                    .location = LOCATION_VERT_TEXCOORDS,
-                    .binding = BINDING_VERT_POSITION,
-                    .format = VK_FORMAT_R32G32_SFLOAT,
-                    .offset = 8 * sizeof(float)
-                }
-            };
-            
-            VkPipelineVertexInputStateCreateInfo plvisci =
-            {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .vertexBindingDescriptionCount = 1,
-                .pVertexBindingDescriptions = vibd,
-                .vertexAttributeDescriptionCount = INPUT_BINDING_COUNT,
-                .pVertexAttributeDescriptions = viads
-            };
-
-            VkPipelineInputAssemblyStateCreateInfo pliasci =
-            {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-                .primitiveRestartEnable = VK_FALSE
-            };
-
-            VkViewport viewport =
-            {
-                .x = 0.0f,
-                .y = 0.0f,
-                .width = (float)vulkanObj->windowSize.width,
-                .height = (float)vulkanObj->windowSize.height,
-                .minDepth = 0.0f,
-                .maxDepth = 1.0f
-            };
-
-            VkRect2D rect =
-            {
-                .offset = {0,0},
-                .extent = {vulkanObj->windowSize.width, vulkanObj->windowSize.height}
-            };
-
-            VkPipelineViewportStateCreateInfo plvpsci =
-            {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .viewportCount = 1,
-                .pViewports = &viewport,
-                .scissorCount = 1,
-                .pScissors = &rect
-            };
-
-            VkPipelineRasterizationStateCreateInfo plrsci =
-            {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .depthClampEnable = VK_FALSE,
-                .rasterizerDiscardEnable = VK_FALSE,
-                .polygonMode = VK_POLYGON_MODE_FILL,
-                .cullMode = VK_CULL_MODE_NONE,
-                .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
-                .depthBiasEnable = VK_FALSE,
-                .depthBiasConstantFactor = 0,
-                .depthBiasClamp = 0,
-                .depthBiasSlopeFactor = 0,
-                .lineWidth = 4
-            };
-
-            VkSampleMask sampMask =
-            {
-                0xFFFFFFFF
-            };
+    }
 
-            VkPipelineMultisampleStateCreateInfo plmssci =
-            {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-                .sampleShadingEnable = VK_FALSE,
-                .minSampleShading = 0,
-                .pSampleMask = &sampMask,
-                .alphaToCoverageEnable = VK_FALSE,
-                .alphaToOneEnable = VK_FALSE
-            };
+    /* Everything inside the renderpass is recorded once per slot, indirect draws read the culled list from the GPU */
+    vkBeginCommandBuffer(*staticCmdBuffer, &cbbi);
+    recordDraws(vulkanObj, *staticCmdBuffer, vulkanObj->drawCmds, vulkanObj->drawCount, vulkanObj->cullBackDrawCount, cullPass);
+    result = vkEndCommandBuffer(*staticCmdBuffer);
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to record the static command buffer: %d\n", result);
+        return result;
+    }
 
-            VkPipelineDepthStencilStateCreateInfo pldssci =
-            {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .depthTestEnable = VK_TRUE,
-                .depthWriteEnable = VK_TRUE,
-                .depthCompareOp = VK_COMPARE_OP_GREATER,
-                .depthBoundsTestEnable = VK_FALSE,
-                .stencilTestEnable = VK_FALSE,
-                .front = { VK_STENCIL_OP_KEEP, VK_STENCIL_OP_KEEP,
-                  VK_STENCIL_OP_KEEP, VK_COMPARE_OP_ALWAYS,
-                  0xFF, 0xFF, 0xFF
-                },
-                .back = { VK_STENCIL_OP_KEEP, VK_STENCIL_OP_KEEP,
-                  VK_STENCIL_OP_KEEP, VK_COMPARE_OP_ALWAYS,
-                  0xFF, 0xFF, 0xFF
-                },
-                .minDepthBounds = 0,
-                .maxDepthBounds = 1
-            };
+    vulkanObj->staleStaticSlots &= ~slot;
 
-            VkPipelineColorBlendAttachmentState pcbas =
-            {
-                .blendEnable = VK_FALSE,
-                .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_COLOR,
-                .dstColorBlendFactor = VK_BLEND_FACTOR_DST_COLOR,
-                .colorBlendOp = VK_BLEND_OP_ADD,
-                .srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-                .dstAlphaBlendFactor = VK_BLEND_FACTOR_DST_ALPHA,
-                .alphaBlendOp = VK_BLEND_OP_ADD,
-                .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
-            };
+    return VK_SUCCESS;
+}
 
-            VkPipelineColorBlendStateCreateInfo plcbsci =
-            {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .logicOpEnable = VK_FALSE,
-                .logicOp = VK_LOGIC_OP_SET,
-                .attachmentCount = 1,
-                .pAttachments = &pcbas,
-                .blendConstants = {0,0,0,0}
-            };
 
-            VkGraphicsPipelineCreateInfo gpci =
-            {
-                .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .stageCount = 0,
-                .pStages = NULL,
-                .pVertexInputState = &plvisci,
-                .pInputAssemblyState = &pliasci,
-                .pTessellationState = NULL,
-                .pViewportState = &plvpsci,
-                .pRasterizationState = &plrsci,
-                .pMultisampleState = &plmssci,
-                .pDepthStencilState = &pldssci,
-                .pColorBlendState = &plcbsci,
-                .pDynamicState = NULL,
-                .layout = vulkanObj->pll,
-                .renderPass = renderPass,
-                .subpass = 0,
-                .basePipelineHandle = NULL,
-                .basePipelineIndex = 0
-            };
+static void readStatistics(VulkanObject *vulkanObj)
+{
+    uint64_t invocations = 0;
+    uint32_t slot = 1u << vulkanObj->frameIndex;
 
-            /* Create the pipeline for texturing */
-            plvisci.vertexAttributeDescriptionCount = 3;
-            result = initGraphicsPipeline(vulkanObj->device, &gpci, &vulkanObj->texPipeline);
-            if (VK_SUCCESS != result)
-            {
-                printf("Error creating texture pipeline %d\n", result);
-            }
+    /* The last frame recorded into this slot has passed its fence */
+    if(vulkanObj->statsPending & slot)
+    {
+        if(VK_SUCCESS == vkGetQueryPoolResults(vulkanObj->device, vulkanObj->statsQueryPool, vulkanObj->frameIndex, 1,
+            sizeof(uint64_t), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+        {
+            vulkanObj->fragmentInvocations += invocations;
+            vulkanObj->statsFrames++;
         }
+        vulkanObj->statsPending &= ~slot;
     }
 }
 
 
 void draw(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, model_t model)
 {
-    uint32_t endFace;
-    uint32_t faceCount;
     uint32_t i;
-    pushConstants_t pc;
+    uint32_t pass;
+    uint32_t visibleCount = vulkanObj->drawCount;
+    uint32_t visibleCullBackCount = vulkanObj->cullBackDrawCount;
+    VkDrawIndirectCommand *drawCmds = vulkanObj->drawCmds;
+    VkBool32 cullPass = (vulkanObj->frustumCulling || vulkanObj->lodSelection) && vulkanObj->drawCount > 0;
+    VkBool32 staticPass;
+    lod_level_t *lod;
 
     /* Begin renderpass */
     static const VkClearValue clearVal[2] =
@@ -1431,38 +3148,98 @@ void draw(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, model_t model)
         .pClearValues = clearVal
     };
 
-    /* Begin renderpass */
-    vkCmdBeginRenderPass(cmdBuf, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+    /* This slot's fence has been waited on, the buffers replaced before the last frame are free again */
+    releaseRetiredResources(vulkanObj);
+    vulkanObj->frameSerial++;
 
-    /* Bind buffer */
-    VkDeviceSize offsets = {0};
-    vkCmdBindVertexBuffers(cmdBuf, 0, 1, &vulkanObj->vertexBuffer.buffer, &offsets);
+    /* Nothing in flight uses this slot's sets, the descriptors queued for it since its last frame go out in one update */
+    flushDescriptorWrites(&vulkanObj->descriptors, vulkanObj->frameIndex);
 
-    /* Bind texture pipeline */
-    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanObj->texPipeline);
+    /* Lights and camera target for the fragment shader */
+    updateSceneBuffer(vulkanObj, &model.sp);
 
-    /* Bind texture descriptor */
-    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanObj->pll, 0, 1, &vulkanObj->descriptorSet, 0, NULL);
+    /* While the scene is loading, the frame only clears or draws the ranges streamed so far, seen from both sides */
+    if(!vulkanObj->sceneReady)
+    {
+        vkCmdBeginRenderPass(cmdBuf, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+        if(vulkanObj->streamDrawCount > 0)
+        {
+            bindDrawState(vulkanObj, cmdBuf);
+            for(pass = vulkanObj->depthPrePass ? RECORD_PASS_DEPTH : RECORD_PASS_SHADE; pass < RECORD_PASS_COUNT; pass++)
+            {
+                recordDrawList(vulkanObj, cmdBuf, vulkanObj->streamDrawCmds, 0, vulkanObj->streamDrawCount, 0, pass);
+            }
+        }
+        vkCmdEndRenderPass(cmdBuf);
+        return;
+    }
 
-    for(i=0;i<model.materialChangeCount;i++)
+    /* Cull the material ranges and pick their levels before the renderpass */
+    if(cullPass && vulkanObj->multiDrawIndirect)
+    {
+        recordCulling(vulkanObj, cmdBuf);
+    }
+    else if(cullPass)
     {
-        endFace = (i < model.materialChangeCount - 1) ? model.materialChange[i+1].startFace : model.numOfFaces;
+        /* Same selection as the cull shader */
+        for(i=0;vulkanObj->lodSelection && i<vulkanObj->drawCount;i++)
+        {
+            lod = &vulkanObj->drawLods[i*MAX_LOD_LEVELS + selectLod(&vulkanObj->drawLods[i*MAX_LOD_LEVELS], &vulkanObj->drawBounds[i], vulkanObj->cameraPosition, vulkanObj->lodScale)];
+            vulkanObj->lodDrawCmds[i] = vulkanObj->drawCmds[i];
+            vulkanObj->lodDrawCmds[i].vertexCount = lod->faceCount*ELEMENTS_PER_FACE;
+            vulkanObj->lodDrawCmds[i].firstVertex = lod->firstFace*ELEMENTS_PER_FACE;
+            drawCmds = vulkanObj->lodDrawCmds;
+        }
+
+        if(vulkanObj->frustumCulling)
+        {
+            /* Layouts match, see indirectDraw_t, each group is compacted on its own */
+            visibleCullBackCount = cullDraws(&vulkanObj->frustum, vulkanObj->drawBounds, vulkanObj->drawCones, vulkanObj->cameraPosition,
+                (indirectDraw_t *)drawCmds, vulkanObj->cullBackDrawCount, (indirectDraw_t *)vulkanObj->visibleDrawCmds);
+            visibleCount = visibleCullBackCount + cullDraws(&vulkanObj->frustum, &vulkanObj->drawBounds[vulkanObj->cullBackDrawCount], &vulkanObj->drawCones[vulkanObj->cullBackDrawCount], vulkanObj->cameraPosition,
+                (indirectDraw_t *)&drawCmds[vulkanObj->cullBackDrawCount], vulkanObj->drawCount - vulkanObj->cullBackDrawCount, (indirectDraw_t *)&vulkanObj->visibleDrawCmds[visibleCullBackCount]);
+            drawCmds = vulkanObj->visibleDrawCmds;
+        }
+    }
 
-        faceCount = (endFace - model.materialChange[i].startFace);
+    /* Replay the pre-recorded draws when the draw list lives on the GPU, the culling above is recorded every frame */
+    staticPass = (vulkanObj->staticCommands && (vulkanObj->multiDrawIndirect || !cullPass) &&
+        VK_SUCCESS == recordStaticDraws(vulkanObj, &rpbi, cullPass)) ? VK_TRUE : VK_FALSE;
 
-        /* Set up the push constants */
-        memcpy(&pc.mp, &model.materialChange[i].material->mp, sizeof(pc.mp));
-        memcpy(&pc.sp, &model.sp, sizeof(model.sp));
+    /* Count the fragment shader invocations of the renderpass */
+    if(VK_NULL_HANDLE != vulkanObj->statsQueryPool)
+    {
+        readStatistics(vulkanObj);
+        vkCmdResetQueryPool(cmdBuf, vulkanObj->statsQueryPool, vulkanObj->frameIndex, 1);
+        vkCmdBeginQuery(cmdBuf, vulkanObj->statsQueryPool, vulkanObj->frameIndex, 0);
+    }
 
-        /* Send the push constants to the shader */
-        vkCmdPushConstants(cmdBuf, vulkanObj->pll, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants_t), &pc);
+    if(staticPass)
+    {
+        vkCmdBeginRenderPass(cmdBuf, &rpbi, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(cmdBuf, 1, &vulkanObj->staticCmdBuffers[vulkanObj->frameIndex]);
+        vkCmdEndRenderPass(cmdBuf);
+    }
+    else if(vulkanObj->recordThreadCount > 0)
+    {
+        /* Record the visible ranges on the worker threads */
+        recordThreadedDraws(vulkanObj, cmdBuf, &rpbi, drawCmds, visibleCount, visibleCullBackCount);
+    }
+    else
+    {
+        /* Begin renderpass */
+        vkCmdBeginRenderPass(cmdBuf, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+        recordDraws(vulkanObj, cmdBuf, drawCmds, visibleCount, visibleCullBackCount, cullPass);
 
-        /* Draw texture */
-        vkCmdDraw(cmdBuf, faceCount*ELEMENTS_PER_FACE, 1, model.materialChange[i].startFace*ELEMENTS_PER_FACE, 0);
+        /* End renderpass */
+        vkCmdEndRenderPass(cmdBuf);
     }
 
-    /* End renderpass */
-    vkCmdEndRenderPass(cmdBuf);
+    if(VK_NULL_HANDLE != vulkanObj->statsQueryPool)
+    {
+        vkCmdEndQuery(cmdBuf, vulkanObj->statsQueryPool, vulkanObj->frameIndex);
+        vulkanObj->statsPending |= 1u << vulkanObj->frameIndex;
+    }
 }
 
 void swapFrontBuffer(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkFence cmdBufFence)
@@ -1470,9 +3247,25 @@ void swapFrontBuffer(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkFence cm
     /* Get next image */
     vkResetFences(vulkanObj->device, 1, &vulkanObj->imageAcquiredFence);
     VkResult result = vkAcquireNextImageKHR(vulkanObj->device, vulkanObj->swapChain, MAX_TIMEOUT, NULL, vulkanObj->imageAcquiredFence, &vulkanObj->imageIndex);
-    if(VK_SUCCESS != result)
+    if(VK_SUBOPTIMAL_KHR == result)
+    {
+        /* The image is still presentable, recreate the swapchain after this frame */
+        vulkanObj->swapChainOutOfDate = VK_TRUE;
+    }
+
+    if(VK_SUCCESS != result && VK_SUBOPTIMAL_KHR != result)
     {
-        printf("Failed to acquire next image\n");
+        if(VK_ERROR_OUT_OF_DATE_KHR == result)
+        {
+            vulkanObj->swapChainOutOfDate = VK_TRUE;
+        }
+        else
+        {
+            printf("Failed to acquire next image\n");
+        }
+
+        /* Still submit the recorded work so the command buffer fence gets signaled */
+        submitFrame(vulkanObj, cmdBuf, cmdBufFence);
     }
     else
     {
@@ -1595,7 +3388,11 @@ void swapFrontBuffer(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkFence cm
                     .pResults = NULL
                 };
                 result = vkQueuePresentKHR(vulkanObj->queue, &presInfo);
-                if(VK_SUCCESS != result)
+                if(VK_ERROR_OUT_OF_DATE_KHR == result || VK_SUBOPTIMAL_KHR == result)
+                {
+                    vulkanObj->swapChainOutOfDate = VK_TRUE;
+                }
+                else if(VK_SUCCESS != result)
                 {
                     printf("Failed to queue presentation\n");
                 }
@@ -1604,6 +3401,37 @@ void swapFrontBuffer(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkFence cm
     }
 }
 
+void submitFrame(VulkanObject *vulkanObj, VkCommandBuffer cmdBuf, VkFence cmdBufFence)
+{
+    /* End the command buffer */
+    VkResult result = vkEndCommandBuffer(cmdBuf);
+    if(VK_SUCCESS != result)
+    {
+        printf("Failed to end command buffer\n");
+    }
+    else
+    {
+        /* Submit without presenting, used when rendering headless or when no image could be acquired */
+        VkSubmitInfo subInfo =
+        {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = NULL,
+            .pWaitDstStageMask = NULL,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmdBuf,
+            .signalSemaphoreCount = 0,
+            .pSignalSemaphores = NULL
+        };
+        result = vkQueueSubmit(vulkanObj->queue, 1, &subInfo, cmdBufFence);
+        if(VK_SUCCESS != result)
+        {
+            printf("Failed to submit command buffer\n");
+        }
+    }
+}
+
 VkResult createSemaphore(VulkanObject *vulkanObj, VkSemaphore semaphore[], uint32_t count)
 {
     VkResult result = VK_SUCCESS;
@@ -1645,4 +3473,122 @@ VkResult createCommandBuffer(VulkanObject *vulkanObj, VkCommandBuffer cmdBuffer[
     
     return result;
 
-}
\ No newline at end of file
+}
+
+
+VkResult createRecordThreads(VulkanObject *vulkanObj, uint32_t threadCount)
+{
+    VkResult result = VK_SUCCESS;
+    uint32_t i, f;
+
+    /* Each frame slot gets its own pool so resetting one never touches a buffer still in flight */
+    VkCommandPoolCreateInfo cpci =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = vulkanObj->queueIndex
+    };
+
+    VkCommandBufferAllocateInfo cbai =
+    {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = VK_NULL_HANDLE,
+        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = RECORD_PASS_COUNT
+    };
+
+    threadCount = (threadCount > MAX_RECORD_THREADS) ? MAX_RECORD_THREADS : threadCount;
+    vulkanObj->recordThreads = (recordThread_t *)memCalloc(MEMORY_RENDERER, threadCount, sizeof(recordThread_t));
+    if(NULL == vulkanObj->recordThreads)
+    {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    vulkanObj->recordThreadCount = threadCount;
+    vulkanObj->recordGeneration = 0;
+    vulkanObj->recordPending = 0;
+    vulkanObj->recordQuit = VK_FALSE;
+    createMutex(&vulkanObj->recordLock);
+    createCondition(&vulkanObj->recordStart);
+    createCondition(&vulkanObj->recordDone);
+
+    for(i=0;i<threadCount && VK_SUCCESS == result;i++)
+    {
+        for(f=0;f<MAX_FRAMES_IN_FLIGHT && VK_SUCCESS == result;f++)
+        {
+            result = vkCreateCommandPool(vulkanObj->device, &cpci, NULL, &vulkanObj->recordThreads[i].cmdPool[f]);
+            if(VK_SUCCESS == result)
+            {
+                cbai.commandPool = vulkanObj->recordThreads[i].cmdPool[f];
+                result = vkAllocateCommandBuffers(vulkanObj->device, &cbai, vulkanObj->recordThreads[i].cmdBuffer[f]);
+            }
+        }
+    }
+
+    if(VK_SUCCESS != result)
+    {
+        destroyRecordThreads(vulkanObj);
+        return result;
+    }
+
+    /* The calling thread records the first slice, a worker that does not start has its slice recorded there too */
+    for(i=1;i<threadCount;i++)
+    {
+        vulkanObj->recordThreads[i].vulkanObj = vulkanObj;
+        vulkanObj->recordThreads[i].running = (0 == createThread(&vulkanObj->recordThreads[i].thread, recordWorker, &vulkanObj->recordThreads[i])) ? VK_TRUE : VK_FALSE;
+        if(!vulkanObj->recordThreads[i].running)
+        {
+            printf("Failed to start recording thread %d, its slice is recorded inline\n", i);
+        }
+    }
+    vulkanObj->recordThreads[0].vulkanObj = vulkanObj;
+
+    printf("Recording threads: %d\n", threadCount);
+    return VK_SUCCESS;
+}
+
+
+void destroyRecordThreads(VulkanObject *vulkanObj)
+{
+    uint32_t i, f;
+
+    if(NULL == vulkanObj->recordThreads)
+    {
+        return;
+    }
+
+    /* Workers sit between frames, they leave at the next wakeup */
+    lockMutex(&vulkanObj->recordLock);
+    vulkanObj->recordQuit = VK_TRUE;
+    broadcastCondition(&vulkanObj->recordStart);
+    unlockMutex(&vulkanObj->recordLock);
+
+    for(i=1;i<vulkanObj->recordThreadCount;i++)
+    {
+        if(vulkanObj->recordThreads[i].running)
+        {
+            joinThread(&vulkanObj->recordThreads[i].thread);
+        }
+    }
+
+    destroyCondition(&vulkanObj->recordDone);
+    destroyCondition(&vulkanObj->recordStart);
+    destroyMutex(&vulkanObj->recordLock);
+
+    /* Destroying a pool frees its command buffers */
+    for(i=0;i<vulkanObj->recordThreadCount;i++)
+    {
+        for(f=0;f<MAX_FRAMES_IN_FLIGHT;f++)
+        {
+            if(VK_NULL_HANDLE != vulkanObj->recordThreads[i].cmdPool[f])
+            {
+                vkDestroyCommandPool(vulkanObj->device, vulkanObj->recordThreads[i].cmdPool[f], NULL);
+            }
+        }
+    }
+
+    memFree(vulkanObj->recordThreads);
+    vulkanObj->recordThreads = NULL;
+    vulkanObj->recordThreadCount = 0;
+}
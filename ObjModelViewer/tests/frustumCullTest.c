@@ -0,0 +1,156 @@
+#include "frustumCull.h"
+#include "testCheck.h"
+
+#define TEST_NEAR                   0.1f
+#define TEST_FAR                    100.0f
+
+/* A 90 degree square frustum puts the side planes at |x| = -z and |y| = -z */
+#define TEST_FOV                    90.0f
+
+#define TEST_DRAW_COUNT             8
+
+
+static void buildFrustum(frustum_t *frustum)
+{
+    float view[16];
+    float projection[16];
+    float viewProj[16];
+
+    /* From the origin down -z, composed the way the renderer does it */
+    generateLookAtMatrix((vec3_t){ 0.0f, 0.0f, 0.0f }, (vec3_t){ 0.0f, 0.0f, -1.0f }, (vec3_t){ 0.0f, 1.0f, 0.0f }, view);
+    generatePerspectiveProjectionMatrix(TEST_FOV, 1.0f, TEST_NEAR, TEST_FAR, projection);
+    matrix4x4By4x4(projection, view, viewProj);
+    extractFrustumPlanes(viewProj, frustum);
+}
+
+
+static float planeDistance(vec4_t *plane, vec3_t point)
+{
+    return plane->x * point.x + plane->y * point.y + plane->z * point.z + plane->w;
+}
+
+
+static uint32_t sphereVisible(frustum_t *frustum, float x, float y, float z, float radius)
+{
+    boundingSphere_t sphere = { { x, y, z }, radius };
+
+    return sphereInFrustum(frustum, &sphere);
+}
+
+
+static void testPlanes(frustum_t *frustum)
+{
+    uint32_t i;
+
+    /* Every plane is normalized and faces the inside */
+    for(i=0;i<FRUSTUM_PLANE_COUNT;i++)
+    {
+        CHECK_NEAR(sqrtf(frustum->planes[i].x*frustum->planes[i].x + frustum->planes[i].y*frustum->planes[i].y + frustum->planes[i].z*frustum->planes[i].z), 1.0f, 1e-4f);
+        CHECK(planeDistance(&frustum->planes[i], (vec3_t){ 0.0f, 0.0f, -10.0f }) > 0.0f);
+    }
+
+    /* Reversed depth, near maps to z = w and far to z = 0, both planes go through the right points */
+    CHECK_NEAR(planeDistance(&frustum->planes[4], (vec3_t){ 0.0f, 0.0f, -TEST_NEAR }), 0.0f, 1e-4f);
+    CHECK_NEAR(planeDistance(&frustum->planes[5], (vec3_t){ 0.0f, 0.0f, -TEST_FAR }), 0.0f, 1e-3f);
+    CHECK(planeDistance(&frustum->planes[4], (vec3_t){ 0.0f, 0.0f, -TEST_NEAR * 0.5f }) < 0.0f);
+    CHECK(planeDistance(&frustum->planes[5], (vec3_t){ 0.0f, 0.0f, -TEST_FAR * 1.5f }) < 0.0f);
+}
+
+
+static void testSpheres(frustum_t *frustum)
+{
+    /* Inside, behind the camera, and wholly past either depth plane */
+    CHECK(sphereVisible(frustum, 0.0f, 0.0f, -10.0f, 1.0f));
+    CHECK(!sphereVisible(frustum, 0.0f, 0.0f, 5.0f, 1.0f));
+    CHECK(!sphereVisible(frustum, 0.0f, 0.0f, -0.04f, 0.01f));
+    CHECK(!sphereVisible(frustum, 0.0f, 0.0f, -TEST_FAR - 2.0f, 1.0f));
+
+    /* Spheres straddling a plane are kept, the ones just clear of it are not */
+    CHECK(sphereVisible(frustum, 0.0f, 0.0f, -TEST_NEAR * 0.5f, TEST_NEAR));
+    CHECK(sphereVisible(frustum, 0.0f, 0.0f, -TEST_FAR - 0.5f, 1.0f));
+    CHECK(sphereVisible(frustum, 10.5f, 0.0f, -10.0f, 1.0f));
+    CHECK(!sphereVisible(frustum, 12.0f, 0.0f, -10.0f, 1.0f));
+    CHECK(sphereVisible(frustum, 0.0f, -10.5f, -10.0f, 1.0f));
+    CHECK(!sphereVisible(frustum, 0.0f, -12.0f, -10.0f, 1.0f));
+}
+
+
+static void testCones(void)
+{
+    /* A quad in the xy plane, wound counter clockwise towards +z */
+    float positions[] = { 0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f };
+    uint32_t faces[] = { 1, 2, 3,  2, 4, 3 };
+    boundingSphere_t sphere = { { 0.0f, 0.0f, -10.0f }, 1.0f };
+    vec3_t camera = { 0.0f, 0.0f, 0.0f };
+    normalCone_t cone;
+
+    cone = computeNormalCone(positions, NULL, faces, 1, 0, 2);
+    CHECK_NEAR(cone.axis.z, 1.0f, 1e-5f);
+    CHECK_NEAR(cone.cutoff, 0.0f, 1e-3f);
+
+    /* Facing away from the camera is culled, facing it is not */
+    cone = (normalCone_t){ { 0.0f, 0.0f, -1.0f }, 0.5f };
+    CHECK(coneBackfacing(&cone, &sphere, camera));
+    cone.axis = (vec3_t){ 0.0f, 0.0f, 1.0f };
+    CHECK(!coneBackfacing(&cone, &sphere, camera));
+
+    /* Seen edge on, some face may turn towards the camera from inside the sphere */
+    cone = (normalCone_t){ { 1.0f, 0.0f, 0.0f }, 0.0f };
+    CHECK(!coneBackfacing(&cone, &sphere, camera));
+
+    /* Too wide to cull from anywhere */
+    cone = (normalCone_t){ { 0.0f, 0.0f, -1.0f }, CONE_NO_CULL };
+    CHECK(!coneBackfacing(&cone, &sphere, camera));
+}
+
+
+static void testCompaction(frustum_t *frustum)
+{
+    boundingSphere_t bounds[TEST_DRAW_COUNT];
+    normalCone_t cones[TEST_DRAW_COUNT];
+    indirectDraw_t draws[TEST_DRAW_COUNT];
+    indirectDraw_t visible[TEST_DRAW_COUNT];
+    vec3_t camera = { 0.0f, 0.0f, 0.0f };
+    uint32_t count;
+    uint32_t i;
+
+    /* Even draws are in view, odd ones behind the camera, and draw 4 faces away */
+    for(i=0;i<TEST_DRAW_COUNT;i++)
+    {
+        bounds[i] = (boundingSphere_t){ { 0.0f, 0.0f, (i % 2 == 0) ? -10.0f : 10.0f }, 1.0f };
+        cones[i] = (normalCone_t){ { 0.0f, 0.0f, (i == 4) ? -1.0f : 1.0f }, 0.5f };
+        draws[i] = (indirectDraw_t){ 3, 1, i * 3, 0 };
+    }
+
+    count = cullDraws(frustum, bounds, NULL, camera, draws, TEST_DRAW_COUNT, visible);
+    CHECK(count == TEST_DRAW_COUNT / 2);
+    for(i=0;i<count;i++)
+    {
+        CHECK(visible[i].firstVertex == i * 2 * 3);
+    }
+
+    /* The survivors keep their order with the cone test on */
+    count = cullDraws(frustum, bounds, cones, camera, draws, TEST_DRAW_COUNT, visible);
+    CHECK(count == TEST_DRAW_COUNT / 2 - 1);
+    if(count == 3)
+    {
+        CHECK(visible[0].firstVertex == 0);
+        CHECK(visible[1].firstVertex == 6);
+        CHECK(visible[2].firstVertex == 18);
+    }
+}
+
+
+int main(void)
+{
+    frustum_t frustum;
+
+    buildFrustum(&frustum);
+    testPlanes(&frustum);
+    testSpheres(&frustum);
+    testCones();
+    testCompaction(&frustum);
+
+    printf("frustumCullTest: %u failed checks\n", s_failures);
+    return TEST_RESULT();
+}
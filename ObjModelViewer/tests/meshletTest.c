@@ -0,0 +1,238 @@
+#include "meshletBuilder.h"
+#include "testCheck.h"
+
+#define DEFAULT_ASSET_DIR           "textures"
+#define TEST_CACHE_FILE             "meshletTest" MESHLET_CACHE_EXTENSION
+
+/* Material of the faces before the first usemtl, which no meshlet holds */
+#define NO_MESHLET_MATERIAL         0xFFFFFFFF
+
+
+/* Length in uint32_t of a face followed by its material, for the sorted comparisons */
+static uint32_t s_recordSize = 0;
+
+
+static int compareRecords(const void *a, const void *b)
+{
+    const uint32_t *ra = (const uint32_t *)a;
+    const uint32_t *rb = (const uint32_t *)b;
+    uint32_t i;
+
+    for(i=0;i<s_recordSize;i++)
+    {
+        if(ra[i] != rb[i])
+        {
+            return (ra[i] < rb[i]) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+
+static VkBool32 loadTestModel(char *assetDir, const char *objFileName, model_t *model, material_table_t *materials)
+{
+    uint64_t size = strlen(assetDir) + strlen(objFileName) + 1;
+    char *fileName = (char *)memAlloc(MEMORY_LOADER, size);
+    VkBool32 loaded;
+
+    memset(model, 0, sizeof(model_t));
+    memset(materials, 0, sizeof(material_table_t));
+
+    strcpy_s(fileName, size, assetDir);
+    strcat_s(fileName, size, objFileName);
+    loaded = loadModel(model, materials, fileName, NULL);
+    memFree(fileName);
+    return loaded;
+}
+
+
+static void freeTestModel(model_t *model, material_table_t *materials, meshlet_list_t *list)
+{
+    releaseParsedArrays(model);
+    memFree(model->materialChange);
+    memFree(model->materialLibFilename);
+    freeMaterialTable(materials);
+    freeMeshlets(list);
+}
+
+
+static uint32_t *faceRecords(model_t *model, uint32_t faceStride, uint32_t *materials)
+{
+    uint32_t *records = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * s_recordSize * model->numOfFaces);
+    uint32_t i;
+
+    /* Every face with the material it is drawn with, in a fixed order */
+    for(i=0;i<model->numOfFaces;i++)
+    {
+        memcpy(&records[i*s_recordSize], &model->f[i*faceStride], sizeof(uint32_t) * faceStride);
+        records[i*s_recordSize + faceStride] = materials[i];
+    }
+    qsort(records, model->numOfFaces, sizeof(uint32_t) * s_recordSize, compareRecords);
+    return records;
+}
+
+
+static uint32_t meshletVertexCount(model_t *model, meshlet_t *meshlet, uint32_t cornerStride)
+{
+    uint32_t *corners[MESHLET_MAX_TRIANGLES * CORNERS_PER_FACE];
+    uint32_t *corner;
+    uint32_t count = 0;
+    uint32_t i, j;
+
+    /* Whole v/vt/vn corners, counted without the builder's bookkeeping */
+    for(i=0;i<meshlet->faceCount * CORNERS_PER_FACE && i<MESHLET_MAX_TRIANGLES * CORNERS_PER_FACE;i++)
+    {
+        corner = &model->f[(meshlet->firstFace * CORNERS_PER_FACE + i) * cornerStride];
+        for(j=0;j<count && 0 != memcmp(corners[j], corner, sizeof(uint32_t) * cornerStride);j++);
+        if(j == count)
+        {
+            corners[count++] = corner;
+        }
+    }
+    return count;
+}
+
+
+static void checkMeshlets(const char *name, model_t *model, meshlet_list_t *list, uint32_t *sourceRecords)
+{
+    uint32_t cornerStride = (model->numOfNormals == 0) ? 2 : 3;
+    uint32_t faceStride = cornerStride * CORNERS_PER_FACE;
+    uint32_t *materials = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * model->numOfFaces);
+    uint32_t *records;
+    uint32_t nextFace = model->materialChange[0].startFace;
+    uint32_t i, j;
+
+    printf("%s: %u faces, %u meshlets\n", name, model->numOfFaces, list->count);
+    CHECK(list->count > 0);
+
+    for(i=0;i<nextFace;i++)
+    {
+        materials[i] = NO_MESHLET_MATERIAL;
+    }
+
+    /* The meshlets tile the faces after the first usemtl, in order and without gaps */
+    for(i=0;i<list->count;i++)
+    {
+        CHECK(list->meshlets[i].firstFace == nextFace);
+        CHECK(list->meshlets[i].faceCount > 0 && list->meshlets[i].faceCount <= MESHLET_MAX_TRIANGLES);
+        CHECK(list->meshlets[i].vertexCount <= MESHLET_MAX_VERTICES);
+        CHECK(list->meshlets[i].vertexCount == meshletVertexCount(model, &list->meshlets[i], cornerStride));
+
+        for(j=list->meshlets[i].firstFace;j<list->meshlets[i].firstFace + list->meshlets[i].faceCount && j<model->numOfFaces;j++)
+        {
+            materials[j] = list->meshlets[i].materialIndex;
+        }
+        nextFace = list->meshlets[i].firstFace + list->meshlets[i].faceCount;
+    }
+    CHECK(nextFace == model->numOfFaces);
+
+    /* Each source face is in exactly one meshlet, of the material its range had */
+    if(nextFace == model->numOfFaces)
+    {
+        records = faceRecords(model, faceStride, materials);
+        CHECK(0 == memcmp(records, sourceRecords, sizeof(uint32_t) * s_recordSize * model->numOfFaces));
+        memFree(records);
+    }
+
+    memFree(materials);
+}
+
+
+static void testModel(char *assetDir, const char *objFileName)
+{
+    model_t model;
+    model_t other;
+    material_table_t materials;
+    material_table_t otherMaterials;
+    meshlet_list_t list = { 0 };
+    meshlet_list_t otherList = { 0 };
+    uint32_t *sourceMaterials;
+    uint32_t *sourceRecords;
+    uint32_t faceStride;
+    uint32_t sourceHash;
+    uint32_t range;
+    uint32_t i;
+
+    if(VK_FALSE == loadTestModel(assetDir, objFileName, &model, &materials) || model.materialChangeCount == 0)
+    {
+        printf("%s could not be loaded\n", objFileName);
+        s_failures++;
+        return;
+    }
+
+    /* The source faces with the material of their range */
+    faceStride = ((model.numOfNormals == 0) ? 2 : 3) * CORNERS_PER_FACE;
+    s_recordSize = faceStride + 1;
+    sourceMaterials = (uint32_t *)memAlloc(MEMORY_LOADER, sizeof(uint32_t) * model.numOfFaces);
+    for(i=0, range=0;i<model.numOfFaces;i++)
+    {
+        while(range < model.materialChangeCount && model.materialChange[range].startFace <= i)
+        {
+            range++;
+        }
+        sourceMaterials[i] = (range == 0) ? NO_MESHLET_MATERIAL : model.materialChange[range-1].materialIndex;
+    }
+    sourceRecords = faceRecords(&model, faceStride, sourceMaterials);
+    memFree(sourceMaterials);
+
+    sourceHash = hashFaces(&model);
+    buildMeshlets(&model, &list);
+    checkMeshlets(objFileName, &model, &list, sourceRecords);
+
+    /* A second build of the same file gives the same faces and meshlets */
+    if(VK_TRUE == loadTestModel(assetDir, objFileName, &other, &otherMaterials))
+    {
+        CHECK(hashFaces(&other) == sourceHash);
+        buildMeshlets(&other, &otherList);
+        CHECK(otherList.count == list.count);
+        CHECK(0 == memcmp(other.f, model.f, sizeof(uint32_t) * faceStride * model.numOfFaces));
+        CHECK(otherList.count == list.count && 0 == memcmp(otherList.meshlets, list.meshlets, sizeof(meshlet_t) * list.count));
+        freeTestModel(&other, &otherMaterials, &otherList);
+    }
+
+    /* What comes back from the cache is the fresh build */
+    CHECK(VK_TRUE == saveMeshletCache(TEST_CACHE_FILE, &model, &list, sourceHash));
+    if(VK_TRUE == loadTestModel(assetDir, objFileName, &other, &otherMaterials))
+    {
+        CHECK(VK_TRUE == loadMeshletCache(TEST_CACHE_FILE, &other, &otherList, hashFaces(&other)));
+        CHECK(otherList.count == list.count && otherList.closed == list.closed);
+        CHECK(0 == memcmp(other.f, model.f, sizeof(uint32_t) * faceStride * model.numOfFaces));
+        CHECK(otherList.count == list.count && 0 == memcmp(otherList.meshlets, list.meshlets, sizeof(meshlet_t) * list.count));
+        freeTestModel(&other, &otherMaterials, &otherList);
+    }
+
+    /* The same faces with another usemtl do not match the cache */
+    if(VK_TRUE == loadTestModel(assetDir, objFileName, &other, &otherMaterials))
+    {
+        other.materialChange[other.materialChangeCount - 1].materialIndex++;
+        CHECK(hashFaces(&other) != sourceHash);
+        CHECK(VK_FALSE == loadMeshletCache(TEST_CACHE_FILE, &other, &otherList, hashFaces(&other)));
+        freeTestModel(&other, &otherMaterials, &otherList);
+    }
+    remove(TEST_CACHE_FILE);
+
+    memFree(sourceRecords);
+    freeTestModel(&model, &materials, &list);
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const char *bundledModels[] =
+    {
+        "/plane/plane.obj",
+        "/sonic/sonic-the-hedgehog.obj",
+        "/bumblebee/bumblebee.obj"
+    };
+
+    char *assetDir = (argc > 1) ? argv[1] : DEFAULT_ASSET_DIR;
+    uint32_t i;
+
+    for(i=0;i<sizeof(bundledModels) / sizeof(bundledModels[0]);i++)
+    {
+        testModel(assetDir, bundledModels[i]);
+    }
+
+    printf("meshletTest: %u failed checks\n", s_failures);
+    return TEST_RESULT();
+}
@@ -0,0 +1,116 @@
+#include "scene.h"
+#include "testCheck.h"
+
+#define TEST_NORMALS_FILE           "objLoaderTest_normals.obj"
+#define TEST_PLAIN_FILE             "objLoaderTest_plain.obj"
+
+#define TEST_FACE_COUNT             2
+
+/* Floats of one expanded vertex, whatever the file had */
+#define TEST_VERTEX_FLOATS          (SCENE_VERTEX_SIZE / sizeof(float))
+
+
+/* A unit quad in the xy plane, wound counter clockwise towards +z, with or without its normal */
+static VkBool32 writeQuad(const char *fileName, VkBool32 normals)
+{
+    FILE *pFile = NULL;
+
+    if(0 != fopen_s(&pFile, fileName, "w"))
+    {
+        printf("Error opening %s\n", fileName);
+        return VK_FALSE;
+    }
+
+    fprintf(pFile, "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n");
+    fprintf(pFile, "vt 0 0\nvt 1 0\nvt 0 1\nvt 1 1\n");
+    if(normals)
+    {
+        fprintf(pFile, "vn 0 0 1\n");
+        fprintf(pFile, "f 1/1/1 2/2/1 3/3/1\nf 2/2/1 4/4/1 3/3/1\n");
+    }
+    else
+    {
+        fprintf(pFile, "f 1/1 2/2 3/3\nf 2/2 4/4 3/3\n");
+    }
+
+    fclose(pFile);
+    return VK_TRUE;
+}
+
+
+static VkBool32 loadQuad(const char *fileName, VkBool32 normals, model_t *model, material_table_t *materials)
+{
+    memset(model, 0, sizeof(model_t));
+    memset(materials, 0, sizeof(material_table_t));
+
+    if(VK_FALSE == writeQuad(fileName, normals) || VK_FALSE == loadObjFile(model, materials, (char *)fileName, NULL))
+    {
+        return VK_FALSE;
+    }
+
+    prepareObjectArrays(model);
+    return VK_TRUE;
+}
+
+
+static void freeQuad(model_t *model, material_table_t *materials)
+{
+    releaseParsedArrays(model);
+    memFree(model->vertArray);
+    memFree(model->materialChange);
+    memFree(model->materialLibFilename);
+    freeMaterialTable(materials);
+}
+
+
+static void testLayout(void)
+{
+    model_t withNormals;
+    model_t plain;
+    material_table_t withNormalsMaterials;
+    material_table_t plainMaterials;
+    float vertices[TEST_FACE_COUNT * ELEMENTS_PER_FACE * 16];
+    uint32_t i;
+
+    if(VK_FALSE == loadQuad(TEST_NORMALS_FILE, VK_TRUE, &withNormals, &withNormalsMaterials) ||
+       VK_FALSE == loadQuad(TEST_PLAIN_FILE, VK_FALSE, &plain, &plainMaterials))
+    {
+        printf("the test quads could not be loaded\n");
+        s_failures++;
+        return;
+    }
+
+    CHECK(withNormals.numOfNormals == 1 && plain.numOfNormals == 0);
+    CHECK(withNormals.numOfFaces == TEST_FACE_COUNT && plain.numOfFaces == TEST_FACE_COUNT);
+
+    /* Both are expanded to whole vertexData_t, the scene and the vertex buffers copy that many bytes */
+    CHECK(expandFaces(&withNormals, 0, TEST_FACE_COUNT, vertices) == TEST_FACE_COUNT * ELEMENTS_PER_FACE * TEST_VERTEX_FLOATS);
+    CHECK(expandFaces(&plain, 0, TEST_FACE_COUNT, vertices) == TEST_FACE_COUNT * ELEMENTS_PER_FACE * TEST_VERTEX_FLOATS);
+
+    /* Every position, normal and texture coordinate is where the other file has it, the face normal stands in for the missing one */
+    for(i=0;i<TEST_FACE_COUNT * ELEMENTS_PER_FACE * TEST_VERTEX_FLOATS;i++)
+    {
+        CHECK_NEAR(plain.vertArray[i], withNormals.vertArray[i], 1e-6f);
+    }
+
+    /* The w of the position is 1 and of the normal 0 */
+    for(i=0;i<TEST_FACE_COUNT * ELEMENTS_PER_FACE;i++)
+    {
+        CHECK(plain.vertArray[i*TEST_VERTEX_FLOATS + 3] == 1.0f);
+        CHECK(plain.vertArray[i*TEST_VERTEX_FLOATS + 7] == 0.0f);
+    }
+
+    freeQuad(&withNormals, &withNormalsMaterials);
+    freeQuad(&plain, &plainMaterials);
+    remove(TEST_NORMALS_FILE);
+    remove(TEST_PLAIN_FILE);
+}
+
+
+int main(void)
+{
+    testLayout();
+
+    printf("objLoaderTest: %u failed checks\n", s_failures);
+    return TEST_RESULT();
+}
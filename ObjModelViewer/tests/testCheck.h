@@ -0,0 +1,25 @@
+#ifndef __TEST_CHECK_H__
+#define __TEST_CHECK_H__
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* Every failed check is printed, the test fails when there were any */
+static uint32_t s_failures = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if(!(condition)) \
+        { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            s_failures++; \
+        } \
+    } while(0)
+
+#define CHECK_NEAR(a, b, tolerance)     CHECK(fabsf((float)(a) - (float)(b)) <= (tolerance))
+
+#define TEST_RESULT()                   ((s_failures == 0) ? 0 : 1)
+
+#endif
@@ -0,0 +1,706 @@
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <vulkan/vulkan.h>
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+#include "objFileLoader.h"
+#include "scene.h"
+#include "bmpTools.h"
+#include "matrixMath.h"
+#include "perfTimer.h"
+
+#define DEFAULT_ITERATIONS          5
+#define DEFAULT_MATH_ITERATIONS     1000000
+#define DEFAULT_ASSET_DIR           "textures"
+
+#define MAX_BENCH_MODELS            16
+#define MAX_BENCH_SCALES            8
+#define MAX_BENCH_STAGES            128
+
+/* Copies of a model side by side in the synthetic meshes, unless other factors are given */
+#define DEFAULT_SCALE_SMALL         4
+#define DEFAULT_SCALE_LARGE         16
+
+/* Gap left between the copies of a tiled model, relative to its width */
+#define TILE_SPACING                1.1f
+
+
+typedef struct _benchOptions_t
+{
+    char *assetDir;
+    char *jsonFileName;
+    char *objFileNames[MAX_BENCH_MODELS];
+    uint32_t objFileCount;
+    uint32_t scales[MAX_BENCH_SCALES];
+    uint32_t scaleCount;
+    uint32_t iterations;
+    uint32_t mathIterations;
+} benchOptions_t;
+
+
+/* The timings of one stage on one input, bytes, allocations and the peak are per iteration */
+typedef struct _benchStage_t
+{
+    char stage[STRLEN];
+    char input[STRLEN];
+    uint32_t iterations;
+    double minMs;
+    double totalMs;
+    uint64_t bytes;
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    uint64_t peakBytes;
+} benchStage_t;
+
+
+/* One timed iteration in progress */
+typedef struct _benchSample_t
+{
+    double startMs;
+    memory_usage_t usage;
+} benchSample_t;
+
+
+static benchStage_t s_stages[MAX_BENCH_STAGES];
+static uint32_t s_stageCount = 0;
+
+/* Keeps the math results alive so the calls are not optimised away */
+static volatile float s_sink = 0.0f;
+
+/* The results' stdout while the loader's progress messages are sent to stderr */
+static int s_resultsOutput = -1;
+
+
+static void startSample(benchSample_t *sample)
+{
+    /* The peak of the stage counts up from what the benchmark already holds */
+    resetMemoryPeaks();
+    getMemoryUsage(MEMORY_SUBSYSTEM_COUNT, &sample->usage);
+    sample->startMs = getTimeMs();
+}
+
+
+static void endSample(benchStage_t *stage, benchSample_t *sample)
+{
+    double elapsedMs = getTimeMs() - sample->startMs;
+    memory_usage_t usage;
+
+    stage->minMs = (elapsedMs < stage->minMs) ? elapsedMs : stage->minMs;
+    stage->totalMs += elapsedMs;
+    stage->iterations++;
+
+    /* Every iteration does the same work, the last one's allocations stand for all of them */
+    getMemoryUsage(MEMORY_SUBSYSTEM_COUNT, &usage);
+    stage->allocations = usage.allocations - sample->usage.allocations;
+    stage->allocatedBytes = usage.allocatedBytes - sample->usage.allocatedBytes;
+    stage->peakBytes = usage.peakBytes - sample->usage.liveBytes;
+}
+
+
+static benchStage_t *addStage(const char *stageName, const char *input, uint64_t bytes)
+{
+    benchStage_t *stage;
+
+    if(s_stageCount == MAX_BENCH_STAGES)
+    {
+        return NULL;
+    }
+
+    stage = &s_stages[s_stageCount++];
+    memset(stage, 0, sizeof(benchStage_t));
+    strncpy_s(stage->stage, STRLEN, stageName, STRLEN - 1);
+    strncpy_s(stage->input, STRLEN, input, STRLEN - 1);
+    stage->minMs = DBL_MAX;
+    stage->bytes = bytes;
+    return stage;
+}
+
+
+static void redirectLoaderOutput(void)
+{
+    /* The loader prints as it goes, none of that may end up between the results */
+    fflush(stdout);
+    s_resultsOutput = dup(fileno(stdout));
+    if(s_resultsOutput >= 0)
+    {
+        dup2(fileno(stderr), fileno(stdout));
+    }
+}
+
+
+static void restoreResultsOutput(void)
+{
+    if(s_resultsOutput < 0)
+    {
+        return;
+    }
+
+    fflush(stdout);
+    dup2(s_resultsOutput, fileno(stdout));
+    close(s_resultsOutput);
+    s_resultsOutput = -1;
+}
+
+
+static uint64_t getFileSize(char *fileName)
+{
+    mapped_file_t file;
+    uint64_t size;
+
+    if(0 != mapFile(&file, fileName))
+    {
+        return 0;
+    }
+    size = file.size;
+    unmapFile(&file);
+    return size;
+}
+
+
+static char *joinPath(const char *path, const char *fileName)
+{
+    uint64_t size = strlen(path) + strlen(fileName) + 1;
+    char *joined = (char *)malloc(size);
+
+    strcpy_s(joined, size, path);
+    strcat_s(joined, size, fileName);
+    return joined;
+}
+
+
+static void inputName(char *objFileName, char *name)
+{
+    char *path = getPath(objFileName);
+    char *dot;
+
+    /* The file name without its directory and extension */
+    strncpy_s(name, STRLEN, objFileName + strlen(path), STRLEN - 1);
+    dot = strrchr(name, '.');
+    if(NULL != dot)
+    {
+        *dot = '\0';
+    }
+    memFree(path);
+}
+
+
+static void freeModel(model_t *model, material_table_t *materials)
+{
+    releaseParsedArrays(model);
+    memFree(model->vertArray);
+    memFree(model->materialChange);
+    memFree(model->materialLibFilename);
+    freeMaterialTable(materials);
+    memset(model, 0, sizeof(model_t));
+}
+
+
+static VkBool32 benchObjParse(char *objFileName, char *name, uint32_t iterations, model_t *model, material_table_t *materials)
+{
+    benchStage_t *stage = addStage("obj-parse", name, getFileSize(objFileName));
+    benchSample_t sample;
+    uint32_t i;
+
+    if(NULL == stage)
+    {
+        return VK_FALSE;
+    }
+
+    for(i=0;i<iterations;i++)
+    {
+        freeModel(model, materials);
+
+        startSample(&sample);
+        if(VK_FALSE == loadObjFile(model, materials, objFileName, NULL))
+        {
+            return VK_FALSE;
+        }
+        endSample(stage, &sample);
+    }
+
+    /* The last parse is kept for the stages that follow */
+    return VK_TRUE;
+}
+
+
+static char *benchMtlParse(char *objFileName, char *name, uint32_t iterations, model_t *model, material_table_t *materials)
+{
+    char *path = getPath(objFileName);
+    char *mtlFileName = joinPath(path, model->materialLibFilename);
+    benchStage_t *stage = addStage("mtl-parse", name, getFileSize(mtlFileName));
+    material_table_t table;
+    benchSample_t sample;
+    uint32_t i;
+
+    /* A fresh table each time, the library alone is timed */
+    for(i=0;NULL != stage && i<iterations;i++)
+    {
+        memset(&table, 0, sizeof(material_table_t));
+
+        startSample(&sample);
+        loadMtlFile(model, &table, mtlFileName);
+        endSample(stage, &sample);
+
+        freeMaterialTable(&table);
+    }
+
+    /* Then read into the table the OBJ filled with usemtl names, like loadModel */
+    loadMtlFile(model, materials, mtlFileName);
+    printf("\n");
+
+    free(mtlFileName);
+    return path;
+}
+
+
+static void benchPrepareArrays(char *name, uint32_t iterations, model_t *model)
+{
+    benchStage_t *stage = addStage("prepare-arrays", name, (uint64_t)model->numOfFaces * ELEMENTS_PER_FACE * SCENE_VERTEX_SIZE);
+    benchSample_t sample;
+    uint32_t i;
+
+    for(i=0;NULL != stage && i<iterations;i++)
+    {
+        startSample(&sample);
+        prepareObjectArrays(model);
+        endSample(stage, &sample);
+
+        memFree(model->vertArray);
+        model->vertArray = NULL;
+    }
+}
+
+
+static void benchBmpDecode(char *name, char *path, uint32_t iterations, material_table_t *materials)
+{
+    benchStage_t *stage;
+    benchSample_t sample;
+    char **fileNames;
+    uint32_t fileCount = 0;
+    uint64_t bytes = 0;
+    unsigned char *pixels;
+    mip_chain_t chain;
+    VkExtent2D size;
+    uint32_t i, j;
+
+    /* Each texture once, materials may share them */
+    fileNames = (char **)malloc(sizeof(char *) * (materials->count + 1));
+    for(i=0;i<materials->count;i++)
+    {
+        if(NULL == materials->entries[i].fileName)
+        {
+            continue;
+        }
+        for(j=0;j<fileCount && 0 != strcmp(materials->entries[i].fileName, fileNames[j] + strlen(path));j++);
+        if(j == fileCount)
+        {
+            fileNames[fileCount] = joinPath(path, materials->entries[i].fileName);
+            bytes += getFileSize(fileNames[fileCount]);
+            fileCount++;
+        }
+    }
+
+    stage = (fileCount > 0) ? addStage("bmp-decode", name, bytes) : NULL;
+
+    /* All of the model's textures make one sample, decoded and mipmapped the way the loader threads do */
+    for(i=0;NULL != stage && i<iterations;i++)
+    {
+        startSample(&sample);
+        for(j=0;j<fileCount;j++)
+        {
+            pixels = loadBmpFile(fileNames[j], &size);
+            if(NULL == pixels)
+            {
+                continue;
+            }
+            buildMipChain(&size, pixels, &chain);
+            memFree(pixels);
+            freeMipChain(&chain);
+        }
+        endSample(stage, &sample);
+    }
+
+    for(i=0;i<fileCount;i++)
+    {
+        free(fileNames[i]);
+    }
+    free(fileNames);
+}
+
+
+static VkBool32 writeTiledObj(model_t *model, material_table_t *materials, uint32_t copies, char *fileName)
+{
+    FILE *pFile = NULL;
+    float minX = FLT_MAX;
+    float maxX = -FLT_MAX;
+    float spacing;
+    uint32_t stride = (model->numOfNormals == 0) ? (ELEMENTS_PER_FACE*2) : (ELEMENTS_PER_FACE*3);
+    uint32_t corner = stride / ELEMENTS_PER_FACE;
+    uint32_t offsets[3];
+    uint32_t range = 0;
+    uint32_t *face;
+    uint32_t c, i, j;
+
+    if(0 != fopen_s(&pFile, fileName, "w"))
+    {
+        printf("Error opening %s\n", fileName);
+        return VK_FALSE;
+    }
+
+    /* The copies are laid out along x without overlapping */
+    for(i=0;i<model->numOfVertices;i++)
+    {
+        minX = (model->v[i*ELEMENTS_PER_VERTEX] < minX) ? model->v[i*ELEMENTS_PER_VERTEX] : minX;
+        maxX = (model->v[i*ELEMENTS_PER_VERTEX] > maxX) ? model->v[i*ELEMENTS_PER_VERTEX] : maxX;
+    }
+    spacing = (maxX - minX) * TILE_SPACING;
+
+    fprintf(pFile, "mtllib %s\n", model->materialLibFilename);
+
+    /* Every vertex, texture coordinate and normal comes before the faces, the loader needs the normals first */
+    for(c=0;c<copies;c++)
+    {
+        for(i=0;i<model->numOfVertices;i++)
+        {
+            fprintf(pFile, "v %f %f %f\n", model->v[i*3] + spacing * c, model->v[i*3+1], model->v[i*3+2]);
+        }
+    }
+    for(c=0;c<copies;c++)
+    {
+        for(i=0;i<model->numOfTexCoords;i++)
+        {
+            fprintf(pFile, "vt %f %f\n", model->vt[i*2], model->vt[i*2+1]);
+        }
+    }
+    for(c=0;c<copies;c++)
+    {
+        for(i=0;i<model->numOfNormals;i++)
+        {
+            fprintf(pFile, "vn %f %f %f\n", model->vn[i*3], model->vn[i*3+1], model->vn[i*3+2]);
+        }
+    }
+
+    /* Each copy repeats the faces and material switches of the model */
+    for(c=0;c<copies;c++)
+    {
+        offsets[0] = model->numOfVertices * c;
+        offsets[1] = model->numOfTexCoords * c;
+        offsets[2] = model->numOfNormals * c;
+
+        range = 0;
+        for(i=0;i<model->numOfFaces;i++)
+        {
+            while(range < model->materialChangeCount && model->materialChange[range].startFace == i)
+            {
+                fprintf(pFile, "usemtl %s\n", materials->entries[model->materialChange[range].materialIndex].name);
+                range++;
+            }
+
+            face = &model->f[stride * i];
+            fprintf(pFile, "f");
+            for(j=0;j<ELEMENTS_PER_FACE;j++)
+            {
+                if(corner == 2)
+                {
+                    fprintf(pFile, " %u/%u", face[j*2] + offsets[0], face[j*2+1] + offsets[1]);
+                }
+                else
+                {
+                    fprintf(pFile, " %u/%u/%u", face[j*3] + offsets[0], face[j*3+1] + offsets[1], face[j*3+2] + offsets[2]);
+                }
+            }
+            fprintf(pFile, "\n");
+        }
+    }
+
+    fclose(pFile);
+    return VK_TRUE;
+}
+
+
+static void benchModel(char *objFileName, char *name, benchOptions_t *options, VkBool32 synthetic)
+{
+    model_t model = { 0 };
+    material_table_t materials = { 0 };
+    char *path;
+    char syntheticName[STRLEN];
+    char syntheticFileName[STRLEN];
+    uint32_t i;
+
+    printf("Benchmarking %s...\n", objFileName);
+
+    if(VK_FALSE == benchObjParse(objFileName, name, options->iterations, &model, &materials))
+    {
+        printf("Failed to parse %s\n", objFileName);
+        freeModel(&model, &materials);
+        return;
+    }
+
+    /* The tiled copies only differ in size, their library and textures are the source model's */
+    if(synthetic)
+    {
+        benchPrepareArrays(name, options->iterations, &model);
+        freeModel(&model, &materials);
+        return;
+    }
+
+    if(NULL == model.materialLibFilename)
+    {
+        printf("%s has no mtllib\n", objFileName);
+        freeModel(&model, &materials);
+        return;
+    }
+
+    path = benchMtlParse(objFileName, name, options->iterations, &model, &materials);
+    benchPrepareArrays(name, options->iterations, &model);
+    benchBmpDecode(name, path, options->iterations, &materials);
+
+    /* Scaled up copies written next to the benchmark, then parsed and prepared like the model */
+    for(i=0;i<options->scaleCount;i++)
+    {
+        snprintf(syntheticName, STRLEN, "%s-x%u", name, options->scales[i]);
+        snprintf(syntheticFileName, STRLEN, "%s-x%u.obj", name, options->scales[i]);
+        if(VK_TRUE == writeTiledObj(&model, &materials, options->scales[i], syntheticFileName))
+        {
+            benchModel(syntheticFileName, syntheticName, options, VK_TRUE);
+            remove(syntheticFileName);
+        }
+    }
+
+    memFree(path);
+    freeModel(&model, &materials);
+}
+
+
+static void benchMatrixMath(uint32_t iterations)
+{
+    benchStage_t *stage;
+    benchSample_t sample;
+    float a[16], b[16], c[16];
+    vec3_t eye = { 0.0f, 0.0f, 10.0f };
+    vec3_t target = { 0.0f, 0.0f, 0.0f };
+    vec3_t up = { 0.0f, 1.0f, 0.0f };
+    vec3_t v;
+    uint32_t i;
+
+    setIdentityMatrix(a);
+    generateRotationMatrix(0.5f, up, b);
+
+    /* One sample per function, the loop is the repetition, bytes are what each call reads and writes */
+    stage = addStage("mat4x4-by-4x4", "math", (uint64_t)iterations * 48 * sizeof(float));
+    startSample(&sample);
+    for(i=0;i<iterations;i++)
+    {
+        matrix4x4By4x4(a, b, c);
+        a[3] = c[3] + 1e-7f;
+    }
+    endSample(stage, &sample);
+    s_sink += c[0];
+
+    stage = addStage("mat4x4-by-4x1", "math", (uint64_t)iterations * 24 * sizeof(float));
+    startSample(&sample);
+    for(i=0;i<iterations;i++)
+    {
+        matrix4x4By4x1(a, b, c);
+        b[0] = c[0];
+    }
+    endSample(stage, &sample);
+    s_sink += c[0];
+
+    stage = addStage("rotation-matrix", "math", (uint64_t)iterations * 19 * sizeof(float));
+    startSample(&sample);
+    for(i=0;i<iterations;i++)
+    {
+        generateRotationMatrix((float)i * 1e-4f, up, c);
+        s_sink += c[1];
+    }
+    endSample(stage, &sample);
+
+    stage = addStage("look-at-matrix", "math", (uint64_t)iterations * 25 * sizeof(float));
+    startSample(&sample);
+    for(i=0;i<iterations;i++)
+    {
+        eye.x = (float)i * 1e-4f;
+        generateLookAtMatrix(eye, target, up, c);
+        s_sink += c[3];
+    }
+    endSample(stage, &sample);
+
+    stage = addStage("perspective-matrix", "math", (uint64_t)iterations * 20 * sizeof(float));
+    startSample(&sample);
+    for(i=0;i<iterations;i++)
+    {
+        generatePerspectiveProjectionMatrix(55.0f + (float)(i & 15), 1.333f, 0.1f, 2000.0f, c);
+        s_sink += c[0];
+    }
+    endSample(stage, &sample);
+
+    stage = addStage("vec3-ops", "math", (uint64_t)iterations * 12 * sizeof(float));
+    startSample(&sample);
+    v = eye;
+    for(i=0;i<iterations;i++)
+    {
+        v = normalize(addProd(crossProd(v, up), scalarProd(up, dotProd(v, eye))));
+    }
+    endSample(stage, &sample);
+    s_sink += v.x;
+}
+
+
+static void printResults(void)
+{
+    benchStage_t *stage;
+    double meanMs;
+    double megabytesPerSec;
+    uint32_t i;
+
+    printf("\n%-20s %-24s %6s %12s %12s %12s %12s %14s %14s\n", "stage", "input", "iters", "min ms", "mean ms", "MB/s", "allocs", "alloc bytes", "peak bytes");
+    for(i=0;i<s_stageCount;i++)
+    {
+        stage = &s_stages[i];
+        meanMs = stage->totalMs / stage->iterations;
+        megabytesPerSec = (stage->minMs > 0.0) ? ((double)stage->bytes / (1024.0 * 1024.0)) / (stage->minMs / 1000.0) : 0.0;
+
+        printf("%-20s %-24s %6u %12.3f %12.3f %12.1f %12" PRIu64 " %14" PRIu64 " %14" PRIu64 "\n", stage->stage, stage->input, stage->iterations, stage->minMs, meanMs, megabytesPerSec, stage->allocations, stage->allocatedBytes, stage->peakBytes);
+    }
+}
+
+
+static VkBool32 writeJson(char *fileName)
+{
+    FILE *pFile = NULL;
+    benchStage_t *stage;
+    uint32_t i;
+
+    if(0 != fopen_s(&pFile, fileName, "w"))
+    {
+        printf("Error opening %s\n", fileName);
+        return VK_FALSE;
+    }
+
+    /* One object per line */
+    for(i=0;i<s_stageCount;i++)
+    {
+        stage = &s_stages[i];
+        fprintf(pFile, "{\"stage\":\"%s\",\"input\":\"%s\",\"iterations\":%u,\"min_ms\":%.6f,\"mean_ms\":%.6f,\"bytes\":%" PRIu64 ",\"bytes_per_sec\":%.1f,",
+            stage->stage, stage->input, stage->iterations, stage->minMs, stage->totalMs / stage->iterations, stage->bytes,
+            (stage->minMs > 0.0) ? (double)stage->bytes / (stage->minMs / 1000.0) : 0.0);
+        fprintf(pFile, "\"allocations\":%" PRIu64 ",\"allocated_bytes\":%" PRIu64 ",\"peak_bytes\":%" PRIu64 "}\n", stage->allocations, stage->allocatedBytes, stage->peakBytes);
+    }
+
+    fclose(pFile);
+    return VK_TRUE;
+}
+
+
+static VkBool32 parseOptions(int argc, char *argv[], benchOptions_t *options)
+{
+    int i;
+
+    options->assetDir = DEFAULT_ASSET_DIR;
+    options->iterations = DEFAULT_ITERATIONS;
+    options->mathIterations = DEFAULT_MATH_ITERATIONS;
+
+    for(i=1;i<argc;i++)
+    {
+        if(0 == strcmp(argv[i], "--iterations") && (i + 1) < argc)
+        {
+            options->iterations = (uint32_t)atoi(argv[++i]);
+            options->iterations = (options->iterations > 0) ? options->iterations : 1;
+        }
+        else if(0 == strcmp(argv[i], "--math-iterations") && (i + 1) < argc)
+        {
+            options->mathIterations = (uint32_t)atoi(argv[++i]);
+        }
+        else if(0 == strcmp(argv[i], "--scale") && (i + 1) < argc)
+        {
+            /* 0 turns the synthetic meshes off */
+            if(options->scaleCount < MAX_BENCH_SCALES)
+            {
+                options->scales[options->scaleCount++] = (uint32_t)atoi(argv[++i]);
+            }
+        }
+        else if(0 == strcmp(argv[i], "--assets") && (i + 1) < argc)
+        {
+            options->assetDir = argv[++i];
+        }
+        else if(0 == strcmp(argv[i], "--json") && (i + 1) < argc)
+        {
+            options->jsonFileName = argv[++i];
+        }
+        else if(argv[i][0] == '-')
+        {
+            return VK_FALSE;
+        }
+        else if(options->objFileCount < MAX_BENCH_MODELS)
+        {
+            options->objFileNames[options->objFileCount++] = argv[i];
+        }
+    }
+
+    if(0 == options->scaleCount)
+    {
+        options->scales[options->scaleCount++] = DEFAULT_SCALE_SMALL;
+        options->scales[options->scaleCount++] = DEFAULT_SCALE_LARGE;
+    }
+    else if(1 == options->scaleCount && 0 == options->scales[0])
+    {
+        options->scaleCount = 0;
+    }
+
+    return VK_TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const char *bundledModels[] =
+    {
+        "/plane/plane.obj",
+        "/sonic/sonic-the-hedgehog.obj",
+        "/bumblebee/bumblebee.obj"
+    };
+
+    benchOptions_t options = { 0 };
+    char *objFileName;
+    char name[STRLEN];
+    uint32_t i;
+
+    if(VK_FALSE == parseOptions(argc, argv, &options))
+    {
+        printf("Usage: %s [<file.obj> ...] [--assets <dir>] [--iterations <count>] [--math-iterations <count>] [--scale <copies>] [--json <file>]\n", argv[0]);
+        return 1;
+    }
+
+    redirectLoaderOutput();
+
+    /* Without models on the command line the bundled ones are timed */
+    for(i=0;i<((options.objFileCount > 0) ? options.objFileCount : sizeof(bundledModels) / sizeof(bundledModels[0]));i++)
+    {
+        objFileName = (options.objFileCount > 0) ? joinPath("", options.objFileNames[i]) : joinPath(options.assetDir, bundledModels[i]);
+        inputName(objFileName, name);
+        benchModel(objFileName, name, &options, VK_FALSE);
+        free(objFileName);
+    }
+
+    benchMatrixMath(options.mathIterations);
+
+    restoreResultsOutput();
+    printResults();
+
+    if(NULL != options.jsonFileName && VK_FALSE == writeJson(options.jsonFileName))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vulkan/vulkan.h>
+
+#include "objFileLoader.h"
+#include "bmpTools.h"
+
+#define DEFAULT_VERTICES            1000000
+#define DEFAULT_MATERIALS           4
+#define DEFAULT_TEXTURES            4
+#define DEFAULT_TEXTURE_SIZE        512
+#define DEFAULT_SEED                1
+#define DEFAULT_OUTPUT              "synthetic"
+
+/* The grid spans this many units whatever its vertex count, the camera is set back to see all of it */
+#define GRID_EXTENT                 100.0f
+#define GRID_HEIGHT                 2.0f
+#define CAMERA_DISTANCE             150.0f
+
+/* Texels per checker square in the generated textures */
+#define CHECKER_SIZE                32
+
+/* Large buffered writes, the files can reach many gigabytes */
+#define OUTPUT_BUFFER_SIZE          (4*1024*1024)
+
+
+typedef struct _generatorOptions_t
+{
+    char *output;
+    uint64_t vertices;
+    uint32_t materials;
+    uint64_t switchEvery;
+    uint32_t textures;
+    uint32_t textureSize;
+    uint32_t seed;
+    VkBool32 normals;
+} generatorOptions_t;
+
+
+/* Everything about a grid vertex comes from its position and the seed, so nothing has to be kept */
+static uint32_t hashVertex(uint32_t seed, uint32_t x, uint32_t y)
+{
+    uint32_t hash = seed * 0x9E3779B9u;
+
+    /* murmur3 finaliser over the mixed coordinates */
+    hash ^= x * 0x85EBCA6Bu;
+    hash = (hash << 13) | (hash >> 19);
+    hash ^= y * 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+
+static float gridHeight(uint32_t seed, uint32_t columns, uint32_t rows, int64_t x, int64_t y)
+{
+    /* Clamped at the edges so border normals are still defined */
+    x = (x < 0) ? 0 : ((x >= columns) ? (columns - 1) : x);
+    y = (y < 0) ? 0 : ((y >= rows) ? (rows - 1) : y);
+    return GRID_HEIGHT * ((float)hashVertex(seed, (uint32_t)x, (uint32_t)y) / 4294967295.0f - 0.5f);
+}
+
+
+static VkBool32 writeObj(generatorOptions_t *options, char *objFileName, char *mtlFileName, uint32_t columns, uint32_t rows, uint64_t *faceCount)
+{
+    FILE *pFile = NULL;
+    char *buffer;
+    char *path = getPath(mtlFileName);
+    float step = GRID_EXTENT / (float)(((columns > rows) ? columns : rows) - 1);
+    float dx, dy, length;
+    uint64_t faces = 0;
+    uint64_t cellFaces = (uint64_t)(columns - 1) * (rows - 1) * 2;
+    uint64_t corner[4];
+    uint64_t *triangle;
+    uint32_t material = 0;
+    uint32_t x, y, i, j;
+
+    /* Both triangles of a cell wind counter clockwise seen from the camera */
+    static const uint32_t triangles[2][3] = { { 0, 1, 3 }, { 0, 3, 2 } };
+
+    if(0 != fopen_s(&pFile, objFileName, "w"))
+    {
+        printf("Error opening %s\n", objFileName);
+        memFree(path);
+        return VK_FALSE;
+    }
+    buffer = (char *)malloc(OUTPUT_BUFFER_SIZE);
+    setvbuf(pFile, buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    /* The library is next to the OBJ file */
+    fprintf(pFile, "# %u x %u grid, seed %u\n", columns, rows, options->seed);
+    fprintf(pFile, "campos 0.0 0.0 %.1f\n", CAMERA_DISTANCE);
+    fprintf(pFile, "lightpos 0.0 %.1f %.1f\n", GRID_EXTENT, GRID_EXTENT);
+    fprintf(pFile, "mtllib %s\n", mtlFileName + strlen(path));
+    memFree(path);
+
+    /* A height field facing the camera, centred on the origin */
+    for(y=0;y<rows;y++)
+    {
+        for(x=0;x<columns;x++)
+        {
+            fprintf(pFile, "v %.4f %.4f %.4f\n", step * x - 0.5f * step * (columns - 1), step * y - 0.5f * step * (rows - 1), gridHeight(options->seed, columns, rows, x, y));
+        }
+    }
+    for(y=0;y<rows;y++)
+    {
+        for(x=0;x<columns;x++)
+        {
+            fprintf(pFile, "vt %.5f %.5f\n", (float)x / (columns - 1), (float)y / (rows - 1));
+        }
+    }
+
+    /* Central differences of the heights, the loader needs the normals before the faces */
+    if(options->normals)
+    {
+        for(y=0;y<rows;y++)
+        {
+            for(x=0;x<columns;x++)
+            {
+                dx = (gridHeight(options->seed, columns, rows, (int64_t)x + 1, y) - gridHeight(options->seed, columns, rows, (int64_t)x - 1, y)) / (2.0f * step);
+                dy = (gridHeight(options->seed, columns, rows, x, (int64_t)y + 1) - gridHeight(options->seed, columns, rows, x, (int64_t)y - 1)) / (2.0f * step);
+                length = sqrtf(dx * dx + dy * dy + 1.0f);
+                fprintf(pFile, "vn %.4f %.4f %.4f\n", -dx / length, -dy / length, 1.0f / length);
+            }
+        }
+    }
+
+    /* Two triangles per cell, the vertex, texture coordinate and normal of a corner share one index */
+    for(y=0;y+1<rows;y++)
+    {
+        for(x=0;x+1<columns;x++)
+        {
+            /* OBJ indices start at 1 */
+            corner[0] = (uint64_t)y * columns + x + 1;
+            corner[1] = corner[0] + 1;
+            corner[2] = corner[0] + columns;
+            corner[3] = corner[2] + 1;
+
+            for(i=0;i<2;i++)
+            {
+                /* Either one range per material in turn, or a switch every switchEvery faces */
+                j = (0 == options->switchEvery) ? (uint32_t)(faces * options->materials / cellFaces) : (uint32_t)((faces / options->switchEvery) % options->materials);
+                if(0 == faces || j != material)
+                {
+                    material = j;
+                    fprintf(pFile, "usemtl material%u\n", material);
+                }
+
+                fprintf(pFile, "f");
+                for(j=0;j<ELEMENTS_PER_FACE;j++)
+                {
+                    triangle = &corner[triangles[i][j]];
+                    if(options->normals)
+                    {
+                        fprintf(pFile, " %" PRIu64 "/%" PRIu64 "/%" PRIu64, *triangle, *triangle, *triangle);
+                    }
+                    else
+                    {
+                        fprintf(pFile, " %" PRIu64 "/%" PRIu64, *triangle, *triangle);
+                    }
+                }
+                fprintf(pFile, "\n");
+                faces++;
+            }
+        }
+    }
+
+    fclose(pFile);
+    free(buffer);
+
+    *faceCount = faces;
+    return VK_TRUE;
+}
+
+
+static VkBool32 writeMtl(generatorOptions_t *options, char *mtlFileName, char *textureName)
+{
+    FILE *pFile = NULL;
+    uint32_t hash;
+    uint32_t i;
+
+    if(0 != fopen_s(&pFile, mtlFileName, "w"))
+    {
+        printf("Error opening %s\n", mtlFileName);
+        return VK_FALSE;
+    }
+
+    /* Each material gets its own tint so the ranges can be told apart untextured */
+    for(i=0;i<options->materials;i++)
+    {
+        hash = hashVertex(options->seed, i, 0xFFFFFFFF);
+
+        fprintf(pFile, "newmtl material%u\n", i);
+        fprintf(pFile, "Ns 96.0\n");
+        fprintf(pFile, "Ka 0.0 0.0 0.0\n");
+        fprintf(pFile, "Kd %.3f %.3f %.3f\n", 0.5f + (hash & 0xFF) / 510.0f, 0.5f + ((hash >> 8) & 0xFF) / 510.0f, 0.5f + ((hash >> 16) & 0xFF) / 510.0f);
+        fprintf(pFile, "Ks 0.01 0.01 0.01\n");
+        fprintf(pFile, "Ni 1.0\n");
+        fprintf(pFile, "d 1.0\n");
+        fprintf(pFile, "illum 2\n");
+
+        /* The textures are shared round robin when there are fewer than materials */
+        if(options->textures > 0)
+        {
+            fprintf(pFile, "map_Kd %s%u.bmp\n", textureName, i % options->textures);
+        }
+        fprintf(pFile, "\n");
+    }
+
+    fclose(pFile);
+    return VK_TRUE;
+}
+
+
+static void writeLittleEndian(uint8_t *data, uint32_t value, uint32_t size)
+{
+    uint32_t i;
+
+    for(i=0;i<size;i++)
+    {
+        data[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+
+static VkBool32 writeBmp(char *fileName, uint32_t size, uint32_t hash)
+{
+    FILE *pFile = NULL;
+    uint8_t header[BMP_HEADER_SIZE] = { 0 };
+    uint8_t colors[2][BMP_PIX_PER_COLOR];
+    uint8_t *row;
+    uint32_t imageSize = size * size * BMP_PIX_PER_COLOR;
+    uint32_t x, y;
+
+    if(0 != fopen_s(&pFile, fileName, "wb"))
+    {
+        printf("Error opening %s\n", fileName);
+        return VK_FALSE;
+    }
+
+    /* File header then BITMAPINFOHEADER, 24 bits per pixel, uncompressed */
+    header[0] = 'B';
+    header[1] = 'M';
+    writeLittleEndian(&header[2], BMP_HEADER_SIZE + imageSize, 4);
+    writeLittleEndian(&header[10], BMP_HEADER_SIZE, 4);
+    writeLittleEndian(&header[14], 40, 4);
+    writeLittleEndian(&header[BMP_WIDTH_OFFSET], size, 4);
+    writeLittleEndian(&header[BMP_HEIGHT_OFFSET], size, 4);
+    writeLittleEndian(&header[26], 1, 2);
+    writeLittleEndian(&header[28], BMP_PIX_PER_COLOR * 8, 2);
+    writeLittleEndian(&header[34], imageSize, 4);
+    writeLittleEndian(&header[38], 2835, 4);
+    writeLittleEndian(&header[42], 2835, 4);
+    fwrite(header, BMP_HEADER_SIZE, 1, pFile);
+
+    /* A checker board of two colours picked by the hash, stored blue first */
+    for(x=0;x<BMP_PIX_PER_COLOR;x++)
+    {
+        colors[0][x] = (uint8_t)(hash >> (x * 8));
+        colors[1][x] = (uint8_t)(255 - colors[0][x]);
+    }
+
+    /* The size is a multiple of four, the rows need no padding */
+    row = (uint8_t *)malloc(size * BMP_PIX_PER_COLOR);
+    for(y=0;y<size;y++)
+    {
+        for(x=0;x<size;x++)
+        {
+            memcpy(&row[x * BMP_PIX_PER_COLOR], colors[((x / CHECKER_SIZE) + (y / CHECKER_SIZE)) & 1], BMP_PIX_PER_COLOR);
+        }
+        fwrite(row, BMP_PIX_PER_COLOR, size, pFile);
+    }
+    free(row);
+
+    fclose(pFile);
+    return VK_TRUE;
+}
+
+
+static VkBool32 parseOptions(int argc, char *argv[], generatorOptions_t *options)
+{
+    int i;
+
+    options->output = DEFAULT_OUTPUT;
+    options->vertices = DEFAULT_VERTICES;
+    options->materials = DEFAULT_MATERIALS;
+    options->textures = DEFAULT_TEXTURES;
+    options->textureSize = DEFAULT_TEXTURE_SIZE;
+    options->seed = DEFAULT_SEED;
+
+    for(i=1;i<argc;i++)
+    {
+        if(0 == strcmp(argv[i], "--vertices") && (i + 1) < argc)
+        {
+            options->vertices = strtoull(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--materials") && (i + 1) < argc)
+        {
+            options->materials = (uint32_t)atoi(argv[++i]);
+            options->materials = (options->materials > 0) ? options->materials : 1;
+        }
+        else if(0 == strcmp(argv[i], "--switch-every") && (i + 1) < argc)
+        {
+            options->switchEvery = strtoull(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--textures") && (i + 1) < argc)
+        {
+            options->textures = (uint32_t)atoi(argv[++i]);
+        }
+        else if(0 == strcmp(argv[i], "--texture-size") && (i + 1) < argc)
+        {
+            options->textureSize = (uint32_t)atoi(argv[++i]);
+        }
+        else if(0 == strcmp(argv[i], "--seed") && (i + 1) < argc)
+        {
+            options->seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(0 == strcmp(argv[i], "--normals"))
+        {
+            options->normals = VK_TRUE;
+        }
+        else if(0 == strcmp(argv[i], "--output") && (i + 1) < argc)
+        {
+            options->output = argv[++i];
+        }
+        else
+        {
+            return VK_FALSE;
+        }
+    }
+
+    /* loadBmpToBuffer reads the rows without their padding, keep them unpadded */
+    options->textureSize = (options->textureSize < 4) ? 4 : ((options->textureSize + 3) & ~3u);
+
+    return VK_TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+    generatorOptions_t options = { 0 };
+    uint64_t size;
+    uint64_t faces = 0;
+    uint32_t columns, rows;
+    char *objFileName;
+    char *mtlFileName;
+    char *textureName;
+    char *fileName;
+    char *path;
+    uint32_t i;
+
+    if(VK_FALSE == parseOptions(argc, argv, &options))
+    {
+        printf("Usage: %s [--vertices <minimum count>] [--normals] [--materials <count>] [--switch-every <faces>] [--textures <count>] [--texture-size <texels>] [--seed <seed>] [--output <name>]\n", argv[0]);
+        return 1;
+    }
+
+    /* The loader reads indices as signed 32 bit integers */
+    if(options.vertices < 4 || options.vertices > INT32_MAX)
+    {
+        printf("The vertex count must be between 4 and %d\n", INT32_MAX);
+        return 1;
+    }
+
+    /* The squarest grid with at least the vertices asked for, which can be up to a row more, the count written is printed */
+    columns = (uint32_t)ceil(sqrt((double)options.vertices));
+    rows = (uint32_t)((options.vertices + columns - 1) / columns);
+    rows = (rows < 2) ? 2 : rows;
+
+    /* <name>.obj and <name>.mtl, the textures are <name>_texture<n>.bmp next to them */
+    size = strlen(options.output) + 32;
+    objFileName = (char *)malloc(size);
+    mtlFileName = (char *)malloc(size);
+    fileName = (char *)malloc(size);
+    snprintf(objFileName, size, "%s.obj", options.output);
+    snprintf(mtlFileName, size, "%s.mtl", options.output);
+    path = getPath(options.output);
+    textureName = (char *)malloc(size);
+    snprintf(textureName, size, "%s_texture", options.output + strlen(path));
+
+    printf("Writing %s: %u x %u vertices%s, %u materials, %u textures of %u x %u\n",
+        objFileName, columns, rows, options.normals ? " with normals" : "", options.materials, options.textures, options.textureSize, options.textureSize);
+
+    if(VK_FALSE == writeObj(&options, objFileName, mtlFileName, columns, rows, &faces) ||
+        VK_FALSE == writeMtl(&options, mtlFileName, textureName))
+    {
+        return 1;
+    }
+
+    for(i=0;i<options.textures;i++)
+    {
+        snprintf(fileName, size, "%s%s%u.bmp", path, textureName, i);
+        if(VK_FALSE == writeBmp(fileName, options.textureSize, hashVertex(options.seed, i, 0xFFFFFFFE)))
+        {
+            return 1;
+        }
+    }
+
+    printf("\tvertices:\t%" PRIu64 "\n", (uint64_t)columns * rows);
+    printf("\tfaces:\t\t%" PRIu64 "\n", faces);
+
+    free(objFileName);
+    free(mtlFileName);
+    free(textureName);
+    free(fileName);
+    memFree(path);
+
+    return 0;
+}